@@ -1,6 +1,74 @@
 #include "Scene.hlsli"
 
-float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in float shine, in bool transparent)
+// Clustered lights, built by Renderer::_buildLightClusters and uploaded by
+// Renderer::_uploadLightClusters. lightClusters holds the offset and count of each
+// cluster's run in lightIndices.
+StructuredBuffer<LIGHT> sceneLights : register(t4);
+StructuredBuffer<uint2> lightClusters : register(t5);
+StructuredBuffer<uint> lightIndices : register(t6);
+
+// Cascaded shadow maps of the sun, one array slice per cascade
+Texture2DArray<float> shadowMap : register(t7);
+SamplerComparisonState shadowSampler : register(s1);
+
+// Irradiance probes, see irradianceProbes.h: ProbeTexels slabs of probeCount.z slices
+// stacked along z, together the 27 order 2 SH values of every probe
+static const float ProbeTexels = 7.0;
+Texture3D<float4> probes : register(t9);
+SamplerState probeSampler : register(s2);
+
+uint2 GetLightCluster(float4 screenPos)
+{
+    uint2 tile = min(uint2(screenPos.xy * clusterScale.xy), clusterCount.xy - 1);
+    int slice = clamp((int)floor(log(max(screenPos.w, 1e-4)) * clusterScale.z + clusterScale.w), 0, (int)clusterCount.z - 1);
+    return lightClusters[(slice * clusterCount.y + tile.y) * clusterCount.x + tile.x];
+}
+
+float GetSunShadow(float3 pos, float viewDepth)
+{
+    if (viewDepth >= cascadeSplits.w)
+        return 1.0;
+
+    uint cascade = (uint)dot(float4(viewDepth >= cascadeSplits), float4(1.0, 1.0, 1.0, 0.0));
+    float4 shadowPos = mul(shadowMatrices[cascade], float4(pos, 1.0));
+    float2 uv = shadowPos.xy * float2(0.5, -0.5) + 0.5;
+    return shadowMap.SampleCmpLevelZero(shadowSampler, float3(uv, cascade), shadowPos.z);
+}
+
+// Diffuse ambient light for a white surface, trilinear between the eight nearest probes.
+// twoSided drops the linear band, which averages the two sides of the surface.
+float3 GetProbeIrradiance(float3 pos, float3 normal, bool twoSided)
+{
+    float3 probe = clamp(pos * probeScale.xyz + probeBias.xyz, 0.0, probeCount.xyz - 1.0);
+    float3 uvw = (probe + 0.5) / float3(probeCount.xy, probeCount.z * ProbeTexels);
+    float4 t[7];
+    [unroll]
+    for (int k = 0; k < 7; k++)
+        t[k] = probes.SampleLevel(probeSampler, uvw + float3(0.0, 0.0, k / ProbeTexels), 0);
+
+    float3 n = normalize(normal);
+    float3 color = t[0].xyz;
+    if (!twoSided)
+        color += float3(t[0].w, t[1].xy) * n.y + float3(t[1].zw, t[2].x) * n.z + t[2].yzw * n.x;
+    color += t[3].xyz * (n.x * n.y) + float3(t[3].w, t[4].xy) * (n.y * n.z) + float3(t[4].zw, t[5].x) * (3.0 * n.z * n.z - 1.0)
+        + t[5].yzw * (n.x * n.z) + t[6].xyz * (n.x * n.x - n.y * n.y);
+    return max(color, 0.0);
+}
+
+// Inverse square falloff windowed to reach exactly zero at the radius (Karis 2013); the +1
+// keeps it finite at the light
+float GetAttenuation(float dist, float radius)
+{
+    float ratio = dist / radius;
+    float window = saturate(1.0 - ratio * ratio * ratio * ratio);
+    return window * window / (dist * dist + 1.0);
+}
+
+// screenPos is SV_POSITION, whose w is the view depth. objectLights is the run of lights
+// reaching the whole object; pixels take it over their cluster's run when it is shorter.
+// baked objects have the sun and the diffuse light of the first lightParams.w lights in
+// their lightmap, only the specular part of those is added here.
+float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in float shine, in bool transparent, in bool baked, in float4 screenPos, in uint2 objectLights)
 {
     float3 finalColor = float3(0, 0, 0);
 
@@ -9,28 +77,42 @@ float3 CalculateColor(in float3 objColor, in float3 objNormal, in float3 pos, in
         return float3(objNormal * 0.5 + float3(0.5, 0.5, 0.5));
     }
 
-    [unroll]
-    for (int i = 0; i < lightParams.x; i++)
+    float3 sunDir = -sunDirection.xyz;
+    float3 sunNorm = transparent && dot(sunDir, objNormal) < 0.0 ? -objNormal : objNormal;
+    if (!baked)
+        finalColor += objColor * max(dot(sunDir, sunNorm), 0) * sunColor.xyz * GetSunShadow(pos, screenPos.w);
+
+    uint2 cluster = GetLightCluster(screenPos);
+    if (objectLights.y < cluster.y)
+        cluster = objectLights;
+
+    for (uint i = 0; i < cluster.y; i++)
     {
+        uint lightIndex = lightIndices[cluster.x + i];
+        LIGHT light = sceneLights[lightIndex];
+        bool bakedLight = baked && (int)lightIndex < lightParams.w;
         float3 norm = objNormal;
 
-        float3 lightDir = lights[i].lightPos.xyz - pos;
+        float3 lightDir = light.lightPos.xyz - pos;
         float lightDist = length(lightDir);
+        if (lightDist >= light.lightPos.w)
+            continue;
         lightDir /= lightDist;
 
-        float atten = clamp(1.0 / (lightDist * lightDist), 0, 1);
+        float atten = GetAttenuation(lightDist, light.lightPos.w);
 
         if (transparent && dot(lightDir, objNormal) < 0.0)
         {
             norm = -norm;
         }
-        finalColor += objColor * max(dot(lightDir, norm), 0) * atten * lights[i].lightColor.xyz;
+        if (!bakedLight)
+            finalColor += objColor * max(dot(lightDir, norm), 0) * atten * light.lightColor.xyz;
 
         float3 viewDir = normalize(cameraPos.xyz - pos);
         float3 reflectDir = reflect(-lightDir, norm);
         float spec = shine > 0 ? pow(max(dot(viewDir, reflectDir), 0.0), shine.x) : 0.0;
 
-        finalColor += objColor * spec * lights[i].lightColor.xyz;
+        finalColor += objColor * spec * atten * light.lightColor.xyz;
     }
 
     return finalColor;
@@ -0,0 +1,23 @@
+Texture2D accumulationTexture : register(t0);
+Texture2D revealageTexture : register(t1);
+
+struct PS_INPUT
+{
+    float4 position : SV_POSITION;
+};
+
+// Weighted average of the transparent colors, blended over the opaque image with
+// 1 - revealage as its coverage
+float4 main(PS_INPUT input) : SV_TARGET
+{
+    int3 pixel = int3(input.position.xy, 0);
+    float revealage = revealageTexture.Load(pixel).r;
+    if (revealage >= 1.0)
+        discard;
+
+    float4 accumulation = accumulationTexture.Load(pixel);
+    if (isinf(max(max(abs(accumulation.r), abs(accumulation.g)), abs(accumulation.b))))
+        accumulation.rgb = accumulation.aaa;
+
+    return float4(accumulation.rgb / max(accumulation.a, 1e-5), 1.0 - revealage);
+}
\ No newline at end of file
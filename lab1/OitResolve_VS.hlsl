@@ -0,0 +1,13 @@
+struct PS_INPUT
+{
+    float4 position : SV_POSITION;
+};
+
+// Fullscreen triangle from the vertex id, no vertex buffer
+PS_INPUT main(uint id : SV_VertexID)
+{
+    PS_INPUT output;
+    float2 uv = float2((id << 1) & 2, id & 2);
+    output.position = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+    return output;
+}
\ No newline at end of file
@@ -2,12 +2,17 @@
 
 Texture2D colorTexture : register(t0);
 Texture2D normals : register(t1);
+// rgb is the baked light of the static lights and the sun, a the ambient occlusion
+Texture2DArray lightmap : register(t8);
 SamplerState colorSampler : register(s0);
 
 cbuffer WorldMatrixBuffer : register(b0)
 {
     float4x4 worldMatrix;
     float4 shine;
+    float4 posScale;
+    float4 posBias;
+    uint4 lightList;
 };
 
 struct PS_INPUT
@@ -17,13 +22,12 @@ struct PS_INPUT
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
     float3 tangent : TANGENT;
+    float2 lightmapUV : TEXCOORD1;
 };
 
 float4 ps(PS_INPUT input) : SV_TARGET
 {
     float3 color = colorTexture.Sample(colorSampler, input.uv).xyz;
-    float3 finalColor = ambientColor.xyz * color;
-
     float3 norm = float3(0, 0, 0);
     if (lightParams.y > 0)
     {
@@ -35,6 +39,15 @@ float4 ps(PS_INPUT input) : SV_TARGET
     {
         norm = input.normal;
     }
+    float3 ambient = ambientColor.xyz * color * GetProbeIrradiance(input.worldPos.xyz, norm, false);
+
+    if (lightList.z > 0)
+    {
+        // The runtime only adds the highlights, the lights that aren't baked and the ambient, all occluded
+        float4 baked = lightmap.Sample(colorSampler, float3(input.lightmapUV, lightList.z - 1));
+        float3 dynamicColor = CalculateColor(color, norm, input.worldPos.xyz, shine.x, false, true, input.position, lightList.xy);
+        return float4(color * baked.rgb + (dynamicColor + ambient) * baked.a, 1.0);
+    }
 
-    return float4(CalculateColor(color, norm, input.worldPos.xyz, shine.x, false), 1.0);
+    return float4(ambient + CalculateColor(color, norm, input.worldPos.xyz, shine.x, false, false, input.position, lightList.xy), 1.0);
 }
\ No newline at end of file
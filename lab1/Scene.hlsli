@@ -1,3 +1,4 @@
+// lightPos.w is the radius the light reaches zero at
 struct LIGHT
 {
     float4 lightPos;
@@ -9,6 +10,14 @@ cbuffer SceneMatrixBuffer : register(b1)
     float4x4 viewProjectionMatrix;
     float4 cameraPos;
     int4 lightParams;
-    LIGHT lights[10];
     float4 ambientColor;
+    float4 clusterScale; // pixels to tiles in xy, slice = log(depth) * z + w
+    uint4 clusterCount;  // tiles across, tiles down, depth slices
+    float4x4 shadowMatrices[4];
+    float4 cascadeSplits; // view depth each cascade ends at
+    float4 sunDirection;  // direction the sunlight travels in
+    float4 sunColor;
+    float4 probeScale;    // world position to probe index: pos * scale + bias
+    float4 probeBias;
+    float4 probeCount;
 };
\ No newline at end of file
@@ -4,6 +4,7 @@ cbuffer WorldMatrixBuffer : register(b0)
 {
     float4x4 worldMatrix;
     float4 color;
+    uint4 lightList;
 };
 
 struct PS_INPUT
@@ -14,5 +15,26 @@ struct PS_INPUT
 
 float4 main(PS_INPUT input) : SV_TARGET
 {
-    return float4(CalculateColor(color.xyz, float3(1.0, 0.0, 0.0), input.worldPos.xyz, 0.0, true), color.w);
+    float3 ambient = ambientColor.xyz * color.xyz * GetProbeIrradiance(input.worldPos.xyz, float3(1.0, 0.0, 0.0), true);
+    return float4(ambient + CalculateColor(color.xyz, float3(1.0, 0.0, 0.0), input.worldPos.xyz, 0.0, true, false, input.position, lightList.xy), color.w);
+}
+
+struct OIT_OUTPUT
+{
+    float4 accumulation : SV_TARGET0;
+    float revealage : SV_TARGET1;
+};
+
+// Weighted blended OIT (McGuire and Bavoil 2013, equation 7). The weight falls off with
+// the view depth in position.w, so nearer surfaces dominate the average.
+OIT_OUTPUT oit(PS_INPUT input)
+{
+    float4 color = main(input);
+    float z = input.position.w;
+    float weight = color.a * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+
+    OIT_OUTPUT output;
+    output.accumulation = float4(color.rgb * color.a, color.a) * weight;
+    output.revealage = color.a;
+    return output;
 }
\ No newline at end of file
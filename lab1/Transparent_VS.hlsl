@@ -2,6 +2,7 @@ cbuffer WorldMatrixBuffer : register(b0)
 {
     float4x4 worldMatrix;
     float4 color;
+    uint4 lightList;
 };
 
 cbuffer SceneMatrixBuffer : register(b1)
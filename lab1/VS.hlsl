@@ -5,14 +5,19 @@ cbuffer WorldMatrixBuffer : register(b0)
 {
     float4x4 worldMatrix;
     float4 shine;
+    float4 posScale;
+    float4 posBias;
+    uint4 lightList;
 };
 
+// Compact vertex: SNORM16 position inside the mesh bounds, half uv, octahedral normal and tangent
 struct VS_INPUT
 {
-    float3 position : POSITION;
+    float4 position : POSITION;
     float2 uv : TEXCOORD;
-    float3 normal : NORMAL;
-    float3 tangent : TANGENT;
+    float2 normal : NORMAL;
+    float2 tangent : TANGENT;
+    float2 lightmapUV : TEXCOORD1;
 };
 
 struct PS_INPUT
@@ -22,17 +27,28 @@ struct PS_INPUT
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
     float3 tangent : TANGENT;
+    float2 lightmapUV : TEXCOORD1;
 };
 
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
 PS_INPUT vs(VS_INPUT input)
 {
     PS_INPUT output;
 
-    output.worldPos = mul(worldMatrix, float4(input.position, 1.0f));
+    float3 position = input.position.xyz * posScale.xyz + posBias.xyz;
+    output.worldPos = mul(worldMatrix, float4(position, 1.0f));
     output.position = mul(viewProjectionMatrix, output.worldPos);
     output.uv = input.uv;
-    output.normal = mul(worldMatrix, float4(input.normal, 0.0f));
-    output.tangent = mul(worldMatrix, float4(input.tangent, 0.0f));
+    output.lightmapUV = input.lightmapUV;
+    output.normal = mul(worldMatrix, float4(OctDecode(input.normal), 0.0f));
+    output.tangent = mul(worldMatrix, float4(OctDecode(input.tangent), 0.0f));
 
     return output;
 }
\ No newline at end of file
@@ -0,0 +1,1321 @@
+#include "benchmark.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "meshgen.h"
+#include "meshImport.h"
+#include "meshFile.h"
+#include "meshlet.h"
+#include "vertexFormat.h"
+#include "transparencySorter.h"
+#include "lightClusters.h"
+#include "shadowCascades.h"
+#include "rayTracer.h"
+#include "lightmapAtlas.h"
+#include "lightBaker.h"
+#include "irradianceProbes.h"
+#include "threadPool.h"
+#include "profiler.h"
+#include "hiResClock.h"
+#include "simulation.h"
+#include "softRenderer.h"
+#include "cameraPath.h"
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdarg>
+#include <cstddef>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using BenchClock = std::chrono::steady_clock;
+
+void BenchPrint(const char* format, ...)
+{
+    char text[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    fputs(text, stdout);
+#ifdef _WIN32
+    OutputDebugStringA(text);
+#endif
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, "benchmark.log", "a");
+#else
+    pFile = fopen("benchmark.log", "a");
+#endif
+    if (pFile)
+    {
+        fputs(text, pFile);
+        fclose(pFile);
+    }
+}
+
+// Set by a check that failed in the benchmarks run so far
+static bool _benchFailed = false;
+
+// Correctness checks inside the benchmarks print "ok" or "FAILED"; a failure makes
+// RunBenchmark return false, so a script or ctest sees it in the exit code
+static const char* _benchCheck(bool ok)
+{
+    _benchFailed = _benchFailed || !ok;
+    return ok ? "ok" : "FAILED";
+}
+
+static double _elapsedNs(BenchClock::time_point start)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+//-----------Frustum culling-------------
+static void _benchCulling()
+{
+    const size_t count = 1000000;
+    const int frames = 50;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> pos(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> rad(0.1f, 2.0f);
+
+    SphereBounds bounds;
+    bounds.Resize(count);
+    for (size_t i = 0; i < count; i++)
+        bounds.Set(i, XMFLOAT3(pos(rng), pos(rng), pos(rng)), rad(rng));
+
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, -50.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 100.0f, 0.01f);
+
+    std::vector<uint32_t> visible;
+    visible.reserve(count);
+
+    double best = 1e30, total = 0.0;
+    size_t numVisible = 0;
+    for (int frame = 0; frame <= frames; frame++)
+    {
+        // Turn the camera a little every frame so each one culls a different set
+        XMMATRIX viewProjection = XMMatrixRotationY(frame * 0.05f) * view * projection;
+        visible.clear();
+
+        BenchClock::time_point start = BenchClock::now();
+        Frustum frustum = ExtractFrustum(viewProjection);
+        numVisible = CullSpheres(frustum, bounds, visible);
+        double ns = _elapsedNs(start);
+
+        if (frame == 0)
+            continue; // warm-up
+        best = ns < best ? ns : best;
+        total += ns;
+    }
+
+#if defined(__AVX__)
+    const char* isa = "AVX";
+#else
+    const char* isa = "SSE";
+#endif
+    BenchPrint("culling (%s): %zu spheres, %zu visible, avg %.3f ns/object, best %.3f ns/object, %.3f ms/frame\n",
+        isa, count, numVisible, total / frames / count, best / count, total / frames * 1e-6);
+}
+
+//-----------BVH-------------
+static void _benchBvh()
+{
+    const int queries = 1000;
+    std::mt19937 rng(7);
+
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, -50.0f, 0.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 100.0f, 0.01f);
+    Frustum frustum = ExtractFrustum(view * projection);
+
+    for (size_t count = 1000; count <= 1000000; count *= 10)
+    {
+        // The world grows with the object count so the density stays the same
+        float extent = 20.0f * cbrtf((float)count / 1000.0f);
+        std::uniform_real_distribution<float> pos(-extent, extent);
+        std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+
+        std::vector<Aabb> boxes(count);
+        for (Aabb& box : boxes)
+            box = SphereAabb(XMFLOAT3(pos(rng), pos(rng), pos(rng)), 0.5f);
+
+        BenchClock::time_point start = BenchClock::now();
+        Bvh bvh;
+        bvh.Build(boxes);
+        double buildMs = _elapsedNs(start) * 1e-6;
+
+        // Move 1% of the objects a little and refit
+        std::vector<Aabb> moved(boxes);
+        start = BenchClock::now();
+        for (size_t i = 0; i < count; i += 100)
+        {
+            moved[i].min.y += 0.1f;
+            moved[i].max.y += 0.1f;
+            bvh.Update((uint32_t)i, moved[i]);
+        }
+        bvh.Refit();
+        double refitMs = _elapsedNs(start) * 1e-6;
+
+        std::vector<uint32_t> visible;
+        start = BenchClock::now();
+        bvh.Cull(frustum, visible);
+        double cullMs = _elapsedNs(start) * 1e-6;
+
+        size_t hits = 0;
+        double rayNs = 0.0;
+        for (int q = 0; q < queries; q++)
+        {
+            XMFLOAT3 origin(pos(rng), pos(rng), pos(rng));
+            XMFLOAT3 direction;
+            XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(dir(rng), dir(rng), dir(rng), 0.0f)));
+
+            uint32_t object;
+            float tHit;
+            start = BenchClock::now();
+            hits += bvh.Raycast(origin, direction, [&](uint32_t i, float tMax)
+                {
+                    float t;
+                    const Aabb& box = bvh.GetBounds(i);
+                    XMFLOAT3 center((box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f);
+                    return IntersectRaySphere(origin, direction, center, 0.5f, t) && t < tMax ? t : -1.0f;
+                }, object, tHit) ? 1 : 0;
+            rayNs += _elapsedNs(start);
+        }
+
+        BenchPrint("bvh: %zu objects, build %.2f ms, refit 1%% %.3f ms, cull %.3f ms (%zu visible), ray %.2f us (%zu/%d hit)\n",
+            count, buildMs, refitMs, cullMs, visible.size(), rayNs / queries * 1e-3, hits, queries);
+    }
+}
+
+//-----------Occlusion culling-------------
+static void _benchOcclusion()
+{
+    const uint32_t numOccludees = 100000;
+    const int frames = 20;
+
+    static const XMFLOAT3 BoxVertices[] = {
+        {-1, -1, -1}, { 1, -1, -1}, { 1,  1, -1}, {-1,  1, -1},
+        {-1, -1,  1}, { 1, -1,  1}, { 1,  1,  1}, {-1,  1,  1}
+    };
+    static const uint16_t BoxIndices[] = {
+        0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,
+        0, 1, 5, 0, 5, 4,  3, 6, 2, 3, 7, 6,
+        0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+    };
+
+    // A city block: rows of buildings in front of the camera with small objects scattered among them
+    std::vector<XMMATRIX> occluders;
+    for (int x = -10; x <= 10; x++)
+        for (int z = 1; z <= 10; z++)
+            occluders.push_back(XMMatrixScaling(3.0f, 8.0f, 3.0f) * XMMatrixTranslation(x * 10.0f, 8.0f, z * 10.0f));
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> px(-100.0f, 100.0f), py(0.0f, 10.0f), pz(5.0f, 110.0f);
+    std::vector<Aabb> occludees(numOccludees);
+    for (Aabb& box : occludees)
+        box = SphereAabb(XMFLOAT3(px(rng), py(rng), pz(rng)), 0.5f);
+
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 4.0f, -5.0f, 0.0f), XMVectorSet(0.0f, 4.0f, 50.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 200.0f, 0.01f);
+
+    ThreadPool pool;
+    pool.Init();
+    OcclusionBuffer buffer;
+    buffer.Resize(320, 180);
+
+    // Known answers: a wall 10 m ahead of the camera hides a box straight behind it, but not
+    // one in front of it, one past its edge or one straddling the edge
+    struct Known
+    {
+        const char* name;
+        XMFLOAT3 center;
+        bool visible;
+    };
+    static const Known KnownCases[] = {
+        { "behind", { 0.0f, 0.0f, 20.0f }, false },
+        { "in front", { 0.0f, 0.0f, 5.0f }, true },
+        { "beside", { 30.0f, 0.0f, 20.0f }, true },
+        { "straddling", { 10.0f, 0.0f, 12.0f }, true },
+    };
+    XMMATRIX eyeView = XMMatrixLookAtLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    buffer.Begin(eyeView * projection);
+    buffer.AddOccluder(BoxVertices, 8, BoxIndices, 36, XMMatrixScaling(8.0f, 8.0f, 0.5f) * XMMatrixTranslation(0.0f, 0.0f, 10.0f));
+    buffer.Rasterize(nullptr);
+    std::string knownWrong;
+    for (const Known& known : KnownCases)
+    {
+        if (buffer.IsVisible(SphereAabb(known.center, 1.0f)) != known.visible)
+            knownWrong += std::string(" ") + known.name;
+    }
+    BenchPrint("occlusion known cases: %s%s\n", _benchCheck(knownWrong.empty()), knownWrong.c_str());
+
+    for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+    {
+        double rasterNs = 0.0, testNs = 0.0;
+        for (int frame = 0; frame <= frames; frame++)
+        {
+            XMMATRIX viewProjection = XMMatrixRotationY(frame * 0.01f) * view * projection;
+
+            BenchClock::time_point start = BenchClock::now();
+            buffer.Begin(viewProjection);
+            for (const XMMATRIX& world : occluders)
+                buffer.AddOccluder(BoxVertices, 8, BoxIndices, 36, world);
+            buffer.Rasterize(pPool);
+            double raster = _elapsedNs(start);
+
+            start = BenchClock::now();
+            for (const Aabb& box : occludees)
+                buffer.IsVisible(box);
+            double test = _elapsedNs(start);
+
+            if (frame == 0)
+                continue; // warm-up
+            rasterNs += raster;
+            testNs += test;
+        }
+
+        const OcclusionStats& stats = buffer.GetStats();
+        BenchPrint("occlusion (%u threads): %ux%u, %u occluder triangles, raster %.3f ms, test %.1f ns/object, %u of %u occluded (%.1f%%)\n",
+            pPool ? pPool->GetNumThreads() : 1, buffer.GetWidth(), buffer.GetHeight(), stats.occluderTriangles,
+            rasterNs / frames * 1e-6, testNs / frames / numOccludees, stats.occludedObjects, stats.testedObjects,
+            100.0 * stats.occludedObjects / stats.testedObjects);
+    }
+}
+
+//-----------Mesh generation-------------
+static void _benchMeshgen()
+{
+    struct Case
+    {
+        const char* name;
+        Mesh (*generate)();
+    };
+    static const Case Cases[] = {
+        { "uv sphere 64x128", [] { return GenerateUVSphere(64, 128); } },
+        { "icosphere 5", [] { return GenerateIcosphere(5); } },
+        { "cube", [] { return GenerateCube(); } },
+        { "plane 128x128", [] { return GeneratePlane(128, 128, 10.0f); } },
+        { "torus 128x48", [] { return GenerateTorus(128, 48, 1.0f, 0.3f); } },
+    };
+    const int reps = 20;
+
+    for (const Case& c : Cases)
+    {
+        Mesh mesh;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < reps; i++)
+            mesh = c.generate();
+        double generateMs = _elapsedNs(start) / reps * 1e-6;
+        uint32_t numVertices = (uint32_t)mesh.vertices.size();
+        float acmrIn = ComputeAcmr(mesh.indices, numVertices);
+
+        std::vector<uint32_t> cacheOnly = mesh.indices;
+        start = BenchClock::now();
+        OptimizeVertexCache(cacheOnly, numVertices);
+        double cacheMs = _elapsedNs(start) * 1e-6;
+        float acmrCache = ComputeAcmr(cacheOnly, numVertices);
+
+        start = BenchClock::now();
+        OptimizeOverdraw(cacheOnly, mesh.vertices);
+        double overdrawMs = _elapsedNs(start) * 1e-6;
+        float acmrOverdraw = ComputeAcmr(cacheOnly, numVertices);
+
+        BenchPrint("meshgen %s: %u vertices, %zu triangles, %s indices, generate %.3f ms, ACMR %.3f -> %.3f (cache, %.2f ms) -> %.3f (overdraw, %.2f ms)\n",
+            c.name, numVertices, mesh.indices.size() / 3, mesh.Fits16BitIndices() ? "16-bit" : "32-bit",
+            generateMs, acmrIn, acmrCache, cacheMs, acmrOverdraw, overdrawMs);
+    }
+}
+
+//-----------Packed vertex format-------------
+static void _benchVertexFormat()
+{
+    // A round trip through PackedVertex must stay within what the shaders can tell apart
+    const float maxPositionError = 2e-5f;
+    const float maxNormalErrorDegrees = 0.04f;
+    struct Case
+    {
+        const char* name;
+        uint32_t segments;
+        uint32_t sides;
+    };
+    static const Case Cases[] = {
+        { "torus 64x32", 64, 32 },
+        { "torus 1024x512", 1024, 512 },
+    };
+
+    for (const Case& c : Cases)
+    {
+        Mesh mesh = GenerateTorus(c.segments, c.sides, 1.0f, 0.3f);
+        size_t count = mesh.vertices.size();
+        PositionQuantization quantization = ComputePositionQuantization(mesh.vertices.data(), count);
+        std::vector<PackedVertex> packed(count);
+        std::vector<MeshVertex> unpacked(count);
+
+        BenchClock::time_point start = BenchClock::now();
+        PackVertices(mesh.vertices.data(), count, quantization, packed.data());
+        double packMs = _elapsedNs(start) * 1e-6;
+        start = BenchClock::now();
+        UnpackVertices(packed.data(), count, quantization, unpacked.data());
+        double unpackMs = _elapsedNs(start) * 1e-6;
+
+        auto degrees = [](const XMFLOAT3& a, const XMFLOAT3& b)
+        {
+            float cosine = XMVectorGetX(XMVector3Dot(XMVector3Normalize(XMLoadFloat3(&a)), XMLoadFloat3(&b)));
+            return XMConvertToDegrees(acosf((std::min)(cosine, 1.0f)));
+        };
+        float positionError = 0.0f, normalError = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            const MeshVertex& a = mesh.vertices[i];
+            const MeshVertex& b = unpacked[i];
+            positionError = (std::max)({ positionError, fabsf(a.pos.x - b.pos.x), fabsf(a.pos.y - b.pos.y), fabsf(a.pos.z - b.pos.z) });
+            normalError = (std::max)({ normalError, degrees(a.normal, b.normal), degrees(a.tangent, b.tangent) });
+        }
+        bool ok = positionError <= maxPositionError && normalError <= maxNormalErrorDegrees;
+        BenchPrint("vertexformat %s: %zu vertices, %zu -> %zu bytes, pack %.3f ms, unpack %.3f ms, "
+            "error %.2e position (max %.0e), %.4f deg normal/tangent (max %.2f), %s\n",
+            c.name, count, count * sizeof(MeshVertex), count * sizeof(PackedVertex), packMs, unpackMs,
+            positionError, maxPositionError, normalError, maxNormalErrorDegrees, _benchCheck(ok));
+    }
+}
+
+//-----------OBJ / glTF import-------------
+static FILE* _openForWrite(const char* path)
+{
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    return pFile;
+}
+
+// Writes the mesh back in the files' right-handed, counter-clockwise, v-up convention
+static bool _writeObj(const char* path, const Mesh& mesh)
+{
+    FILE* pFile = _openForWrite(path);
+    if (!pFile)
+        return false;
+    std::string text;
+    char line[128];
+    for (const MeshVertex& v : mesh.vertices)
+    {
+        snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+            v.pos.x, v.pos.y, -v.pos.z, v.uv.x, 1.0f - v.uv.y, v.normal.x, v.normal.y, -v.normal.z);
+        text += line;
+    }
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        uint32_t a = mesh.indices[i] + 1, b = mesh.indices[i + 2] + 1, c = mesh.indices[i + 1] + 1;
+        snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+        text += line;
+    }
+    bool result = fwrite(text.data(), 1, text.size(), pFile) == text.size();
+    fclose(pFile);
+    return result;
+}
+
+static bool _writeGltf(const char* path, const char* binPath, const char* binUri, const Mesh& mesh)
+{
+    std::vector<float> positions, normals, texcoords;
+    for (const MeshVertex& v : mesh.vertices)
+    {
+        positions.insert(positions.end(), { v.pos.x, v.pos.y, -v.pos.z });
+        normals.insert(normals.end(), { v.normal.x, v.normal.y, -v.normal.z });
+        texcoords.insert(texcoords.end(), { v.uv.x, v.uv.y });
+    }
+    size_t sizes[] = { positions.size() * 4, normals.size() * 4, texcoords.size() * 4, mesh.indices.size() * 4 };
+    FILE* pFile = _openForWrite(binPath);
+    if (!pFile)
+        return false;
+    fwrite(positions.data(), 1, sizes[0], pFile);
+    fwrite(normals.data(), 1, sizes[1], pFile);
+    fwrite(texcoords.data(), 1, sizes[2], pFile);
+    std::vector<uint32_t> indices(mesh.indices);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        std::swap(indices[i + 1], indices[i + 2]);
+    fwrite(indices.data(), 1, sizes[3], pFile);
+    fclose(pFile);
+
+    pFile = _openForWrite(path);
+    if (!pFile)
+        return false;
+    size_t count = mesh.vertices.size();
+    fprintf(pFile,
+        "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],\n"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}],\n"
+        "\"buffers\":[{\"uri\":\"%s\",\"byteLength\":%zu}],\n"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu},{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},"
+        "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}],\n"
+        "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+        "{\"bufferView\":2,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC2\"},"
+        "{\"bufferView\":3,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}]}\n",
+        binUri, sizes[0] + sizes[1] + sizes[2] + sizes[3],
+        sizes[0], sizes[0], sizes[1], sizes[0] + sizes[1], sizes[2], sizes[0] + sizes[1] + sizes[2], sizes[3],
+        count, count, count, mesh.indices.size());
+    fclose(pFile);
+    return true;
+}
+
+static void _benchImport()
+{
+    // A large synthetic model round-tripped through both formats
+    Mesh source = GenerateTorus(1024, 512, 1.0f, 0.3f);
+    if (!_writeObj("bench_import.obj", source) || !_writeGltf("bench_import.gltf", "bench_import.bin", "bench_import.bin", source))
+    {
+        BenchPrint("import: can't write the test files\n");
+        return;
+    }
+
+    ThreadPool pool;
+    pool.Init();
+
+    struct Case
+    {
+        const char* path;
+        ThreadPool* pPool;
+    };
+    const Case Cases[] = {
+        { "bench_import.obj", nullptr },
+        { "bench_import.obj", &pool },
+        { "bench_import.gltf", nullptr },
+        { "bench_import.gltf", &pool },
+    };
+    for (const Case& c : Cases)
+    {
+        Mesh mesh;
+        uint64_t bytesRead = 0;
+        BenchClock::time_point start = BenchClock::now();
+        bool imported = ImportMesh(c.path, mesh, c.pPool, &bytesRead);
+        double ms = _elapsedNs(start) * 1e-6;
+        if (!imported)
+        {
+            BenchPrint("import %s: failed\n", c.path);
+            continue;
+        }
+        BenchPrint("import %s, %u threads: %.1f MB in %.1f ms, %.1f MB/s, %zu vertices (source %zu), %zu triangles\n",
+            c.path, c.pPool ? c.pPool->GetNumThreads() : 1, bytesRead / 1e6, ms, bytesRead / 1e6 / (ms * 1e-3),
+            mesh.vertices.size(), source.vertices.size(), mesh.indices.size() / 3);
+    }
+
+    remove("bench_import.obj");
+    remove("bench_import.gltf");
+    remove("bench_import.bin");
+}
+
+//-----------Mesh file validation-------------
+static void _benchMeshFile()
+{
+    Mesh mesh = GenerateTorus(1024, 512, 1.0f, 0.3f);
+    MeshFileData data = {};
+    data.vertices = mesh.vertices;
+    data.indices = mesh.indices;
+    MeshFileLod lod = {};
+    lod.range.indexCount = (uint32_t)mesh.indices.size();
+    data.lods.push_back(lod);
+    MeshFileSubmesh submesh = {};
+    submesh.numLods = 1;
+    data.submeshes.push_back(submesh);
+    if (!WriteMeshFile("bench_meshfile.mesh", data, true))
+    {
+        BenchPrint("meshfile: can't write the test file\n");
+        return;
+    }
+
+    MeshFile file;
+    BenchClock::time_point start = BenchClock::now();
+    bool opened = file.Open("bench_meshfile.mesh");
+    double openMs = _elapsedNs(start) * 1e-6;
+    std::vector<uint8_t> bytes;
+    MeshFileHeader header = {};
+    if (opened)
+    {
+        header = file.GetHeader();
+        const uint8_t* pData = reinterpret_cast<const uint8_t*>(&file.GetHeader());
+        bytes.assign(pData, pData + header.fileSize);
+    }
+    file.Close();
+    BenchPrint("meshfile: %u vertices, %u indices, open with validation %.2f ms, %s\n",
+        header.numVertices, header.numIndices, openMs, _benchCheck(opened));
+    if (!opened)
+        return;
+
+    // Damaged files Open has to turn down before the renderer reads through them
+    struct Damage
+    {
+        const char* name;
+        void (*apply)(std::vector<uint8_t>& bytes, const MeshFileHeader& header);
+    };
+    static const Damage Damages[] = {
+        { "index past the vertices", [](std::vector<uint8_t>& bytes, const MeshFileHeader& header)
+            {
+                uint32_t index = header.numVertices;
+                memcpy(&bytes[header.indexOffset], &index, header.indexSize);
+            } },
+        { "lod past the indices", [](std::vector<uint8_t>& bytes, const MeshFileHeader& header)
+            {
+                uint32_t startIndex = header.numIndices;
+                memcpy(&bytes[header.lodOffset + offsetof(MeshLod, startIndex)], &startIndex, sizeof(startIndex));
+            } },
+        { "submesh without lods", [](std::vector<uint8_t>& bytes, const MeshFileHeader& header)
+            {
+                uint32_t numLods = 0;
+                memcpy(&bytes[header.submeshOffset + offsetof(MeshFileSubmesh, numLods)], &numLods, sizeof(numLods));
+            } },
+    };
+    for (const Damage& damage : Damages)
+    {
+        std::vector<uint8_t> damaged = bytes;
+        damage.apply(damaged, header);
+        FILE* pFile = _openForWrite("bench_meshfile.mesh");
+        bool written = pFile && fwrite(damaged.data(), 1, damaged.size(), pFile) == damaged.size();
+        if (pFile)
+            fclose(pFile);
+        MeshFile damagedFile;
+        bool rejected = written && !damagedFile.Open("bench_meshfile.mesh");
+        BenchPrint("meshfile %s: rejection %s\n", damage.name, _benchCheck(rejected));
+    }
+
+    remove("bench_meshfile.mesh");
+}
+
+//-----------Meshlets-------------
+static void _benchMeshlets()
+{
+    Mesh mesh = GenerateTorus(1024, 512, 1.0f, 0.3f);
+    OptimizeMesh(mesh);
+    size_t numTriangles = mesh.indices.size() / 3;
+
+    MeshletData data;
+    BenchClock::time_point start = BenchClock::now();
+    BuildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(), data);
+    double buildMs = _elapsedNs(start) * 1e-6;
+    // An index past the vertices, as a damaged .mesh file may have, must be turned down
+    MeshletData rejected;
+    std::vector<uint32_t> badIndices(mesh.indices.begin(), mesh.indices.begin() + 3);
+    badIndices[2] = (uint32_t)mesh.vertices.size();
+    bool rejects = !BuildMeshlets(badIndices.data(), badIndices.size(), mesh.vertices.data(), mesh.vertices.size(), rejected);
+    BenchPrint("meshlet build: %zu triangles -> %zu meshlets, %.1f vertices and %.1f triangles each, %.1f ms, bad index rejection %s\n",
+        numTriangles, data.meshlets.size(), (double)data.vertices.size() / data.meshlets.size(),
+        (double)numTriangles / data.meshlets.size(), buildMs, _benchCheck(rejects));
+
+    // Views from outside, close up and from inside the ring
+    struct View
+    {
+        const char* name;
+        XMFLOAT3 eye;
+        XMFLOAT3 target;
+    };
+    static const View Views[] = {
+        { "whole", { 0.0f, 2.0f, -3.0f }, { 0.0f, 0.0f, 0.0f } },
+        { "close", { 1.0f, 0.2f, -0.9f }, { 1.0f, 0.0f, 0.0f } },
+        { "inside", { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+    };
+    const int reps = 50;
+    std::vector<uint32_t> indices;
+    indices.reserve(mesh.indices.size());
+    for (const View& view : Views)
+    {
+        XMMATRIX viewMatrix = XMMatrixLookAtLH(XMLoadFloat3(&view.eye), XMLoadFloat3(&view.target), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        Frustum frustum = ExtractFrustum(viewMatrix * XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 100.0f, 0.01f));
+
+        uint32_t visible = 0;
+        start = BenchClock::now();
+        for (int i = 0; i < reps; i++)
+        {
+            indices.clear();
+            visible = CullMeshlets(data, frustum, view.eye, 0, indices);
+        }
+        double cullMs = _elapsedNs(start) / reps * 1e-6;
+        BenchPrint("meshlet cull %s: %u of %zu meshlets, %.1f%% of the triangles submitted, %.3f ms\n",
+            view.name, visible, data.meshlets.size(), 100.0 * indices.size() / mesh.indices.size(), cullMs);
+    }
+}
+
+//-----------Transparency sorting-------------
+static void _benchSort()
+{
+    const uint32_t count = 100000;
+    const double budgetMs = TransparencySortBudgetMs;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> pos(-20.0f, 20.0f);
+    TransparencySorter sorter;
+    sorter.Resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        sorter.SetPosition(i, XMFLOAT3(pos(rng), pos(rng), pos(rng)));
+
+    ThreadPool pool;
+    pool.Init();
+
+    // A camera walking into the cloud, a slow orbit around it and a cut to a random direction
+    // every frame
+    struct Motion
+    {
+        const char* name;
+        float walk;
+        float turn;
+    };
+    static const Motion Motions[] = {
+        { "walk", 0.05f, 0.0f },
+        { "orbit", 0.0f, 0.0001f },
+        { "cuts", 0.0f, 0.0f },
+    };
+    std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+    const int frames = 100;
+    // The sorter stops at the budget, but a frame the OS preempts runs over whatever it does
+    const int allowedOverBudget = frames / 20;
+    for (const Motion& motion : Motions)
+    {
+        float yaw = 0.0f;
+        float distance = 30.0f;
+        double totalMs = 0.0, worstMs = 0.0;
+        int insertions = 0, deferred = 0, overBudget = 0;
+        bool sorted = true;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            if (motion.walk == 0.0f && motion.turn == 0.0f)
+                yaw = angle(rng);
+            yaw += motion.turn;
+            distance -= motion.walk;
+            XMFLOAT3 dir(sinf(yaw), 0.0f, cosf(yaw));
+            XMFLOAT3 eye(-distance * dir.x, 0.0f, -distance * dir.z);
+
+            BenchClock::time_point start = BenchClock::now();
+            const std::vector<uint32_t>& order = sorter.Sort(eye, dir, &pool);
+            double ms = _elapsedNs(start) * 1e-6;
+            totalMs += ms;
+            worstMs = (std::max)(worstMs, ms);
+            overBudget += ms > budgetMs;
+            insertions += sorter.GetLastMethod() == TransparencySorter::Insertion;
+
+            // A deferred frame keeps an earlier order, sorted by depths that aren't this frame's
+            if (sorter.GetLastMethod() == TransparencySorter::Deferred)
+            {
+                deferred++;
+                continue;
+            }
+            for (uint32_t i = 1; i < count && sorted; i++)
+                sorted = sorter.GetDepth(order[i - 1]) >= sorter.GetDepth(order[i]);
+        }
+        BenchPrint("sort %s: %u objects, %.3f ms average, %.3f ms worst, %d of %d frames over the %.1f ms budget %s, "
+            "%d by insertion, %d deferred, order %s\n",
+            motion.name, count, totalMs / frames, worstMs, overBudget, frames, budgetMs, _benchCheck(overBudget <= allowedOverBudget),
+            insertions, deferred, _benchCheck(sorted));
+    }
+
+    // What the renderer did before: a fresh vector of (index, depth) pairs and std::sort
+    XMFLOAT3 dir(0.6f, 0.0f, 0.8f);
+    std::vector<std::pair<uint32_t, float>> pairs;
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < 10; frame++)
+    {
+        std::vector<std::pair<uint32_t, float>> cameraDist;
+        for (uint32_t i = 0; i < count; i++)
+            cameraDist.push_back({ i, sorter.GetDepth(i) + frame });
+        std::sort(cameraDist.begin(), cameraDist.end(), [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b)
+        {
+            return a.second > b.second;
+        });
+        pairs.swap(cameraDist);
+    }
+    BenchPrint("sort std::sort: %u objects, %.3f ms\n", count, _elapsedNs(start) / 10 * 1e-6);
+}
+
+//-----------Light clusters-------------
+static void _benchClusters()
+{
+    const uint32_t counts[] = { 256, 1024, 4096, 16384 };
+    XMFLOAT3 eye(0.0f, 2.0f, -20.0f), target(0.0f, 0.0f, 0.0f);
+    XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&target), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    const float aspect = 16.0f / 9.0f;
+    XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, aspect, 100.0f, 0.01f);
+    XMFLOAT4X4 p;
+    XMStoreFloat4x4(&p, projection);
+
+    ThreadPool pool;
+    pool.Init();
+
+    for (uint32_t count : counts)
+    {
+        // Lights reaching about a unit, spread over a 40 x 6 x 40 area
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> px(-20.0f, 20.0f), py(-3.0f, 3.0f), pr(0.8f, 1.6f);
+        SphereBounds lights;
+        lights.Resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            lights.Set(i, XMFLOAT3(px(rng), py(rng), px(rng)), pr(rng));
+
+        LightClusters clusters;
+        const int reps = 20;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < reps; i++)
+            clusters.Build(lights, view, p.m[0][0], p.m[1][1], &pool);
+        double buildMs = _elapsedNs(start) / reps * 1e-6;
+
+        // Points on rays through the screen: the cluster the shader picks must list every light reaching them
+        std::vector<XMFLOAT3> viewCenters(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            XMFLOAT3 center = lights.GetCenter(i);
+            XMStoreFloat3(&viewCenters[i], XMVector3TransformCoord(XMLoadFloat3(&center), view));
+        }
+        uint32_t missed = 0;
+        uint64_t perPoint = 0;
+        const uint32_t samples = 50000000 / count;
+        std::uniform_real_distribution<float> ndc(-0.999f, 0.999f), depth(0.05f, 60.0f);
+        for (uint32_t s = 0; s < samples; s++)
+        {
+            float nx = ndc(rng), ny = ndc(rng), z = depth(rng);
+            XMFLOAT3 viewPos(nx * z / p.m[0][0], ny * z / p.m[1][1], z);
+            uint32_t tx = (uint32_t)((nx * 0.5f + 0.5f) * ClusterTilesX);
+            uint32_t ty = (uint32_t)((0.5f - ny * 0.5f) * ClusterTilesY);
+            int slice = (int)floorf(logf(z) * clusters.GetSliceScale() + clusters.GetSliceBias());
+            slice = (std::min)((std::max)(slice, 0), (int)ClusterSlices - 1);
+            const ClusterRange& range = clusters.GetRanges()[(slice * ClusterTilesY + ty) * ClusterTilesX + tx];
+            const uint32_t* listed = &clusters.GetIndices()[0] + range.offset;
+            perPoint += range.count;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                float dx = viewCenters[i].x - viewPos.x, dy = viewCenters[i].y - viewPos.y, dz = viewCenters[i].z - viewPos.z;
+                float radius = lights.GetRadius(i);
+                if (dx * dx + dy * dy + dz * dz <= radius * radius && std::find(listed, listed + range.count, i) == listed + range.count)
+                    missed++;
+            }
+        }
+
+        // Per-object lists for unit cubes around the scene
+        size_t clusterIndices = clusters.GetIndices().size();
+        uint64_t perObject = 0;
+        const uint32_t objects = 1000;
+        for (uint32_t i = 0; i < objects; i++)
+        {
+            XMFLOAT3 center(px(rng), py(rng), px(rng));
+            Aabb box = { XMFLOAT3(center.x - 1.0f, center.y - 1.0f, center.z - 1.0f), XMFLOAT3(center.x + 1.0f, center.y + 1.0f, center.z + 1.0f) };
+            perObject += clusters.AddObjectLights(box).count;
+        }
+
+        BenchPrint("clusters %u lights: %.3f ms, %zu indices, %.1f lights per pixel on average, %u at most, %u missed, %.1f per object\n",
+            count, buildMs, clusterIndices, (double)perPoint / samples, clusters.GetMaxLightsPerCluster(), missed, (double)perObject / objects);
+    }
+}
+
+//-----------Shadow cascades-------------
+static void _benchShadows()
+{
+    ShadowFitDesc desc = {};
+    desc.fovY = XM_PIDIV2;
+    desc.aspect = 16.0f / 9.0f;
+    desc.nearZ = 0.01f;
+    desc.shadowDistance = 40.0f;
+    desc.lightDir = XMFLOAT3(-0.4f, -1.0f, 0.3f);
+    desc.resolution = 2048;
+    desc.numCascades = 4;
+    desc.splitLambda = 0.7f;
+    desc.casterReach = 50.0f;
+
+    // A 32 x 32 grid of static boxes and one that moves every frame
+    std::vector<Aabb> boxes;
+    for (int z = 0; z < 32; z++)
+    {
+        for (int x = 0; x < 32; x++)
+            boxes.push_back(SphereAabb(XMFLOAT3(x * 3.0f - 48.0f, 0.0f, z * 3.0f - 48.0f), 1.0f));
+    }
+    const uint32_t moving = (uint32_t)boxes.size();
+    boxes.push_back(SphereAabb(XMFLOAT3(0.0f, 0.0f, 2.0f), 1.0f));
+    Bvh bvh;
+    bvh.Build(boxes);
+    std::vector<uint64_t> states(boxes.size(), 1);
+
+    // Every corner of a cascade's slice of the camera frustum must land inside its shadow map
+    ShadowCascades cascades;
+    uint32_t outside = 0;
+    float tanY = tanf(desc.fovY * 0.5f), tanX = tanY * desc.aspect;
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> angle(0.0f, XM_2PI), offset(-10.0f, 10.0f);
+    for (int test = 0; test < 100; test++)
+    {
+        XMVECTOR eye = XMVectorSet(offset(rng), 2.0f, offset(rng), 1.0f);
+        XMMATRIX view = XMMatrixLookToLH(eye, XMVectorSet(sinf(angle(rng)), -0.3f, cosf(angle(rng)), 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMStoreFloat4x4(&desc.cameraView, view);
+        cascades.Fit(desc);
+        XMMATRIX invView = XMMatrixInverse(nullptr, view);
+        for (uint32_t i = 0; i < cascades.GetCount(); i++)
+        {
+            const ShadowCascade& cascade = cascades.GetCascade(i);
+            XMMATRIX toShadow = XMMatrixMultiply(invView, XMLoadFloat4x4(&cascade.viewProjection));
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float z = corner & 4 ? cascade.splitFar : cascade.splitNear;
+                XMFLOAT3 p;
+                XMStoreFloat3(&p, XMVector3TransformCoord(XMVectorSet(corner & 1 ? z * tanX : -z * tanX, corner & 2 ? z * tanY : -z * tanY, z, 1.0f), toShadow));
+                if (fabsf(p.x) > 1.0001f || fabsf(p.y) > 1.0001f || p.z < -0.0001f || p.z > 1.0001f)
+                    outside++;
+            }
+        }
+    }
+
+    // A slowly sliding camera only moves a cascade when its center crosses a texel, and with
+    // static casters only moved cascades are redrawn
+    XMFLOAT3 eye(0.0f, 2.0f, -10.0f);
+    int changes = 0, renders[2] = {};
+    const int frames = 1000;
+    XMFLOAT4X4 last[MaxShadowCascades] = {};
+    double fitMs = 0.0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        eye.x += 0.001f;
+        XMStoreFloat4x4(&desc.cameraView, XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(0.0f, -0.3f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+
+        BenchClock::time_point start = BenchClock::now();
+        cascades.Fit(desc);
+        states[moving] = frame < frames / 2 ? 1 : frame + 2;
+        cascades.CullCasters(bvh, [](uint32_t) { return true; }, states.data());
+        fitMs += _elapsedNs(start) * 1e-6;
+
+        for (uint32_t i = 0; i < cascades.GetCount(); i++)
+        {
+            changes += memcmp(&last[i], &cascades.GetCascade(i).viewProjection, sizeof(XMFLOAT4X4)) != 0;
+            last[i] = cascades.GetCascade(i).viewProjection;
+            if (cascades.NeedsRender(i))
+            {
+                renders[frame >= frames / 2]++;
+                cascades.MarkRendered(i);
+            }
+        }
+    }
+
+    BenchPrint("shadows: %u cascades, texels %.3f/%.3f/%.3f/%.3f, %u corners outside, fit + cull %.3f ms\n",
+        cascades.GetCount(), cascades.GetCascade(0).texelSize, cascades.GetCascade(1).texelSize, cascades.GetCascade(2).texelSize,
+        cascades.GetCascade(3).texelSize, outside, fitMs / frames);
+    BenchPrint("shadows: camera slides %.3f units a frame: %d of %u cascade updates moved the cascade, %d redrawn with static casters, "
+        "%d once one caster moves every frame (%zu/%zu/%zu/%zu casters)\n",
+        0.001f, changes, frames * cascades.GetCount(), renders[0], renders[1],
+        cascades.GetCasters(0).size(), cascades.GetCasters(1).size(), cascades.GetCasters(2).size(), cascades.GetCasters(3).size());
+}
+
+//-----------Lightmap baking-------------
+static void _benchBake()
+{
+    // A floor with a torus and a cube on it, charted into one atlas
+    Mesh meshes[3] = { GeneratePlane(32, 32, 16.0f), GenerateTorus(64, 32, 1.0f, 0.3f), GenerateCube() };
+    XMMATRIX worlds[3] = { XMMatrixTranslation(0.0f, -1.0f, 0.0f), XMMatrixTranslation(-2.0f, -0.7f, 0.0f), XMMatrixTranslation(2.0f, 0.0f, 0.0f) };
+    LightmapAtlasBuilder atlas;
+    BenchClock::time_point start = BenchClock::now();
+    for (Mesh& mesh : meshes)
+        atlas.AddMesh(mesh);
+    bool packed = atlas.Pack(512);
+    double atlasMs = _elapsedNs(start) * 1e-6;
+
+    RayTracer scene;
+    std::vector<XMFLOAT3> corners;
+    for (int i = 0; i < 3; i++)
+    {
+        scene.AddMesh(&meshes[i].vertices[0].pos, sizeof(MeshVertex), meshes[i].indices.data(), meshes[i].indices.size(), worlds[i]);
+        for (uint32_t index : meshes[i].indices)
+        {
+            XMFLOAT3 p;
+            XMStoreFloat3(&p, XMVector3TransformCoord(XMLoadFloat3(&meshes[i].vertices[index].pos), worlds[i]));
+            corners.push_back(p);
+        }
+    }
+    start = BenchClock::now();
+    scene.Build();
+    double buildMs = _elapsedNs(start) * 1e-6;
+
+    // Closest hits against testing every triangle
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> coord(-4.0f, 4.0f), unit(-1.0f, 1.0f);
+    const int checkRays = 2000;
+    int wrong = 0, hits = 0;
+    for (int r = 0; r < checkRays; r++)
+    {
+        XMFLOAT3 origin(coord(rng), coord(rng) * 0.5f + 1.0f, coord(rng)), dir;
+        XMStoreFloat3(&dir, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f)));
+        float best = FLT_MAX;
+        for (size_t t = 0; t < corners.size(); t += 3)
+        {
+            float tHit;
+            if (IntersectRayTriangle(origin, dir, corners[t], corners[t + 1], corners[t + 2], tHit) && tHit > 0.0f && tHit < best)
+                best = tHit;
+        }
+        RayHit hit;
+        bool found = scene.Intersect(origin, dir, FLT_MAX, hit);
+        hits += found;
+        if (found != (best < FLT_MAX) || (found && fabsf(hit.t - best) > 1e-3f * (1.0f + best)))
+            wrong++;
+    }
+
+    // Single-thread rate of short occlusion rays leaving the floor
+    const int occlusionRays = 1000000;
+    int blocked = 0;
+    start = BenchClock::now();
+    for (int r = 0; r < occlusionRays; r++)
+    {
+        XMFLOAT3 origin(coord(rng), -0.999f, coord(rng)), dir;
+        XMStoreFloat3(&dir, XMVector3Normalize(XMVectorSet(unit(rng), 1.0f, unit(rng), 0.0f)));
+        blocked += scene.Occluded(origin, dir, BakeAoDistance);
+    }
+    double occlusionNs = _elapsedNs(start) / occlusionRays;
+
+    BenchPrint("bake: %zu triangles, build %.2f ms, %d/%d closest hits wrong (%d hit), occlusion %.1f ns/ray (%.1f%% blocked), "
+        "%u charts in %.2f ms%s, %.1f texels per unit\n",
+        scene.GetTriangleCount(), buildMs, wrong, checkRays, hits, occlusionNs, 100.0 * blocked / occlusionRays,
+        atlas.GetChartCount(), atlasMs, packed ? "" : " (didn't fit)", atlas.GetDensity());
+
+    LightmapBakeDesc desc = {};
+    size_t firstVertex = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        LightmapReceiver receiver = { meshes[i].vertices.data(), atlas.GetUVs().data() + firstVertex, meshes[i].indices.data(), meshes[i].indices.size(), {}, 0 };
+        XMStoreFloat4x4(&receiver.world, worlds[i]);
+        desc.receivers.push_back(receiver);
+        firstVertex += meshes[i].vertices.size();
+    }
+    desc.pOccluders = &scene;
+    desc.lights.assign(StaticLights, StaticLights + StaticLightCount);
+    XMStoreFloat3(&desc.sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+    desc.sunColor = XMFLOAT3(SunColor.x, SunColor.y, SunColor.z);
+    desc.size = 512;
+    desc.numSlices = 1;
+    desc.aoRays = 32;
+    desc.aoDistance = BakeAoDistance;
+
+    ThreadPool pool;
+    pool.Init();
+    std::vector<XMFLOAT4> texels;
+    LightmapBakeStats stats = {};
+    BakeLightmaps(desc, pool, texels, &stats);
+    double ao = 0.0;
+    for (const XMFLOAT4& texel : texels)
+        ao += texel.w;
+    BenchPrint("bake: %u^2 texels, %.1f%% covered, %llu rays in %.2f s on %u threads, %.2f Mrays/s, mean AO %.3f\n",
+        desc.size, 100.0 * stats.texels / texels.size(), (unsigned long long)stats.rays, stats.seconds, pool.GetNumThreads(),
+        stats.rays / 1e6 / (std::max)(stats.seconds, 1e-9), ao / texels.size());
+}
+
+//-----------Irradiance probes-------------
+static void _benchProbes()
+{
+    ThreadPool pool;
+    pool.Init();
+
+    // A white sky alone has an irradiance of pi from every side
+    ProbeBakeDesc desc = {};
+    desc.skyRadiance = XMFLOAT3(1.0f, 1.0f, 1.0f);
+    desc.albedo = ProbeAlbedo;
+    desc.gridMin = desc.gridMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    desc.counts = XMUINT3(1, 1, 1);
+    desc.rays = ProbeRays;
+    std::vector<ProbeSH> probes;
+    BakeProbes(desc, pool, probes);
+    static const XMFLOAT3 Normals[] = { { 0, 1, 0 }, { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 }, { 0.577f, 0.577f, 0.577f } };
+    float skyError = 0.0f;
+    for (const XMFLOAT3& n : Normals)
+        skyError = (std::max)(skyError, fabsf(EvaluateProbe(probes[0], n).x - 1.0f));
+
+    // Under a black floor that hides the lower half, E / pi = (1 + cos) / 2 exactly in order 1
+    Mesh floor = GeneratePlane(1, 1, 1000.0f);
+    RayTracer occluders;
+    occluders.AddMesh(&floor.vertices[0].pos, sizeof(MeshVertex), floor.indices.data(), floor.indices.size(), XMMatrixTranslation(0.0f, -1.0f, 0.0f));
+    occluders.Build();
+    desc.pScene = &occluders;
+    BakeProbes(desc, pool, probes);
+    float floorError = 0.0f;
+    for (const XMFLOAT3& n : Normals)
+        floorError = (std::max)(floorError, fabsf(EvaluateProbe(probes[0], n).x - (1.0f + n.y) * 0.5f));
+
+    // The renderer's grid around a cube and a torus lit by the scene lights
+    Mesh cube = GenerateCube(), torus = GenerateTorus(64, 32, 1.0f, 0.3f);
+    RayTracer scene;
+    scene.AddMesh(&cube.vertices[0].pos, sizeof(MeshVertex), cube.indices.data(), cube.indices.size(),
+        XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z));
+    scene.AddMesh(&torus.vertices[0].pos, sizeof(MeshVertex), torus.indices.data(), torus.indices.size(),
+        XMMatrixScaling(ModelRadius, ModelRadius, ModelRadius) * XMMatrixTranslation(ModelPosition.x, ModelPosition.y, ModelPosition.z));
+    scene.Build();
+    desc.pScene = &scene;
+    desc.skyRadiance = SkyRadiance;
+    desc.lights.assign(StaticLights, StaticLights + StaticLightCount);
+    XMStoreFloat3(&desc.sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+    desc.sunColor = XMFLOAT3(SunColor.x, SunColor.y, SunColor.z);
+    desc.gridMin = ProbeGridMin;
+    desc.gridMax = ProbeGridMax;
+    desc.counts = ProbeGridCounts;
+    ProbeBakeStats stats = {};
+    BakeProbes(desc, pool, probes, &stats);
+    std::vector<XMHALF4> texels;
+    PackProbes(probes, desc.counts, texels);
+
+    BenchPrint("probes: sky error %.4f, floor error %.4f; %u probes (%u inside geometry), %llu rays in %.1f ms on %u threads, "
+        "%.2f Mrays/s, %zu KB as half SH\n",
+        skyError, floorError, stats.probes, stats.invalid, (unsigned long long)stats.rays, stats.seconds * 1e3, pool.GetNumThreads(),
+        stats.rays / 1e6 / (std::max)(stats.seconds, 1e-9), texels.size() * sizeof(XMHALF4) / 1024);
+}
+
+//-----------Profiler-------------
+static void _benchProfiler()
+{
+    const int zones = 1000000;
+    auto start = BenchClock::now();
+    for (int i = 0; i < zones; i++)
+    {
+        PROFILE_ZONE("off");
+    }
+    double offNs = _elapsedNs(start) / zones;
+
+    // Frames of 1000 zones each so the rings never wrap
+    ProfilerSetEnabled(true);
+    ProfilerResetStats();
+    start = BenchClock::now();
+    for (int frame = 0; frame < zones / 1000; frame++)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            PROFILE_ZONE("on");
+        }
+        ProfilerEndFrame();
+    }
+    double onNs = _elapsedNs(start) / zones;
+
+    // A 2 ms zone with a 1 ms child, and workers that record on their own threads
+    ProfilerResetStats();
+    ThreadPool pool;
+    pool.Init();
+    for (int frame = 0; frame < 10; frame++)
+    {
+        {
+            PROFILE_ZONE("parent");
+            int64_t begin = ClockNow();
+            {
+                PROFILE_ZONE("child");
+                while (ClockMilliseconds(ClockNow() - begin) < 1.0)
+                    ;
+            }
+            while (ClockMilliseconds(ClockNow() - begin) < 2.0)
+                ;
+            pool.ParallelFor(64, 1, [](uint32_t, uint32_t) { PROFILE_ZONE("job"); });
+        }
+        ProfilerEndFrame();
+    }
+    std::vector<ProfileZoneStats> stats;
+    ProfilerGetStats(stats);
+    ProfilerSetEnabled(false);
+
+    BenchPrint("profiler: %.1f ns/zone off, %.1f ns/zone on (with collection), clock resolution %.1f ns\n%stitle: %s\n",
+        offNs, onNs, 1e9 / ClockFrequency(), ProfilerFormatStats(stats).c_str(), ProfilerFormatTopZones(stats, 3).c_str());
+}
+
+//-----------Fixed-step simulation-------------
+static void _benchSimulation()
+{
+    // The same ticks from steady 144 Hz frames and from frames of 1 to 40 ms must give the
+    // same state bit for bit
+    const uint64_t ticks = 6000;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> frameTime(0.001, 0.040);
+    SimulationState states[2];
+    uint32_t frames[2] = {};
+    float maxAlphaStep = 0.0f;
+    for (int run = 0; run < 2; run++)
+    {
+        FixedTimestep timestep;
+        ResetSimulation(states[run]);
+        SimulationState previous = states[run];
+        float lastAngle = 0.0f;
+        while (timestep.GetTicks() < ticks)
+        {
+            uint32_t due = timestep.Advance(run == 0 ? 1.0 / 144.0 : frameTime(rng));
+            for (uint32_t i = 0; i < due && timestep.GetTicks() - due + i < ticks; i++)
+            {
+                previous = states[run];
+                StepSimulation(states[run], timestep.GetStep());
+            }
+            // Between ticks the drawn angle moves by at most a tick's worth
+            SimulationFrame frame;
+            InterpolateSimulation(previous, states[run], timestep.GetAlpha(), frame);
+            XMFLOAT4X4 m;
+            XMStoreFloat4x4(&m, frame.cubeWorld);
+            float angle = atan2f(-m._31, m._11);
+            float turn = fabsf(angle - lastAngle);
+            if (run == 0 && frames[run] > 0)
+                maxAlphaStep = (std::max)(maxAlphaStep, (std::min)(turn, XM_2PI - turn));
+            lastAngle = angle;
+            frames[run]++;
+        }
+    }
+    bool same = memcmp(&states[0], &states[1], sizeof(SimulationState)) == 0;
+
+    // A one second hitch runs the capped number of ticks and drops the rest
+    FixedTimestep hitch;
+    uint32_t caught = hitch.Advance(1.0);
+
+    auto start = BenchClock::now();
+    SimulationState state;
+    ResetSimulation(state);
+    for (int i = 0; i < 1000000; i++)
+        StepSimulation(state, 1.0f / DefaultSimulationRate);
+    double stepNs = _elapsedNs(start) / 1000000;
+
+    BenchPrint("simulation: %llu ticks from %u and %u frames %s, drawn spin %.4f rad/frame at most (tick %.4f), "
+        "1 s hitch ran %u ticks and dropped %.3f s, %.1f ns/tick\n",
+        (unsigned long long)ticks, frames[0], frames[1], same ? "identical" : "DIFFER", maxAlphaStep, 1.0f / DefaultSimulationRate,
+        caught, hitch.GetDroppedSeconds(), stepNs);
+}
+
+//-----------Camera path-------------
+static void _benchCameraPath()
+{
+    // Keys with a NaN or infinite time are dropped, also as the first key, where there is
+    // no earlier one to compare with
+    CameraPath path;
+    path.Add({ NAN, 1.0f, 1.0f, 1.0f });
+    path.Add({ 0.0f, 0.0f, 0.0f, 10.0f });
+    path.Add({ INFINITY, 1.0f, 1.0f, 1.0f });
+    path.Add({ 1.0f, 1.0f, 0.5f, 20.0f });
+    path.Add({ -INFINITY, 1.0f, 1.0f, 1.0f });
+    CameraPathKey middle = path.Sample(0.5f);
+    CameraPathKey start = path.Sample(NAN);
+    bool added = path.GetKeyCount() == 2 && middle.phi == 0.5f && middle.r == 15.0f && start.time == 0.0f;
+    BenchPrint("camerapath: %zu of 5 keys kept, sample at 0.5 s r %.2f, at NaN time %.2f s, %s\n",
+        path.GetKeyCount(), middle.r, start.time, _benchCheck(added));
+
+    // A file with such a key is damaged and doesn't load
+    CameraPathHeader header = {};
+    header.magic = CameraPathMagic;
+    header.version = CameraPathVersion;
+    header.numKeys = 3;
+    CameraPathKey keys[3] = { { 0.0f, 0.0f, 0.0f, 10.0f }, { 1.0f, 1.0f, 0.5f, 20.0f }, { NAN, 0.0f, 0.0f, 10.0f } };
+    FILE* pFile = _openForWrite("bench_camerapath.path");
+    bool written = pFile && fwrite(&header, sizeof(header), 1, pFile) == 1 && fwrite(keys, sizeof(keys), 1, pFile) == 1;
+    if (pFile)
+        fclose(pFile);
+    CameraPath loaded;
+    bool rejected = written && !loaded.Load("bench_camerapath.path") && loaded.GetKeyCount() == 0;
+    BenchPrint("camerapath: file with a NaN key time rejection %s\n", _benchCheck(rejected));
+
+    remove("bench_camerapath.path");
+}
+
+// Brighter than the target can hold, like the transparent planes: clamped to white first
+static XMFLOAT4 _benchHalfWhite(const void*, const SoftPixel&)
+{
+    return XMFLOAT4(2.0f, 2.0f, 2.0f, 0.5f);
+}
+
+static void _benchSoftRaster()
+{
+    ThreadPool pool;
+    pool.Init();
+
+    // Fill rule and blending: a screen-covering quad of two blended triangles leaves every
+    // pixel at exactly one blend of the clamped color, none twice along the diagonal and
+    // none skipped
+    SoftRasterizer raster;
+    raster.Resize(1280, 720);
+    raster.Clear(XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+    SoftVertex quad[4] = {};
+    quad[0].clip = XMFLOAT4(-1.0f, 1.0f, 0.5f, 1.0f);
+    quad[1].clip = XMFLOAT4(1.0f, 1.0f, 0.5f, 1.0f);
+    quad[2].clip = XMFLOAT4(1.0f, -1.0f, 0.5f, 1.0f);
+    quad[3].clip = XMFLOAT4(-1.0f, -1.0f, 0.5f, 1.0f);
+    static const uint32_t QuadIndices[] = { 0, 1, 2, 0, 2, 3 };
+    SoftDrawState blend = { SoftDepthTest, SoftBlendAlpha, 0, _benchHalfWhite, nullptr };
+    raster.Draw(blend, quad, QuadIndices, 6);
+    raster.Flush(&pool);
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < raster.GetWidth() * raster.GetHeight(); i++)
+        wrong += (raster.GetColor()[i] & 0xFF) != 128 ? 1 : 0;
+
+    auto start = BenchClock::now();
+    SoftRenderer renderer;
+    renderer.Init(pool);
+    double initMs = _elapsedNs(start) / 1e6;
+    BenchPrint("softraster: fill rule and blend %s (%u pixels off), init with the probe bake %.1f ms, %u threads\n",
+        _benchCheck(wrong == 0), wrong, initMs, pool.GetNumThreads());
+
+    struct Resolution { uint32_t width, height, frames; };
+    static const Resolution Resolutions[] = { { 1280, 720, 60 }, { 3840, 2160, 20 } };
+    for (const Resolution& resolution : Resolutions)
+    {
+        renderer.Resize(resolution.width, resolution.height);
+        XMMATRIX view, projection;
+        GetDefaultSoftCamera(resolution.width / (float)resolution.height, view, projection);
+
+        SimulationState previous, current;
+        ResetSimulation(current);
+        std::vector<double> frameMs;
+        // The first two frames fault the targets in and aren't counted
+        for (uint32_t i = 0; i < resolution.frames + 2; i++)
+        {
+            previous = current;
+            StepSimulation(current, 1.0f / DefaultSimulationRate);
+            SimulationFrame frame;
+            InterpolateSimulation(previous, current, 1.0f, frame);
+            auto frameStart = BenchClock::now();
+            renderer.Render(view, projection, frame);
+            if (i >= 2)
+                frameMs.push_back(_elapsedNs(frameStart) / 1e6);
+        }
+
+        FrameTimingSummary summary = SummarizeFrameTimes(frameMs);
+        const SoftRasterStats& stats = renderer.GetTarget().GetStats();
+        double pixels = (double)resolution.width * resolution.height;
+        BenchPrint("softraster: %ux%u mean %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms (%.1f fps); %u triangles in %u tile bins, "
+            "%.2f shaded pixels per pixel, %.0f Mpixels/s\n",
+            resolution.width, resolution.height, summary.meanMs, summary.p50Ms, summary.p95Ms, summary.maxMs, 1000.0 / summary.meanMs,
+            stats.triangles, stats.binned, stats.shadedPixels / pixels, pixels / 1e3 / summary.meanMs);
+    }
+}
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark Benchmarks[] = {
+    { "culling", _benchCulling },
+    { "bvh", _benchBvh },
+    { "occlusion", _benchOcclusion },
+    { "meshgen", _benchMeshgen },
+    { "vertexformat", _benchVertexFormat },
+    { "import", _benchImport },
+    { "meshfile", _benchMeshFile },
+    { "meshlet", _benchMeshlets },
+    { "sort", _benchSort },
+    { "clusters", _benchClusters },
+    { "shadows", _benchShadows },
+    { "bake", _benchBake },
+    { "probes", _benchProbes },
+    { "profiler", _benchProfiler },
+    { "simulation", _benchSimulation },
+    { "camerapath", _benchCameraPath },
+    { "softraster", _benchSoftRaster },
+};
+
+bool RunBenchmark(const char* name)
+{
+    bool found = false;
+    _benchFailed = false;
+    for (const Benchmark& bench : Benchmarks)
+    {
+        if (strcmp(name, "all") == 0 || strcmp(name, bench.name) == 0)
+        {
+            bench.run();
+            found = true;
+        }
+    }
+    if (!found)
+        BenchPrint("unknown benchmark '%s'\n", name);
+    return found && !_benchFailed;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// CPU micro-benchmarks started from the command line (-bench <name>|all).
+// Results go to stdout, the debugger output and benchmark.log. Returns false for an unknown
+// name or when a benchmark's correctness check failed.
+bool RunBenchmark(const char* name);
+void BenchPrint(const char* format, ...);
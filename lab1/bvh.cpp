@@ -0,0 +1,366 @@
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+static const uint32_t NoParent = 0xFFFFFFFF;
+
+static float _surfaceArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+{
+    float dx = mx.x - mn.x, dy = mx.y - mn.y, dz = mx.z - mn.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static void _grow(XMFLOAT3& mn, XMFLOAT3& mx, const XMFLOAT3& bmin, const XMFLOAT3& bmax)
+{
+    mn.x = (std::min)(mn.x, bmin.x); mn.y = (std::min)(mn.y, bmin.y); mn.z = (std::min)(mn.z, bmin.z);
+    mx.x = (std::max)(mx.x, bmax.x); mx.y = (std::max)(mx.y, bmax.y); mx.z = (std::max)(mx.z, bmax.z);
+}
+
+Aabb TransformAabb(const Aabb& box, FXMMATRIX matrix)
+{
+    // Arvo: the extent along each output axis is the absolute matrix applied to the half-size
+    XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&box.min), XMLoadFloat3(&box.max)), 0.5f);
+    XMVECTOR extent = XMVectorScale(XMVectorSubtract(XMLoadFloat3(&box.max), XMLoadFloat3(&box.min)), 0.5f);
+
+    XMVECTOR newCenter = XMVector3Transform(center, matrix);
+    XMVECTOR newExtent = XMVectorAdd(XMVectorAdd(
+        XMVectorMultiply(XMVectorSplatX(extent), XMVectorAbs(matrix.r[0])),
+        XMVectorMultiply(XMVectorSplatY(extent), XMVectorAbs(matrix.r[1]))),
+        XMVectorMultiply(XMVectorSplatZ(extent), XMVectorAbs(matrix.r[2])));
+
+    Aabb result;
+    XMStoreFloat3(&result.min, XMVectorSubtract(newCenter, newExtent));
+    XMStoreFloat3(&result.max, XMVectorAdd(newCenter, newExtent));
+    return result;
+}
+
+Aabb SphereAabb(const XMFLOAT3& center, float radius)
+{
+    Aabb box;
+    box.min = XMFLOAT3(center.x - radius, center.y - radius, center.z - radius);
+    box.max = XMFLOAT3(center.x + radius, center.y + radius, center.z + radius);
+    return box;
+}
+
+bool IntersectRayAabb(const XMFLOAT3& origin, const XMFLOAT3& invDir, const Aabb& box, float tMax, float& tHit)
+{
+    float tx1 = (box.min.x - origin.x) * invDir.x, tx2 = (box.max.x - origin.x) * invDir.x;
+    float ty1 = (box.min.y - origin.y) * invDir.y, ty2 = (box.max.y - origin.y) * invDir.y;
+    float tz1 = (box.min.z - origin.z) * invDir.z, tz2 = (box.max.z - origin.z) * invDir.z;
+
+    float tNear = (std::max)((std::max)((std::min)(tx1, tx2), (std::min)(ty1, ty2)), (std::min)(tz1, tz2));
+    float tFar = (std::min)((std::min)((std::max)(tx1, tx2), (std::max)(ty1, ty2)), (std::max)(tz1, tz2));
+
+    tHit = (std::max)(tNear, 0.0f);
+    return tNear <= tFar && tFar >= 0.0f && tNear < tMax;
+}
+
+bool IntersectRaySphere(const XMFLOAT3& origin, const XMFLOAT3& dir, const XMFLOAT3& center, float radius, float& tHit)
+{
+    XMFLOAT3 oc(origin.x - center.x, origin.y - center.y, origin.z - center.z);
+    float a = dir.x * dir.x + dir.y * dir.y + dir.z * dir.z;
+    float b = oc.x * dir.x + oc.y * dir.y + oc.z * dir.z;
+    float c = oc.x * oc.x + oc.y * oc.y + oc.z * oc.z - radius * radius;
+    float disc = b * b - a * c;
+    if (disc < 0.0f || a == 0.0f)
+        return false;
+
+    float s = sqrtf(disc);
+    float t = (-b - s) / a;
+    if (t < 0.0f)
+        t = (-b + s) / a;
+    tHit = t;
+    return t >= 0.0f;
+}
+
+bool IntersectRayTriangle(const XMFLOAT3& origin, const XMFLOAT3& dir, const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2, float& tHit)
+{
+    // Moller-Trumbore, two-sided
+    XMVECTOR o = XMLoadFloat3(&origin);
+    XMVECTOR d = XMLoadFloat3(&dir);
+    XMVECTOR p0 = XMLoadFloat3(&v0);
+    XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&v1), p0);
+    XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&v2), p0);
+
+    XMVECTOR p = XMVector3Cross(d, e2);
+    float det = XMVectorGetX(XMVector3Dot(e1, p));
+    if (fabsf(det) < 1e-8f)
+        return false;
+    float invDet = 1.0f / det;
+
+    XMVECTOR s = XMVectorSubtract(o, p0);
+    float u = XMVectorGetX(XMVector3Dot(s, p)) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    XMVECTOR q = XMVector3Cross(s, e1);
+    float v = XMVectorGetX(XMVector3Dot(d, q)) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    tHit = XMVectorGetX(XMVector3Dot(e2, q)) * invDet;
+    return tHit >= 0.0f;
+}
+
+void Bvh::Build(const std::vector<Aabb>& bounds)
+{
+    _bounds = bounds;
+    uint32_t count = (uint32_t)bounds.size();
+
+    _indices.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        _indices[i] = i;
+    _leafOf.assign(count, 0);
+    _dirtyLeaves.clear();
+
+    _nodes.clear();
+    _parents.clear();
+    _builtArea = _area = 0.0;
+    if (count == 0)
+        return;
+
+    _nodes.reserve(2 * count);
+    _parents.reserve(2 * count);
+    _nodes.push_back(Node());
+    _parents.push_back(NoParent);
+    _buildNode(0, 0, count);
+
+    _builtArea = _area = _totalArea();
+}
+
+void Bvh::_buildNode(uint32_t node, uint32_t first, uint32_t count)
+{
+    XMFLOAT3 mn(FLT_MAX, FLT_MAX, FLT_MAX), mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    XMFLOAT3 cmn = mn, cmx = mx;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const Aabb& box = _bounds[_indices[i]];
+        _grow(mn, mx, box.min, box.max);
+        XMFLOAT3 c((box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f);
+        _grow(cmn, cmx, c, c);
+    }
+    _nodes[node].min = mn;
+    _nodes[node].max = mx;
+
+    if (count <= MaxLeafSize)
+    {
+        _nodes[node].leftOrFirst = first;
+        _nodes[node].count = count;
+        for (uint32_t i = first; i < first + count; i++)
+            _leafOf[_indices[i]] = node;
+        return;
+    }
+
+    // Median split of the centroids along the longest axis
+    float ext[3] = { cmx.x - cmn.x, cmx.y - cmn.y, cmx.z - cmn.z };
+    int axis = ext[1] > ext[0] ? 1 : 0;
+    axis = ext[2] > ext[axis] ? 2 : axis;
+
+    uint32_t half = count / 2;
+    std::nth_element(_indices.begin() + first, _indices.begin() + first + half, _indices.begin() + first + count,
+        [&](uint32_t a, uint32_t b)
+        {
+            const float* ba = &_bounds[a].min.x;
+            const float* bb = &_bounds[b].min.x;
+            const float* ta = &_bounds[a].max.x;
+            const float* tb = &_bounds[b].max.x;
+            return ba[axis] + ta[axis] < bb[axis] + tb[axis];
+        });
+
+    uint32_t left = (uint32_t)_nodes.size();
+    _nodes.push_back(Node());
+    _nodes.push_back(Node());
+    _parents.push_back(node);
+    _parents.push_back(node);
+    _nodes[node].leftOrFirst = left;
+    _nodes[node].count = 0;
+
+    _buildNode(left, first, half);
+    _buildNode(left + 1, first + half, count - half);
+}
+
+void Bvh::Update(uint32_t object, const Aabb& bounds)
+{
+    _bounds[object] = bounds;
+    _dirtyLeaves.push_back(_leafOf[object]);
+}
+
+void Bvh::_fitNode(uint32_t node)
+{
+    Node& n = _nodes[node];
+    XMFLOAT3 mn(FLT_MAX, FLT_MAX, FLT_MAX), mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    if (n.count > 0)
+    {
+        for (uint32_t i = n.leftOrFirst; i < n.leftOrFirst + n.count; i++)
+            _grow(mn, mx, _bounds[_indices[i]].min, _bounds[_indices[i]].max);
+    }
+    else
+    {
+        _grow(mn, mx, _nodes[n.leftOrFirst].min, _nodes[n.leftOrFirst].max);
+        _grow(mn, mx, _nodes[n.leftOrFirst + 1].min, _nodes[n.leftOrFirst + 1].max);
+    }
+    n.min = mn;
+    n.max = mx;
+}
+
+void Bvh::Refit()
+{
+    if (_dirtyLeaves.empty())
+        return;
+
+    for (uint32_t leaf : _dirtyLeaves)
+    {
+        // Walk up only while the boxes actually change
+        for (uint32_t node = leaf; node != NoParent; node = _parents[node])
+        {
+            Node before = _nodes[node];
+            _fitNode(node);
+            const Node& after = _nodes[node];
+            _area += _surfaceArea(after.min, after.max) - _surfaceArea(before.min, before.max);
+            if (node != leaf && memcmp(&before.min, &after.min, sizeof(XMFLOAT3)) == 0 && memcmp(&before.max, &after.max, sizeof(XMFLOAT3)) == 0)
+                break;
+        }
+    }
+    _dirtyLeaves.clear();
+
+    // Refitting never changes the topology, so objects that drift apart slowly degrade the tree
+    if (_nodes.size() > 1 && _area > 2.0 * _builtArea)
+        Build(std::vector<Aabb>(_bounds));
+}
+
+double Bvh::_totalArea() const
+{
+    double area = 0.0;
+    for (const Node& n : _nodes)
+        area += _surfaceArea(n.min, n.max);
+    return area;
+}
+
+void Bvh::_collect(uint32_t node, std::vector<uint32_t>& visible) const
+{
+    const Node& n = _nodes[node];
+    if (n.count > 0)
+    {
+        for (uint32_t i = n.leftOrFirst; i < n.leftOrFirst + n.count; i++)
+            visible.push_back(_indices[i]);
+        return;
+    }
+    _collect(n.leftOrFirst, visible);
+    _collect(n.leftOrFirst + 1, visible);
+}
+
+// Returns -1 when the box is outside a plane, otherwise the planes it still straddles
+static int _testPlanes(const Frustum& frustum, const XMFLOAT3& mn, const XMFLOAT3& mx, int planeMask)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(planeMask & (1 << p)))
+            continue;
+        const XMFLOAT4& pl = frustum.planes[p];
+        float farDist = pl.x * (pl.x >= 0.0f ? mx.x : mn.x) + pl.y * (pl.y >= 0.0f ? mx.y : mn.y) + pl.z * (pl.z >= 0.0f ? mx.z : mn.z) + pl.w;
+        if (farDist < 0.0f)
+            return -1;
+        float nearDist = pl.x * (pl.x >= 0.0f ? mn.x : mx.x) + pl.y * (pl.y >= 0.0f ? mn.y : mx.y) + pl.z * (pl.z >= 0.0f ? mn.z : mx.z) + pl.w;
+        if (nearDist >= 0.0f)
+            planeMask &= ~(1 << p);
+    }
+    return planeMask;
+}
+
+void Bvh::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+    if (_nodes.empty())
+        return;
+
+    struct Entry { uint32_t node; int planeMask; };
+    Entry stack[64];
+    int top = 0;
+    stack[top++] = { 0, 0x3F };
+
+    while (top > 0)
+    {
+        Entry e = stack[--top];
+        const Node& n = _nodes[e.node];
+
+        int mask = _testPlanes(frustum, n.min, n.max, e.planeMask);
+        if (mask < 0)
+            continue;
+        if (mask == 0)
+        {
+            // Fully inside: everything below is visible without further tests
+            _collect(e.node, visible);
+            continue;
+        }
+
+        if (n.count > 0)
+        {
+            for (uint32_t i = n.leftOrFirst; i < n.leftOrFirst + n.count; i++)
+            {
+                const Aabb& box = _bounds[_indices[i]];
+                if (_testPlanes(frustum, box.min, box.max, mask) >= 0)
+                    visible.push_back(_indices[i]);
+            }
+            continue;
+        }
+
+        stack[top++] = { n.leftOrFirst, mask };
+        stack[top++] = { n.leftOrFirst + 1, mask };
+    }
+}
+
+bool Bvh::Raycast(const XMFLOAT3& origin, const XMFLOAT3& dir, const std::function<float(uint32_t, float)>& exactHit,
+    uint32_t& object, float& tHit) const
+{
+    if (_nodes.empty())
+        return false;
+
+    XMFLOAT3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+    float closest = FLT_MAX;
+    bool hit = false;
+
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const Node& n = _nodes[stack[--top]];
+        float tBox;
+        if (!IntersectRayAabb(origin, invDir, Aabb{ n.min, n.max }, closest, tBox))
+            continue;
+
+        if (n.count > 0)
+        {
+            for (uint32_t i = n.leftOrFirst; i < n.leftOrFirst + n.count; i++)
+            {
+                float t = exactHit(_indices[i], closest);
+                if (t >= 0.0f && t < closest)
+                {
+                    closest = t;
+                    object = _indices[i];
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so the farther one is usually rejected by the closest hit
+        uint32_t a = n.leftOrFirst, b = n.leftOrFirst + 1;
+        float ta, tb;
+        bool hitA = IntersectRayAabb(origin, invDir, Aabb{ _nodes[a].min, _nodes[a].max }, closest, ta);
+        bool hitB = IntersectRayAabb(origin, invDir, Aabb{ _nodes[b].min, _nodes[b].max }, closest, tb);
+        if (hitA && hitB && tb < ta)
+        {
+            std::swap(a, b);
+            std::swap(hitA, hitB);
+        }
+        if (hitB)
+            stack[top++] = b;
+        if (hitA)
+            stack[top++] = a;
+    }
+
+    tHit = closest;
+    return hit;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "culling.h"
+#include <functional>
+
+struct Aabb
+{
+    XMFLOAT3 min;
+    XMFLOAT3 max;
+};
+
+Aabb TransformAabb(const Aabb& box, FXMMATRIX matrix);
+Aabb SphereAabb(const XMFLOAT3& center, float radius);
+
+bool IntersectRayAabb(const XMFLOAT3& origin, const XMFLOAT3& invDir, const Aabb& box, float tMax, float& tHit);
+bool IntersectRaySphere(const XMFLOAT3& origin, const XMFLOAT3& dir, const XMFLOAT3& center, float radius, float& tHit);
+bool IntersectRayTriangle(const XMFLOAT3& origin, const XMFLOAT3& dir, const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2, float& tHit);
+
+// Bounding volume hierarchy over per-object boxes. Moving objects are handled by
+// Update + Refit, which only walks up from the leaves that changed; the tree is
+// rebuilt once refitting has inflated it too much.
+class Bvh
+{
+public:
+    void Build(const std::vector<Aabb>& bounds);
+    void Update(uint32_t object, const Aabb& bounds);
+    void Refit();
+
+    size_t Size() const { return _bounds.size(); }
+    const Aabb& GetBounds(uint32_t object) const { return _bounds[object]; }
+
+    void Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+    // exactHit(object, tMax) returns the hit distance along the ray or a negative value on a miss
+    bool Raycast(const XMFLOAT3& origin, const XMFLOAT3& dir, const std::function<float(uint32_t, float)>& exactHit,
+        uint32_t& object, float& tHit) const;
+
+    static const uint32_t MaxLeafSize = 2;
+
+private:
+    struct Node
+    {
+        XMFLOAT3 min;
+        uint32_t leftOrFirst;   // first child for inner nodes, first index for leaves
+        XMFLOAT3 max;
+        uint32_t count;         // 0 for inner nodes
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _parents;
+    std::vector<uint32_t> _indices;
+    std::vector<uint32_t> _leafOf;
+    std::vector<Aabb> _bounds;
+    std::vector<uint32_t> _dirtyLeaves;
+    double _builtArea = 0.0;
+    double _area = 0.0;         // summed node surface area, kept up to date by Refit
+
+    void _buildNode(uint32_t node, uint32_t first, uint32_t count);
+    void _fitNode(uint32_t node);
+    void _collect(uint32_t node, std::vector<uint32_t>& visible) const;
+    double _totalArea() const;
+};
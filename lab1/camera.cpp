@@ -6,17 +6,6 @@ Camera::Camera()
     _r = 7.0f;
     _theta = XM_PIDIV4;
     _phi = -XM_PIDIV4;
-    _updateViewMatrix();
-}
-
-XMFLOAT3 Camera::GetPos() 
-{
-    XMFLOAT3 pos = XMFLOAT3(cosf(_theta) * cosf(_phi), sinf(_theta), cosf(_theta) * sinf(_phi));
-    pos.x = pos.x * _r + _center.x;
-    pos.y = pos.y * _r + _center.y;
-    pos.z = pos.z * _r + _center.z;
-
-    return pos;
 }
 
 void Camera::ChangePos(float dphi, float dtheta) 
@@ -24,18 +13,78 @@ void Camera::ChangePos(float dphi, float dtheta)
     _phi -= dphi;
     _theta += dtheta;
     _theta = min(max(_theta, -XM_PIDIV2), XM_PIDIV2);
-    _updateViewMatrix();
+    _viewDirty = true;
 }
 
-void Camera::_updateViewMatrix() 
+void Camera::SetOrbit(float phi, float theta, float r)
 {
-    XMFLOAT3 pos = GetPos();
-    float upTheta = _theta + XM_PIDIV2;
-    XMFLOAT3 up = XMFLOAT3(cosf(upTheta) * cosf(_phi), sinf(upTheta), cosf(upTheta) * sinf(_phi));
-
-    _viewMatrix = DirectX::XMMatrixLookAtLH(
-        DirectX::XMVectorSet(pos.x, pos.y, pos.z, 0.0f),
-        DirectX::XMVectorSet(_center.x, _center.y, _center.z, 0.0f),
-        DirectX::XMVectorSet(up.x, up.y, up.z, 0.0f)
-    );
+    _phi = phi;
+    _theta = theta;
+    _r = r;
+    _viewDirty = true;
+}
+
+void Camera::SetProjection(float fovY, float aspect, float nearZ, float farZ)
+{
+    _fovY = fovY;
+    _aspect = aspect;
+    _nearZ = nearZ;
+    _farZ = farZ;
+    _projectionDirty = true;
+}
+
+void Camera::SetAspect(float aspect)
+{
+    if (aspect == _aspect)
+        return;
+    _aspect = aspect;
+    _projectionDirty = true;
+}
+
+void Camera::_update() 
+{
+    if (!_viewDirty && !_projectionDirty)
+        return;
+
+    if (_viewDirty)
+    {
+        float sinTheta, cosTheta, sinPhi, cosPhi;
+        XMScalarSinCos(&sinTheta, &cosTheta, _theta);
+        XMScalarSinCos(&sinPhi, &cosPhi, _phi);
+        _pos = XMFLOAT3(cosTheta * cosPhi * _r + _center.x, sinTheta * _r + _center.y, cosTheta * sinPhi * _r + _center.z);
+
+        // Rotated a quarter turn further than the view direction: cos(theta + pi/2) = -sin(theta)
+        XMFLOAT3 up = XMFLOAT3(-sinTheta * cosPhi, cosTheta, -sinTheta * sinPhi);
+        _viewMatrix = XMMatrixLookAtLH(
+            XMVectorSet(_pos.x, _pos.y, _pos.z, 0.0f),
+            XMVectorSet(_center.x, _center.y, _center.z, 0.0f),
+            XMVectorSet(up.x, up.y, up.z, 0.0f)
+        );
+    }
+
+    if (_projectionDirty)
+    {
+        if (_farZ > 0.0f)
+        {
+            // Near and far swapped
+            _projectionMatrix = XMMatrixPerspectiveFovLH(_fovY, _aspect, _farZ, _nearZ);
+        }
+        else
+        {
+            // The far plane's limit: clip z is the constant nearZ and w the view depth,
+            // so depth is nearZ / z
+            float yScale = 1.0f / tanf(_fovY * 0.5f);
+            _projectionMatrix = XMMATRIX(
+                yScale / _aspect, 0.0f, 0.0f, 0.0f,
+                0.0f, yScale, 0.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 1.0f,
+                0.0f, 0.0f, _nearZ, 0.0f);
+        }
+    }
+
+    _viewProjectionMatrix = XMMatrixMultiply(_viewMatrix, _projectionMatrix);
+    _inverseViewProjectionMatrix = XMMatrixInverse(nullptr, _viewProjectionMatrix);
+    _frustum = ExtractFrustum(_viewProjectionMatrix);
+    _viewDirty = false;
+    _projectionDirty = false;
 }
\ No newline at end of file
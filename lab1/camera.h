@@ -1,21 +1,47 @@
 #pragma once
 #include <d3d11_1.h>
 #include <directxmath.h>
+#include "culling.h"
 
 using namespace DirectX;
 
+// Orbit camera. The matrices, the position and the frustum are cached and only rebuilt
+// when ChangePos or the projection parameters have made them stale.
 class Camera 
 {
 public:
     Camera();
     void ChangePos(float dphi, float dtheta);
-    XMFLOAT3 GetPos();
-    XMMATRIX& GetViewMatrix() { return _viewMatrix; };
+    // The orbit as is, for recording and replaying camera paths
+    void GetOrbit(float& phi, float& theta, float& r) const { phi = _phi; theta = _theta; r = _r; }
+    void SetOrbit(float phi, float theta, float r);
+    // Reverse-Z: depth 1 at nearZ. farZ <= 0 makes the projection infinite, depth then
+    // reaches 0 only at infinity
+    void SetProjection(float fovY, float aspect, float nearZ, float farZ);
+    void SetAspect(float aspect);
+
+    const XMFLOAT3& GetPos() { _update(); return _pos; }
+    const XMMATRIX& GetViewMatrix() { _update(); return _viewMatrix; }
+    const XMMATRIX& GetProjectionMatrix() { _update(); return _projectionMatrix; }
+    const XMMATRIX& GetViewProjectionMatrix() { _update(); return _viewProjectionMatrix; }
+    const XMMATRIX& GetInverseViewProjectionMatrix() { _update(); return _inverseViewProjectionMatrix; }
+    const Frustum& GetFrustum() { _update(); return _frustum; }
 private:
     XMMATRIX _viewMatrix;
+    XMMATRIX _projectionMatrix;
+    XMMATRIX _viewProjectionMatrix;
+    XMMATRIX _inverseViewProjectionMatrix;
+    Frustum _frustum;
+    XMFLOAT3 _pos;
     XMFLOAT3 _center;
     float _r;
     float _theta;
     float _phi;
-    void _updateViewMatrix();
+    float _fovY = XM_PIDIV2;
+    float _aspect = 1.0f;
+    float _nearZ = 0.01f;
+    float _farZ = 0.0f;
+    bool _viewDirty = true;
+    bool _projectionDirty = true;
+    void _update();
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "cameraPath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+void CameraPath::Add(const CameraPathKey& key)
+{
+    // A NaN or infinite time would leave Sample without a pair of keys around any time
+    if (std::isfinite(key.time) && (_keys.empty() || key.time > _keys.back().time))
+        _keys.push_back(key);
+}
+
+bool CameraPath::Save(const char* path) const
+{
+    CameraPathHeader header = {};
+    header.magic = CameraPathMagic;
+    header.version = CameraPathVersion;
+    header.numKeys = (uint32_t)_keys.size();
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (!pFile)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, pFile) == 1
+        && fwrite(_keys.data(), sizeof(CameraPathKey), _keys.size(), pFile) == _keys.size();
+    ok = fclose(pFile) == 0 && ok;
+    return ok;
+}
+
+bool CameraPath::Load(const char* path)
+{
+    _keys.clear();
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "rb");
+#else
+    pFile = fopen(path, "rb");
+#endif
+    if (!pFile)
+        return false;
+    CameraPathHeader header;
+    bool ok = fread(&header, sizeof(header), 1, pFile) == 1
+        && header.magic == CameraPathMagic && header.version == CameraPathVersion && header.numKeys > 0;
+    // The keys must fill the rest of the file exactly, before a damaged count allocates them
+    if (ok)
+    {
+        long keysStart = ftell(pFile);
+        ok = keysStart >= 0 && fseek(pFile, 0, SEEK_END) == 0;
+        long fileSize = ok ? ftell(pFile) : -1;
+        ok = ok && fileSize >= 0
+            && (uint64_t)fileSize == sizeof(header) + (uint64_t)header.numKeys * sizeof(CameraPathKey)
+            && fseek(pFile, keysStart, SEEK_SET) == 0;
+    }
+    if (ok)
+    {
+        std::vector<CameraPathKey> keys(header.numKeys);
+        ok = fread(keys.data(), sizeof(CameraPathKey), keys.size(), pFile) == keys.size();
+        // Add drops keys out of order, so a damaged file can't break Sample; times that
+        // aren't finite mean the file is damaged
+        for (size_t i = 0; ok && i < keys.size(); i++)
+        {
+            ok = std::isfinite(keys[i].time);
+            Add(keys[i]);
+        }
+    }
+    fclose(pFile);
+    if (!ok)
+        _keys.clear();
+    return ok;
+}
+
+CameraPathKey CameraPath::Sample(float time) const
+{
+    // Also takes a NaN time, which compares false against both ends
+    if (!(time > _keys.front().time))
+        return _keys.front();
+    if (time >= _keys.back().time)
+        return _keys.back();
+
+    auto next = std::upper_bound(_keys.begin(), _keys.end(), time,
+        [](float t, const CameraPathKey& key) { return t < key.time; });
+    const CameraPathKey& b = *next;
+    const CameraPathKey& a = *(next - 1);
+    float s = (time - a.time) / (b.time - a.time);
+    CameraPathKey key;
+    key.time = time;
+    key.phi = a.phi + (b.phi - a.phi) * s;
+    key.theta = a.theta + (b.theta - a.theta) * s;
+    key.r = a.r + (b.r - a.r) * s;
+    return key;
+}
+
+static double _percentile(const std::vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+    return sorted[(std::max)(rank, (size_t)1) - 1];
+}
+
+FrameTimingSummary SummarizeFrameTimes(const std::vector<double>& frameMs)
+{
+    FrameTimingSummary summary = {};
+    summary.frames = frameMs.size();
+    if (frameMs.empty())
+        return summary;
+
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (double ms : sorted)
+        total += ms;
+    summary.meanMs = total / sorted.size();
+    summary.p50Ms = _percentile(sorted, 50.0);
+    summary.p95Ms = _percentile(sorted, 95.0);
+    summary.p99Ms = _percentile(sorted, 99.0);
+    summary.maxMs = sorted.back();
+    return summary;
+}
+
+bool WriteFrameTimings(const char* path, const char* cameraPath, float timestep, const std::vector<double>& frameMs)
+{
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "w");
+#else
+    pFile = fopen(path, "w");
+#endif
+    if (!pFile)
+        return false;
+
+    // The path is written as is apart from the characters JSON must escape
+    std::string name;
+    for (const char* c = cameraPath; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            name += '\\';
+        name += *c;
+    }
+
+    FrameTimingSummary summary = SummarizeFrameTimes(frameMs);
+    fprintf(pFile, "{\n  \"path\": \"%s\",\n  \"timestep\": %.6f,\n  \"frames\": %zu,\n", name.c_str(), timestep, summary.frames);
+    fprintf(pFile, "  \"mean_ms\": %.4f,\n  \"p50_ms\": %.4f,\n  \"p95_ms\": %.4f,\n  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n",
+        summary.meanMs, summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs);
+    fprintf(pFile, "  \"frame_ms\": [");
+    for (size_t i = 0; i < frameMs.size(); i++)
+        fprintf(pFile, "%s%.4f", i % 16 ? ", " : (i ? ",\n    " : "\n    "), frameMs[i]);
+    fprintf(pFile, "\n  ]\n}\n");
+    return fclose(pFile) == 0;
+}
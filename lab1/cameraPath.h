@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Recorded camera motion for reproducible benchmarks. Recording keeps one key per frame:
+// the simulation time _updateScene animated the scene with and the orbit of the camera.
+// Replay doesn't repeat the recorded frames; it steps the simulation time by a fixed
+// amount and interpolates the path, so every run and every machine draws the same frames.
+// File: CameraPathHeader followed by the keys.
+static const uint32_t CameraPathMagic = 0x48544150; // "PATH"
+static const uint32_t CameraPathVersion = 1;
+
+struct CameraPathHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numKeys;
+    uint32_t reserved;
+};
+
+struct CameraPathKey
+{
+    float time;                 // seconds, increasing
+    float phi;
+    float theta;
+    float r;
+};
+
+class CameraPath
+{
+public:
+    void Clear() { _keys.clear(); }
+    // Keys not later than the last one or with a time that isn't finite are dropped
+    void Add(const CameraPathKey& key);
+
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+
+    size_t GetKeyCount() const { return _keys.size(); }
+    float GetStartTime() const { return _keys.empty() ? 0.0f : _keys.front().time; }
+    float GetEndTime() const { return _keys.empty() ? 0.0f : _keys.back().time; }
+    // Linear between the keys around time, clamped to the ends (a NaN time to the start);
+    // the path must not be empty
+    CameraPathKey Sample(float time) const;
+
+private:
+    std::vector<CameraPathKey> _keys;
+};
+
+struct FrameTimingSummary
+{
+    size_t frames;
+    double meanMs;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+// Nearest-rank percentiles of the frame times
+FrameTimingSummary SummarizeFrameTimes(const std::vector<double>& frameMs);
+
+// JSON report of a replay: the path file, the time step, the summary and every frame time
+bool WriteFrameTimings(const char* path, const char* cameraPath, float timestep, const std::vector<double>& frameMs);
@@ -0,0 +1,173 @@
+#include "constantRing.h"
+#include <cassert>
+#include <cstring>
+
+HRESULT ConstantRing::Init(ID3D11Device* pDevice, ID3D11DeviceContext1* pContext1, UINT size)
+{
+    _pd3dDevice = pDevice;
+    _pContext1 = pContext1;
+    _size = (size + Alignment - 1) / Alignment * Alignment;
+    _head = 0;
+    _frameEnd = 0;
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (_pContext1 && SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+    {
+        _offsetting = options.ConstantBufferOffsetting == TRUE;
+        _noOverwrite = options.MapNoOverwriteOnDynamicConstantBuffer == TRUE;
+    }
+
+    if (!_offsetting)
+    {
+        _shadow.resize(_size);
+        return S_OK;
+    }
+
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = _size;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+
+    return pDevice->CreateBuffer(&desc, nullptr, &_pBuffer);
+}
+
+void ConstantRing::Cleanup()
+{
+    if (_pBuffer) _pBuffer->Release();
+    _pBuffer = nullptr;
+    for (UINT i = 0; i < MaxSlots; i++)
+    {
+        if (_pScratchVS[i]) _pScratchVS[i]->Release();
+        if (_pScratchPS[i]) _pScratchPS[i]->Release();
+        _pScratchVS[i] = nullptr;
+        _pScratchPS[i] = nullptr;
+    }
+    _shadow.clear();
+    _pContext1 = nullptr;
+    _pd3dDevice = nullptr;
+}
+
+bool ConstantRing::Begin(ID3D11DeviceContext* pContext, UINT reserve)
+{
+    assert(!_mapped);
+    reserve = (reserve + Alignment - 1) / Alignment * Alignment;
+    if (reserve > _size)
+        return false;
+
+    if (!_offsetting)
+    {
+        _head = 0;
+        _frameEnd = reserve;
+        _pData = _shadow.data();
+        _mapped = true;
+        return true;
+    }
+
+    // Without NO_OVERWRITE support every frame starts a fresh buffer instance
+    D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (!_noOverwrite || _head + reserve > _size)
+    {
+        mapType = D3D11_MAP_WRITE_DISCARD;
+        _head = 0;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    HRESULT hr = pContext->Map(_pBuffer, 0, mapType, 0, &subresource);
+    if (FAILED(hr))
+        return false;
+
+    _pData = reinterpret_cast<BYTE*>(subresource.pData);
+    _frameEnd = _head + reserve;
+    _mapped = true;
+    return true;
+}
+
+void ConstantRing::End(ID3D11DeviceContext* pContext)
+{
+    if (!_mapped)
+        return;
+    if (_offsetting)
+        pContext->Unmap(_pBuffer, 0);
+    _pData = nullptr;
+    _mapped = false;
+}
+
+ConstantSlice ConstantRing::Push(const void* pData, UINT size)
+{
+    ConstantSlice slice;
+    UINT alignedSize = (size + Alignment - 1) / Alignment * Alignment;
+    assert(_mapped && _head + alignedSize <= _frameEnd);
+    if (!_mapped || _head + alignedSize > _frameEnd)
+        return slice;
+
+    memcpy(_pData + _head, pData, size);
+    slice.firstConstant = _head / 16;
+    slice.numConstants = alignedSize / 16;
+    _head += alignedSize;
+    return slice;
+}
+
+void ConstantRing::BindVS(ID3D11DeviceContext* pContext, UINT slot, const ConstantSlice& slice)
+{
+    if (_offsetting)
+    {
+        _pContext1->VSSetConstantBuffers1(slot, 1, &_pBuffer, &slice.firstConstant, &slice.numConstants);
+        return;
+    }
+
+    ID3D11Buffer* pScratch = _getScratch(_pScratchVS, slot);
+    if (_copyToScratch(pContext, pScratch, slice))
+        pContext->VSSetConstantBuffers(slot, 1, &pScratch);
+}
+
+void ConstantRing::BindPS(ID3D11DeviceContext* pContext, UINT slot, const ConstantSlice& slice)
+{
+    if (_offsetting)
+    {
+        _pContext1->PSSetConstantBuffers1(slot, 1, &_pBuffer, &slice.firstConstant, &slice.numConstants);
+        return;
+    }
+
+    ID3D11Buffer* pScratch = _getScratch(_pScratchPS, slot);
+    if (_copyToScratch(pContext, pScratch, slice))
+        pContext->PSSetConstantBuffers(slot, 1, &pScratch);
+}
+
+ID3D11Buffer* ConstantRing::_getScratch(ID3D11Buffer** ppScratch, UINT slot)
+{
+    assert(slot < MaxSlots);
+    if (slot >= MaxSlots)
+        return nullptr;
+
+    if (!ppScratch[slot])
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = Alignment;
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+
+        _pd3dDevice->CreateBuffer(&desc, nullptr, &ppScratch[slot]);
+    }
+    return ppScratch[slot];
+}
+
+bool ConstantRing::_copyToScratch(ID3D11DeviceContext* pContext, ID3D11Buffer* pScratch, const ConstantSlice& slice)
+{
+    assert(slice.numConstants * 16 <= Alignment);
+    if (!pScratch || slice.numConstants == 0)
+        return false;
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    if (FAILED(pContext->Map(pScratch, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource)))
+        return false;
+
+    memcpy(subresource.pData, _shadow.data() + slice.firstConstant * 16, Alignment);
+    pContext->Unmap(pScratch, 0);
+    return true;
+}
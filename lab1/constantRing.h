@@ -0,0 +1,56 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+
+// Range of a ConstantRing, in 16-byte shader constants as VSSetConstantBuffers1 expects them
+struct ConstantSlice
+{
+    UINT firstConstant = 0;
+    UINT numConstants = 0;
+};
+
+// One large dynamic constant buffer shared by all per-draw data of a frame.
+// The whole frame is written through a single Map (NO_OVERWRITE, or DISCARD on wrap),
+// every draw then binds its 256-byte aligned slice by offset.
+class ConstantRing
+{
+public:
+    HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext1* pContext1, UINT size);
+    void Cleanup();
+
+    bool Begin(ID3D11DeviceContext* pContext, UINT reserve);
+    void End(ID3D11DeviceContext* pContext);
+
+    ConstantSlice Push(const void* pData, UINT size);
+    template <typename T>
+    ConstantSlice Push(const T& data) { return Push(&data, sizeof(T)); }
+
+    void BindVS(ID3D11DeviceContext* pContext, UINT slot, const ConstantSlice& slice);
+    void BindPS(ID3D11DeviceContext* pContext, UINT slot, const ConstantSlice& slice);
+
+    static const UINT Alignment = 256;
+    static const UINT MaxSlots = 4;
+
+private:
+    ID3D11Device* _pd3dDevice = nullptr;
+    ID3D11DeviceContext1* _pContext1 = nullptr;
+    ID3D11Buffer* _pBuffer = nullptr;
+
+    bool _offsetting = false;
+    bool _noOverwrite = false;
+    bool _mapped = false;
+
+    UINT _size = 0;
+    UINT _head = 0;
+    UINT _frameEnd = 0;
+    BYTE* _pData = nullptr;
+
+    // D3D11.0 runtimes can't bind by offset: the frame is kept on the CPU and
+    // each bind is copied into a small per-slot buffer instead
+    std::vector<BYTE> _shadow;
+    ID3D11Buffer* _pScratchVS[MaxSlots] = { nullptr, nullptr, nullptr, nullptr };
+    ID3D11Buffer* _pScratchPS[MaxSlots] = { nullptr, nullptr, nullptr, nullptr };
+
+    ID3D11Buffer* _getScratch(ID3D11Buffer** ppScratch, UINT slot);
+    bool _copyToScratch(ID3D11DeviceContext* pContext, ID3D11Buffer* pScratch, const ConstantSlice& slice);
+};
@@ -0,0 +1,147 @@
+#include "culling.h"
+#include <cfloat>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+Frustum ExtractFrustum(FXMMATRIX viewProjection)
+{
+    // Row-vector convention: clip = v * M, so the planes come from the columns of M
+    XMMATRIX m = XMMatrixTranspose(viewProjection);
+
+    XMVECTOR planes[6] = {
+        XMVectorAdd(m.r[3], m.r[0]),      // left
+        XMVectorSubtract(m.r[3], m.r[0]), // right
+        XMVectorAdd(m.r[3], m.r[1]),      // bottom
+        XMVectorSubtract(m.r[3], m.r[1]), // top
+        m.r[2],                           // z >= 0
+        XMVectorSubtract(m.r[3], m.r[2])  // z <= w
+    };
+
+    Frustum frustum;
+    for (int i = 0; i < 6; i++)
+    {
+        // An infinite projection leaves one depth plane without a normal; it can't reject anything
+        float length = XMVectorGetX(XMVector3Length(planes[i]));
+        if (length < 1e-6f)
+            frustum.planes[i] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+        else
+            XMStoreFloat4(&frustum.planes[i], XMVectorScale(planes[i], 1.0f / length));
+    }
+    return frustum;
+}
+
+bool IsSphereVisible(const Frustum& frustum, const XMFLOAT3& center, float radius)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        const XMFLOAT4& p = frustum.planes[i];
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+void SphereBounds::Resize(size_t count)
+{
+    _count = count;
+    size_t padded = (count + Lanes - 1) / Lanes * Lanes;
+
+    // Padding lanes get a negative radius so they never pass the plane test
+    _x.assign(padded, 0.0f);
+    _y.assign(padded, 0.0f);
+    _z.assign(padded, 0.0f);
+    _r.assign(padded, -FLT_MAX);
+}
+
+void SphereBounds::Set(size_t i, const XMFLOAT3& center, float radius)
+{
+    _x[i] = center.x;
+    _y[i] = center.y;
+    _z[i] = center.z;
+    _r[i] = radius;
+}
+
+static inline void _appendMask(unsigned mask, size_t base, size_t count, std::vector<uint32_t>& visible)
+{
+    while (mask)
+    {
+        unsigned long bit = 0;
+#ifdef _MSC_VER
+        _BitScanForward(&bit, mask);
+#else
+        bit = __builtin_ctz(mask);
+#endif
+        mask &= mask - 1;
+        if (base + bit < count)
+            visible.push_back((uint32_t)(base + bit));
+    }
+}
+
+size_t CullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible)
+{
+    size_t count = bounds.Size();
+    size_t before = visible.size();
+
+    const float* xs = bounds.X();
+    const float* ys = bounds.Y();
+    const float* zs = bounds.Z();
+    const float* rs = bounds.R();
+
+#if defined(__AVX__)
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++)
+    {
+        px[p] = _mm256_set1_ps(frustum.planes[p].x);
+        py[p] = _mm256_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    for (size_t i = 0; i < count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 y = _mm256_loadu_ps(ys + i);
+        __m256 z = _mm256_loadu_ps(zs + i);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(rs + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                _mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+        }
+        _appendMask((unsigned)_mm256_movemask_ps(inside), i, count, visible);
+    }
+#else
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int p = 0; p < 6; p++)
+    {
+        px[p] = _mm_set1_ps(frustum.planes[p].x);
+        py[p] = _mm_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    for (size_t i = 0; i < count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(rs + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                _mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+        }
+        _appendMask((unsigned)_mm_movemask_ps(inside), i, count, visible);
+    }
+#endif
+
+    return visible.size() - before;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Six inward-facing planes (ax + by + cz + d >= 0 inside), normalized
+struct Frustum
+{
+    XMFLOAT4 planes[6];
+};
+
+Frustum ExtractFrustum(FXMMATRIX viewProjection);
+
+// Bounding spheres stored as separate x/y/z/r arrays so that several of them
+// are tested against a plane with a single SIMD instruction
+class SphereBounds
+{
+public:
+    void Resize(size_t count);
+    size_t Size() const { return _count; }
+
+    void Set(size_t i, const XMFLOAT3& center, float radius);
+    XMFLOAT3 GetCenter(size_t i) const { return XMFLOAT3(_x[i], _y[i], _z[i]); }
+    float GetRadius(size_t i) const { return _r[i]; }
+
+    const float* X() const { return _x.data(); }
+    const float* Y() const { return _y.data(); }
+    const float* Z() const { return _z.data(); }
+    const float* R() const { return _r.data(); }
+
+    static const size_t Lanes = 8;
+
+private:
+    size_t _count = 0;
+    std::vector<float> _x;
+    std::vector<float> _y;
+    std::vector<float> _z;
+    std::vector<float> _r;
+};
+
+// Appends the indices of spheres that intersect the frustum, returns how many were visible
+size_t CullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible);
+bool IsSphereVisible(const Frustum& frustum, const XMFLOAT3& center, float radius);
@@ -0,0 +1,144 @@
+#include "framePacer.h"
+#include <algorithm>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+LONGLONG FramePacer::_now()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+void FramePacer::Configure(UINT maxFramesInFlight, bool vsync, float fpsCap)
+{
+    _maxFramesInFlight = (std::max)(maxFramesInFlight, 1u);
+    _vsync = vsync;
+    _fpsCap = (std::max)(fpsCap, 0.0f);
+}
+
+HRESULT FramePacer::Init(ID3D11Device* pDevice, IDXGISwapChain* pSwapChain, bool waitable)
+{
+    HRESULT hr = S_OK;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    _frequency = frequency.QuadPart;
+    _lastPresent = _now();
+
+    _waitable = waitable;
+    if (_waitable)
+    {
+        hr = pSwapChain->QueryInterface(__uuidof(IDXGISwapChain2), reinterpret_cast<void**>(&_pSwapChain2));
+        if (SUCCEEDED(hr))
+        {
+            _hFrameLatency = _pSwapChain2->GetFrameLatencyWaitableObject();
+            hr = _pSwapChain2->SetMaximumFrameLatency(_maxFramesInFlight);
+        }
+        else
+        {
+            _waitable = false;
+        }
+    }
+    if (!_waitable)
+    {
+        // Blt-model or pre-8.1 swap chains: the queue can only be bounded on the device
+        hr = pDevice->QueryInterface(__uuidof(IDXGIDevice1), reinterpret_cast<void**>(&_pDxgiDevice));
+        if (SUCCEEDED(hr))
+            hr = _pDxgiDevice->SetMaximumFrameLatency(_maxFramesInFlight);
+    }
+
+    _hTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!_hTimer)
+        _hTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+
+    return hr;
+}
+
+void FramePacer::Cleanup()
+{
+    if (_hFrameLatency) CloseHandle(_hFrameLatency);
+    if (_hTimer) CloseHandle(_hTimer);
+    if (_pSwapChain2) _pSwapChain2->Release();
+    if (_pDxgiDevice) _pDxgiDevice->Release();
+
+    _hFrameLatency = nullptr;
+    _hTimer = nullptr;
+    _pSwapChain2 = nullptr;
+    _pDxgiDevice = nullptr;
+}
+
+void FramePacer::SetMaxFramesInFlight(UINT maxFramesInFlight)
+{
+    _maxFramesInFlight = (std::max)(maxFramesInFlight, 1u);
+    if (_pSwapChain2)
+        _pSwapChain2->SetMaximumFrameLatency(_maxFramesInFlight);
+    else if (_pDxgiDevice)
+        _pDxgiDevice->SetMaximumFrameLatency(_maxFramesInFlight);
+}
+
+void FramePacer::SetFrameCap(float fpsCap)
+{
+    _fpsCap = (std::max)(fpsCap, 0.0f);
+    _nextFrameStart = 0;
+}
+
+void FramePacer::OnInput()
+{
+    // Only the oldest input not yet picked up by a frame matters for latency
+    if (_pendingInput == 0)
+        _pendingInput = _now();
+}
+
+void FramePacer::BeginFrame()
+{
+    if (_fpsCap > 0.0f)
+    {
+        LONGLONG period = (LONGLONG)(_frequency / _fpsCap);
+        LONGLONG now = _now();
+        if (_nextFrameStart != 0 && now < _nextFrameStart)
+            _waitUntil(_nextFrameStart);
+
+        // Don't try to catch up on frames that were already missed
+        _nextFrameStart = (std::max)(_nextFrameStart + period, _now());
+    }
+
+    _frameInput = _pendingInput;
+    _pendingInput = 0;
+}
+
+HRESULT FramePacer::Present(IDXGISwapChain* pSwapChain)
+{
+    HRESULT hr = pSwapChain->Present(_vsync ? 1 : 0, 0);
+
+    LONGLONG now = _now();
+    _frameTimeMs = (now - _lastPresent) * 1000.0 / _frequency;
+    _lastPresent = now;
+
+    if (_frameInput != 0)
+    {
+        double latency = (now - _frameInput) * 1000.0 / _frequency;
+        _inputLatencyMs = _inputLatencyMs == 0.0 ? latency : _inputLatencyMs * 0.9 + latency * 0.1;
+        _frameInput = 0;
+    }
+
+    return hr;
+}
+
+void FramePacer::_waitUntil(LONGLONG target)
+{
+    // Sleep on the timer for the bulk of the interval and spin only the last half millisecond
+    const LONGLONG spin = _frequency / 2000;
+    LONGLONG now = _now();
+    if (_hTimer && target - now > spin)
+    {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)((target - now - spin) * 10000000.0 / _frequency);
+        if (SetWaitableTimer(_hTimer, &due, 0, nullptr, nullptr, FALSE))
+            WaitForSingleObject(_hTimer, INFINITE);
+    }
+    while (_now() < target)
+        YieldProcessor();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <d3d11_1.h>
+#include <dxgi1_3.h>
+
+// Paces frames against a flip-model swap chain: the main loop sleeps on the frame-latency
+// waitable object instead of spinning, the queue depth is bounded by the max frames in flight
+// and an optional CPU cap delays the start of a frame (not its present) to keep latency low.
+class FramePacer
+{
+public:
+    void Configure(UINT maxFramesInFlight, bool vsync, float fpsCap);
+    HRESULT Init(ID3D11Device* pDevice, IDXGISwapChain* pSwapChain, bool waitable);
+    void Cleanup();
+
+    UINT GetSwapChainFlags() const { return _waitable ? DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT : 0; }
+    HANDLE GetFrameWaitHandle() const { return _hFrameLatency; }
+
+    void SetMaxFramesInFlight(UINT maxFramesInFlight);
+    void SetFrameCap(float fpsCap);
+
+    void OnInput();
+    void BeginFrame();
+    HRESULT Present(IDXGISwapChain* pSwapChain);
+
+    double GetInputLatencyMs() const { return _inputLatencyMs; }
+    double GetFrameTimeMs() const { return _frameTimeMs; }
+
+private:
+    IDXGISwapChain2* _pSwapChain2 = nullptr;
+    IDXGIDevice1* _pDxgiDevice = nullptr;
+    HANDLE _hFrameLatency = nullptr;
+    HANDLE _hTimer = nullptr;
+
+    bool _waitable = false;
+    bool _vsync = true;
+    UINT _maxFramesInFlight = 1;
+    float _fpsCap = 0.0f;
+
+    LONGLONG _frequency = 0;
+    LONGLONG _nextFrameStart = 0;
+    LONGLONG _lastPresent = 0;
+    LONGLONG _pendingInput = 0;
+    LONGLONG _frameInput = 0;
+
+    double _inputLatencyMs = 0.0;
+    double _frameTimeMs = 0.0;
+
+    static LONGLONG _now();
+    void _waitUntil(LONGLONG target);
+};
@@ -0,0 +1,158 @@
+#include "gpuProfiler.h"
+#include "hiResClock.h"
+
+HRESULT GpuProfiler::Init(ID3D11Device* pDevice)
+{
+    HRESULT hr = S_OK;
+    D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+    D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+    for (Frame& frame : _frames)
+    {
+        if (SUCCEEDED(hr))
+            hr = pDevice->CreateQuery(&disjointDesc, &frame.pDisjoint);
+        if (SUCCEEDED(hr))
+            hr = pDevice->CreateQuery(&timestampDesc, &frame.pFrameStart);
+        for (UINT i = 0; i < GpuProfilerMaxRanges && SUCCEEDED(hr); i++)
+        {
+            hr = pDevice->CreateQuery(&timestampDesc, &frame.pStarts[i]);
+            if (SUCCEEDED(hr))
+                hr = pDevice->CreateQuery(&timestampDesc, &frame.pEnds[i]);
+        }
+    }
+
+    if (FAILED(hr))
+        Cleanup();
+    _initialized = SUCCEEDED(hr);
+    return hr;
+}
+
+void GpuProfiler::Cleanup()
+{
+    for (Frame& frame : _frames)
+    {
+        if (frame.pDisjoint) frame.pDisjoint->Release();
+        if (frame.pFrameStart) frame.pFrameStart->Release();
+        for (UINT i = 0; i < GpuProfilerMaxRanges; i++)
+        {
+            if (frame.pStarts[i]) frame.pStarts[i]->Release();
+            if (frame.pEnds[i]) frame.pEnds[i]->Release();
+        }
+        frame = Frame();
+    }
+    _write = _read = 0;
+    _active = false;
+    _initialized = false;
+}
+
+void GpuProfiler::BeginFrame(ID3D11DeviceContext* pContext, int64_t cpuStart)
+{
+    Frame& frame = _frames[_write];
+    // All slots are waiting on the GPU: this frame goes unmeasured
+    if (!_initialized || frame.pending)
+        return;
+
+    int64_t start = ClockNow();
+    frame.numRanges = 0;
+    frame.cpuStart = cpuStart;
+    pContext->Begin(frame.pDisjoint);
+    pContext->End(frame.pFrameStart);
+    _queryTicks += ClockNow() - start;
+    _depth = 0;
+    _active = true;
+}
+
+void GpuProfiler::EndFrame(ID3D11DeviceContext* pContext)
+{
+    if (!_active)
+        return;
+    // Ranges left open end with the frame
+    while (_depth > 0)
+        End(pContext);
+
+    Frame& frame = _frames[_write];
+    int64_t start = ClockNow();
+    pContext->End(frame.pDisjoint);
+    _queryTicks += ClockNow() - start;
+    frame.pending = true;
+    _write = (_write + 1) % GpuProfilerFrames;
+    _active = false;
+}
+
+void GpuProfiler::Begin(ID3D11DeviceContext* pContext, const char* name)
+{
+    // Ranges past the limit aren't measured but still nest, so End pairs up
+    Frame& frame = _frames[_write];
+    UINT range = GpuProfilerMaxRanges;
+    if (_active && frame.numRanges < GpuProfilerMaxRanges && _depth < GpuProfilerMaxRanges)
+    {
+        range = frame.numRanges++;
+        frame.names[range] = name;
+        frame.depths[range] = _depth;
+        int64_t start = ClockNow();
+        pContext->End(frame.pStarts[range]);
+        _queryTicks += ClockNow() - start;
+    }
+    if (_depth < GpuProfilerMaxRanges)
+        _open[_depth] = range;
+    _depth++;
+}
+
+void GpuProfiler::End(ID3D11DeviceContext* pContext)
+{
+    if (_depth == 0)
+        return;
+    _depth--;
+    if (_active && _depth < GpuProfilerMaxRanges && _open[_depth] < GpuProfilerMaxRanges)
+    {
+        int64_t start = ClockNow();
+        pContext->End(_frames[_write].pEnds[_open[_depth]]);
+        _queryTicks += ClockNow() - start;
+    }
+}
+
+bool GpuProfiler::Collect(ID3D11DeviceContext* pContext, int64_t& cpuStart, std::vector<GpuRange>& ranges)
+{
+    Frame& frame = _frames[_read];
+    if (!frame.pending)
+        return false;
+
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    if (pContext->GetData(frame.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        return false;
+
+    // The disjoint query ends after every timestamp of the frame, so they are all ready
+    UINT64 frameStart = 0;
+    bool valid = !disjoint.Disjoint && disjoint.Frequency != 0
+        && pContext->GetData(frame.pFrameStart, &frameStart, sizeof(frameStart), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+    ranges.clear();
+    for (UINT i = 0; valid && i < frame.numRanges; i++)
+    {
+        UINT64 start = 0, end = 0;
+        if (pContext->GetData(frame.pStarts[i], &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK
+            || pContext->GetData(frame.pEnds[i], &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        {
+            valid = false;
+            break;
+        }
+        GpuRange range;
+        range.name = frame.names[i];
+        range.depth = frame.depths[i];
+        range.startMs = (double)(INT64)(start - frameStart) * 1000.0 / disjoint.Frequency;
+        range.endMs = (double)(INT64)(end - frameStart) * 1000.0 / disjoint.Frequency;
+        ranges.push_back(range);
+    }
+
+    cpuStart = frame.cpuStart;
+    frame.pending = false;
+    _read = (_read + 1) % GpuProfilerFrames;
+    if (!valid)
+        ranges.clear();
+    return true;
+}
+
+int64_t GpuProfiler::TakeQueryTicks()
+{
+    int64_t ticks = _queryTicks;
+    _queryTicks = 0;
+    return ticks;
+}
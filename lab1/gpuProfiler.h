@@ -0,0 +1,95 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include <cstdint>
+#include "profiler.h"
+
+// GPU time of render passes from D3D11 timestamp queries. A frame's queries are read back
+// GpuProfilerFrames frames later without stalling; a frame whose slot is still waiting on
+// the GPU, or that the driver reports as disjoint, is skipped.
+static const UINT GpuProfilerFrames = 4;
+static const UINT GpuProfilerMaxRanges = 32;
+
+struct GpuRange
+{
+    const char* name;
+    uint32_t depth;
+    double startMs;             // from the first command of the frame
+    double endMs;
+};
+
+class GpuProfiler
+{
+public:
+    HRESULT Init(ID3D11Device* pDevice);
+    void Cleanup();
+
+    // Nothing is measured outside BeginFrame / EndFrame. cpuStart is the ClockNow time the
+    // frame was submitted, handed back by Collect to place the ranges on the CPU timeline.
+    void BeginFrame(ID3D11DeviceContext* pContext, int64_t cpuStart);
+    void EndFrame(ID3D11DeviceContext* pContext);
+    bool IsFrameActive() const { return _active; }
+
+    void Begin(ID3D11DeviceContext* pContext, const char* name);
+    void End(ID3D11DeviceContext* pContext);
+
+    // Reads back the oldest finished frame; false when none is ready yet. ranges comes back
+    // empty for a frame whose timestamps can't be trusted.
+    bool Collect(ID3D11DeviceContext* pContext, int64_t& cpuStart, std::vector<GpuRange>& ranges);
+
+    // CPU time spent issuing queries since the last call, in ClockNow ticks
+    int64_t TakeQueryTicks();
+
+private:
+    struct Frame
+    {
+        ID3D11Query* pDisjoint = nullptr;
+        ID3D11Query* pFrameStart = nullptr;
+        ID3D11Query* pStarts[GpuProfilerMaxRanges] = {};
+        ID3D11Query* pEnds[GpuProfilerMaxRanges] = {};
+        const char* names[GpuProfilerMaxRanges] = {};
+        uint32_t depths[GpuProfilerMaxRanges] = {};
+        UINT numRanges = 0;
+        int64_t cpuStart = 0;
+        bool pending = false;
+    };
+
+    Frame _frames[GpuProfilerFrames];
+    UINT _write = 0;            // frame being recorded
+    UINT _read = 0;             // oldest frame not collected
+    bool _active = false;
+    bool _initialized = false;
+    int64_t _queryTicks = 0;
+
+    // Ranges still open, innermost last
+    UINT _open[GpuProfilerMaxRanges] = {};
+    UINT _depth = 0;
+};
+
+class GpuScope
+{
+public:
+    GpuScope(GpuProfiler& profiler, ID3D11DeviceContext* pContext, const char* name)
+        : _profiler(profiler), _pContext(pContext), _active(profiler.IsFrameActive())
+    {
+        if (_active)
+            _profiler.Begin(_pContext, name);
+    }
+    ~GpuScope()
+    {
+        if (_active)
+            _profiler.End(_pContext);
+    }
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+
+private:
+    GpuProfiler& _profiler;
+    ID3D11DeviceContext* _pContext;
+    bool _active;
+};
+
+// A CPU zone and the GPU range of the commands issued in it
+#define PROFILE_GPU_ZONE(profiler, context, name) \
+    PROFILE_ZONE(name); \
+    GpuScope PROFILE_CONCAT(_gpuZone, __LINE__)(profiler, context, name)
@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------
+// Entry point of the headless build (CMakeLists.txt): the command line modes of lab1.cpp
+// that don't open a window, for machines without Direct3D.
+//--------------------------------------------------------------------------------------
+
+#include "benchmark.h"
+#include "meshConverter.h"
+#include "lightBaker.h"
+#include "softRenderer.h"
+#include "profiler.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+
+std::string BenchmarkName;
+std::string MeshConvertInput;
+std::string MeshConvertOutput;
+bool MeshConvertPacked = true;
+std::string ModelPath;
+std::string BakeOutput;
+std::string SoftRenderOutput;
+uint32_t SoftRenderWidth = 1280;
+uint32_t SoftRenderHeight = 720;
+
+
+//--------------------------------------------------------------------------------------
+// Command line: -bench <name|all> -meshconv <input> <output> [-float]
+// -bake <output.dds> [-mesh <file>] -softrender <output.ppm> [-softsize <width> <height>]
+//--------------------------------------------------------------------------------------
+static bool _parseCommandLine(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc)
+            BenchmarkName = argv[++i];
+        else if (strcmp(argv[i], "-meshconv") == 0 && i + 2 < argc)
+        {
+            MeshConvertInput = argv[++i];
+            MeshConvertOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "-float") == 0)
+            MeshConvertPacked = false;
+        else if (strcmp(argv[i], "-mesh") == 0 && i + 1 < argc)
+            ModelPath = argv[++i];
+        else if (strcmp(argv[i], "-bake") == 0 && i + 1 < argc)
+            BakeOutput = argv[++i];
+        else if (strcmp(argv[i], "-softrender") == 0 && i + 1 < argc)
+            SoftRenderOutput = argv[++i];
+        else if (strcmp(argv[i], "-softsize") == 0 && i + 2 < argc)
+        {
+            SoftRenderWidth = (uint32_t)atoi(argv[++i]);
+            SoftRenderHeight = (uint32_t)atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "unknown or incomplete option '%s'\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    ProfilerSetThreadName("main");
+    if (!_parseCommandLine(argc, argv))
+        return 2;
+
+    if (!BenchmarkName.empty())
+        return RunBenchmark(BenchmarkName.c_str()) ? 0 : 1;
+    if (!MeshConvertInput.empty())
+        return ConvertMesh(MeshConvertInput.c_str(), MeshConvertOutput.c_str(), MeshConvertPacked) ? 0 : 1;
+    if (!BakeOutput.empty())
+        return BakeStaticScene(BakeOutput.c_str(), ModelPath.c_str()) ? 0 : 1;
+    if (!SoftRenderOutput.empty())
+        return SoftRenderScene(SoftRenderOutput.c_str(), SoftRenderWidth, SoftRenderHeight, SoftRenderFrames) ? 0 : 1;
+
+    fprintf(stderr, "usage: %s -bench <name|all> | -meshconv <input> <output> [-float] | "
+        "-bake <output.dds> [-mesh <file>] | -softrender <output.ppm> [-softsize <width> <height>]\n", argv[0]);
+    return 2;
+}
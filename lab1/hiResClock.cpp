@@ -0,0 +1,41 @@
+#include "hiResClock.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+static int64_t _queryFrequency()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+}
+
+int64_t ClockNow()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+int64_t ClockFrequency()
+{
+    // Fixed at boot, so it is asked once
+    static const int64_t frequency = _queryFrequency();
+    return frequency;
+}
+#else
+int64_t ClockNow()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int64_t ClockFrequency()
+{
+    return 1000000000;
+}
+#endif
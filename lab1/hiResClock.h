@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// Monotonic high-resolution clock: QueryPerformanceCounter on Windows, clock_gettime with
+// CLOCK_MONOTONIC elsewhere. Ticks only mean something relative to each other.
+int64_t ClockNow();
+int64_t ClockFrequency();
+
+inline double ClockSeconds(int64_t ticks) { return (double)ticks / ClockFrequency(); }
+inline double ClockMilliseconds(int64_t ticks) { return ticks * 1000.0 / ClockFrequency(); }
@@ -0,0 +1,213 @@
+#include "irradianceProbes.h"
+#include "lightBaker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+// A probe is taken for inside geometry when more of its rays than this hit back faces
+static const float ProbeMaxBackfaces = 0.1f;
+
+// Real SH basis up to order 2 (Sloan, "Stupid Spherical Harmonics Tricks"), in the order
+// 00, 1-1, 10, 11, 2-2, 2-1, 20, 21, 22
+static void _basis(const XMFLOAT3& d, float y[ProbeCoefficients])
+{
+    y[0] = 0.282095f;
+    y[1] = 0.488603f * d.y;
+    y[2] = 0.488603f * d.z;
+    y[3] = 0.488603f * d.x;
+    y[4] = 1.092548f * d.x * d.y;
+    y[5] = 1.092548f * d.y * d.z;
+    y[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    y[7] = 1.092548f * d.x * d.z;
+    y[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+// Convolution with the clamped cosine (Ramamoorthi and Hanrahan 2001), divided by pi
+static const float BandScale[ProbeCoefficients] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+// Spherical Fibonacci set: even coverage without randomness, so neighbouring probes agree
+static void _directions(uint32_t count, std::vector<XMFLOAT3>& directions)
+{
+    directions.resize(count);
+    const float goldenAngle = XM_PI * (3.0f - sqrtf(5.0f));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float z = 1.0f - (2.0f * i + 1.0f) / count;
+        float r = sqrtf((std::max)(0.0f, 1.0f - z * z));
+        float phi = goldenAngle * i;
+        directions[i] = XMFLOAT3(r * cosf(phi), r * sinf(phi), z);
+    }
+}
+
+static XMFLOAT3 _probePosition(const ProbeBakeDesc& desc, uint32_t x, uint32_t y, uint32_t z)
+{
+    XMUINT3 last(desc.counts.x - 1, desc.counts.y - 1, desc.counts.z - 1);
+    return XMFLOAT3(
+        desc.gridMin.x + (last.x ? (desc.gridMax.x - desc.gridMin.x) * x / last.x : 0.0f),
+        desc.gridMin.y + (last.y ? (desc.gridMax.y - desc.gridMin.y) * y / last.y : 0.0f),
+        desc.gridMin.z + (last.z ? (desc.gridMax.z - desc.gridMin.z) * z / last.z : 0.0f));
+}
+
+// Radiance projected onto the basis; false when the probe sits inside geometry
+static bool _bakeProbe(const ProbeBakeDesc& desc, const XMFLOAT3& pos, const std::vector<XMFLOAT3>& directions,
+    const std::vector<float>& basis, ProbeSH& probe, uint64_t& rays)
+{
+    float sh[ProbeCoefficients * 3] = {};
+    uint32_t backfaces = 0;
+    for (size_t i = 0; i < directions.size(); i++)
+    {
+        const XMFLOAT3& dir = directions[i];
+        XMFLOAT3 radiance;
+        RayHit hit;
+        rays++;
+        if (desc.pScene && desc.pScene->Intersect(pos, dir, FLT_MAX, hit))
+        {
+            XMFLOAT3 n = desc.pScene->GetFaceNormal(hit.triangle);
+            if (n.x * dir.x + n.y * dir.y + n.z * dir.z > 0.0f)
+            {
+                backfaces++;
+                continue;
+            }
+            XMFLOAT3 hitPos(pos.x + dir.x * hit.t, pos.y + dir.y * hit.t, pos.z + dir.z * hit.t);
+            XMFLOAT3 origin(hitPos.x + n.x * BakeRayOffset, hitPos.y + n.y * BakeRayOffset, hitPos.z + n.z * BakeRayOffset);
+            XMFLOAT3 irradiance = ComputeDirectIrradiance(*desc.pScene, desc.lights, desc.sunDirection, desc.sunColor, hitPos, n, origin, rays);
+            float reflectance = desc.albedo / XM_PI;
+            radiance = XMFLOAT3(irradiance.x * reflectance, irradiance.y * reflectance, irradiance.z * reflectance);
+        }
+        else
+        {
+            XMFLOAT3 sky = desc.pSky ? desc.pSky->Sample(dir) : XMFLOAT3(1.0f, 1.0f, 1.0f);
+            radiance = XMFLOAT3(sky.x * desc.skyRadiance.x, sky.y * desc.skyRadiance.y, sky.z * desc.skyRadiance.z);
+        }
+
+        const float* y = &basis[i * ProbeCoefficients];
+        for (uint32_t c = 0; c < ProbeCoefficients; c++)
+        {
+            sh[c * 3] += radiance.x * y[c];
+            sh[c * 3 + 1] += radiance.y * y[c];
+            sh[c * 3 + 2] += radiance.z * y[c];
+        }
+    }
+
+    // Monte Carlo weight of each direction, then the cosine lobe and the basis constant of
+    // the polynomial the shader evaluates
+    float weight = 4.0f * XM_PI / directions.size();
+    static const float Constants[ProbeCoefficients] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+    for (uint32_t c = 0; c < ProbeCoefficients; c++)
+    {
+        for (uint32_t k = 0; k < 3; k++)
+            probe.values[c * 3 + k] = sh[c * 3 + k] * weight * BandScale[c] * Constants[c];
+    }
+    return backfaces <= directions.size() * ProbeMaxBackfaces;
+}
+
+void BakeProbes(const ProbeBakeDesc& desc, ThreadPool& pool, std::vector<ProbeSH>& probes, ProbeBakeStats* pStats)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint32_t count = desc.counts.x * desc.counts.y * desc.counts.z;
+    probes.assign(count, ProbeSH());
+
+    std::vector<XMFLOAT3> directions;
+    _directions((std::max)(desc.rays, 1u), directions);
+    std::vector<float> basis(directions.size() * ProbeCoefficients);
+    for (size_t i = 0; i < directions.size(); i++)
+        _basis(directions[i], &basis[i * ProbeCoefficients]);
+
+    std::vector<uint8_t> valid(count);
+    std::atomic<uint64_t> totalRays{ 0 };
+    pool.ParallelFor(count, 1, [&](uint32_t begin, uint32_t end)
+        {
+            uint64_t rays = 0;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t x = i % desc.counts.x, y = i / desc.counts.x % desc.counts.y, z = i / (desc.counts.x * desc.counts.y);
+                valid[i] = _bakeProbe(desc, _probePosition(desc, x, y, z), directions, basis, probes[i], rays) ? 1 : 0;
+            }
+            totalRays += rays;
+        });
+
+    // Probes inside geometry only see its back faces; they take the average of their valid
+    // neighbours, a ring per pass, so they don't leak darkness into the surfaces next to them
+    uint32_t invalid = 0;
+    for (uint8_t v : valid)
+        invalid += v ? 0 : 1;
+    for (uint32_t remaining = invalid; remaining > 0;)
+    {
+        std::vector<uint8_t> next = valid;
+        uint32_t filled = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (valid[i])
+                continue;
+            int x = (int)(i % desc.counts.x), y = (int)(i / desc.counts.x % desc.counts.y), z = (int)(i / (desc.counts.x * desc.counts.y));
+            ProbeSH sum = {};
+            uint32_t neighbours = 0;
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int nx = x + dx, ny = y + dy, nz = z + dz;
+                        if (nx < 0 || ny < 0 || nz < 0 || nx >= (int)desc.counts.x || ny >= (int)desc.counts.y || nz >= (int)desc.counts.z)
+                            continue;
+                        uint32_t n = ((uint32_t)nz * desc.counts.y + ny) * desc.counts.x + nx;
+                        if (!valid[n])
+                            continue;
+                        for (uint32_t k = 0; k < ProbeCoefficients * 3; k++)
+                            sum.values[k] += probes[n].values[k];
+                        neighbours++;
+                    }
+                }
+            }
+            if (neighbours == 0)
+                continue;
+            for (uint32_t k = 0; k < ProbeCoefficients * 3; k++)
+                probes[i].values[k] = sum.values[k] / neighbours;
+            next[i] = 1;
+            filled++;
+        }
+        valid.swap(next);
+        // Nothing valid anywhere: the grid is left as baked
+        if (filled == 0)
+            break;
+        remaining -= filled;
+    }
+
+    if (pStats)
+    {
+        pStats->probes = count;
+        pStats->invalid = invalid;
+        pStats->rays = totalRays;
+        pStats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+XMFLOAT3 EvaluateProbe(const ProbeSH& probe, const XMFLOAT3& normal)
+{
+    float y[ProbeCoefficients] = { 1.0f, normal.y, normal.z, normal.x, normal.x * normal.y, normal.y * normal.z,
+        3.0f * normal.z * normal.z - 1.0f, normal.x * normal.z, normal.x * normal.x - normal.y * normal.y };
+    XMFLOAT3 result(0.0f, 0.0f, 0.0f);
+    for (uint32_t c = 0; c < ProbeCoefficients; c++)
+    {
+        result.x += probe.values[c * 3] * y[c];
+        result.y += probe.values[c * 3 + 1] * y[c];
+        result.z += probe.values[c * 3 + 2] * y[c];
+    }
+    return XMFLOAT3((std::max)(result.x, 0.0f), (std::max)(result.y, 0.0f), (std::max)(result.z, 0.0f));
+}
+
+void PackProbes(const std::vector<ProbeSH>& probes, const XMUINT3& counts, std::vector<XMHALF4>& texels)
+{
+    size_t slab = (size_t)counts.x * counts.y * counts.z;
+    texels.resize(slab * ProbeTexels);
+    for (size_t i = 0; i < slab && i < probes.size(); i++)
+    {
+        float values[ProbeTexels * 4] = {};
+        std::copy(probes[i].values, probes[i].values + ProbeCoefficients * 3, values);
+        for (uint32_t k = 0; k < ProbeTexels; k++)
+            texels[k * slab + i] = XMHALF4(values[k * 4], values[k * 4 + 1], values[k * 4 + 2], values[k * 4 + 3]);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "rayTracer.h"
+#include "sceneLayout.h"
+#include "skyCubemap.h"
+#include "threadPool.h"
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// Ambient light for everything the lightmaps don't cover: a grid of probes, each the
+// irradiance around one point as order 2 spherical harmonics (9 coefficients per channel).
+// Every probe traces ProbeRays rays; misses see the sky, hits see the surface lit once by the
+// lights and the sun. The coefficients are stored already convolved with the cosine lobe and
+// divided by pi, with the basis constants folded in, so a shader gets the diffuse light
+// as a polynomial in the normal (GetProbeIrradiance in ColorCalc.hlsli).
+static const uint32_t ProbeRays = 512;
+static const uint32_t ProbeCoefficients = 9;
+// 27 values in half precision take 7 RGBA texels per probe
+static const uint32_t ProbeTexels = 7;
+// Reflectance assumed for every surface the bounce light comes from
+static const float ProbeAlbedo = 0.5f;
+// Skybox mip level faces are read at, small is enough for order 2
+static const uint32_t ProbeSkySize = 32;
+
+struct ProbeBakeDesc
+{
+    const RayTracer* pScene;        // built; nullptr for the sky alone
+    const SkyCubemap* pSky;         // nullptr for a constant sky of skyRadiance
+    XMFLOAT3 skyRadiance;           // scales the sky texture
+    std::vector<Light> lights;
+    XMFLOAT3 sunDirection;          // direction the sunlight travels in
+    XMFLOAT3 sunColor;
+    float albedo;
+    XMFLOAT3 gridMin;               // first and last probe, the others are spaced evenly between
+    XMFLOAT3 gridMax;
+    XMUINT3 counts;
+    uint32_t rays;
+};
+
+struct ProbeBakeStats
+{
+    uint32_t probes;
+    uint32_t invalid;               // inside geometry, filled from their neighbours
+    uint64_t rays;
+    double seconds;
+};
+
+// One probe: red, green and blue of each coefficient in turn
+struct ProbeSH
+{
+    float values[ProbeCoefficients * 3];
+};
+
+// probes receives counts.x * counts.y * counts.z probes, x fastest
+void BakeProbes(const ProbeBakeDesc& desc, ThreadPool& pool, std::vector<ProbeSH>& probes, ProbeBakeStats* pStats = nullptr);
+
+// Diffuse light for a white surface with this normal, what the shader computes
+XMFLOAT3 EvaluateProbe(const ProbeSH& probe, const XMFLOAT3& normal);
+
+// Texture3D layout: ProbeTexels slabs of counts.z slices stacked along z, slab k holding
+// values 4k to 4k+3 of every probe, so each slab filters on its own
+void PackProbes(const std::vector<ProbeSH>& probes, const XMUINT3& counts, std::vector<XMHALF4>& texels);
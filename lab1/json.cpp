@@ -0,0 +1,279 @@
+#include "json.h"
+#include <cstring>
+#include <cstdlib>
+
+const JsonValue* JsonValue::Find(const char* name) const
+{
+    for (const std::pair<std::string, JsonValue>& member : members)
+    {
+        if (member.first == name)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+double JsonValue::GetNumber(const char* name, double fallback) const
+{
+    const JsonValue* pValue = Find(name);
+    return pValue && pValue->type == Number ? pValue->number : fallback;
+}
+
+const char* JsonValue::GetString(const char* name, const char* fallback) const
+{
+    const JsonValue* pValue = Find(name);
+    return pValue && pValue->type == String ? pValue->string.c_str() : fallback;
+}
+
+class JsonParser
+{
+public:
+    JsonParser(const char* text, size_t length) : _p(text), _end(text + length) {}
+
+    bool ParseDocument(JsonValue& value)
+    {
+        if (!_parseValue(value, 0))
+            return false;
+        _skipSpace();
+        return _p == _end;
+    }
+
+private:
+    static const int MaxDepth = 256;
+
+    const char* _p;
+    const char* _end;
+
+    void _skipSpace()
+    {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+            _p++;
+    }
+
+    bool _match(const char* literal)
+    {
+        size_t length = strlen(literal);
+        if ((size_t)(_end - _p) < length || memcmp(_p, literal, length) != 0)
+            return false;
+        _p += length;
+        return true;
+    }
+
+    static int _hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    bool _parseHex4(unsigned& code)
+    {
+        if (_end - _p < 4)
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            int digit = _hexDigit(*_p++);
+            if (digit < 0)
+                return false;
+            code = code * 16 + digit;
+        }
+        return true;
+    }
+
+    static void _appendUtf8(std::string& out, unsigned code)
+    {
+        if (code < 0x80)
+            out += (char)code;
+        else if (code < 0x800)
+        {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool _parseString(std::string& out)
+    {
+        // The opening quote is already consumed
+        while (_p < _end && *_p != '"')
+        {
+            char c = *_p++;
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (_p == _end)
+                return false;
+            c = *_p++;
+            switch (c)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                unsigned code;
+                if (!_parseHex4(code))
+                    return false;
+                // Surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && _match("\\u"))
+                {
+                    unsigned low;
+                    if (!_parseHex4(low) || low < 0xDC00 || low >= 0xE000)
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                _appendUtf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (_p == _end)
+            return false;
+        _p++;
+        return true;
+    }
+
+    bool _parseNumber(double& number)
+    {
+        // strtod would run past the buffer, so the token is copied out first
+        const char* start = _p;
+        while (_p < _end && (strchr("+-0123456789.eE", *_p) != nullptr))
+            _p++;
+        size_t length = _p - start;
+        if (length == 0 || length > 63)
+            return false;
+        char token[64];
+        memcpy(token, start, length);
+        token[length] = '\0';
+        char* pEnd = nullptr;
+        number = strtod(token, &pEnd);
+        return pEnd == token + length;
+    }
+
+    bool _parseValue(JsonValue& value, int depth)
+    {
+        if (depth > MaxDepth)
+            return false;
+        _skipSpace();
+        if (_p == _end)
+            return false;
+
+        char c = *_p;
+        if (c == '{')
+        {
+            _p++;
+            value.type = JsonValue::Object;
+            _skipSpace();
+            if (_p < _end && *_p == '}')
+            {
+                _p++;
+                return true;
+            }
+            while (true)
+            {
+                _skipSpace();
+                if (_p == _end || *_p++ != '"')
+                    return false;
+                value.members.emplace_back();
+                if (!_parseString(value.members.back().first))
+                    return false;
+                _skipSpace();
+                if (_p == _end || *_p++ != ':')
+                    return false;
+                if (!_parseValue(value.members.back().second, depth + 1))
+                    return false;
+                _skipSpace();
+                if (_p == _end)
+                    return false;
+                if (*_p == ',')
+                {
+                    _p++;
+                    continue;
+                }
+                return *_p++ == '}';
+            }
+        }
+        if (c == '[')
+        {
+            _p++;
+            value.type = JsonValue::Array;
+            _skipSpace();
+            if (_p < _end && *_p == ']')
+            {
+                _p++;
+                return true;
+            }
+            while (true)
+            {
+                value.items.emplace_back();
+                if (!_parseValue(value.items.back(), depth + 1))
+                    return false;
+                _skipSpace();
+                if (_p == _end)
+                    return false;
+                if (*_p == ',')
+                {
+                    _p++;
+                    continue;
+                }
+                return *_p++ == ']';
+            }
+        }
+        if (c == '"')
+        {
+            _p++;
+            value.type = JsonValue::String;
+            return _parseString(value.string);
+        }
+        if (_match("true"))
+        {
+            value.type = JsonValue::Bool;
+            value.boolean = true;
+            return true;
+        }
+        if (_match("false"))
+        {
+            value.type = JsonValue::Bool;
+            return true;
+        }
+        if (_match("null"))
+        {
+            value.type = JsonValue::Null;
+            return true;
+        }
+        value.type = JsonValue::Number;
+        return _parseNumber(value.number);
+    }
+};
+
+bool ParseJson(const char* text, size_t length, JsonValue& value)
+{
+    value = JsonValue();
+    JsonParser parser(text, length);
+    return parser.ParseDocument(value);
+}
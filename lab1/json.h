@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+
+// Small JSON document model for asset metadata (glTF). Numbers are kept as double,
+// objects keep their members in file order.
+struct JsonValue
+{
+    enum Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    Type type = Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* Find(const char* name) const;
+
+    // Typed lookups of object members with a fallback when the member is missing or of another type
+    double GetNumber(const char* name, double fallback) const;
+    const char* GetString(const char* name, const char* fallback) const;
+};
+
+// Parses a UTF-8 document; returns false on a syntax error
+bool ParseJson(const char* text, size_t length, JsonValue& value);
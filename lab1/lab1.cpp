@@ -15,6 +15,13 @@
 
 #include "resource.h"
 #include "renderer.h"
+#include "benchmark.h"
+#include "meshConverter.h"
+#include "lightBaker.h"
+#include "softRenderer.h"
+#include <shellapi.h>
+#include <cwchar>
+#include <string>
 
 
 using namespace DirectX;
@@ -30,12 +37,45 @@ UINT WindowWidth = 720;
 UINT WindowHeight = 720;
 Renderer* g_renderer = nullptr;
 
+UINT MaxFramesInFlight = 1;
+bool VSync = true;
+float FrameCap = 0.0f;
+std::string BenchmarkName;
+std::string MeshConvertInput;
+std::string MeshConvertOutput;
+bool MeshConvertPacked = true;
+std::string ModelPath;
+std::string BakeOutput;
+std::string SoftRenderOutput;
+UINT SoftRenderWidth = 1280;
+UINT SoftRenderHeight = 720;
+std::string LightmapPath;
+TransparencyMode Transparency = TransparencySorted;
+UINT ExtraLights = 0;
+float CameraFarZ = 0.0f;
+float MouseSmoothing = 0.0f;
+float MousePrediction = 0.0f;
+std::string CameraRecordPath;
+std::string CameraReplayPath;
+std::string ReplayReportPath = "replay.json";
+ULONGLONG g_titleUpdateTime = 0;
+int64_t g_profilerPrintTime = 0;
+std::string g_profilerTopZones;
+const UINT ProfilerTitleZones = 3;
+UINT TraceFrames = 0;
+const UINT DefaultTraceFrames = 120;
+float SimulationRate = DefaultSimulationRate;
+std::string TracePath = "trace.json";
+
 
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
 HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
+void ParseCommandLine(LPWSTR lpCmdLine);
+void UpdateWindowTitle();
+void PrintProfilerSummary();
 
 
 //--------------------------------------------------------------------------------------
@@ -45,7 +85,18 @@ LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
+
+    ProfilerSetThreadName("main");
+    ParseCommandLine(lpCmdLine);
+
+    if (!BenchmarkName.empty())
+        return RunBenchmark(BenchmarkName.c_str()) ? 0 : 1;
+    if (!MeshConvertInput.empty())
+        return ConvertMesh(MeshConvertInput.c_str(), MeshConvertOutput.c_str(), MeshConvertPacked) ? 0 : 1;
+    if (!BakeOutput.empty())
+        return BakeStaticScene(BakeOutput.c_str(), ModelPath.c_str()) ? 0 : 1;
+    if (!SoftRenderOutput.empty())
+        return SoftRenderScene(SoftRenderOutput.c_str(), SoftRenderWidth, SoftRenderHeight, SoftRenderFrames) ? 0 : 1;
 
     if (FAILED(InitWindow(hInstance, nCmdShow)))
         return 0;
@@ -61,7 +112,18 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
         }
         else
         {
+            // Sleep until input arrives or the swap chain is ready to accept another frame
+            HANDLE hFrame = g_renderer->GetFrameWaitHandle();
+            if (hFrame && MsgWaitForMultipleObjectsEx(1, &hFrame, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE) != WAIT_OBJECT_0)
+                continue;
+
             g_renderer->Render();
+            ProfilerEndFrame();
+            g_renderer->UpdateTraceCapture();
+            UpdateWindowTitle();
+            PrintProfilerSummary();
+            if (g_renderer->IsReplayFinished())
+                DestroyWindow(g_hWnd);
         }
     }
 
@@ -120,6 +182,19 @@ HRESULT InitWindow(HINSTANCE hInstance, int nCmdShow)
     }
 
     g_renderer = new Renderer();
+    g_renderer->SetFramePacing(MaxFramesInFlight, VSync, FrameCap);
+    g_renderer->SetModelPath(ModelPath.c_str());
+    g_renderer->SetLightmapPath(LightmapPath.c_str());
+    g_renderer->SetTransparencyMode(Transparency);
+    g_renderer->SetExtraLightCount(ExtraLights);
+    g_renderer->SetCameraFarZ(CameraFarZ);
+    g_renderer->SetMouseFilter(MouseSmoothing, MousePrediction);
+    g_renderer->SetCameraRecording(CameraRecordPath.c_str());
+    g_renderer->SetCameraReplay(CameraReplayPath.c_str(), ReplayReportPath.c_str());
+    g_renderer->SetSimulationRate(SimulationRate);
+    // Started before the device so the trace has the init zones
+    if (TraceFrames > 0)
+        g_renderer->StartTraceCapture(TraceFrames, TracePath.c_str());
     if (FAILED(g_renderer->InitDevice(hInstance, g_hWnd)))
     {
         delete g_renderer;
@@ -170,6 +245,28 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         g_renderer->MouseMoved(wParam, lParam);
         break;
 
+    case WM_INPUT:
+        // DefWindowProc still has to see the message to free it
+        if (g_renderer)
+            g_renderer->RawInput(lParam);
+        return DefWindowProc(hWnd, message, wParam, lParam);
+
+    case WM_KEYDOWN:
+        // O switches between sorted and order-independent transparency
+        if (g_renderer && wParam == 'O')
+            g_renderer->SetTransparencyMode(g_renderer->GetTransparencyMode() == TransparencySorted ? TransparencyWeightedOit : TransparencySorted);
+        // T captures a trace of the next frames
+        if (g_renderer && wParam == 'T')
+            g_renderer->StartTraceCapture(TraceFrames > 0 ? TraceFrames : DefaultTraceFrames, TracePath.c_str());
+        // P turns the CPU profiler on and off
+        if (wParam == 'P')
+        {
+            ProfilerSetEnabled(!ProfilerIsEnabled());
+            ProfilerResetStats();
+            g_profilerPrintTime = ClockNow();
+        }
+        break;
+
     default:
         return DefWindowProc(hWnd, message, wParam, lParam);
     }
@@ -178,5 +275,134 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 }
 
 
+//--------------------------------------------------------------------------------------
+// Command line: -latency <max frames in flight> -fpscap <fps> -novsync -bench <name|all>
+// -meshconv <input> <output> [-float] -mesh <file> -oit -lights <count>
+// -bake <output.dds> [-mesh <file>] -lightmap <file> -farz <distance>
+// -mousesmooth <ms> -mousepredict <ms> -record <path file> -replay <path file> [-report <file.json>]
+// -profile -capture <frames> -trace <file.json> -simrate <ticks per second>
+// -softrender <output.ppm> [-softsize <width> <height>]
+//--------------------------------------------------------------------------------------
+static std::string _toUtf8(LPCWSTR text)
+{
+    int size = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+    if (size <= 1)
+        return std::string();
+    std::string result(size - 1, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, -1, &result[0], size, nullptr, nullptr);
+    return result;
+}
 
+void ParseCommandLine(LPWSTR lpCmdLine)
+{
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(lpCmdLine, &argc);
+    if (!argv)
+        return;
 
+    for (int i = 0; i < argc; i++)
+    {
+        if (wcscmp(argv[i], L"-latency") == 0 && i + 1 < argc)
+            MaxFramesInFlight = (UINT)_wtoi(argv[++i]);
+        else if (wcscmp(argv[i], L"-fpscap") == 0 && i + 1 < argc)
+            FrameCap = (float)_wtof(argv[++i]);
+        else if (wcscmp(argv[i], L"-novsync") == 0)
+            VSync = false;
+        else if (wcscmp(argv[i], L"-bench") == 0 && i + 1 < argc)
+        {
+            // Benchmark names are plain ASCII
+            for (LPCWSTR c = argv[++i]; *c; c++)
+                BenchmarkName += (char)*c;
+        }
+        else if (wcscmp(argv[i], L"-meshconv") == 0 && i + 2 < argc)
+        {
+            MeshConvertInput = _toUtf8(argv[++i]);
+            MeshConvertOutput = _toUtf8(argv[++i]);
+        }
+        else if (wcscmp(argv[i], L"-float") == 0)
+            MeshConvertPacked = false;
+        else if (wcscmp(argv[i], L"-mesh") == 0 && i + 1 < argc)
+            ModelPath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-oit") == 0)
+            Transparency = TransparencyWeightedOit;
+        else if (wcscmp(argv[i], L"-lights") == 0 && i + 1 < argc)
+            ExtraLights = (UINT)_wtoi(argv[++i]);
+        else if (wcscmp(argv[i], L"-bake") == 0 && i + 1 < argc)
+            BakeOutput = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-lightmap") == 0 && i + 1 < argc)
+            LightmapPath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-farz") == 0 && i + 1 < argc)
+            CameraFarZ = (float)_wtof(argv[++i]);
+        else if (wcscmp(argv[i], L"-mousesmooth") == 0 && i + 1 < argc)
+            MouseSmoothing = (float)_wtof(argv[++i]);
+        else if (wcscmp(argv[i], L"-mousepredict") == 0 && i + 1 < argc)
+            MousePrediction = (float)_wtof(argv[++i]);
+        else if (wcscmp(argv[i], L"-record") == 0 && i + 1 < argc)
+            CameraRecordPath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-replay") == 0 && i + 1 < argc)
+            CameraReplayPath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-report") == 0 && i + 1 < argc)
+            ReplayReportPath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-profile") == 0)
+            ProfilerSetEnabled(true);
+        else if (wcscmp(argv[i], L"-capture") == 0 && i + 1 < argc)
+            TraceFrames = (UINT)_wtoi(argv[++i]);
+        else if (wcscmp(argv[i], L"-trace") == 0 && i + 1 < argc)
+            TracePath = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-simrate") == 0 && i + 1 < argc)
+            SimulationRate = (float)_wtof(argv[++i]);
+        else if (wcscmp(argv[i], L"-softrender") == 0 && i + 1 < argc)
+            SoftRenderOutput = _toUtf8(argv[++i]);
+        else if (wcscmp(argv[i], L"-softsize") == 0 && i + 2 < argc)
+        {
+            SoftRenderWidth = (UINT)_wtoi(argv[++i]);
+            SoftRenderHeight = (UINT)_wtoi(argv[++i]);
+        }
+    }
+
+    LocalFree(argv);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shows frame time and input-to-present latency in the window caption, and the slowest
+// zones while the profiler is on
+//--------------------------------------------------------------------------------------
+void UpdateWindowTitle()
+{
+    ULONGLONG now = GetTickCount64();
+    if (now - g_titleUpdateTime < 500)
+        return;
+    g_titleUpdateTime = now;
+
+    WCHAR title[512];
+    swprintf_s(title, L"Tronyagina Alexandra | frame %.2f ms | input latency %.2f ms | picked %hs | transparency %hs (O) | profiler %hs (P)%hs%hs | %hs (T)",
+        g_renderer->GetFrameTime(), g_renderer->GetInputLatency(), g_renderer->GetPickedObjectName(),
+        g_renderer->GetTransparencyMode() == TransparencySorted ? "sorted" : "OIT", ProfilerIsEnabled() ? "on" : "off",
+        g_profilerTopZones.empty() ? "" : ": ", g_profilerTopZones.c_str(), g_renderer->IsCapturingTrace() ? "capturing" : "trace");
+    SetWindowText(g_hWnd, title);
+}
+
+
+//--------------------------------------------------------------------------------------
+// While the profiler is on, prints min, avg and max of every zone over the last second
+// to the debugger output, keeps the slowest for the window title and starts over
+//--------------------------------------------------------------------------------------
+void PrintProfilerSummary()
+{
+    if (!ProfilerIsEnabled())
+    {
+        g_profilerTopZones.clear();
+        return;
+    }
+    int64_t now = ClockNow();
+    if (ClockSeconds(now - g_profilerPrintTime) < 1.0)
+        return;
+    g_profilerPrintTime = now;
+
+    std::vector<ProfileZoneStats> stats;
+    ProfilerGetStats(stats);
+    OutputDebugStringA(ProfilerFormatStats(stats).c_str());
+    g_profilerTopZones = ProfilerFormatTopZones(stats, ProfilerTitleZones);
+    ProfilerResetStats();
+}
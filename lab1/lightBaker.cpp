@@ -0,0 +1,421 @@
+#include "lightBaker.h"
+#include "lightmapAtlas.h"
+#include "meshFile.h"
+#include "benchmark.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX::PackedVector;
+
+// Gaps between charts are at most twice the padding, this fills them with room to spare
+static const uint32_t DilationPasses = LightmapPadding * 2 + 1;
+
+struct BakeTexel
+{
+    XMFLOAT3 pos;
+    XMFLOAT3 normal;
+    XMFLOAT3 faceNormal;    // on the same side as normal, for the ray offset
+    bool covered;
+};
+
+static float _edge(const XMFLOAT2& a, const XMFLOAT2& b, float x, float y)
+{
+    return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// Texel centers inside the receiver's triangles get the interpolated surface point
+static void _rasterize(const LightmapReceiver& receiver, uint32_t size, BakeTexel* slice)
+{
+    XMMATRIX world = XMLoadFloat4x4(&receiver.world);
+    for (size_t i = 0; i + 2 < receiver.numIndices; i += 3)
+    {
+        XMFLOAT2 uv[3];
+        XMVECTOR p[3], n[3];
+        for (int c = 0; c < 3; c++)
+        {
+            uint32_t index = receiver.indices[i + c];
+            uv[c] = XMFLOAT2(receiver.lightmapUVs[index].x * size, receiver.lightmapUVs[index].y * size);
+            p[c] = XMVector3TransformCoord(XMLoadFloat3(&receiver.vertices[index].pos), world);
+            n[c] = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&receiver.vertices[index].normal), world));
+        }
+
+        float area = _edge(uv[0], uv[1], uv[2].x, uv[2].y);
+        if (fabsf(area) < 1e-12f)
+            continue;
+        XMVECTOR face = XMVector3Normalize(XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0])));
+        if (XMVectorGetX(XMVector3Dot(face, XMVectorAdd(XMVectorAdd(n[0], n[1]), n[2]))) < 0.0f)
+            face = XMVectorNegate(face);
+
+        float minX = (std::min)((std::min)(uv[0].x, uv[1].x), uv[2].x), maxX = (std::max)((std::max)(uv[0].x, uv[1].x), uv[2].x);
+        float minY = (std::min)((std::min)(uv[0].y, uv[1].y), uv[2].y), maxY = (std::max)((std::max)(uv[0].y, uv[1].y), uv[2].y);
+        int x0 = (std::max)((int)ceilf(minX - 0.5f), 0), x1 = (std::min)((int)floorf(maxX - 0.5f), (int)size - 1);
+        int y0 = (std::max)((int)ceilf(minY - 0.5f), 0), y1 = (std::min)((int)floorf(maxY - 0.5f), (int)size - 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                float cx = x + 0.5f, cy = y + 0.5f;
+                float w0 = _edge(uv[1], uv[2], cx, cy) / area;
+                float w1 = _edge(uv[2], uv[0], cx, cy) / area;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < -1e-5f || w1 < -1e-5f || w2 < -1e-5f)
+                    continue;
+
+                BakeTexel& texel = slice[(size_t)y * size + x];
+                XMStoreFloat3(&texel.pos, XMVectorAdd(XMVectorAdd(XMVectorScale(p[0], w0), XMVectorScale(p[1], w1)), XMVectorScale(p[2], w2)));
+                XMStoreFloat3(&texel.normal, XMVector3Normalize(XMVectorAdd(XMVectorAdd(XMVectorScale(n[0], w0), XMVectorScale(n[1], w1)), XMVectorScale(n[2], w2))));
+                XMStoreFloat3(&texel.faceNormal, face);
+                texel.covered = true;
+            }
+        }
+    }
+}
+
+static uint32_t _hash(uint32_t x)
+{
+    x ^= x >> 16; x *= 0x7FEB352D;
+    x ^= x >> 15; x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+static float _radicalInverse(uint32_t bits)
+{
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    return bits * 2.3283064365386963e-10f;
+}
+
+XMFLOAT3 ComputeDirectIrradiance(const RayTracer& scene, const std::vector<Light>& lights, const XMFLOAT3& sunDirection, const XMFLOAT3& sunColor,
+    const XMFLOAT3& pos, const XMFLOAT3& n, const XMFLOAT3& origin, uint64_t& rays)
+{
+    XMFLOAT3 irradiance(0.0f, 0.0f, 0.0f);
+    for (const Light& light : lights)
+    {
+        XMFLOAT3 toLight(light.pos.x - pos.x, light.pos.y - pos.y, light.pos.z - pos.z);
+        float dist = sqrtf(toLight.x * toLight.x + toLight.y * toLight.y + toLight.z * toLight.z);
+        if (dist >= light.pos.w || dist < 1e-6f)
+            continue;
+        XMFLOAT3 dir(toLight.x / dist, toLight.y / dist, toLight.z / dist);
+        float nDotL = n.x * dir.x + n.y * dir.y + n.z * dir.z;
+        if (nDotL <= 0.0f)
+            continue;
+
+        rays++;
+        if (scene.Occluded(origin, dir, dist - BakeRayOffset))
+            continue;
+
+        // GetAttenuation in ColorCalc.hlsli
+        float ratio = dist / light.pos.w;
+        float window = (std::max)(0.0f, (std::min)(1.0f, 1.0f - ratio * ratio * ratio * ratio));
+        float atten = window * window / (dist * dist + 1.0f) * nDotL;
+        irradiance.x += light.color.x * atten;
+        irradiance.y += light.color.y * atten;
+        irradiance.z += light.color.z * atten;
+    }
+
+    XMFLOAT3 toSun(-sunDirection.x, -sunDirection.y, -sunDirection.z);
+    float sunDotN = n.x * toSun.x + n.y * toSun.y + n.z * toSun.z;
+    if (sunDotN > 0.0f && sunColor.x + sunColor.y + sunColor.z > 0.0f)
+    {
+        rays++;
+        if (!scene.Occluded(origin, toSun, FLT_MAX))
+        {
+            irradiance.x += sunColor.x * sunDotN;
+            irradiance.y += sunColor.y * sunDotN;
+            irradiance.z += sunColor.z * sunDotN;
+        }
+    }
+    return irradiance;
+}
+
+// One texel: direct light with shadow rays, then ambient occlusion from a Hammersley set
+// rotated per texel (Cranley-Patterson) so neighbouring texels don't share their noise
+static XMFLOAT4 _bakeTexel(const LightmapBakeDesc& desc, const BakeTexel& texel, uint32_t seed, uint64_t& rays)
+{
+    const RayTracer& scene = *desc.pOccluders;
+    XMFLOAT3 n = texel.normal;
+    XMFLOAT3 origin(texel.pos.x + texel.faceNormal.x * BakeRayOffset, texel.pos.y + texel.faceNormal.y * BakeRayOffset,
+        texel.pos.z + texel.faceNormal.z * BakeRayOffset);
+
+    XMFLOAT3 irradiance = ComputeDirectIrradiance(scene, desc.lights, desc.sunDirection, desc.sunColor, texel.pos, n, origin, rays);
+
+    // Orthonormal basis around the normal (Duff et al. 2017)
+    float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    XMFLOAT3 t(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    XMFLOAT3 bt(b, sign + n.y * n.y * a, -n.y);
+
+    float rotateU = (_hash(seed) & 0xFFFFFF) / 16777216.0f;
+    float rotateV = (_hash(seed ^ 0x9E3779B9) & 0xFFFFFF) / 16777216.0f;
+    uint32_t occluded = 0;
+    for (uint32_t i = 0; i < desc.aoRays; i++)
+    {
+        float u1 = (i + 0.5f) / desc.aoRays + rotateU;
+        float u2 = _radicalInverse(i) + rotateV;
+        u1 -= floorf(u1);
+        u2 -= floorf(u2);
+
+        float r = sqrtf(u1), phi = XM_2PI * u2, h = sqrtf((std::max)(0.0f, 1.0f - u1));
+        float c = r * cosf(phi), s = r * sinf(phi);
+        XMFLOAT3 dir(t.x * c + bt.x * s + n.x * h, t.y * c + bt.y * s + n.y * h, t.z * c + bt.z * s + n.z * h);
+
+        // Directions under the actual surface would start inside it
+        if (dir.x * texel.faceNormal.x + dir.y * texel.faceNormal.y + dir.z * texel.faceNormal.z <= 0.0f)
+        {
+            occluded++;
+            continue;
+        }
+        rays++;
+        if (scene.Occluded(origin, dir, desc.aoDistance))
+            occluded++;
+    }
+    float ao = desc.aoRays ? 1.0f - (float)occluded / desc.aoRays : 1.0f;
+
+    return XMFLOAT4(irradiance.x, irradiance.y, irradiance.z, ao);
+}
+
+// Uncovered texels next to covered ones take their average, one ring per pass
+static void _dilate(std::vector<XMFLOAT4>& texels, std::vector<uint8_t>& covered, uint32_t size, uint32_t numSlices)
+{
+    std::vector<uint8_t> next;
+    for (uint32_t pass = 0; pass < DilationPasses; pass++)
+    {
+        next = covered;
+        for (uint32_t s = 0; s < numSlices; s++)
+        {
+            size_t base = (size_t)s * size * size;
+            for (uint32_t y = 0; y < size; y++)
+            {
+                for (uint32_t x = 0; x < size; x++)
+                {
+                    size_t index = base + (size_t)y * size + x;
+                    if (covered[index])
+                        continue;
+
+                    XMFLOAT4 sum(0.0f, 0.0f, 0.0f, 0.0f);
+                    uint32_t count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = (int)x + dx, ny = (int)y + dy;
+                            if (nx < 0 || ny < 0 || nx >= (int)size || ny >= (int)size)
+                                continue;
+                            size_t neighbour = base + (size_t)ny * size + nx;
+                            if (!covered[neighbour])
+                                continue;
+                            sum.x += texels[neighbour].x; sum.y += texels[neighbour].y;
+                            sum.z += texels[neighbour].z; sum.w += texels[neighbour].w;
+                            count++;
+                        }
+                    }
+                    if (count > 0)
+                    {
+                        texels[index] = XMFLOAT4(sum.x / count, sum.y / count, sum.z / count, sum.w / count);
+                        next[index] = 1;
+                    }
+                }
+            }
+        }
+        covered.swap(next);
+    }
+}
+
+void BakeLightmaps(const LightmapBakeDesc& desc, ThreadPool& pool, std::vector<XMFLOAT4>& texels, LightmapBakeStats* pStats)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t sliceTexels = (size_t)desc.size * desc.size;
+    std::vector<BakeTexel> surface(sliceTexels * desc.numSlices, BakeTexel{});
+    for (const LightmapReceiver& receiver : desc.receivers)
+    {
+        if (receiver.slice < desc.numSlices)
+            _rasterize(receiver, desc.size, surface.data() + receiver.slice * sliceTexels);
+    }
+
+    // Tiles keep the texels a thread works on close together, and finish at similar speeds
+    texels.assign(sliceTexels * desc.numSlices, XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+    uint32_t tilesPerRow = (desc.size + BakeTileSize - 1) / BakeTileSize;
+    uint32_t tilesPerSlice = tilesPerRow * tilesPerRow;
+    std::atomic<uint64_t> totalRays{ 0 };
+    pool.ParallelFor(tilesPerSlice * desc.numSlices, 1, [&](uint32_t begin, uint32_t end)
+        {
+            uint64_t rays = 0;
+            for (uint32_t tile = begin; tile < end; tile++)
+            {
+                uint32_t slice = tile / tilesPerSlice;
+                uint32_t x0 = tile % tilesPerSlice % tilesPerRow * BakeTileSize, y0 = tile % tilesPerSlice / tilesPerRow * BakeTileSize;
+                for (uint32_t y = y0; y < (std::min)(y0 + BakeTileSize, desc.size); y++)
+                {
+                    for (uint32_t x = x0; x < (std::min)(x0 + BakeTileSize, desc.size); x++)
+                    {
+                        size_t index = slice * sliceTexels + (size_t)y * desc.size + x;
+                        if (surface[index].covered)
+                            texels[index] = _bakeTexel(desc, surface[index], (uint32_t)index, rays);
+                    }
+                }
+            }
+            totalRays += rays;
+        });
+
+    std::vector<uint8_t> covered(surface.size());
+    uint64_t numCovered = 0;
+    for (size_t i = 0; i < surface.size(); i++)
+    {
+        covered[i] = surface[i].covered ? 1 : 0;
+        numCovered += covered[i];
+    }
+    _dilate(texels, covered, desc.size, desc.numSlices);
+
+    if (pStats)
+    {
+        pStats->texels = numCovered;
+        pStats->rays = totalRays;
+        pStats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool WriteLightmapDds(const char* path, const std::vector<XMFLOAT4>& texels, uint32_t size, uint32_t numSlices)
+{
+    // DDS_HEADER with a DDS_PIXELFORMAT of 'DX10', then DDS_HEADER_DXT10
+    struct DdsHeader
+    {
+        uint32_t magic, size, flags, height, width, pitch, depth, mipMapCount, reserved1[11];
+        uint32_t pfSize, pfFlags, pfFourCC, pfRGBBitCount, pfRMask, pfGMask, pfBMask, pfAMask;
+        uint32_t caps, caps2, caps3, caps4, reserved2;
+        uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+    } header = {};
+    header.magic = 0x20534444;          // "DDS "
+    header.size = 124;
+    header.flags = 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000; // caps, height, width, pitch, pixel format, mip count
+    header.height = size;
+    header.width = size;
+    header.pitch = size * sizeof(XMHALF4);
+    header.mipMapCount = 1;
+    header.pfSize = 32;
+    header.pfFlags = 0x4;               // DDPF_FOURCC
+    header.pfFourCC = 0x30315844;       // "DX10"
+    header.caps = 0x1000;               // DDSCAPS_TEXTURE
+    header.dxgiFormat = 10;             // DXGI_FORMAT_R16G16B16A16_FLOAT
+    header.resourceDimension = 3;       // D3D11_RESOURCE_DIMENSION_TEXTURE2D
+    header.arraySize = numSlices;
+
+    std::vector<XMHALF4> halves(texels.size());
+    for (size_t i = 0; i < texels.size(); i++)
+        halves[i] = XMHALF4(texels[i].x, texels[i].y, texels[i].z, texels[i].w);
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (!pFile)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, pFile) == 1
+        && fwrite(halves.data(), sizeof(XMHALF4), halves.size(), pFile) == halves.size();
+    ok = fclose(pFile) == 0 && ok;
+    return ok;
+}
+
+bool BakeStaticScene(const char* output, const char* modelPath)
+{
+    ThreadPool pool;
+    pool.Init();
+
+    RayTracer occluders;
+    LightmapBakeDesc desc = {};
+    desc.pOccluders = &occluders;
+    desc.lights.assign(StaticLights, StaticLights + StaticLightCount);
+    XMStoreFloat3(&desc.sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+    desc.sunColor = XMFLOAT3(SunColor.x, SunColor.y, SunColor.z);
+    desc.size = LightmapSize;
+    desc.numSlices = LightmapSliceCount;
+    desc.aoRays = BakeAoRays;
+    desc.aoDistance = BakeAoDistance;
+
+    // The cube's uvs go through the same UNORM16 rounding as the renderer's vertex stream
+    Mesh cube = GenerateCube();
+    LightmapAtlasBuilder cubeAtlas;
+    cubeAtlas.AddMesh(cube);
+    cubeAtlas.Pack();
+    std::vector<XMFLOAT2> cubeUVs(cubeAtlas.GetUVs().size());
+    for (size_t i = 0; i < cubeUVs.size(); i++)
+    {
+        XMUSHORTN2 packed(cubeAtlas.GetUVs()[i].x, cubeAtlas.GetUVs()[i].y);
+        XMStoreFloat2(&cubeUVs[i], XMLoadUShortN2(&packed));
+    }
+    XMMATRIX cubeWorld = XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z);
+    LightmapReceiver receiver = { cube.vertices.data(), cubeUVs.data(), cube.indices.data(), cube.indices.size(), {}, LightmapCubeSlice };
+    XMStoreFloat4x4(&receiver.world, cubeWorld);
+    desc.receivers.push_back(receiver);
+    occluders.AddMesh(&cube.vertices[0].pos, sizeof(MeshVertex), cube.indices.data(), cube.indices.size(), cubeWorld);
+
+    // Every LOD has its own charts and is baked; only the finest one casts shadows
+    MeshFile file;
+    std::vector<MeshVertex> modelVertices;
+    std::vector<uint32_t> modelIndices;
+    std::vector<XMFLOAT2> modelUVs;
+    if (modelPath && *modelPath)
+    {
+        if (!file.Open(modelPath))
+        {
+            BenchPrint("bake: can't open '%s'\n", modelPath);
+            return false;
+        }
+        const MeshFileHeader& header = file.GetHeader();
+        modelVertices.resize(header.numVertices);
+        if (header.vertexFormat == MeshFileVertexFormat_Packed)
+            UnpackVertices(static_cast<const PackedVertex*>(file.GetVertices()), header.numVertices, header.quantization, modelVertices.data());
+        else
+            modelVertices.assign(static_cast<const MeshVertex*>(file.GetVertices()), static_cast<const MeshVertex*>(file.GetVertices()) + header.numVertices);
+        modelIndices.resize(header.numIndices);
+        for (uint32_t i = 0; i < header.numIndices; i++)
+            modelIndices[i] = header.indexSize == 2 ? static_cast<const uint16_t*>(file.GetIndices())[i] : static_cast<const uint32_t*>(file.GetIndices())[i];
+        modelUVs.resize(header.numVertices);
+        for (uint32_t i = 0; i < header.numVertices; i++)
+            XMStoreFloat2(&modelUVs[i], XMLoadUShortN2(&file.GetLightmapUVs()[i]));
+
+        XMMATRIX modelWorld = GetModelWorld(header.bounds);
+        for (uint32_t s = 0; s < header.numSubmeshes; s++)
+        {
+            const MeshFileSubmesh& submesh = file.GetSubmeshes()[s];
+            for (uint32_t l = 0; l < submesh.numLods; l++)
+            {
+                const MeshLod& range = file.GetLods()[submesh.firstLod + l].range;
+                receiver = { modelVertices.data() + range.baseVertex, modelUVs.data() + range.baseVertex,
+                    modelIndices.data() + range.startIndex, range.indexCount, {}, LightmapModelSlice };
+                XMStoreFloat4x4(&receiver.world, modelWorld);
+                desc.receivers.push_back(receiver);
+                if (l == 0)
+                    occluders.AddMesh(&modelVertices[range.baseVertex].pos, sizeof(MeshVertex), receiver.indices, receiver.numIndices, modelWorld);
+            }
+        }
+    }
+    occluders.Build();
+
+    std::vector<XMFLOAT4> texels;
+    LightmapBakeStats stats = {};
+    BakeLightmaps(desc, pool, texels, &stats);
+    BenchPrint("bake: %zu triangles, %u slices of %u^2, %llu texels, %llu rays in %.2f s on %u threads, %.2f Mrays/s\n",
+        occluders.GetTriangleCount(), desc.numSlices, desc.size, (unsigned long long)stats.texels, (unsigned long long)stats.rays,
+        stats.seconds, pool.GetNumThreads(), stats.rays / 1e6 / (std::max)(stats.seconds, 1e-9));
+
+    if (!WriteLightmapDds(output, texels, desc.size, desc.numSlices))
+    {
+        BenchPrint("bake: can't write '%s'\n", output);
+        return false;
+    }
+    BenchPrint("bake: wrote %s\n", output);
+    return true;
+}
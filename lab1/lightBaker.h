@@ -0,0 +1,68 @@
+#pragma once
+#include "rayTracer.h"
+#include "sceneLayout.h"
+#include "threadPool.h"
+#include "meshgen.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Offline baking of the static lighting (-bake). The texels a receiver covers are found by
+// drawing its triangles in lightmap uv space; every texel then traces shadow rays to the
+// lights and the sun, and cosine-distributed rays for ambient occlusion. The lightmaps are
+// cut into BakeTileSize tiles that the threads of the pool take one at a time, and the gaps
+// between charts are filled from the nearest baked texels so filtering never reads black.
+static const uint32_t BakeTileSize = 16;
+static const uint32_t BakeAoRays = 64;
+static const float BakeAoDistance = 1.5f;
+// Rays start this far off the surface so they don't hit the triangle they leave from
+static const float BakeRayOffset = 2e-3f;
+
+// A mesh drawn into one lightmap slice
+struct LightmapReceiver
+{
+    const MeshVertex* vertices;     // indices are relative to this
+    const XMFLOAT2* lightmapUVs;    // one per vertex
+    const uint32_t* indices;
+    size_t numIndices;
+    XMFLOAT4X4 world;
+    uint32_t slice;
+};
+
+struct LightmapBakeDesc
+{
+    std::vector<LightmapReceiver> receivers;
+    const RayTracer* pOccluders;    // world-space triangles that cast shadows, built
+    std::vector<Light> lights;
+    XMFLOAT3 sunDirection;          // direction the sunlight travels in; zero color for no sun
+    XMFLOAT3 sunColor;
+    uint32_t size;
+    uint32_t numSlices;
+    uint32_t aoRays;
+    float aoDistance;
+};
+
+struct LightmapBakeStats
+{
+    uint64_t texels;                // covered by a receiver
+    uint64_t rays;
+    double seconds;
+};
+
+// texels receives numSlices * size * size values, slice by slice and row by row: rgb is the
+// irradiance from the lights and the sun, a the unoccluded fraction of the hemisphere
+void BakeLightmaps(const LightmapBakeDesc& desc, ThreadPool& pool, std::vector<XMFLOAT4>& texels, LightmapBakeStats* pStats = nullptr);
+
+// Irradiance from the lights and the sun at pos with normal n; the shadow rays start at origin,
+// pos moved BakeRayOffset off the surface. Also used for the bounce light of the probes.
+XMFLOAT3 ComputeDirectIrradiance(const RayTracer& scene, const std::vector<Light>& lights, const XMFLOAT3& sunDirection, const XMFLOAT3& sunColor,
+    const XMFLOAT3& pos, const XMFLOAT3& n, const XMFLOAT3& origin, uint64_t& rays);
+
+// Writes the texels as an R16G16B16A16_FLOAT texture array
+bool WriteLightmapDds(const char* path, const std::vector<XMFLOAT4>& texels, uint32_t size, uint32_t numSlices);
+
+// The -bake mode: the static cube and the model at modelPath (may be empty) go into the
+// LightmapSliceCount slices of output. Progress goes through BenchPrint.
+bool BakeStaticScene(const char* output, const char* modelPath);
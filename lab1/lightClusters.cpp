@@ -0,0 +1,223 @@
+#include "lightClusters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Far edge of the last slice; large but finite so the tile edges through the view axis stay 0
+static const float ClusterMaxZ = 1e6f;
+
+float LightClusters::GetSliceScale() const
+{
+    return ClusterSlices / logf(ClusterFarZ / ClusterNearZ);
+}
+
+float LightClusters::GetSliceBias() const
+{
+    return -(float)ClusterSlices * logf(ClusterNearZ) / logf(ClusterFarZ / ClusterNearZ);
+}
+
+static float _sliceDepth(uint32_t slice)
+{
+    if (slice == 0)
+        return 0.0f;
+    if (slice == ClusterSlices)
+        return ClusterMaxZ;
+    return ClusterNearZ * powf(ClusterFarZ / ClusterNearZ, (float)slice / ClusterSlices);
+}
+
+void LightClusters::LightList::Clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    r.clear();
+    ids.clear();
+}
+
+void LightClusters::LightList::Push(const LightList& source, uint32_t i)
+{
+    x.push_back(source.x[i]);
+    y.push_back(source.y[i]);
+    z.push_back(source.z[i]);
+    r.push_back(source.r[i]);
+    ids.push_back(source.ids[i]);
+}
+
+void LightClusters::LightList::Pad()
+{
+    // Whole vectors can then be loaded; the lanes past Size() are masked off
+    size_t padded = (ids.size() + 3) & ~(size_t)3;
+    x.resize(padded, 0.0f);
+    y.resize(padded, 0.0f);
+    z.resize(padded, 0.0f);
+    r.resize(padded, 0.0f);
+}
+
+// Calls touch(i) for every light of the padded list whose sphere reaches into the box
+template <typename Touch>
+static void _forTouching(const std::vector<float>& xs, const std::vector<float>& ys, const std::vector<float>& zs, const std::vector<float>& rs,
+    uint32_t count, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, Touch touch)
+{
+    __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+    __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+    __m128 zero = _mm_setzero_ps();
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&xs[i]);
+        __m128 y = _mm_loadu_ps(&ys[i]);
+        __m128 z = _mm_loadu_ps(&zs[i]);
+        __m128 r = _mm_loadu_ps(&rs[i]);
+
+        // Squared distance from the center to the box
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmple_ps(dist2, _mm_mul_ps(r, r)));
+        while (mask)
+        {
+            unsigned long bit = 0;
+#ifdef _MSC_VER
+            _BitScanForward(&bit, mask);
+#else
+            bit = __builtin_ctz(mask);
+#endif
+            mask &= mask - 1;
+            if (i + bit < count)
+                touch(i + (uint32_t)bit);
+        }
+    }
+}
+
+void LightClusters::_buildSlice(uint32_t slice, float projScaleX, float projScaleY)
+{
+    Slice& data = _slices[slice];
+    float z0 = _sliceDepth(slice);
+    float z1 = _sliceDepth(slice + 1);
+
+    // Every tile of a slice is inside the box around its far face, so lights are filtered
+    // by slice, then by tile row, before the per-cluster test
+    const LightList& all = _viewLights;
+    data.lights.Clear();
+    _forTouching(all.x, all.y, all.z, all.r, all.Size(),
+        XMFLOAT3(-z1 / projScaleX, -z1 / projScaleY, z0), XMFLOAT3(z1 / projScaleX, z1 / projScaleY, z1),
+        [&](uint32_t i) { data.lights.Push(all, i); });
+    data.lights.Pad();
+
+    data.indices.clear();
+    for (uint32_t ty = 0; ty < ClusterTilesY; ty++)
+    {
+        // Slopes y / z of the tile edges; row 0 is at the top of the screen
+        float top = (1.0f - 2.0f * ty / ClusterTilesY) / projScaleY;
+        float bottom = (1.0f - 2.0f * (ty + 1) / ClusterTilesY) / projScaleY;
+        float minY = (std::min)(bottom * z0, bottom * z1);
+        float maxY = (std::max)(top * z0, top * z1);
+
+        const LightList& lights = data.lights;
+        data.row.Clear();
+        _forTouching(lights.x, lights.y, lights.z, lights.r, lights.Size(),
+            XMFLOAT3(-z1 / projScaleX, minY, z0), XMFLOAT3(z1 / projScaleX, maxY, z1),
+            [&](uint32_t i) { data.row.Push(lights, i); });
+        data.row.Pad();
+
+        const LightList& row = data.row;
+        for (uint32_t tx = 0; tx < ClusterTilesX; tx++)
+        {
+            float left = (-1.0f + 2.0f * tx / ClusterTilesX) / projScaleX;
+            float right = (-1.0f + 2.0f * (tx + 1) / ClusterTilesX) / projScaleX;
+            XMFLOAT3 boxMin((std::min)(left * z0, left * z1), minY, z0);
+            XMFLOAT3 boxMax((std::max)(right * z0, right * z1), maxY, z1);
+
+            ClusterRange& range = _ranges[(slice * ClusterTilesY + ty) * ClusterTilesX + tx];
+            range.offset = (uint32_t)data.indices.size();
+            _forTouching(row.x, row.y, row.z, row.r, row.Size(), boxMin, boxMax,
+                [&](uint32_t i) { data.indices.push_back(row.ids[i]); });
+            range.count = (uint32_t)data.indices.size() - range.offset;
+        }
+    }
+}
+
+void LightClusters::Build(const SphereBounds& lights, FXMMATRIX view, float projScaleX, float projScaleY, ThreadPool* pPool)
+{
+    // World to view space four lights at a time; SphereBounds is padded to 8 lanes
+    uint32_t count = (uint32_t)lights.Size();
+    size_t padded = (count + 3) & ~(size_t)3;
+    _viewLights.x.resize(padded);
+    _viewLights.y.resize(padded);
+    _viewLights.z.resize(padded);
+    _viewLights.r.resize(padded);
+    _viewLights.ids.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        _viewLights.ids[i] = i;
+    _worldLights.x.assign(lights.X(), lights.X() + padded);
+    _worldLights.y.assign(lights.Y(), lights.Y() + padded);
+    _worldLights.z.assign(lights.Z(), lights.Z() + padded);
+    _worldLights.r.assign(lights.R(), lights.R() + padded);
+    _worldLights.ids = _viewLights.ids;
+
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, view);
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(lights.X() + i);
+        __m128 y = _mm_loadu_ps(lights.Y() + i);
+        __m128 z = _mm_loadu_ps(lights.Z() + i);
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.m[0][c])), _mm_mul_ps(y, _mm_set1_ps(m.m[1][c]))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.m[2][c])), _mm_set1_ps(m.m[3][c])));
+            float* target = c == 0 ? _viewLights.x.data() : c == 1 ? _viewLights.y.data() : _viewLights.z.data();
+            _mm_storeu_ps(target + i, v);
+        }
+        _mm_storeu_ps(_viewLights.r.data() + i, _mm_loadu_ps(lights.R() + i));
+    }
+
+    _ranges.resize(ClusterCount);
+    auto job = [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t slice = begin; slice < end; slice++)
+            _buildSlice(slice, projScaleX, projScaleY);
+    };
+    if (pPool)
+        pPool->ParallelFor(ClusterSlices, 1, job);
+    else
+        job(0, ClusterSlices);
+
+    // Slices were built into their own lists; join them and rebase the offsets
+    size_t total = 0;
+    for (const Slice& slice : _slices)
+        total += slice.indices.size();
+    _indices.resize(total);
+
+    uint32_t base = 0;
+    _maxLights = 0;
+    for (uint32_t slice = 0; slice < ClusterSlices; slice++)
+    {
+        const std::vector<uint32_t>& indices = _slices[slice].indices;
+        if (!indices.empty())
+            memcpy(&_indices[base], indices.data(), indices.size() * sizeof(uint32_t));
+
+        ClusterRange* ranges = &_ranges[slice * ClusterTilesX * ClusterTilesY];
+        for (uint32_t i = 0; i < ClusterTilesX * ClusterTilesY; i++)
+        {
+            ranges[i].offset += base;
+            _maxLights = (std::max)(_maxLights, ranges[i].count);
+        }
+        base += (uint32_t)indices.size();
+    }
+}
+
+ClusterRange LightClusters::AddObjectLights(const Aabb& box)
+{
+    const LightList& all = _worldLights;
+    ClusterRange range = { (uint32_t)_indices.size(), 0 };
+    _forTouching(all.x, all.y, all.z, all.r, all.Size(), box.min, box.max,
+        [&](uint32_t i) { _indices.push_back(i); });
+    range.count = (uint32_t)_indices.size() - range.offset;
+    return range;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "culling.h"
+#include "bvh.h"
+#include "threadPool.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Clustered forward shading: the view frustum is cut into screen tiles and exponentially
+// spaced depth slices, and every cluster gets the list of point lights whose range touches
+// it. Pixel shaders find their cluster from SV_POSITION and only loop over that list.
+static const uint32_t ClusterTilesX = 16;
+static const uint32_t ClusterTilesY = 9;
+static const uint32_t ClusterSlices = 24;
+static const uint32_t ClusterCount = ClusterTilesX * ClusterTilesY * ClusterSlices;
+
+// View depths the slices are spread between; the first slice also takes everything nearer
+// and the last everything farther
+static const float ClusterNearZ = 0.1f;
+static const float ClusterFarZ = 100.0f;
+
+// Matches the uint2 of lightClusters in ColorCalc.hlsli
+struct ClusterRange
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+class LightClusters
+{
+public:
+    // lights holds world-space centers and radii; projScaleX and projScaleY are the
+    // x and y scales of the projection (elements 11 and 22)
+    void Build(const SphereBounds& lights, FXMMATRIX view, float projScaleX, float projScaleY, ThreadPool* pPool = nullptr);
+
+    // Appends the lights reaching a world-space box to the index list and returns their run.
+    // Shaders use it instead of the cluster's list when it is shorter. Call after Build.
+    ClusterRange AddObjectLights(const Aabb& box);
+
+    // Cluster (x, y, slice) is at (slice * ClusterTilesY + y) * ClusterTilesX + x, tile row 0 is at the top
+    const std::vector<ClusterRange>& GetRanges() const { return _ranges; }
+    const std::vector<uint32_t>& GetIndices() const { return _indices; }
+    uint32_t GetMaxLightsPerCluster() const { return _maxLights; }
+
+    // slice = floor(log(viewZ) * scale + bias)
+    float GetSliceScale() const;
+    float GetSliceBias() const;
+
+private:
+    // Lights as separate x/y/z/r arrays plus their index in the input
+    struct LightList
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> r;
+        std::vector<uint32_t> ids;
+
+        void Clear();
+        void Push(const LightList& source, uint32_t i);
+        void Pad();
+        uint32_t Size() const { return (uint32_t)ids.size(); }
+    };
+
+    struct Slice
+    {
+        LightList lights;
+        LightList row;
+        std::vector<uint32_t> indices;
+    };
+
+    LightList _worldLights;
+    LightList _viewLights;
+    Slice _slices[ClusterSlices];
+    std::vector<ClusterRange> _ranges;
+    std::vector<uint32_t> _indices;
+    uint32_t _maxLights = 0;
+
+    void _buildSlice(uint32_t slice, float projScaleX, float projScaleY);
+};
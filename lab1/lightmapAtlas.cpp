@@ -0,0 +1,285 @@
+#include "lightmapAtlas.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// Faces join a chart while their normal is within about 37 degrees of the chart's first
+// face, which keeps the projection from folding and the stretch under 25%
+static const float ChartMinCosine = 0.8f;
+
+static const uint32_t NoChart = 0xFFFFFFFF;
+
+static uint64_t _positionKey(const XMFLOAT3& p)
+{
+    uint32_t bits[3];
+    memcpy(bits, &p, sizeof(bits));
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t b : bits)
+        hash = (hash ^ b) * 1099511628211ull;
+    return hash;
+}
+
+void LightmapAtlasBuilder::AddMesh(Mesh& mesh)
+{
+    size_t numTriangles = mesh.indices.size() / 3;
+    size_t numVertices = mesh.vertices.size();
+
+    // Triangles are neighbours when they share an edge by position, so charts run across uv seams
+    std::vector<uint32_t> positionId(numVertices);
+    {
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        buckets.reserve(numVertices);
+        for (uint32_t i = 0; i < numVertices; i++)
+        {
+            std::vector<uint32_t>& bucket = buckets[_positionKey(mesh.vertices[i].pos)];
+            positionId[i] = i;
+            for (uint32_t other : bucket)
+            {
+                if (memcmp(&mesh.vertices[other].pos, &mesh.vertices[i].pos, sizeof(XMFLOAT3)) == 0)
+                {
+                    positionId[i] = other;
+                    break;
+                }
+            }
+            if (positionId[i] == i)
+                bucket.push_back(i);
+        }
+    }
+
+    struct Edge
+    {
+        uint64_t key;
+        uint32_t triangle;
+        bool operator<(const Edge& other) const { return key < other.key || (key == other.key && triangle < other.triangle); }
+    };
+    std::vector<Edge> edges;
+    edges.reserve(numTriangles * 3);
+    for (uint32_t t = 0; t < numTriangles; t++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            uint32_t a = positionId[mesh.indices[t * 3 + corner]], b = positionId[mesh.indices[t * 3 + (corner + 1) % 3]];
+            if (a != b)
+                edges.push_back({ (uint64_t)(std::min)(a, b) << 32 | (std::max)(a, b), t });
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // Neighbour lists in one array, offsets per triangle
+    std::vector<uint32_t> neighbourStart(numTriangles + 1, 0), neighbours;
+    for (size_t i = 0, j; i < edges.size(); i = j)
+    {
+        for (j = i + 1; j < edges.size() && edges[j].key == edges[i].key; j++);
+        for (size_t a = i; a < j; a++)
+            neighbourStart[edges[a].triangle + 1] += (uint32_t)(j - i - 1);
+    }
+    for (size_t t = 0; t < numTriangles; t++)
+        neighbourStart[t + 1] += neighbourStart[t];
+    neighbours.resize(neighbourStart[numTriangles]);
+    {
+        std::vector<uint32_t> fill(neighbourStart.begin(), neighbourStart.end() - 1);
+        for (size_t i = 0, j; i < edges.size(); i = j)
+        {
+            for (j = i + 1; j < edges.size() && edges[j].key == edges[i].key; j++);
+            for (size_t a = i; a < j; a++)
+            {
+                for (size_t b = i; b < j; b++)
+                {
+                    if (a != b)
+                        neighbours[fill[edges[a].triangle]++] = edges[b].triangle;
+                }
+            }
+        }
+    }
+
+    std::vector<XMFLOAT3> faceNormals(numTriangles);
+    for (size_t t = 0; t < numTriangles; t++)
+    {
+        XMVECTOR p0 = XMLoadFloat3(&mesh.vertices[mesh.indices[t * 3]].pos);
+        XMVECTOR p1 = XMLoadFloat3(&mesh.vertices[mesh.indices[t * 3 + 1]].pos);
+        XMVECTOR p2 = XMLoadFloat3(&mesh.vertices[mesh.indices[t * 3 + 2]].pos);
+        XMStoreFloat3(&faceNormals[t], XMVector3Normalize(XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0))));
+    }
+
+    // Grow charts breadth first from the lowest unassigned triangle
+    uint32_t firstChart = (uint32_t)_charts.size();
+    std::vector<uint32_t> triangleChart(numTriangles, NoChart);
+    std::vector<XMFLOAT3> chartAxes;
+    std::vector<uint32_t> queue;
+    for (uint32_t seed = 0; seed < numTriangles; seed++)
+    {
+        if (triangleChart[seed] != NoChart)
+            continue;
+
+        uint32_t chart = (uint32_t)chartAxes.size();
+        XMFLOAT3 axis = faceNormals[seed];
+        if (axis.x * axis.x + axis.y * axis.y + axis.z * axis.z < 0.5f)
+            axis = XMFLOAT3(0.0f, 1.0f, 0.0f); // degenerate seed
+        chartAxes.push_back(axis);
+
+        triangleChart[seed] = chart;
+        queue.assign(1, seed);
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            uint32_t t = queue[head];
+            for (uint32_t i = neighbourStart[t]; i < neighbourStart[t + 1]; i++)
+            {
+                uint32_t n = neighbours[i];
+                const XMFLOAT3& normal = faceNormals[n];
+                if (triangleChart[n] != NoChart || normal.x * axis.x + normal.y * axis.y + normal.z * axis.z < ChartMinCosine)
+                    continue;
+                triangleChart[n] = chart;
+                queue.push_back(n);
+            }
+        }
+    }
+
+    // Every vertex belongs to one chart; corners of triangles in other charts get copies
+    std::vector<uint32_t> vertexChart(numVertices, NoChart);
+    std::unordered_map<uint64_t, uint32_t> copies;
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        uint32_t chart = triangleChart[i / 3];
+        uint32_t vertex = mesh.indices[i];
+        if (vertexChart[vertex] == NoChart)
+        {
+            vertexChart[vertex] = chart;
+            continue;
+        }
+        if (vertexChart[vertex] == chart)
+            continue;
+
+        uint64_t key = (uint64_t)vertex << 32 | chart;
+        auto found = copies.find(key);
+        if (found == copies.end())
+        {
+            found = copies.emplace(key, (uint32_t)mesh.vertices.size()).first;
+            MeshVertex copy = mesh.vertices[vertex];
+            mesh.vertices.push_back(copy);
+            vertexChart.push_back(chart);
+        }
+        mesh.indices[i] = found->second;
+    }
+
+    _charts.resize(firstChart + chartAxes.size());
+    for (size_t c = firstChart; c < _charts.size(); c++)
+    {
+        _charts[c].min = XMFLOAT2(FLT_MAX, FLT_MAX);
+        _charts[c].max = XMFLOAT2(-FLT_MAX, -FLT_MAX);
+        _charts[c].rotated = false;
+        _charts[c].x = _charts[c].y = 0;
+    }
+
+    size_t firstVertex = _uvs.size();
+    _uvs.resize(firstVertex + mesh.vertices.size());
+    _chartOf.resize(firstVertex + mesh.vertices.size());
+    for (size_t v = 0; v < mesh.vertices.size(); v++)
+    {
+        uint32_t chart = vertexChart[v];
+        if (chart == NoChart)
+        {
+            // Not used by any triangle
+            _chartOf[firstVertex + v] = NoChart;
+            _uvs[firstVertex + v] = XMFLOAT2(0.0f, 0.0f);
+            continue;
+        }
+
+        // Planar coordinates in the plane of the chart's axis
+        XMVECTOR axis = XMLoadFloat3(&chartAxes[chart]);
+        XMVECTOR up = fabsf(chartAxes[chart].y) < 0.99f ? XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f) : XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+        XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(up, axis));
+        XMVECTOR bitangent = XMVector3Cross(axis, tangent);
+        XMVECTOR pos = XMLoadFloat3(&mesh.vertices[v].pos);
+        XMFLOAT2 uv(XMVectorGetX(XMVector3Dot(pos, tangent)), XMVectorGetX(XMVector3Dot(pos, bitangent)));
+
+        Chart& c = _charts[firstChart + chart];
+        c.min = XMFLOAT2((std::min)(c.min.x, uv.x), (std::min)(c.min.y, uv.y));
+        c.max = XMFLOAT2((std::max)(c.max.x, uv.x), (std::max)(c.max.y, uv.y));
+        _chartOf[firstVertex + v] = firstChart + chart;
+        _uvs[firstVertex + v] = uv;
+    }
+}
+
+bool LightmapAtlasBuilder::_place(float density, uint32_t size, uint32_t padding, const std::vector<uint32_t>& order)
+{
+    // Shelves filled left to right, tallest charts first
+    uint32_t x = 0, y = 0, shelf = 0;
+    for (uint32_t c : order)
+    {
+        Chart& chart = _charts[c];
+        float w = chart.rotated ? chart.max.y - chart.min.y : chart.max.x - chart.min.x;
+        float h = chart.rotated ? chart.max.x - chart.min.x : chart.max.y - chart.min.y;
+        uint32_t width = (uint32_t)ceilf(w * density) + 1 + 2 * padding;
+        uint32_t height = (uint32_t)ceilf(h * density) + 1 + 2 * padding;
+        if (x + width > size)
+        {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if (x + width > size || y + height > size)
+            return false;
+        chart.x = x + padding;
+        chart.y = y + padding;
+        x += width;
+        shelf = (std::max)(shelf, height);
+    }
+    return true;
+}
+
+bool LightmapAtlasBuilder::Pack(uint32_t size, uint32_t padding)
+{
+    double area = 0.0;
+    for (Chart& chart : _charts)
+    {
+        if (chart.min.x > chart.max.x)
+            chart.min = chart.max = XMFLOAT2(0.0f, 0.0f);
+        chart.rotated = chart.max.y - chart.min.y > chart.max.x - chart.min.x;
+        area += (double)(chart.max.x - chart.min.x) * (chart.max.y - chart.min.y);
+    }
+
+    std::vector<uint32_t> order(_charts.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            const Chart& ca = _charts[a];
+            const Chart& cb = _charts[b];
+            float ha = ca.rotated ? ca.max.x - ca.min.x : ca.max.y - ca.min.y;
+            float hb = cb.rotated ? cb.max.x - cb.min.x : cb.max.y - cb.min.y;
+            return ha > hb;
+        });
+
+    // The largest density that packs, between nothing and the one filling the atlas exactly
+    float lo = 0.0f, hi = (float)(size / sqrt((std::max)(area, 1e-12)));
+    if (!_place(lo, size, padding, order))
+        return false;
+    for (int i = 0; i < 24; i++)
+    {
+        float mid = (lo + hi) * 0.5f;
+        if (_place(mid, size, padding, order))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    _density = lo;
+    _place(_density, size, padding, order);
+
+    // Texel centers sit at half-integers, charts start half a texel in
+    for (size_t v = 0; v < _uvs.size(); v++)
+    {
+        if (_chartOf[v] == NoChart)
+        {
+            _uvs[v] = XMFLOAT2(0.0f, 0.0f);
+            continue;
+        }
+        const Chart& chart = _charts[_chartOf[v]];
+        float u = (_uvs[v].x - chart.min.x) * _density, w = (_uvs[v].y - chart.min.y) * _density;
+        if (chart.rotated)
+            std::swap(u, w);
+        _uvs[v] = XMFLOAT2((chart.x + 0.5f + u) / size, (chart.y + 0.5f + w) / size);
+    }
+    return true;
+}
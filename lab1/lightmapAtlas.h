@@ -0,0 +1,48 @@
+#pragma once
+#include "meshgen.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Lightmaps are square; every chart keeps LightmapPadding texels free around it so bilinear
+// filtering and the dilation of the baked texels stay inside the chart's own area
+static const uint32_t LightmapSize = 1024;
+static const uint32_t LightmapPadding = 2;
+
+// Second uv set for lightmaps. AddMesh cuts a mesh into charts whose triangles face roughly the
+// same way as the chart's first one, projects each chart onto that triangle's plane
+// and duplicates the vertices on chart borders. Pack then lays the charts of every added mesh
+// out in one atlas at a single texel density, as large as fits. The result only depends on
+// the meshes, so the renderer and the baker get the same uvs from the same geometry.
+class LightmapAtlasBuilder
+{
+public:
+    // The mesh may gain vertices; their uvs are appended after the ones of earlier meshes
+    void AddMesh(Mesh& mesh);
+    // Call once after the last AddMesh; false when the charts don't fit even at the smallest density
+    bool Pack(uint32_t size = LightmapSize, uint32_t padding = LightmapPadding);
+
+    // One uv per vertex of the added meshes, in the order they were added
+    const std::vector<XMFLOAT2>& GetUVs() const { return _uvs; }
+    uint32_t GetChartCount() const { return (uint32_t)_charts.size(); }
+    // Texels per mesh unit chosen by Pack
+    float GetDensity() const { return _density; }
+
+private:
+    struct Chart
+    {
+        XMFLOAT2 min;
+        XMFLOAT2 max;
+        bool rotated;       // laid out with x and y swapped so it is wider than tall
+        uint32_t x, y;      // texel position of the corner after Pack
+    };
+
+    std::vector<XMFLOAT2> _uvs;         // planar coordinates in mesh units until Pack
+    std::vector<uint32_t> _chartOf;     // per vertex
+    std::vector<Chart> _charts;
+    float _density = 0.0f;
+
+    bool _place(float density, uint32_t size, uint32_t padding, const std::vector<uint32_t>& order);
+};
@@ -0,0 +1,27 @@
+#include "lod.h"
+#include <cmath>
+
+float ProjectedSize(float radius, float distance, float viewportHeight, float fovY)
+{
+    if (distance <= radius)
+        return viewportHeight;
+    return radius * viewportHeight / (distance * tanf(fovY * 0.5f));
+}
+
+uint32_t SelectLod(float projectedSize, uint32_t current, const float* minSizes, uint32_t numLods, float hysteresis)
+{
+    if (current >= numLods)
+    {
+        uint32_t lod = 0;
+        while (lod + 1 < numLods && projectedSize < minSizes[lod])
+            lod++;
+        return lod;
+    }
+
+    uint32_t lod = current;
+    while (lod > 0 && projectedSize >= minSizes[lod - 1] * (1.0f + hysteresis))
+        lod--;
+    while (lod + 1 < numLods && projectedSize < minSizes[lod] * (1.0f - hysteresis))
+        lod++;
+    return lod;
+}
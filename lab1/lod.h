@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+// One level of a mesh packed with its other levels into shared vertex and index buffers
+struct MeshLod
+{
+    uint32_t startIndex;
+    uint32_t indexCount;
+    int32_t baseVertex;
+};
+
+// Height in pixels of a sphere of the given radius seen from `distance` away
+float ProjectedSize(float radius, float distance, float viewportHeight, float fovY);
+
+// minSizes[i] is the smallest projected size level i is meant for (finest level first,
+// the last entry is normally 0). A level only changes once the size is past the
+// threshold by the hysteresis fraction, so objects sitting on a boundary don't pop.
+// Pass current >= numLods to select without hysteresis.
+uint32_t SelectLod(float projectedSize, uint32_t current, const float* minSizes, uint32_t numLods, float hysteresis);
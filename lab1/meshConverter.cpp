@@ -0,0 +1,126 @@
+#include "meshConverter.h"
+#include "meshFile.h"
+#include "meshgen.h"
+#include "meshImport.h"
+#include "lightmapAtlas.h"
+#include "benchmark.h"
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#include <chrono>
+
+// Appends a mesh as the next LOD of the last submesh. Every LOD gets its own lightmap charts;
+// the vertices they duplicate go after the optimized ones.
+static void _appendLod(MeshFileData& data, Mesh& mesh, float minPixels, LightmapAtlasBuilder& atlas)
+{
+    OptimizeMesh(mesh);
+    atlas.AddMesh(mesh);
+
+    MeshFileLod lod;
+    lod.range.startIndex = (uint32_t)data.indices.size();
+    lod.range.indexCount = (uint32_t)mesh.indices.size();
+    lod.range.baseVertex = (int32_t)data.vertices.size();
+    lod.minPixels = minPixels;
+    data.lods.push_back(lod);
+
+    data.vertices.insert(data.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    data.indices.insert(data.indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+    MeshFileSubmesh& submesh = data.submeshes.back();
+    submesh.numLods++;
+    for (const MeshVertex& v : mesh.vertices)
+    {
+        submesh.bounds.min = XMFLOAT3((std::min)(submesh.bounds.min.x, v.pos.x), (std::min)(submesh.bounds.min.y, v.pos.y), (std::min)(submesh.bounds.min.z, v.pos.z));
+        submesh.bounds.max = XMFLOAT3((std::max)(submesh.bounds.max.x, v.pos.x), (std::max)(submesh.bounds.max.y, v.pos.y), (std::max)(submesh.bounds.max.z, v.pos.z));
+    }
+}
+
+static void _beginSubmesh(MeshFileData& data, uint32_t material)
+{
+    MeshFileSubmesh submesh = {};
+    submesh.firstLod = (uint32_t)data.lods.size();
+    submesh.material = material;
+    submesh.bounds = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    data.submeshes.push_back(submesh);
+}
+
+static bool _generate(const char* name, MeshFileData& data, LightmapAtlasBuilder& atlas)
+{
+    // Each level halves the tessellation of the previous one
+    static const float MinPixels[] = { 256.0f, 96.0f, 32.0f, 0.0f };
+    const uint32_t numLods = sizeof(MinPixels) / sizeof(MinPixels[0]);
+
+    _beginSubmesh(data, 0);
+    for (uint32_t lod = 0; lod < numLods; lod++)
+    {
+        uint32_t detail = 64 >> lod;
+        Mesh mesh;
+        if (strcmp(name, "sphere") == 0)
+            mesh = GenerateUVSphere(detail, detail * 2);
+        else if (strcmp(name, "icosphere") == 0)
+            mesh = GenerateIcosphere(5 - lod);
+        else if (strcmp(name, "plane") == 0)
+            mesh = GeneratePlane(detail, detail, 2.0f);
+        else if (strcmp(name, "torus") == 0)
+            mesh = GenerateTorus(detail * 2, detail, 1.0f, 0.3f);
+        else if (strcmp(name, "cube") == 0)
+            mesh = GenerateCube();
+        else
+            return false;
+
+        _appendLod(data, mesh, MinPixels[lod], atlas);
+        if (strcmp(name, "cube") == 0)
+            break; // nothing to simplify
+    }
+    return true;
+}
+
+// OBJ and glTF files have no simplified levels, they are written as a single LOD
+static bool _import(const char* path, MeshFileData& data, LightmapAtlasBuilder& atlas)
+{
+    ThreadPool pool;
+    pool.Init();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Mesh mesh;
+    uint64_t bytesRead = 0;
+    if (!ImportMesh(path, mesh, &pool, &bytesRead))
+        return false;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    BenchPrint("meshconv: imported %s, %.1f MB in %.2f ms, %.1f MB/s\n", path, bytesRead / 1e6, seconds * 1e3,
+        bytesRead / 1e6 / (std::max)(seconds, 1e-9));
+
+    _beginSubmesh(data, 0);
+    _appendLod(data, mesh, 0.0f, atlas);
+    return true;
+}
+
+bool ConvertMesh(const char* input, const char* output, bool packed)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    MeshFileData data;
+    LightmapAtlasBuilder atlas;
+    if (IsImportableMesh(input) ? !_import(input, data, atlas) : !_generate(input, data, atlas))
+    {
+        BenchPrint("meshconv: can't read input '%s'\n", input);
+        return false;
+    }
+    if (!atlas.Pack())
+    {
+        BenchPrint("meshconv: %u lightmap charts don't fit a %u texel atlas\n", atlas.GetChartCount(), LightmapSize);
+        return false;
+    }
+    data.lightmapUVs = atlas.GetUVs();
+    if (!WriteMeshFile(output, data, packed))
+    {
+        BenchPrint("meshconv: can't write '%s'\n", output);
+        return false;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    BenchPrint("meshconv: %s -> %s, %zu vertices (%s), %zu indices, %zu submeshes, %zu lods, %u lightmap charts at %.1f texels per unit, %.2f ms\n",
+        input, output, data.vertices.size(), packed ? "packed" : "float", data.indices.size(),
+        data.submeshes.size(), data.lods.size(), atlas.GetChartCount(), atlas.GetDensity(), ms);
+    return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Offline conversion to the binary mesh format (-meshconv <input> <output> [-float]).
+// The input is an .obj, .gltf or .glb file, or the name of a procedural mesh (sphere,
+// icosphere, cube, plane, torus), which is written with a chain of LODs. Progress goes
+// through BenchPrint.
+bool ConvertMesh(const char* input, const char* output, bool packed);
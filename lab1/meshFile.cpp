@@ -0,0 +1,232 @@
+#include "meshFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t _align(uint64_t offset)
+{
+    return (offset + MeshFileAlignment - 1) / MeshFileAlignment * MeshFileAlignment;
+}
+
+static bool _writeAt(FILE* pFile, uint64_t& position, uint64_t offset, const void* data, size_t size)
+{
+    static const uint8_t Zeros[MeshFileAlignment] = {};
+    while (position < offset)
+    {
+        size_t pad = (size_t)(offset - position) < sizeof(Zeros) ? (size_t)(offset - position) : sizeof(Zeros);
+        if (fwrite(Zeros, 1, pad, pFile) != pad)
+            return false;
+        position += pad;
+    }
+    if (size > 0 && fwrite(data, 1, size, pFile) != size)
+        return false;
+    position += size;
+    return true;
+}
+
+bool WriteMeshFile(const char* path, const MeshFileData& data, bool packed)
+{
+    MeshFileHeader header = {};
+    header.magic = MeshFileMagic;
+    header.version = MeshFileVersion;
+    header.vertexFormat = packed ? MeshFileVertexFormat_Packed : MeshFileVertexFormat_Float;
+    header.vertexStride = packed ? sizeof(PackedVertex) : sizeof(MeshVertex);
+    header.numVertices = (uint32_t)data.vertices.size();
+    header.numIndices = (uint32_t)data.indices.size();
+    header.numSubmeshes = (uint32_t)data.submeshes.size();
+    header.numLods = (uint32_t)data.lods.size();
+
+    uint32_t maxIndex = 0;
+    for (uint32_t index : data.indices)
+        maxIndex = index > maxIndex ? index : maxIndex;
+    header.indexSize = maxIndex <= 0xFFFF ? 2 : 4;
+
+    header.bounds = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    for (const MeshFileSubmesh& submesh : data.submeshes)
+    {
+        header.bounds.min = XMFLOAT3((std::min)(header.bounds.min.x, submesh.bounds.min.x), (std::min)(header.bounds.min.y, submesh.bounds.min.y), (std::min)(header.bounds.min.z, submesh.bounds.min.z));
+        header.bounds.max = XMFLOAT3((std::max)(header.bounds.max.x, submesh.bounds.max.x), (std::max)(header.bounds.max.y, submesh.bounds.max.y), (std::max)(header.bounds.max.z, submesh.bounds.max.z));
+    }
+    header.quantization = ComputePositionQuantization(data.vertices.data(), data.vertices.size());
+
+    header.vertexOffset = _align(sizeof(MeshFileHeader));
+    header.indexOffset = _align(header.vertexOffset + (uint64_t)header.numVertices * header.vertexStride);
+    header.submeshOffset = _align(header.indexOffset + (uint64_t)header.numIndices * header.indexSize);
+    header.lodOffset = _align(header.submeshOffset + header.numSubmeshes * sizeof(MeshFileSubmesh));
+    header.lightmapOffset = _align(header.lodOffset + header.numLods * sizeof(MeshFileLod));
+    header.fileSize = header.lightmapOffset + (uint64_t)header.numVertices * sizeof(XMUSHORTN2);
+
+    std::vector<uint8_t> vertexBlob((size_t)header.numVertices * header.vertexStride);
+    if (packed)
+        PackVertices(data.vertices.data(), data.vertices.size(), header.quantization, reinterpret_cast<PackedVertex*>(vertexBlob.data()));
+    else if (!data.vertices.empty())
+        memcpy(vertexBlob.data(), data.vertices.data(), vertexBlob.size());
+
+    std::vector<uint8_t> indexBlob((size_t)header.numIndices * header.indexSize);
+    if (header.indexSize == 2)
+    {
+        for (size_t i = 0; i < data.indices.size(); i++)
+            reinterpret_cast<uint16_t*>(indexBlob.data())[i] = (uint16_t)data.indices[i];
+    }
+    else if (!data.indices.empty())
+    {
+        memcpy(indexBlob.data(), data.indices.data(), indexBlob.size());
+    }
+
+    // Meshes without lightmap uvs get zeros
+    std::vector<XMUSHORTN2> lightmapBlob(header.numVertices, XMUSHORTN2(0.0f, 0.0f));
+    for (size_t i = 0; i < data.lightmapUVs.size() && i < lightmapBlob.size(); i++)
+        lightmapBlob[i] = XMUSHORTN2(data.lightmapUVs[i].x, data.lightmapUVs[i].y);
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (!pFile)
+        return false;
+
+    uint64_t position = 0;
+    bool ok = _writeAt(pFile, position, 0, &header, sizeof(header))
+        && _writeAt(pFile, position, header.vertexOffset, vertexBlob.data(), vertexBlob.size())
+        && _writeAt(pFile, position, header.indexOffset, indexBlob.data(), indexBlob.size())
+        && _writeAt(pFile, position, header.submeshOffset, data.submeshes.data(), data.submeshes.size() * sizeof(MeshFileSubmesh))
+        && _writeAt(pFile, position, header.lodOffset, data.lods.data(), data.lods.size() * sizeof(MeshFileLod))
+        && _writeAt(pFile, position, header.lightmapOffset, lightmapBlob.data(), lightmapBlob.size() * sizeof(XMUSHORTN2));
+    ok = fclose(pFile) == 0 && ok;
+    return ok;
+}
+
+bool MeshFile::Open(const char* path)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    _hFile = hFile;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+    _size = (uint64_t)size.QuadPart;
+
+    _hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_hMapping)
+        _pData = (const uint8_t*)MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    _fd = open(path, O_RDONLY);
+    if (_fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(_fd, &info) != 0 || info.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+    _size = (uint64_t)info.st_size;
+
+    void* pData = mmap(nullptr, (size_t)_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (pData != MAP_FAILED)
+        _pData = (const uint8_t*)pData;
+#endif
+
+    if (!_pData || !_validate())
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::Close()
+{
+#ifdef _WIN32
+    if (_pData)
+        UnmapViewOfFile(_pData);
+    if (_hMapping)
+        CloseHandle(_hMapping);
+    if (_hFile)
+        CloseHandle(_hFile);
+    _hMapping = nullptr;
+    _hFile = nullptr;
+#else
+    if (_pData)
+        munmap((void*)_pData, (size_t)_size);
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+#endif
+    _pData = nullptr;
+    _size = 0;
+}
+
+bool MeshFile::_validate() const
+{
+    if (_size < sizeof(MeshFileHeader))
+        return false;
+
+    const MeshFileHeader& header = GetHeader();
+    if (header.magic != MeshFileMagic || header.version != MeshFileVersion || header.fileSize > _size)
+        return false;
+
+    uint32_t stride = header.vertexFormat == MeshFileVertexFormat_Packed ? sizeof(PackedVertex) : sizeof(MeshVertex);
+    if (header.vertexFormat > MeshFileVertexFormat_Packed || header.vertexStride != stride)
+        return false;
+    if (header.indexSize != 2 && header.indexSize != 4)
+        return false;
+
+    auto inside = [&](uint64_t offset, uint64_t size)
+    {
+        return offset % MeshFileAlignment == 0 && offset <= _size && size <= _size - offset;
+    };
+    if (!inside(header.vertexOffset, (uint64_t)header.numVertices * header.vertexStride)
+        || !inside(header.indexOffset, (uint64_t)header.numIndices * header.indexSize)
+        || !inside(header.submeshOffset, (uint64_t)header.numSubmeshes * sizeof(MeshFileSubmesh))
+        || !inside(header.lodOffset, (uint64_t)header.numLods * sizeof(MeshFileLod))
+        || !inside(header.lightmapOffset, (uint64_t)header.numVertices * sizeof(XMUSHORTN2)))
+        return false;
+
+    // Draw ranges must stay inside the buffers so a bad file can't make the GPU read past them
+    const MeshFileSubmesh* submeshes = GetSubmeshes();
+    for (uint32_t i = 0; i < header.numSubmeshes; i++)
+    {
+        // The renderer always draws one of a submesh's LODs, so it needs at least one
+        if (submeshes[i].numLods == 0 || submeshes[i].firstLod > header.numLods
+            || submeshes[i].numLods > header.numLods - submeshes[i].firstLod)
+            return false;
+    }
+    const MeshFileLod* lods = GetLods();
+    for (uint32_t i = 0; i < header.numLods; i++)
+    {
+        const MeshLod& range = lods[i].range;
+        if (range.startIndex > header.numIndices || range.indexCount > header.numIndices - range.startIndex
+            || range.baseVertex < 0 || (uint32_t)range.baseVertex > header.numVertices)
+            return false;
+
+        // Every vertex the range fetches, baseVertex + index, must exist too
+        uint32_t available = header.numVertices - (uint32_t)range.baseVertex;
+        for (uint32_t j = range.startIndex; j < range.startIndex + range.indexCount; j++)
+        {
+            uint32_t index = header.indexSize == 2 ? static_cast<const uint16_t*>(GetIndices())[j] : static_cast<const uint32_t*>(GetIndices())[j];
+            if (index >= available)
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "bvh.h"
+#include "lod.h"
+#include "vertexFormat.h"
+
+// Binary mesh file, version 2. A header followed by blobs that each start on a
+// MeshFileAlignment boundary, so the vertex and index data can be handed to the GPU
+// straight from a memory mapping of the file:
+//   MeshFileHeader | vertices | indices | MeshFileSubmesh[] | MeshFileLod[] | lightmap uvs
+// Version 2 added the lightmap uvs, one UNORM16 pair per vertex in their own vertex stream.
+static const uint32_t MeshFileMagic = 0x4853454D; // "MESH"
+static const uint32_t MeshFileVersion = 2;
+static const uint32_t MeshFileAlignment = 64;
+
+enum MeshFileVertexFormat : uint32_t
+{
+    MeshFileVertexFormat_Float = 0,     // MeshVertex
+    MeshFileVertexFormat_Packed = 1     // PackedVertex, decoded with the header quantization
+};
+
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexFormat;
+    uint32_t vertexStride;
+    uint32_t indexSize;         // 2 or 4 bytes
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint32_t numSubmeshes;
+    uint32_t numLods;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t submeshOffset;
+    uint64_t lodOffset;
+    uint64_t lightmapOffset;
+    uint64_t fileSize;
+    Aabb bounds;
+    PositionQuantization quantization;
+};
+
+// A part of the mesh with its own material; its LODs are lods[firstLod .. firstLod + numLods), finest first
+struct MeshFileSubmesh
+{
+    uint32_t firstLod;
+    uint32_t numLods;
+    uint32_t material;
+    uint32_t reserved;
+    Aabb bounds;
+};
+
+struct MeshFileLod
+{
+    MeshLod range;              // indices are relative to range.baseVertex
+    float minPixels;            // smallest projected height the level is meant for
+};
+
+struct MeshFileData
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshFileSubmesh> submeshes;
+    std::vector<MeshFileLod> lods;
+    std::vector<XMFLOAT2> lightmapUVs;  // per vertex, or empty for none
+};
+
+// Index size is picked from the largest index; packed selects PackedVertex for the vertex blob
+bool WriteMeshFile(const char* path, const MeshFileData& data, bool packed);
+
+// Read-only view of a mapped mesh file. Open validates the header and every range against
+// the file size, and every index against the vertex count; the pointers stay valid until Close.
+class MeshFile
+{
+public:
+    MeshFile() = default;
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+    ~MeshFile() { Close(); }
+
+    bool Open(const char* path);
+    void Close();
+
+    const MeshFileHeader& GetHeader() const { return *reinterpret_cast<const MeshFileHeader*>(_pData); }
+    const void* GetVertices() const { return _pData + GetHeader().vertexOffset; }
+    const void* GetIndices() const { return _pData + GetHeader().indexOffset; }
+    const MeshFileSubmesh* GetSubmeshes() const { return reinterpret_cast<const MeshFileSubmesh*>(_pData + GetHeader().submeshOffset); }
+    const MeshFileLod* GetLods() const { return reinterpret_cast<const MeshFileLod*>(_pData + GetHeader().lodOffset); }
+    const XMUSHORTN2* GetLightmapUVs() const { return reinterpret_cast<const XMUSHORTN2*>(_pData + GetHeader().lightmapOffset); }
+
+private:
+    const uint8_t* _pData = nullptr;
+    uint64_t _size = 0;
+#ifdef _WIN32
+    void* _hFile = nullptr;
+    void* _hMapping = nullptr;
+#else
+    int _fd = -1;
+#endif
+
+    bool _validate() const;
+};
@@ -0,0 +1,1101 @@
+#include "meshImport.h"
+#include "json.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <cctype>
+#include <atomic>
+#include <string>
+
+static void _parallelFor(ThreadPool* pPool, uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& job)
+{
+    if (pPool)
+        pPool->ParallelFor(count, grain, job);
+    else if (count > 0)
+        job(0, count);
+}
+
+static bool _readFile(const char* path, std::vector<char>& data)
+{
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "rb");
+#else
+    pFile = fopen(path, "rb");
+#endif
+    if (!pFile)
+        return false;
+
+#ifdef _WIN32
+    _fseeki64(pFile, 0, SEEK_END);
+    long long size = _ftelli64(pFile);
+    _fseeki64(pFile, 0, SEEK_SET);
+#else
+    fseek(pFile, 0, SEEK_END);
+    long long size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+#endif
+    bool result = size >= 0;
+    if (result)
+    {
+        data.resize((size_t)size);
+        result = fread(data.data(), 1, data.size(), pFile) == data.size();
+    }
+    fclose(pFile);
+    return result;
+}
+
+static XMFLOAT3 _normalize(const XMFLOAT3& v)
+{
+    XMFLOAT3 result;
+    XMStoreFloat3(&result, XMVector3Normalize(XMLoadFloat3(&v)));
+    return result;
+}
+
+//-----------Welding and tangent space-------------
+static uint32_t _hashBytes(const void* data, size_t size)
+{
+    // FNV-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static const uint32_t DedupEmpty = 0xFFFFFFFF;
+
+// Open addressing table of vertex ids for deduplication. hash(id) and equal(id, id) are
+// supplied by the caller, so the keys themselves live in the caller's arrays.
+class DedupTable
+{
+public:
+    explicit DedupTable(size_t expected)
+    {
+        size_t size = 16;
+        while (size < expected * 2)
+            size *= 2;
+        _slots.assign(size, DedupEmpty);
+    }
+
+    // Returns the id already stored for an equal key, or stores and returns `id`
+    template<typename Hash, typename Equal>
+    uint32_t Insert(uint32_t id, Hash hash, Equal equal)
+    {
+        if ((_count + 1) * 2 > _slots.size())
+            _grow(hash);
+
+        size_t mask = _slots.size() - 1;
+        for (size_t slot = hash(id) & mask;; slot = (slot + 1) & mask)
+        {
+            if (_slots[slot] == DedupEmpty)
+            {
+                _slots[slot] = id;
+                _count++;
+                return id;
+            }
+            if (equal(_slots[slot], id))
+                return _slots[slot];
+        }
+    }
+
+private:
+    std::vector<uint32_t> _slots;
+    size_t _count = 0;
+
+    template<typename Hash>
+    void _grow(Hash hash)
+    {
+        std::vector<uint32_t> old;
+        old.swap(_slots);
+        _slots.assign(old.size() * 2, DedupEmpty);
+        size_t mask = _slots.size() - 1;
+        for (uint32_t id : old)
+        {
+            if (id == DedupEmpty)
+                continue;
+            size_t slot = hash(id) & mask;
+            while (_slots[slot] != DedupEmpty)
+                slot = (slot + 1) & mask;
+            _slots[slot] = id;
+        }
+    }
+};
+
+void WeldVertices(Mesh& mesh)
+{
+    const std::vector<MeshVertex>& vertices = mesh.vertices;
+    std::vector<uint32_t> remap(vertices.size());
+    std::vector<MeshVertex> welded;
+    welded.reserve(vertices.size());
+
+    DedupTable table(vertices.size());
+    auto hash = [&](uint32_t id) { return _hashBytes(&vertices[id], sizeof(MeshVertex)); };
+    auto equal = [&](uint32_t a, uint32_t b) { return memcmp(&vertices[a], &vertices[b], sizeof(MeshVertex)) == 0; };
+    std::vector<uint32_t> newIndex(vertices.size());
+    for (uint32_t i = 0; i < (uint32_t)vertices.size(); i++)
+    {
+        uint32_t first = table.Insert(i, hash, equal);
+        if (first == i)
+        {
+            newIndex[i] = (uint32_t)welded.size();
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = newIndex[first];
+    }
+
+    for (uint32_t& index : mesh.indices)
+        index = remap[index];
+    mesh.vertices.swap(welded);
+}
+
+void GenerateNormals(Mesh& mesh)
+{
+    std::vector<XMFLOAT3> sums(mesh.vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const uint32_t* tri = &mesh.indices[i];
+        XMVECTOR p0 = XMLoadFloat3(&mesh.vertices[tri[0]].pos);
+        XMVECTOR p1 = XMLoadFloat3(&mesh.vertices[tri[1]].pos);
+        XMVECTOR p2 = XMLoadFloat3(&mesh.vertices[tri[2]].pos);
+        // Clockwise front faces: the unnormalized cross product points outward and is twice the area
+        XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+        for (int k = 0; k < 3; k++)
+            XMStoreFloat3(&sums[tri[k]], XMVectorAdd(XMLoadFloat3(&sums[tri[k]]), normal));
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+        mesh.vertices[i].normal = _normalize(sums[i]);
+}
+
+void GenerateTangents(Mesh& mesh)
+{
+    std::vector<XMFLOAT3> sums(mesh.vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const uint32_t* tri = &mesh.indices[i];
+        const MeshVertex& v0 = mesh.vertices[tri[0]];
+        const MeshVertex& v1 = mesh.vertices[tri[1]];
+        const MeshVertex& v2 = mesh.vertices[tri[2]];
+
+        float du1 = v1.uv.x - v0.uv.x, dv1 = v1.uv.y - v0.uv.y;
+        float du2 = v2.uv.x - v0.uv.x, dv2 = v2.uv.y - v0.uv.y;
+        float det = du1 * dv2 - du2 * dv1;
+        if (fabsf(det) < 1e-12f)
+            continue;
+
+        // dP/du from the two edges
+        XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&v1.pos), XMLoadFloat3(&v0.pos));
+        XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&v2.pos), XMLoadFloat3(&v0.pos));
+        XMVECTOR tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1)), 1.0f / det);
+        for (int k = 0; k < 3; k++)
+            XMStoreFloat3(&sums[tri[k]], XMVectorAdd(XMLoadFloat3(&sums[tri[k]]), tangent));
+    }
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        // Gram-Schmidt against the normal; without uv gradient any perpendicular will do
+        XMVECTOR normal = XMLoadFloat3(&mesh.vertices[i].normal);
+        XMVECTOR tangent = XMLoadFloat3(&sums[i]);
+        tangent = XMVectorSubtract(tangent, XMVectorScale(normal, XMVectorGetX(XMVector3Dot(normal, tangent))));
+        if (XMVectorGetX(XMVector3LengthSq(tangent)) < 1e-20f)
+        {
+            XMVECTOR axis = fabsf(mesh.vertices[i].normal.x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+            tangent = XMVector3Cross(normal, axis);
+        }
+        XMStoreFloat3(&mesh.vertices[i].tangent, XMVector3Normalize(tangent));
+    }
+}
+
+//-----------OBJ-------------
+// Corners of the triangulated faces. Negative OBJ indices count back from the vertices
+// read so far, so a chunk stores them relative to its own first vertex (the matching
+// bit in `relative`) and they are resolved once every chunk knows where it starts.
+struct ObjCorner
+{
+    int32_t index[3];           // position, texcoord, normal
+    uint32_t relative;
+};
+
+static const int32_t ObjMissing = INT_MIN;
+static const size_t ObjChunkSize = 1 << 20;
+
+struct ObjChunk
+{
+    std::vector<XMFLOAT3> positions;
+    std::vector<XMFLOAT2> texcoords;
+    std::vector<XMFLOAT3> normals;
+    std::vector<ObjCorner> corners;
+    bool valid = true;
+};
+
+static const char* _skipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// strtof is locale dependent and much slower than needed for OBJ numbers
+static const char* _parseFloat(const char* p, const char* end, float& value)
+{
+    static const double Powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = _skipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits = true)
+        mantissa = mantissa * 10.0 + (*p - '0');
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits = true, exponent--)
+            mantissa = mantissa * 10.0 + (*p - '0');
+    }
+    if (!digits)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            e = (std::min)(e * 10 + (*p - '0'), 1000);
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if (exponent < 0)
+        mantissa = -exponent <= 22 ? mantissa / Powers[-exponent] : mantissa * pow(10.0, exponent);
+    else if (exponent > 0)
+        mantissa = exponent <= 22 ? mantissa * Powers[exponent] : mantissa * pow(10.0, exponent);
+    value = (float)(negative ? -mantissa : mantissa);
+    return p;
+}
+
+static const char* _parseInt(const char* p, const char* end, int64_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || *p < '0' || *p > '9')
+        return nullptr;
+    value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        value = (std::min)(value * 10 + (*p - '0'), (int64_t)INT_MAX + 1);
+    if (negative)
+        value = -value;
+    return p;
+}
+
+// v, v/t, v//n or v/t/n
+static const char* _parseObjCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+{
+    const size_t counts[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+    corner.relative = 0;
+    for (int k = 0; k < 3; k++)
+        corner.index[k] = ObjMissing;
+
+    for (int k = 0; k < 3; k++)
+    {
+        if (k > 0)
+        {
+            if (p == end || *p != '/')
+                break;
+            p++;
+            if (p == end || (*p != '-' && (*p < '0' || *p > '9')))
+                continue;
+        }
+
+        int64_t value;
+        p = _parseInt(p, end, value);
+        if (!p || value == 0 || value > INT_MAX || value < -(int64_t)INT_MAX)
+            return nullptr;
+        if (value > 0)
+        {
+            corner.index[k] = (int32_t)(value - 1);
+        }
+        else
+        {
+            corner.index[k] = (int32_t)((int64_t)counts[k] + value);
+            corner.relative |= 1u << k;
+        }
+    }
+    return p;
+}
+
+static void _parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+    std::vector<ObjCorner> polygon;
+    while (p < end && chunk.valid)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd)
+            lineEnd = end;
+        p = _skipSpaces(p, lineEnd);
+
+        if (lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            XMFLOAT3 v;
+            p += 1;
+            chunk.valid = (p = _parseFloat(p, lineEnd, v.x)) && (p = _parseFloat(p, lineEnd, v.y)) && (p = _parseFloat(p, lineEnd, v.z));
+            chunk.positions.push_back(v);
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            // A third texture coordinate is ignored, a missing v is 0
+            XMFLOAT2 uv(0.0f, 0.0f);
+            p += 2;
+            chunk.valid = (p = _parseFloat(p, lineEnd, uv.x)) != nullptr;
+            if (chunk.valid)
+                _parseFloat(p, lineEnd, uv.y);
+            chunk.texcoords.push_back(uv);
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            XMFLOAT3 n;
+            p += 2;
+            chunk.valid = (p = _parseFloat(p, lineEnd, n.x)) && (p = _parseFloat(p, lineEnd, n.y)) && (p = _parseFloat(p, lineEnd, n.z));
+            chunk.normals.push_back(n);
+        }
+        else if (lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            polygon.clear();
+            p += 1;
+            while (true)
+            {
+                p = _skipSpaces(p, lineEnd);
+                if (p == lineEnd || *p == '\r' || *p == '#')
+                    break;
+                ObjCorner corner;
+                p = _parseObjCorner(p, lineEnd, chunk, corner);
+                if (!p)
+                {
+                    chunk.valid = false;
+                    break;
+                }
+                polygon.push_back(corner);
+            }
+
+            // Fan triangulation of convex polygons, reversed so the counter-clockwise
+            // right-handed faces become clockwise after z is mirrored
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                chunk.corners.push_back(polygon[0]);
+                chunk.corners.push_back(polygon[i]);
+                chunk.corners.push_back(polygon[i - 1]);
+            }
+        }
+        // Groups, objects, materials, smoothing groups and comments are skipped
+
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+}
+
+bool ImportObj(const char* path, Mesh& mesh, ThreadPool* pPool, uint64_t* pBytesRead)
+{
+    std::vector<char> text;
+    if (!_readFile(path, text))
+        return false;
+    if (pBytesRead)
+        *pBytesRead = text.size();
+
+    // Split at line starts into chunks that are parsed independently
+    const char* data = text.data();
+    const size_t size = text.size();
+    uint32_t numChunks = (uint32_t)(size / ObjChunkSize) + 1;
+    std::vector<size_t> chunkBegin(numChunks + 1, size);
+    chunkBegin[0] = 0;
+    for (uint32_t i = 1; i < numChunks; i++)
+    {
+        size_t position = (std::max)((size_t)i * (size / numChunks), chunkBegin[i - 1]);
+        const char* newline = position < size ? static_cast<const char*>(memchr(data + position, '\n', size - position)) : nullptr;
+        chunkBegin[i] = newline ? newline - data + 1 : size;
+    }
+
+    std::vector<ObjChunk> chunks(numChunks);
+    _parallelFor(pPool, numChunks, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+            _parseObjChunk(data + chunkBegin[i], data + chunkBegin[i + 1], chunks[i]);
+    });
+
+    // First position, texcoord, normal and corner of every chunk
+    std::vector<int64_t> bases((numChunks + 1) * 4, 0);
+    for (uint32_t i = 0; i < numChunks; i++)
+    {
+        if (!chunks[i].valid)
+            return false;
+        int64_t* base = &bases[i * 4];
+        base[4] = base[0] + chunks[i].positions.size();
+        base[5] = base[1] + chunks[i].texcoords.size();
+        base[6] = base[2] + chunks[i].normals.size();
+        base[7] = base[3] + chunks[i].corners.size();
+    }
+    const int64_t* totals = &bases[numChunks * 4];
+    if (totals[3] == 0 || totals[3] > UINT_MAX || totals[0] >= UINT_MAX)
+        return false;
+
+    // Absolute attribute indices per corner, 0xFFFFFFFF for a missing attribute
+    struct ObjKey
+    {
+        uint32_t index[3];
+    };
+    std::vector<ObjKey> keys((size_t)totals[3]);
+    std::vector<uint8_t> chunkValid(numChunks, 1);
+    _parallelFor(pPool, numChunks, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const int64_t* base = &bases[i * 4];
+            ObjKey* out = &keys[(size_t)base[3]];
+            for (const ObjCorner& corner : chunks[i].corners)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    int64_t index = corner.index[k];
+                    if (index == ObjMissing)
+                    {
+                        out->index[k] = 0xFFFFFFFF;
+                        continue;
+                    }
+                    if (corner.relative & (1u << k))
+                        index += base[k];
+                    if (index < 0 || index >= totals[k])
+                        chunkValid[i] = 0;
+                    out->index[k] = (uint32_t)index;
+                }
+                out++;
+            }
+        }
+    });
+    if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end())
+        return false;
+
+    // Weld corners that reference the same attributes
+    DedupTable table(keys.size() / 4);
+    auto hash = [&](uint32_t id)
+    {
+        const uint32_t* index = keys[id].index;
+        uint32_t h = index[0] * 0x9E3779B1u ^ index[1] * 0x85EBCA77u ^ index[2] * 0xC2B2AE3Du;
+        return h ^ (h >> 15);
+    };
+    auto equal = [&](uint32_t a, uint32_t b) { return memcmp(&keys[a], &keys[b], sizeof(ObjKey)) == 0; };
+    std::vector<uint32_t> firstCorner;
+    std::vector<uint32_t> vertexOfCorner(keys.size());
+    mesh.indices.resize(keys.size());
+    for (uint32_t i = 0; i < (uint32_t)keys.size(); i++)
+    {
+        uint32_t first = table.Insert(i, hash, equal);
+        if (first == i)
+        {
+            vertexOfCorner[i] = (uint32_t)firstCorner.size();
+            firstCorner.push_back(i);
+        }
+        mesh.indices[i] = vertexOfCorner[first];
+    }
+
+    // Gather the attributes; chunk lookup by binary search over the chunk bases
+    auto attribute = [&](int k, uint32_t index, uint32_t& chunk) -> uint32_t
+    {
+        uint32_t lo = 0, hi = numChunks - 1;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi + 1) / 2;
+            if (bases[mid * 4 + k] <= index)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        chunk = lo;
+        return index - (uint32_t)bases[lo * 4 + k];
+    };
+
+    std::atomic<bool> missingNormals{ false };
+    mesh.vertices.resize(firstCorner.size());
+    _parallelFor(pPool, (uint32_t)firstCorner.size(), 4096, [&](uint32_t begin, uint32_t end)
+    {
+        bool missing = false;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const ObjKey& key = keys[firstCorner[i]];
+            MeshVertex& v = mesh.vertices[i];
+            uint32_t chunk;
+
+            // Right-handed with v going up to left-handed with texture rows going down
+            uint32_t local = attribute(0, key.index[0], chunk);
+            const XMFLOAT3& pos = chunks[chunk].positions[local];
+            v.pos = XMFLOAT3(pos.x, pos.y, -pos.z);
+
+            v.uv = XMFLOAT2(0.0f, 0.0f);
+            if (key.index[1] != 0xFFFFFFFF)
+            {
+                local = attribute(1, key.index[1], chunk);
+                const XMFLOAT2& uv = chunks[chunk].texcoords[local];
+                v.uv = XMFLOAT2(uv.x, 1.0f - uv.y);
+            }
+
+            v.normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+            if (key.index[2] != 0xFFFFFFFF)
+            {
+                local = attribute(2, key.index[2], chunk);
+                const XMFLOAT3& normal = chunks[chunk].normals[local];
+                v.normal = _normalize(XMFLOAT3(normal.x, normal.y, -normal.z));
+            }
+            else
+            {
+                missing = true;
+            }
+            v.tangent = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        }
+        if (missing)
+            missingNormals = true;
+    });
+
+    if (missingNormals)
+        GenerateNormals(mesh);
+    GenerateTangents(mesh);
+    return true;
+}
+
+//-----------glTF-------------
+static const uint32_t GlbMagic = 0x46546C67;        // "glTF"
+static const uint32_t GlbChunkJson = 0x4E4F534A;    // "JSON"
+static const uint32_t GlbChunkBin = 0x004E4942;     // "BIN\0"
+
+enum GltfComponentType
+{
+    GltfByte = 5120,
+    GltfUnsignedByte = 5121,
+    GltfShort = 5122,
+    GltfUnsignedShort = 5123,
+    GltfUnsignedInt = 5125,
+    GltfFloat = 5126
+};
+
+struct GltfAccessor
+{
+    const uint8_t* data;
+    uint32_t count;
+    uint32_t stride;
+    uint32_t componentType;
+    uint32_t components;
+    bool normalized;
+};
+
+static uint32_t _componentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case GltfByte:
+    case GltfUnsignedByte:
+        return 1;
+    case GltfShort:
+    case GltfUnsignedShort:
+        return 2;
+    case GltfUnsignedInt:
+    case GltfFloat:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static bool _decodeBase64(const char* text, std::vector<char>& data)
+{
+    data.clear();
+    uint32_t bits = 0;
+    int numBits = 0;
+    for (const char* c = text; *c && *c != '='; c++)
+    {
+        int value;
+        if (*c >= 'A' && *c <= 'Z')
+            value = *c - 'A';
+        else if (*c >= 'a' && *c <= 'z')
+            value = *c - 'a' + 26;
+        else if (*c >= '0' && *c <= '9')
+            value = *c - '0' + 52;
+        else if (*c == '+')
+            value = 62;
+        else if (*c == '/')
+            value = 63;
+        else
+            return false;
+
+        bits = (bits << 6) | value;
+        numBits += 6;
+        if (numBits >= 8)
+        {
+            numBits -= 8;
+            data.push_back((char)((bits >> numBits) & 0xFF));
+        }
+    }
+    return true;
+}
+
+static int _hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static std::string _decodeUri(const char* uri)
+{
+    // Percent-escapes, e.g. %20 for spaces in file names
+    std::string result;
+    for (const char* c = uri; *c; c++)
+    {
+        int high = c[0] == '%' && c[1] ? _hexValue(c[1]) : -1;
+        int low = high >= 0 && c[2] ? _hexValue(c[2]) : -1;
+        if (low >= 0)
+        {
+            result += (char)(high * 16 + low);
+            c += 2;
+        }
+        else
+        {
+            result += *c;
+        }
+    }
+    return result;
+}
+
+static int _getIndex(const JsonValue& object, const char* name)
+{
+    double value = object.GetNumber(name, -1.0);
+    return value >= 0.0 && value < (double)INT_MAX ? (int)value : -1;
+}
+
+static const JsonValue* _getItem(const JsonValue& document, const char* array, int index)
+{
+    const JsonValue* pArray = document.Find(array);
+    if (!pArray || pArray->type != JsonValue::Array || index < 0 || index >= (int)pArray->items.size())
+        return nullptr;
+    return &pArray->items[index];
+}
+
+static bool _getAccessor(const JsonValue& document, const std::vector<std::vector<char>>& buffers, int index, GltfAccessor& accessor)
+{
+    const JsonValue* pAccessor = _getItem(document, "accessors", index);
+    if (!pAccessor || pAccessor->Find("sparse"))
+        return false;
+    const JsonValue* pView = _getItem(document, "bufferViews", _getIndex(*pAccessor, "bufferView"));
+    if (!pView)
+        return false;
+    int buffer = _getIndex(*pView, "buffer");
+    if (buffer < 0 || buffer >= (int)buffers.size())
+        return false;
+
+    static const char* Types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    const char* type = pAccessor->GetString("type", "");
+    accessor.components = 0;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        if (strcmp(type, Types[i]) == 0)
+            accessor.components = i + 1;
+    }
+    accessor.componentType = (uint32_t)pAccessor->GetNumber("componentType", 0.0);
+    uint32_t elementSize = accessor.components * _componentSize(accessor.componentType);
+    if (elementSize == 0)
+        return false;
+
+    accessor.count = (uint32_t)pAccessor->GetNumber("count", 0.0);
+    accessor.normalized = false;
+    const JsonValue* pNormalized = pAccessor->Find("normalized");
+    if (pNormalized && pNormalized->type == JsonValue::Bool)
+        accessor.normalized = pNormalized->boolean;
+
+    uint64_t viewOffset = (uint64_t)pView->GetNumber("byteOffset", 0.0);
+    uint64_t viewLength = (uint64_t)pView->GetNumber("byteLength", 0.0);
+    uint64_t offset = (uint64_t)pAccessor->GetNumber("byteOffset", 0.0);
+    accessor.stride = (uint32_t)pView->GetNumber("byteStride", 0.0);
+    if (accessor.stride == 0)
+        accessor.stride = elementSize;
+
+    // Everything the accessor touches has to lie inside its view, and the view inside the buffer
+    if (viewOffset + viewLength > buffers[buffer].size())
+        return false;
+    if (accessor.count > 0 && offset + (uint64_t)accessor.stride * (accessor.count - 1) + elementSize > viewLength)
+        return false;
+    accessor.data = reinterpret_cast<const uint8_t*>(buffers[buffer].data()) + viewOffset + offset;
+    return true;
+}
+
+static float _readComponent(const uint8_t* p, uint32_t componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case GltfByte:
+    {
+        int8_t value = (int8_t)*p;
+        return normalized ? (std::max)(value / 127.0f, -1.0f) : value;
+    }
+    case GltfUnsignedByte:
+        return normalized ? *p / 255.0f : *p;
+    case GltfShort:
+    {
+        int16_t value;
+        memcpy(&value, p, sizeof(value));
+        return normalized ? (std::max)(value / 32767.0f, -1.0f) : value;
+    }
+    case GltfUnsignedShort:
+    {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return normalized ? value / 65535.0f : value;
+    }
+    case GltfUnsignedInt:
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return (float)value;
+    }
+    default:
+    {
+        float value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    }
+}
+
+static XMVECTOR _readElement(const GltfAccessor& accessor, uint32_t i)
+{
+    float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const uint8_t* p = accessor.data + (size_t)accessor.stride * i;
+    uint32_t size = _componentSize(accessor.componentType);
+    for (uint32_t c = 0; c < accessor.components; c++)
+        values[c] = _readComponent(p + c * size, accessor.componentType, accessor.normalized);
+    return XMVectorSet(values[0], values[1], values[2], values[3]);
+}
+
+static uint32_t _readIndex(const GltfAccessor& accessor, uint32_t i)
+{
+    const uint8_t* p = accessor.data + (size_t)accessor.stride * i;
+    if (accessor.componentType == GltfUnsignedByte)
+        return *p;
+    if (accessor.componentType == GltfUnsignedShort)
+    {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static XMMATRIX _getNodeMatrix(const JsonValue& node)
+{
+    // glTF stores column-major matrices for column vectors, which is the same memory
+    // layout as a row-major matrix for DirectXMath's row vectors
+    const JsonValue* pMatrix = node.Find("matrix");
+    if (pMatrix && pMatrix->type == JsonValue::Array && pMatrix->items.size() == 16)
+    {
+        XMFLOAT4X4 matrix;
+        for (int i = 0; i < 16; i++)
+            matrix.m[i / 4][i % 4] = (float)pMatrix->items[i].number;
+        return XMLoadFloat4x4(&matrix);
+    }
+
+    auto readVector = [&](const char* name, XMVECTOR fallback, size_t size)
+    {
+        const JsonValue* pValue = node.Find(name);
+        if (!pValue || pValue->type != JsonValue::Array || pValue->items.size() != size)
+            return fallback;
+        float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < size; i++)
+            values[i] = (float)pValue->items[i].number;
+        return XMVectorSet(values[0], values[1], values[2], values[3]);
+    };
+    XMVECTOR scale = readVector("scale", XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f), 3);
+    XMVECTOR rotation = readVector("rotation", XMQuaternionIdentity(), 4);
+    XMVECTOR translation = readVector("translation", XMVectorZero(), 3);
+    return XMMatrixScalingFromVector(scale) * XMMatrixRotationQuaternion(rotation) * XMMatrixTranslationFromVector(translation);
+}
+
+struct GltfContext
+{
+    const JsonValue& document;
+    const std::vector<std::vector<char>>& buffers;
+    ThreadPool* pPool;
+    Mesh& mesh;
+    bool missingNormals;
+};
+
+static bool _appendPrimitive(GltfContext& context, const JsonValue& primitive, FXMMATRIX world)
+{
+    // Points and lines have nothing to contribute to a triangle mesh
+    if (primitive.GetNumber("mode", 4.0) != 4.0)
+        return true;
+
+    const JsonValue* pAttributes = primitive.Find("attributes");
+    if (!pAttributes)
+        return false;
+    GltfAccessor positions, normals, texcoords;
+    if (!_getAccessor(context.document, context.buffers, _getIndex(*pAttributes, "POSITION"), positions) || positions.components != 3)
+        return false;
+    bool hasNormals = _getAccessor(context.document, context.buffers, _getIndex(*pAttributes, "NORMAL"), normals) && normals.count == positions.count;
+    bool hasTexcoords = _getAccessor(context.document, context.buffers, _getIndex(*pAttributes, "TEXCOORD_0"), texcoords) && texcoords.count == positions.count;
+    context.missingNormals |= !hasNormals;
+
+    Mesh& mesh = context.mesh;
+    uint32_t baseVertex = (uint32_t)mesh.vertices.size();
+    mesh.vertices.resize(baseVertex + (size_t)positions.count);
+
+    XMMATRIX normalMatrix = XMMatrixTranspose(XMMatrixInverse(nullptr, world));
+    _parallelFor(context.pPool, positions.count, 4096, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            // Right-handed to left-handed; glTF texture rows already go down
+            MeshVertex& v = mesh.vertices[baseVertex + i];
+            XMStoreFloat3(&v.pos, XMVector3TransformCoord(_readElement(positions, i), world));
+            v.pos.z = -v.pos.z;
+            v.normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+            if (hasNormals)
+            {
+                XMStoreFloat3(&v.normal, XMVector3Normalize(XMVector3TransformNormal(_readElement(normals, i), normalMatrix)));
+                v.normal.z = -v.normal.z;
+            }
+            v.uv = XMFLOAT2(0.0f, 0.0f);
+            if (hasTexcoords)
+                XMStoreFloat2(&v.uv, _readElement(texcoords, i));
+            v.tangent = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        }
+    });
+
+    // Mirroring z keeps the counter-clockwise order, so triangles are reversed to be clockwise,
+    // unless a mirroring node transform already reversed them
+    bool flip = XMVectorGetX(XMMatrixDeterminant(world)) >= 0.0f;
+    size_t firstIndex = mesh.indices.size();
+    int indicesAccessor = _getIndex(primitive, "indices");
+    if (indicesAccessor >= 0)
+    {
+        GltfAccessor indices;
+        if (!_getAccessor(context.document, context.buffers, indicesAccessor, indices) || indices.components != 1 ||
+            (indices.componentType != GltfUnsignedByte && indices.componentType != GltfUnsignedShort && indices.componentType != GltfUnsignedInt))
+            return false;
+        mesh.indices.resize(firstIndex + indices.count / 3 * 3);
+        for (uint32_t i = 0; i < indices.count / 3 * 3; i++)
+        {
+            uint32_t index = _readIndex(indices, i);
+            if (index >= positions.count)
+                return false;
+            mesh.indices[firstIndex + i] = baseVertex + index;
+        }
+    }
+    else
+    {
+        mesh.indices.resize(firstIndex + positions.count / 3 * 3);
+        for (uint32_t i = 0; i < positions.count / 3 * 3; i++)
+            mesh.indices[firstIndex + i] = baseVertex + i;
+    }
+    if (flip)
+    {
+        for (size_t i = firstIndex; i + 2 < mesh.indices.size(); i += 3)
+            std::swap(mesh.indices[i + 1], mesh.indices[i + 2]);
+    }
+    return true;
+}
+
+static bool _appendMesh(GltfContext& context, int meshIndex, FXMMATRIX world)
+{
+    const JsonValue* pMesh = _getItem(context.document, "meshes", meshIndex);
+    const JsonValue* pPrimitives = pMesh ? pMesh->Find("primitives") : nullptr;
+    if (!pPrimitives || pPrimitives->type != JsonValue::Array)
+        return false;
+    for (const JsonValue& primitive : pPrimitives->items)
+    {
+        if (!_appendPrimitive(context, primitive, world))
+            return false;
+    }
+    return true;
+}
+
+static bool _appendNode(GltfContext& context, int nodeIndex, FXMMATRIX parentWorld, int depth)
+{
+    // The depth limit also stops cycles in malformed files
+    const JsonValue* pNode = _getItem(context.document, "nodes", nodeIndex);
+    if (!pNode || depth > 64)
+        return false;
+
+    XMMATRIX world = _getNodeMatrix(*pNode) * parentWorld;
+    int meshIndex = _getIndex(*pNode, "mesh");
+    if (meshIndex >= 0 && !_appendMesh(context, meshIndex, world))
+        return false;
+
+    const JsonValue* pChildren = pNode->Find("children");
+    if (pChildren && pChildren->type == JsonValue::Array)
+    {
+        for (const JsonValue& child : pChildren->items)
+        {
+            if (!_appendNode(context, (int)child.number, world, depth + 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ImportGltf(const char* path, Mesh& mesh, ThreadPool* pPool, uint64_t* pBytesRead)
+{
+    std::vector<char> file;
+    if (!_readFile(path, file))
+        return false;
+    uint64_t bytesRead = file.size();
+
+    // .glb: 12-byte header, then a JSON chunk and an optional binary chunk
+    const char* json = file.data();
+    size_t jsonLength = file.size();
+    std::vector<char> glbBinary;
+    uint32_t header[3];
+    if (file.size() >= 20 && (memcpy(header, file.data(), sizeof(header)), header[0] == GlbMagic))
+    {
+        size_t offset = 12;
+        jsonLength = 0;
+        while (offset + 8 <= file.size())
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, file.data() + offset, sizeof(chunk));
+            offset += 8;
+            if (chunk[0] > file.size() - offset)
+                return false;
+            if (chunk[1] == GlbChunkJson)
+            {
+                json = file.data() + offset;
+                jsonLength = chunk[0];
+            }
+            else if (chunk[1] == GlbChunkBin)
+            {
+                glbBinary.assign(file.data() + offset, file.data() + offset + chunk[0]);
+            }
+            offset += (chunk[0] + 3) & ~3u;
+        }
+    }
+
+    JsonValue document;
+    if (!ParseJson(json, jsonLength, document))
+        return false;
+
+    // Buffers: the .glb binary chunk, base64 data URIs or files next to the .gltf
+    std::string directory(path);
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+
+    std::vector<std::vector<char>> buffers;
+    const JsonValue* pBuffers = document.Find("buffers");
+    if (pBuffers && pBuffers->type == JsonValue::Array)
+    {
+        for (const JsonValue& buffer : pBuffers->items)
+        {
+            buffers.emplace_back();
+            const char* uri = buffer.GetString("uri", nullptr);
+            if (!uri)
+            {
+                buffers.back().swap(glbBinary);
+            }
+            else if (strncmp(uri, "data:", 5) == 0)
+            {
+                const char* base64 = strstr(uri, ";base64,");
+                if (!base64 || !_decodeBase64(base64 + 8, buffers.back()))
+                    return false;
+            }
+            else
+            {
+                if (!_readFile((directory + _decodeUri(uri)).c_str(), buffers.back()))
+                    return false;
+                bytesRead += buffers.back().size();
+            }
+            if (buffers.back().size() < (size_t)buffer.GetNumber("byteLength", 0.0))
+                return false;
+        }
+    }
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    GltfContext context = { document, buffers, pPool, mesh, false };
+
+    // The default scene with its node transforms, or every mesh as is when there are no scenes
+    int sceneIndex = _getIndex(document, "scene");
+    const JsonValue* pScene = _getItem(document, "scenes", sceneIndex >= 0 ? sceneIndex : 0);
+    if (pScene)
+    {
+        const JsonValue* pNodes = pScene->Find("nodes");
+        if (pNodes && pNodes->type == JsonValue::Array)
+        {
+            for (const JsonValue& node : pNodes->items)
+            {
+                if (!_appendNode(context, (int)node.number, XMMatrixIdentity(), 0))
+                    return false;
+            }
+        }
+    }
+    else
+    {
+        const JsonValue* pMeshes = document.Find("meshes");
+        for (size_t i = 0; pMeshes && i < pMeshes->items.size(); i++)
+        {
+            if (!_appendMesh(context, (int)i, XMMatrixIdentity()))
+                return false;
+        }
+    }
+    if (mesh.indices.empty())
+        return false;
+
+    if (pBytesRead)
+        *pBytesRead = bytesRead;
+
+    WeldVertices(mesh);
+    if (context.missingNormals)
+        GenerateNormals(mesh);
+    GenerateTangents(mesh);
+    return true;
+}
+
+//-----------Dispatch-------------
+static const char* _extension(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/') || strchr(dot, '\\'))
+        return "";
+    return dot + 1;
+}
+
+static bool _equalNoCase(const char* a, const char* b)
+{
+    for (; *a && *b; a++, b++)
+    {
+        if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+            return false;
+    }
+    return *a == *b;
+}
+
+bool IsImportableMesh(const char* path)
+{
+    const char* extension = _extension(path);
+    return _equalNoCase(extension, "obj") || _equalNoCase(extension, "gltf") || _equalNoCase(extension, "glb");
+}
+
+bool ImportMesh(const char* path, Mesh& mesh, ThreadPool* pPool, uint64_t* pBytesRead)
+{
+    const char* extension = _extension(path);
+    if (_equalNoCase(extension, "obj"))
+        return ImportObj(path, mesh, pPool, pBytesRead);
+    if (_equalNoCase(extension, "gltf") || _equalNoCase(extension, "glb"))
+        return ImportGltf(path, mesh, pPool, pBytesRead);
+    return false;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "meshgen.h"
+#include "threadPool.h"
+
+// Importers for Wavefront OBJ and glTF 2.0 (.gltf with .bin or data: buffers, and .glb).
+// Both fill a Mesh in the renderer's TexVertex layout: left-handed (z is negated),
+// clockwise front faces, texture rows going down, vertices welded and tangents generated
+// from the uv layout. pPool spreads the parsing over its threads, pBytesRead receives
+// the total size of the files that were read.
+bool ImportObj(const char* path, Mesh& mesh, ThreadPool* pPool = nullptr, uint64_t* pBytesRead = nullptr);
+bool ImportGltf(const char* path, Mesh& mesh, ThreadPool* pPool = nullptr, uint64_t* pBytesRead = nullptr);
+
+// Picks the importer from the file extension
+bool ImportMesh(const char* path, Mesh& mesh, ThreadPool* pPool = nullptr, uint64_t* pBytesRead = nullptr);
+bool IsImportableMesh(const char* path);
+
+// Merges vertices with identical contents and remaps the indices
+void WeldVertices(Mesh& mesh);
+// Per-vertex direction of increasing u, orthogonal to the normal. PS.hlsl rebuilds the
+// bitangent as cross(normal, tangent), so mirrored uv islands get a flipped bitangent.
+void GenerateTangents(Mesh& mesh);
+// Area-weighted vertex normals from the faces
+void GenerateNormals(Mesh& mesh);
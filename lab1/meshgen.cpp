@@ -0,0 +1,550 @@
+#include "meshgen.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <cassert>
+
+std::vector<uint16_t> Mesh::GetIndices16() const
+{
+    assert(Fits16BitIndices());
+    return std::vector<uint16_t>(indices.begin(), indices.end());
+}
+
+// sin and cos of start + i * step for i in [0, count), four angles per XMVectorSinCos
+static void _sinCosTable(uint32_t count, float start, float step, std::vector<float>& sines, std::vector<float>& cosines)
+{
+    uint32_t padded = (count + 3) & ~3u;
+    sines.resize(padded);
+    cosines.resize(padded);
+
+    XMVECTOR offsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+    for (uint32_t i = 0; i < padded; i += 4)
+    {
+        XMVECTOR angles = XMVectorAdd(XMVectorReplicate(start + i * step), XMVectorScale(offsets, step));
+        XMVECTOR s, c;
+        XMVectorSinCos(&s, &c, angles);
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&sines[i]), s);
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&cosines[i]), c);
+    }
+}
+
+static void _addTriangle(Mesh& mesh, uint32_t a, uint32_t b, uint32_t c)
+{
+    mesh.indices.push_back(a);
+    mesh.indices.push_back(b);
+    mesh.indices.push_back(c);
+}
+
+// Adds a triangle, flipping it if needed so that it faces along the normal of its first vertex
+static void _addOrientedTriangle(Mesh& mesh, uint32_t a, uint32_t b, uint32_t c)
+{
+    XMVECTOR p0 = XMLoadFloat3(&mesh.vertices[a].pos);
+    XMVECTOR faceNormal = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&mesh.vertices[b].pos), p0),
+        XMVectorSubtract(XMLoadFloat3(&mesh.vertices[c].pos), p0));
+    if (XMVectorGetX(XMVector3Dot(faceNormal, XMLoadFloat3(&mesh.vertices[a].normal))) < 0.0f)
+        std::swap(b, c);
+    _addTriangle(mesh, a, b, c);
+}
+
+Mesh GenerateUVSphere(uint32_t latSegments, uint32_t longSegments)
+{
+    Mesh mesh;
+    uint32_t rows = latSegments + 1, cols = longSegments + 1;
+
+    std::vector<float> sinTheta, cosTheta, sinPhi, cosPhi;
+    _sinCosTable(rows, 0.0f, XM_PI / latSegments, sinTheta, cosTheta);
+    _sinCosTable(cols, 0.0f, XM_2PI / longSegments, sinPhi, cosPhi);
+
+    // The seam column and the pole rows are duplicated so every vertex has its own uv
+    mesh.vertices.resize((size_t)rows * cols);
+    for (uint32_t r = 0; r < rows; r++)
+    {
+        MeshVertex* row = &mesh.vertices[(size_t)r * cols];
+        for (uint32_t c = 0; c < cols; c++)
+        {
+            XMFLOAT3 n(sinTheta[r] * cosPhi[c], cosTheta[r], sinTheta[r] * sinPhi[c]);
+            row[c].pos = n;
+            row[c].normal = n;
+            row[c].uv = XMFLOAT2((float)c / longSegments, (float)r / latSegments);
+            row[c].tangent = XMFLOAT3(-sinPhi[c], 0.0f, cosPhi[c]);
+        }
+    }
+
+    mesh.indices.reserve((size_t)longSegments * (latSegments - 1) * 6);
+    for (uint32_t r = 0; r < latSegments; r++)
+    {
+        for (uint32_t c = 0; c < longSegments; c++)
+        {
+            uint32_t a = r * cols + c, b = a + 1, d = a + cols, e = d + 1;
+            // The triangles touching a pole collapse to a line, leave them out
+            if (r > 0)
+                _addTriangle(mesh, a, b, d);
+            if (r + 1 < latSegments)
+                _addTriangle(mesh, b, e, d);
+        }
+    }
+    return mesh;
+}
+
+Mesh GenerateIcosphere(uint32_t subdivisions)
+{
+    const float t = (1.0f + sqrtf(5.0f)) * 0.5f;
+    static const uint32_t Faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+    };
+
+    std::vector<XMFLOAT3> positions = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    std::vector<uint32_t> triangles(&Faces[0][0], &Faces[0][0] + 60);
+
+    for (uint32_t level = 0; level < subdivisions; level++)
+    {
+        // Each edge is split once, shared by the two triangles on either side
+        std::unordered_map<uint64_t, uint32_t> midpoints;
+        auto midpoint = [&](uint32_t a, uint32_t b)
+        {
+            uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+            auto it = midpoints.find(key);
+            if (it != midpoints.end())
+                return it->second;
+            XMFLOAT3 m;
+            XMStoreFloat3(&m, XMVectorScale(XMVectorAdd(XMLoadFloat3(&positions[a]), XMLoadFloat3(&positions[b])), 0.5f));
+            positions.push_back(m);
+            midpoints.emplace(key, (uint32_t)positions.size() - 1);
+            return (uint32_t)positions.size() - 1;
+        };
+
+        std::vector<uint32_t> refined;
+        refined.reserve(triangles.size() * 4);
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            uint32_t a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+            uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            uint32_t sub[12] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+            refined.insert(refined.end(), sub, sub + 12);
+        }
+        triangles.swap(refined);
+    }
+
+    Mesh mesh;
+    mesh.vertices.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&positions[i]));
+        MeshVertex& v = mesh.vertices[i];
+        XMStoreFloat3(&v.pos, n);
+        v.normal = v.pos;
+        float phi = atan2f(v.pos.z, v.pos.x);
+        v.uv = XMFLOAT2(phi / XM_2PI + 0.5f, acosf((std::max)(-1.0f, (std::min)(1.0f, v.pos.y))) / XM_PI);
+        v.tangent = XMFLOAT3(-sinf(phi), 0.0f, cosf(phi));
+    }
+
+    mesh.indices.reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i += 3)
+        _addOrientedTriangle(mesh, triangles[i], triangles[i + 1], triangles[i + 2]);
+    return mesh;
+}
+
+Mesh GenerateCube()
+{
+    // normal, tangent (u direction) and bitangent (v direction, texture rows go down) per face
+    static const XMFLOAT3 Faces[6][3] = {
+        {{ 0, -1,  0}, {1, 0, 0}, {0, 0,  1}},
+        {{ 0,  1,  0}, {1, 0, 0}, {0, 0, -1}},
+        {{ 1,  0,  0}, {0, 0, 1}, {0, -1, 0}},
+        {{-1,  0,  0}, {0, 0, -1}, {0, -1, 0}},
+        {{ 0,  0,  1}, {-1, 0, 0}, {0, -1, 0}},
+        {{ 0,  0, -1}, {1, 0, 0}, {0, -1, 0}}
+    };
+
+    Mesh mesh;
+    for (const XMFLOAT3* face : Faces)
+    {
+        XMVECTOR n = XMLoadFloat3(&face[0]), u = XMLoadFloat3(&face[1]), v = XMLoadFloat3(&face[2]);
+        uint32_t first = (uint32_t)mesh.vertices.size();
+        for (int corner = 0; corner < 4; corner++)
+        {
+            float cu = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+            float cv = corner >= 2 ? 1.0f : 0.0f;
+            MeshVertex vertex;
+            XMStoreFloat3(&vertex.pos, XMVectorAdd(n, XMVectorAdd(XMVectorScale(u, 2.0f * cu - 1.0f), XMVectorScale(v, 2.0f * cv - 1.0f))));
+            vertex.uv = XMFLOAT2(cu, cv);
+            vertex.normal = face[0];
+            vertex.tangent = face[1];
+            mesh.vertices.push_back(vertex);
+        }
+        _addOrientedTriangle(mesh, first, first + 1, first + 2);
+        _addOrientedTriangle(mesh, first, first + 2, first + 3);
+    }
+    return mesh;
+}
+
+Mesh GeneratePlane(uint32_t xSegments, uint32_t zSegments, float size)
+{
+    Mesh mesh;
+    uint32_t cols = xSegments + 1, rows = zSegments + 1;
+    mesh.vertices.resize((size_t)rows * cols);
+    for (uint32_t j = 0; j < rows; j++)
+    {
+        for (uint32_t i = 0; i < cols; i++)
+        {
+            float u = (float)i / xSegments, v = (float)j / zSegments;
+            MeshVertex& vertex = mesh.vertices[(size_t)j * cols + i];
+            vertex.pos = XMFLOAT3((u - 0.5f) * size, 0.0f, (v - 0.5f) * size);
+            vertex.uv = XMFLOAT2(u, 1.0f - v);
+            vertex.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            vertex.tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+        }
+    }
+
+    mesh.indices.reserve((size_t)xSegments * zSegments * 6);
+    for (uint32_t j = 0; j < zSegments; j++)
+    {
+        for (uint32_t i = 0; i < xSegments; i++)
+        {
+            uint32_t a = j * cols + i, b = a + 1, d = a + cols, e = d + 1;
+            _addTriangle(mesh, a, d, b);
+            _addTriangle(mesh, b, d, e);
+        }
+    }
+    return mesh;
+}
+
+Mesh GenerateTorus(uint32_t majorSegments, uint32_t minorSegments, float majorRadius, float minorRadius)
+{
+    Mesh mesh;
+    uint32_t cols = majorSegments + 1, rows = minorSegments + 1;
+
+    std::vector<float> sinPhi, cosPhi, sinTheta, cosTheta;
+    _sinCosTable(cols, 0.0f, XM_2PI / majorSegments, sinPhi, cosPhi);
+    _sinCosTable(rows, 0.0f, XM_2PI / minorSegments, sinTheta, cosTheta);
+
+    mesh.vertices.resize((size_t)rows * cols);
+    for (uint32_t j = 0; j < rows; j++)
+    {
+        float ring = majorRadius + minorRadius * cosTheta[j];
+        for (uint32_t i = 0; i < cols; i++)
+        {
+            MeshVertex& vertex = mesh.vertices[(size_t)j * cols + i];
+            vertex.pos = XMFLOAT3(ring * cosPhi[i], minorRadius * sinTheta[j], ring * sinPhi[i]);
+            vertex.normal = XMFLOAT3(cosTheta[j] * cosPhi[i], sinTheta[j], cosTheta[j] * sinPhi[i]);
+            vertex.uv = XMFLOAT2((float)i / majorSegments, (float)j / minorSegments);
+            vertex.tangent = XMFLOAT3(-sinPhi[i], 0.0f, cosPhi[i]);
+        }
+    }
+
+    mesh.indices.reserve((size_t)majorSegments * minorSegments * 6);
+    for (uint32_t j = 0; j < minorSegments; j++)
+    {
+        for (uint32_t i = 0; i < majorSegments; i++)
+        {
+            uint32_t a = j * cols + i, b = a + 1, d = a + cols, e = d + 1;
+            _addTriangle(mesh, a, d, b);
+            _addTriangle(mesh, b, d, e);
+        }
+    }
+    return mesh;
+}
+
+//-----------Optimization-------------
+float ComputeAcmr(const std::vector<uint32_t>& indices, uint32_t numVertices, uint32_t cacheSize)
+{
+    if (indices.empty())
+        return 0.0f;
+
+    // FIFO: a vertex is still cached while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(numVertices, 0);
+    uint32_t misses = 0;
+    for (uint32_t index : indices)
+    {
+        if (loadedAt[index] == 0 || misses + 1 - loadedAt[index] > cacheSize)
+        {
+            misses++;
+            loadedAt[index] = misses;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+namespace
+{
+    const int ForsythCacheSize = 32;
+    const uint32_t ForsythMaxValence = 32;
+
+    // Score tables, indexed by cache position + 1 (0 = not cached) and by remaining triangles
+    struct ForsythTables
+    {
+        float cache[ForsythCacheSize + 1];
+        float valence[ForsythMaxValence + 1];
+
+        ForsythTables()
+        {
+            cache[0] = 0.0f;
+            for (int i = 0; i < ForsythCacheSize; i++)
+            {
+                // The last triangle's vertices get a fixed score so the next one doesn't simply reuse them
+                if (i < 3)
+                    cache[i + 1] = 0.75f;
+                else
+                    cache[i + 1] = powf(1.0f - (i - 3) / (float)(ForsythCacheSize - 3), 1.5f);
+            }
+            // Vertices with few triangles left are finished off first
+            valence[0] = 0.0f;
+            for (uint32_t i = 1; i <= ForsythMaxValence; i++)
+                valence[i] = 2.0f / sqrtf((float)i);
+        }
+    };
+    const ForsythTables Forsyth;
+
+    float _forsythScore(int cachePosition, uint32_t remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        return Forsyth.cache[cachePosition + 1] + Forsyth.valence[(std::min)(remaining, ForsythMaxValence)];
+    }
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t numVertices)
+{
+    uint32_t numTriangles = (uint32_t)(indices.size() / 3);
+    if (numTriangles == 0)
+        return;
+
+    // Triangles of every vertex; the first `remaining` entries are the ones not emitted yet
+    std::vector<uint32_t> offsets(numVertices + 1, 0), remaining(numVertices, 0);
+    for (uint32_t index : indices)
+        remaining[index]++;
+    for (uint32_t v = 0; v < numVertices; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cachePosition(numVertices, -1);
+    std::vector<float> vertexScore(numVertices);
+    for (uint32_t v = 0; v < numVertices; v++)
+        vertexScore[v] = _forsythScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(numTriangles);
+    std::vector<bool> emitted(numTriangles, false);
+    for (uint32_t t = 0; t < numTriangles; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    uint32_t best = (uint32_t)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    uint32_t cursor = 0;
+
+    int cache[ForsythCacheSize + 3];
+    int cacheCount = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    for (uint32_t n = 0; n < numTriangles; n++)
+    {
+        if (best == UINT32_MAX)
+        {
+            // Nothing in the cache is left: continue with the next triangle in input order
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        const uint32_t* tri = &indices[best * 3];
+        result.insert(result.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = tri[k];
+            uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t i = 0; i < remaining[v]; i++)
+            {
+                if (list[i] == best)
+                {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // The triangle's vertices move to the front, everything else shifts back
+        int newCache[ForsythCacheSize + 3];
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCount++] = (int)tri[k];
+        for (int i = 0; i < cacheCount; i++)
+        {
+            int v = cache[i];
+            if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+                newCache[newCount++] = v;
+        }
+
+        best = UINT32_MAX;
+        float bestScore = -1.0f;
+        for (int i = 0; i < newCount; i++)
+        {
+            uint32_t v = (uint32_t)newCache[i];
+            cachePosition[v] = i < ForsythCacheSize ? i : -1;
+
+            float score = _forsythScore(cachePosition[v], remaining[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            const uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++)
+            {
+                uint32_t t = list[j];
+                triangleScore[t] += delta;
+                if (i < ForsythCacheSize && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = (std::min)(newCount, ForsythCacheSize);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+
+    indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices, float threshold)
+{
+    uint32_t numTriangles = (uint32_t)(indices.size() / 3);
+    if (numTriangles == 0)
+        return;
+
+    // Hard boundaries: triangles that miss on all three vertices start from a cold cache anyway
+    std::vector<uint32_t> hard;
+    {
+        std::vector<uint32_t> loadedAt(vertices.size(), 0);
+        uint32_t misses = 0;
+        for (uint32_t t = 0; t < numTriangles; t++)
+        {
+            int triangleMisses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+                if (loadedAt[v] == 0 || misses + 1 - loadedAt[v] > VertexCacheSize)
+                {
+                    loadedAt[v] = ++misses;
+                    triangleMisses++;
+                }
+            }
+            if (t == 0 || triangleMisses == 3)
+                hard.push_back(t);
+        }
+        hard.push_back(numTriangles);
+    }
+
+    // Soft boundaries: split a hard cluster where its prefix, replayed from a cold cache, is
+    // within the threshold of the whole cluster's ACMR
+    std::vector<uint32_t> clusters;
+    std::vector<uint32_t> loadedAt(vertices.size(), 0);
+    uint32_t stamp = 0;
+    for (size_t h = 0; h + 1 < hard.size(); h++)
+    {
+        uint32_t begin = hard[h], end = hard[h + 1];
+        std::vector<uint32_t> part(indices.begin() + begin * 3, indices.begin() + end * 3);
+        float clusterAcmr = ComputeAcmr(part, (uint32_t)vertices.size());
+
+        clusters.push_back(begin);
+        uint32_t misses = 0, start = begin;
+        stamp += VertexCacheSize + 1; // invalidates every earlier entry
+        uint32_t base = stamp;
+        for (uint32_t t = begin; t < end; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+                if (loadedAt[v] <= base || stamp + 1 - loadedAt[v] > VertexCacheSize)
+                {
+                    loadedAt[v] = ++stamp;
+                    misses++;
+                }
+            }
+            uint32_t count = t + 1 - start;
+            if (t + 1 < end && count >= 8 && (float)misses / count <= threshold * clusterAcmr)
+            {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                stamp += VertexCacheSize + 1;
+                base = stamp;
+            }
+        }
+    }
+    clusters.push_back(numTriangles);
+
+    // Sort clusters so the ones facing away from the mesh center (likely in front) draw first
+    XMVECTOR meshCenter = XMVectorZero();
+    for (const MeshVertex& v : vertices)
+        meshCenter = XMVectorAdd(meshCenter, XMLoadFloat3(&v.pos));
+    meshCenter = XMVectorScale(meshCenter, 1.0f / (std::max)((size_t)1, vertices.size()));
+
+    struct Cluster { uint32_t begin, end; float sortKey; };
+    std::vector<Cluster> sorted;
+    for (size_t c = 0; c + 1 < clusters.size(); c++)
+    {
+        XMVECTOR center = XMVectorZero(), normal = XMVectorZero();
+        float area = 0.0f;
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3]].pos);
+            XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].pos);
+            XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].pos);
+            XMVECTOR n = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+            float a = XMVectorGetX(XMVector3Length(n));
+            center = XMVectorAdd(center, XMVectorScale(XMVectorAdd(XMVectorAdd(p0, p1), p2), a / 3.0f));
+            normal = XMVectorAdd(normal, n);
+            area += a;
+        }
+        if (area > 0.0f)
+            center = XMVectorScale(center, 1.0f / area);
+        float key = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, meshCenter), XMVector3Normalize(normal)));
+        sorted.push_back({ clusters[c], clusters[c + 1], key });
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const Cluster& c : sorted)
+        result.insert(result.end(), indices.begin() + c.begin * 3, indices.begin() + c.end * 3);
+    indices.swap(result);
+}
+
+void OptimizeVertexFetch(Mesh& mesh)
+{
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t& index : mesh.indices)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = (uint32_t)vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+void OptimizeMesh(Mesh& mesh)
+{
+    OptimizeVertexCache(mesh.indices, (uint32_t)mesh.vertices.size());
+    OptimizeOverdraw(mesh.indices, mesh.vertices);
+    OptimizeVertexFetch(mesh);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Same layout as TexVertex
+struct MeshVertex
+{
+    XMFLOAT3 pos;
+    XMFLOAT2 uv;
+    XMFLOAT3 normal;
+    XMFLOAT3 tangent;
+};
+
+// Indexed triangle list, clockwise when seen from outside (D3D front faces)
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+
+    bool Fits16BitIndices() const { return vertices.size() <= 0x10000; }
+    std::vector<uint16_t> GetIndices16() const;
+};
+
+// Unit-radius sphere around the y axis; latSegments counts the bands from pole to pole
+Mesh GenerateUVSphere(uint32_t latSegments, uint32_t longSegments);
+// Unit-radius sphere from a subdivided icosahedron, no texture seam handling
+Mesh GenerateIcosphere(uint32_t subdivisions);
+// Cube from -1 to 1 with a full texture on every face
+Mesh GenerateCube();
+// Square in the xz plane from -size/2 to size/2 facing +y
+Mesh GeneratePlane(uint32_t xSegments, uint32_t zSegments, float size);
+// Torus around the y axis
+Mesh GenerateTorus(uint32_t majorSegments, uint32_t minorSegments, float majorRadius, float minorRadius);
+
+static const uint32_t VertexCacheSize = 16;
+
+// Average cache miss ratio: transformed vertices per triangle with a FIFO post-transform cache
+float ComputeAcmr(const std::vector<uint32_t>& indices, uint32_t numVertices, uint32_t cacheSize = VertexCacheSize);
+
+// Triangle order for the post-transform cache (Forsyth's linear-speed algorithm)
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t numVertices);
+// Reorders clusters of the cache-optimized order so outward-facing ones come first. threshold
+// bounds how much the ACMR may grow (1.05 = 5%) to get smaller clusters.
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<MeshVertex>& vertices, float threshold = 1.05f);
+// Renumbers the vertices in the order they're first used by the index buffer
+void OptimizeVertexFetch(Mesh& mesh);
+
+// All three passes in their intended order
+void OptimizeMesh(Mesh& mesh);
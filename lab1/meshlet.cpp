@@ -0,0 +1,157 @@
+#include "meshlet.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+static void _computeBounds(const MeshletData& data, const Meshlet& meshlet, const MeshVertex* vertices,
+    XMFLOAT3& center, float& radius, MeshletCone& cone)
+{
+    // Sphere around the box center, good enough for clusters this small
+    XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        XMVECTOR p = XMLoadFloat3(&vertices[data.vertices[meshlet.vertexOffset + i]].pos);
+        boxMin = XMVectorMin(boxMin, p);
+        boxMax = XMVectorMax(boxMax, p);
+    }
+    XMVECTOR c = XMVectorScale(XMVectorAdd(boxMin, boxMax), 0.5f);
+    float radiusSq = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        XMVECTOR p = XMLoadFloat3(&vertices[data.vertices[meshlet.vertexOffset + i]].pos);
+        radiusSq = (std::max)(radiusSq, XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(p, c))));
+    }
+    XMStoreFloat3(&center, c);
+    radius = sqrtf(radiusSq);
+
+    // Face normals, outward for clockwise triangles
+    XMVECTOR normals[MeshletMaxTriangles];
+    uint32_t numNormals = 0;
+    XMVECTOR sum = XMVectorZero();
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+        const uint8_t* tri = &data.triangles[meshlet.triangleOffset + t * 3];
+        XMVECTOR p0 = XMLoadFloat3(&vertices[data.vertices[meshlet.vertexOffset + tri[0]]].pos);
+        XMVECTOR p1 = XMLoadFloat3(&vertices[data.vertices[meshlet.vertexOffset + tri[1]]].pos);
+        XMVECTOR p2 = XMLoadFloat3(&vertices[data.vertices[meshlet.vertexOffset + tri[2]]].pos);
+        XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+        if (XMVectorGetX(XMVector3LengthSq(normal)) < 1e-30f)
+            continue;
+        normal = XMVector3Normalize(normal);
+        normals[numNormals++] = normal;
+        sum = XMVectorAdd(sum, normal);
+    }
+
+    cone.axis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    cone.cutoff = 1.0f;
+    if (numNormals == 0 || XMVectorGetX(XMVector3LengthSq(sum)) < 1e-12f)
+        return;
+
+    XMVECTOR axis = XMVector3Normalize(sum);
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i < numNormals; i++)
+        minDot = (std::min)(minDot, XMVectorGetX(XMVector3Dot(axis, normals[i])));
+
+    // Wider than ~84 degrees the test would almost never pass
+    if (minDot <= 0.1f)
+        return;
+    XMStoreFloat3(&cone.axis, axis);
+    cone.cutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+bool BuildMeshlets(const uint32_t* indices, size_t numIndices, const MeshVertex* vertices, size_t numVertices, MeshletData& data)
+{
+    data.meshlets.clear();
+    data.vertices.clear();
+    data.triangles.clear();
+    data.spheres.Resize(0);
+    data.cones.clear();
+
+    // The indices index the slot table below, one out of range would write past it
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        if (indices[i] >= numVertices)
+            return false;
+    }
+
+    // Slot of each mesh vertex in the meshlet being built, 0xFF when it isn't in it
+    std::vector<uint8_t> slot(numVertices, 0xFF);
+    Meshlet current = {};
+
+    auto flush = [&]()
+    {
+        if (current.triangleCount == 0)
+            return;
+        for (uint32_t i = 0; i < current.vertexCount; i++)
+            slot[data.vertices[current.vertexOffset + i]] = 0xFF;
+        data.meshlets.push_back(current);
+        current.vertexOffset = (uint32_t)data.vertices.size();
+        current.triangleOffset = (uint32_t)data.triangles.size();
+        current.vertexCount = 0;
+        current.triangleCount = 0;
+    };
+
+    for (size_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        const uint32_t* tri = &indices[i];
+        uint32_t newVertices = (slot[tri[0]] == 0xFF) + (slot[tri[1]] == 0xFF && tri[1] != tri[0]) +
+            (slot[tri[2]] == 0xFF && tri[2] != tri[0] && tri[2] != tri[1]);
+        if (current.vertexCount + newVertices > MeshletMaxVertices || current.triangleCount == MeshletMaxTriangles)
+            flush();
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (slot[tri[k]] == 0xFF)
+            {
+                slot[tri[k]] = (uint8_t)current.vertexCount++;
+                data.vertices.push_back(tri[k]);
+            }
+            data.triangles.push_back(slot[tri[k]]);
+        }
+        current.triangleCount++;
+    }
+    flush();
+
+    data.spheres.Resize(data.meshlets.size());
+    data.cones.resize(data.meshlets.size());
+    for (size_t i = 0; i < data.meshlets.size(); i++)
+    {
+        XMFLOAT3 center;
+        float radius;
+        _computeBounds(data, data.meshlets[i], vertices, center, radius, data.cones[i]);
+        data.spheres.Set(i, center, radius);
+    }
+    return true;
+}
+
+uint32_t CullMeshlets(const MeshletData& data, const Frustum& frustum, const XMFLOAT3& cameraPos, uint32_t baseVertex,
+    std::vector<uint32_t>& indices)
+{
+    // Frustum first, SIMD over the sphere arrays; cones only for the survivors
+    std::vector<uint32_t> inFrustum;
+    inFrustum.reserve(data.meshlets.size());
+    CullSpheres(frustum, data.spheres, inFrustum);
+
+    uint32_t numVisible = 0;
+    XMVECTOR camera = XMLoadFloat3(&cameraPos);
+    for (uint32_t i : inFrustum)
+    {
+        const MeshletCone& cone = data.cones[i];
+        XMFLOAT3 center = data.spheres.GetCenter(i);
+        XMVECTOR toCenter = XMVectorSubtract(XMLoadFloat3(&center), camera);
+        float along = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&cone.axis)));
+        if (along >= cone.cutoff * XMVectorGetX(XMVector3Length(toCenter)) + data.spheres.GetRadius(i))
+            continue;
+
+        const Meshlet& meshlet = data.meshlets[i];
+        const uint32_t* meshletVertices = &data.vertices[meshlet.vertexOffset];
+        const uint8_t* triangles = &data.triangles[meshlet.triangleOffset];
+        size_t first = indices.size();
+        indices.resize(first + meshlet.triangleCount * 3);
+        for (uint32_t j = 0; j < meshlet.triangleCount * 3; j++)
+            indices[first + j] = baseVertex + meshletVertices[triangles[j]];
+        numVisible++;
+    }
+    return numVisible;
+}
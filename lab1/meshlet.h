@@ -0,0 +1,46 @@
+#pragma once
+#include "culling.h"
+#include "meshgen.h"
+
+// Limits of one cluster; 124 triangles keep the local index data of a meshlet in 372 bytes
+static const uint32_t MeshletMaxVertices = 64;
+static const uint32_t MeshletMaxTriangles = 124;
+
+struct Meshlet
+{
+    uint32_t vertexOffset;      // first entry in MeshletData::vertices
+    uint32_t triangleOffset;    // first entry in MeshletData::triangles
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Normal cone of a meshlet: every triangle faces away from a viewer at p when
+// dot(center - p, axis) >= cutoff * |center - p| + radius. A cone that is too wide has a
+// zero axis and never culls.
+struct MeshletCone
+{
+    XMFLOAT3 axis;
+    float cutoff;               // sine of the cone half-angle
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;     // mesh vertex ids of each meshlet
+    std::vector<uint8_t> triangles;     // 3 indices into the meshlet's vertices per triangle
+    SphereBounds spheres;
+    std::vector<MeshletCone> cones;
+
+    size_t GetTriangleCount() const { return triangles.size() / 3; }
+};
+
+// Splits an indexed triangle list into meshlets, keeping the triangle order. Run it on a
+// vertex cache optimized order so that neighbouring triangles end up together. False, with
+// data left empty, when an index isn't below numVertices.
+bool BuildMeshlets(const uint32_t* indices, size_t numIndices, const MeshVertex* vertices, size_t numVertices, MeshletData& data);
+
+// Appends the triangles of the meshlets that pass the frustum and backface cone tests, with
+// baseVertex added to each index. frustum and cameraPos are in the mesh's object space.
+// Returns the number of visible meshlets.
+uint32_t CullMeshlets(const MeshletData& data, const Frustum& frustum, const XMFLOAT3& cameraPos, uint32_t baseVertex,
+    std::vector<uint32_t>& indices);
@@ -0,0 +1,92 @@
+#include "mouseInput.h"
+#include <cmath>
+
+// Generic desktop page, mouse usage
+static const USHORT MouseUsagePage = 0x01;
+static const USHORT MouseUsage = 0x02;
+
+// Longest step the filters see, so a hitch doesn't turn into a jump
+static const float MaxConsumeSeconds = 0.1f;
+// Time constant of the velocity estimate the prediction uses
+static const float VelocitySmoothingSeconds = 0.02f;
+
+bool MouseInput::Register(HWND hWnd)
+{
+    RAWINPUTDEVICE device;
+    device.usUsagePage = MouseUsagePage;
+    device.usUsage = MouseUsage;
+    device.dwFlags = 0;
+    device.hwndTarget = hWnd;
+    _raw = RegisterRawInputDevices(&device, 1, sizeof(device)) == TRUE;
+    return _raw;
+}
+
+void MouseInput::SetFilter(float smoothingMs, float predictionMs)
+{
+    _smoothingSeconds = smoothingMs > 0.0f ? smoothingMs / 1000.0f : 0.0f;
+    _predictionSeconds = predictionMs > 0.0f ? predictionMs / 1000.0f : 0.0f;
+}
+
+bool MouseInput::OnRawInput(LPARAM lParam)
+{
+    RAWINPUT input;
+    UINT size = sizeof(input);
+    if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER)) == (UINT)-1)
+        return false;
+    if (input.header.dwType != RIM_TYPEMOUSE)
+        return false;
+    if (input.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE)
+    {
+        _raw = false;
+        return false;
+    }
+    AddDelta((float)input.data.mouse.lLastX, (float)input.data.mouse.lLastY);
+    return true;
+}
+
+void MouseInput::AddDelta(float dx, float dy)
+{
+    _pendingX += dx;
+    _pendingY += dy;
+}
+
+void MouseInput::Consume(float& dx, float& dy)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    if (_frequency == 0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        _frequency = frequency.QuadPart;
+        _lastConsume = counter.QuadPart;
+    }
+    float seconds = (float)(counter.QuadPart - _lastConsume) / _frequency;
+    seconds = seconds < MaxConsumeSeconds ? seconds : MaxConsumeSeconds;
+    _lastConsume = counter.QuadPart;
+
+    float inputX = _pendingX, inputY = _pendingY;
+    _pendingX = _pendingY = 0.0f;
+
+    // Exponential decay of what is held back: the same share per unit of time at any frame rate
+    _laggingX += inputX;
+    _laggingY += inputY;
+    float keep = _smoothingSeconds > 0.0f ? expf(-seconds / _smoothingSeconds) : 0.0f;
+    dx = _laggingX * (1.0f - keep);
+    dy = _laggingY * (1.0f - keep);
+    _laggingX *= keep;
+    _laggingY *= keep;
+
+    if (_predictionSeconds > 0.0f && seconds > 0.0f)
+    {
+        float blend = 1.0f - expf(-seconds / VelocitySmoothingSeconds);
+        _velocityX += (inputX / seconds - _velocityX) * blend;
+        _velocityY += (inputY / seconds - _velocityY) * blend;
+        // Only the change of the lead is applied, so it adds nothing once the motion stops
+        float leadX = _velocityX * _predictionSeconds, leadY = _velocityY * _predictionSeconds;
+        dx += leadX - _leadX;
+        dy += leadY - _leadY;
+        _leadX = leadX;
+        _leadY = leadY;
+    }
+}
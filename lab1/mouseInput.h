@@ -0,0 +1,47 @@
+#pragma once
+#include <windows.h>
+
+// Mouse motion for the camera. Relative counts from WM_INPUT (or cursor deltas from
+// WM_MOUSEMOVE when raw input can't be registered) are only summed as they arrive, however
+// high the polling rate, and handed out once per frame by Consume.
+// Optional smoothing releases the motion over a time constant instead of all at once; the
+// total is kept, only spread out. Optional prediction leads the output by the current
+// velocity times a lead time and takes the lead back as the motion slows down.
+class MouseInput
+{
+public:
+    // Asks for WM_INPUT from the mouse; false leaves AddDelta as the only source
+    bool Register(HWND hWnd);
+    bool IsRawInput() const { return _raw; }
+
+    // Time constant of the smoothing and lead time of the prediction, 0 turns either off
+    void SetFilter(float smoothingMs, float predictionMs);
+
+    // Handles a WM_INPUT message; true if it was relative mouse motion. A device reporting
+    // absolute positions (a tablet, remote desktop) switches back to cursor deltas.
+    bool OnRawInput(LPARAM lParam);
+    void AddDelta(float dx, float dy);
+
+    // Motion to apply this frame, in mouse counts
+    void Consume(float& dx, float& dy);
+
+private:
+    bool _raw = false;
+    float _smoothingSeconds = 0.0f;
+    float _predictionSeconds = 0.0f;
+
+    // Summed since the last Consume
+    float _pendingX = 0.0f;
+    float _pendingY = 0.0f;
+    // Held back by the smoothing
+    float _laggingX = 0.0f;
+    float _laggingY = 0.0f;
+    // Velocity estimate and the lead it produced last frame
+    float _velocityX = 0.0f;
+    float _velocityY = 0.0f;
+    float _leadX = 0.0f;
+    float _leadY = 0.0f;
+
+    LONGLONG _frequency = 0;
+    LONGLONG _lastConsume = 0;
+};
@@ -0,0 +1,248 @@
+#include "occlusion.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+void OcclusionBuffer::Resize(uint32_t width, uint32_t height)
+{
+    _tilesX = (width + TileSize - 1) / TileSize;
+    _tilesY = (height + TileSize - 1) / TileSize;
+    _width = _tilesX * TileSize;
+    _height = _tilesY * TileSize;
+
+    _depth.assign(_width * _height, 0.0f);
+    _tileFar.assign(_tilesX * _tilesY, 0.0f);
+    _rowBins.resize(_tilesY);
+}
+
+void OcclusionBuffer::Begin(FXMMATRIX viewProjection)
+{
+    XMStoreFloat4x4(&_viewProjection, viewProjection);
+    _triangles.clear();
+    for (std::vector<uint32_t>& bin : _rowBins)
+        bin.clear();
+    _stats = OcclusionStats();
+}
+
+void OcclusionBuffer::AddOccluder(const XMFLOAT3* vertices, uint32_t numVertices, const uint16_t* indices, uint32_t numIndices, FXMMATRIX world)
+{
+    XMMATRIX worldViewProjection = XMMatrixMultiply(world, XMLoadFloat4x4(&_viewProjection));
+
+    // Clip space positions; a vertex in front of the near plane is flagged with w = 0
+    _clip.resize(numVertices);
+    for (uint32_t i = 0; i < numVertices; i++)
+    {
+        XMStoreFloat4(&_clip[i], XMVector3Transform(XMLoadFloat3(&vertices[i]), worldViewProjection));
+        if (_clip[i].w < 1e-4f || _clip[i].z > _clip[i].w)
+            _clip[i].w = 0.0f;
+    }
+
+    for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        const XMFLOAT4& p0 = _clip[indices[i]];
+        const XMFLOAT4& p1 = _clip[indices[i + 1]];
+        const XMFLOAT4& p2 = _clip[indices[i + 2]];
+
+        // Clipping would cost more than it's worth here: dropping an occluder is always safe
+        if (p0.w == 0.0f || p1.w == 0.0f || p2.w == 0.0f)
+            continue;
+        _setupTriangle(p0, p1, p2);
+    }
+}
+
+void OcclusionBuffer::_setupTriangle(const XMFLOAT4& p0, const XMFLOAT4& p1, const XMFLOAT4& p2)
+{
+    float x[3], y[3], z[3];
+    const XMFLOAT4* p[3] = { &p0, &p1, &p2 };
+    for (int i = 0; i < 3; i++)
+    {
+        const XMFLOAT4& v = *p[i];
+        float invW = 1.0f / v.w;
+        x[i] = (v.x * invW * 0.5f + 0.5f) * _width;
+        y[i] = (0.5f - v.y * invW * 0.5f) * _height;
+        z[i] = v.z * invW;
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (fabsf(area) < 1e-6f)
+        return;
+    if (area < 0.0f)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    Triangle tri;
+    tri.minX = (std::max)(0, (int)floorf((std::min)({ x[0], x[1], x[2] })));
+    tri.maxX = (std::min)((int)_width - 1, (int)ceilf((std::max)({ x[0], x[1], x[2] })));
+    tri.minY = (std::max)(0, (int)floorf((std::min)({ y[0], y[1], y[2] })));
+    tri.maxY = (std::min)((int)_height - 1, (int)ceilf((std::max)({ y[0], y[1], y[2] })));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        tri.edgeA[i] = -(y[j] - y[i]);
+        tri.edgeB[i] = x[j] - x[i];
+        tri.edgeC[i] = -tri.edgeA[i] * x[i] - tri.edgeB[i] * y[i];
+    }
+
+    tri.zA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+    tri.zB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+    tri.zC = z[0] - tri.zA * x[0] - tri.zB * y[0];
+
+    uint32_t index = (uint32_t)_triangles.size();
+    _triangles.push_back(tri);
+    for (int row = tri.minY / (int)TileSize; row <= tri.maxY / (int)TileSize; row++)
+        _rowBins[row].push_back(index);
+    _stats.occluderTriangles++;
+}
+
+void OcclusionBuffer::Rasterize(ThreadPool* pPool)
+{
+    auto rows = [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t row = begin; row < end; row++)
+            _rasterizeTileRow(row);
+    };
+    if (pPool)
+        pPool->ParallelFor(_tilesY, 1, rows);
+    else
+        rows(0, _tilesY);
+}
+
+void OcclusionBuffer::_rasterizeTileRow(uint32_t row)
+{
+    int rowMinY = (int)(row * TileSize);
+    int rowMaxY = rowMinY + (int)TileSize - 1;
+    float* rowDepth = &_depth[rowMinY * _width];
+    std::fill(rowDepth, rowDepth + TileSize * _width, 0.0f);
+
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t index : _rowBins[row])
+    {
+        const Triangle& tri = _triangles[index];
+        int minY = (std::max)(tri.minY, rowMinY);
+        int maxY = (std::min)(tri.maxY, rowMaxY);
+        int minX = tri.minX & ~3;
+
+        __m128 a0 = _mm_set1_ps(tri.edgeA[0]), a1 = _mm_set1_ps(tri.edgeA[1]), a2 = _mm_set1_ps(tri.edgeA[2]);
+        __m128 za = _mm_set1_ps(tri.zA);
+        // Stepping four pixels to the right adds 4*a to every plane
+        __m128 a0Step = _mm_set1_ps(tri.edgeA[0] * 4.0f), a1Step = _mm_set1_ps(tri.edgeA[1] * 4.0f), a2Step = _mm_set1_ps(tri.edgeA[2] * 4.0f);
+        __m128 zStep = _mm_set1_ps(tri.zA * 4.0f);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)minX), laneOffsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(za, px), _mm_set1_ps(tri.zB * py + tri.zC));
+
+            float* pixel = &_depth[y * _width];
+            for (int x = minX; x <= tri.maxX; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 old = _mm_loadu_ps(pixel + x);
+                    __m128 nearest = _mm_max_ps(old, z);
+                    _mm_storeu_ps(pixel + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                }
+                e0 = _mm_add_ps(e0, a0Step);
+                e1 = _mm_add_ps(e1, a1Step);
+                e2 = _mm_add_ps(e2, a2Step);
+                z = _mm_add_ps(z, zStep);
+            }
+        }
+    }
+
+    // HiZ: the farthest depth of each tile (reverse-Z, so the smallest value)
+    for (uint32_t tx = 0; tx < _tilesX; tx++)
+    {
+        __m128 farthest = _mm_set1_ps(FLT_MAX);
+        for (uint32_t y = 0; y < TileSize; y++)
+        {
+            const float* pixel = rowDepth + y * _width + tx * TileSize;
+            farthest = _mm_min_ps(farthest, _mm_min_ps(_mm_loadu_ps(pixel), _mm_loadu_ps(pixel + 4)));
+        }
+        farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+        farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+        _tileFar[row * _tilesX + tx] = _mm_cvtss_f32(farthest);
+    }
+}
+
+bool OcclusionBuffer::IsVisible(const Aabb& box)
+{
+    _stats.testedObjects++;
+    XMMATRIX viewProjection = XMLoadFloat4x4(&_viewProjection);
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = 0.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        XMVECTOR corner = XMVectorSet(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z, 1.0f);
+        XMFLOAT4 p;
+        XMStoreFloat4(&p, XMVector4Transform(corner, viewProjection));
+
+        // Boxes crossing the near plane are too close to be worth testing
+        if (p.w < 1e-4f || p.z > p.w)
+            return true;
+
+        float invW = 1.0f / p.w;
+        float x = (p.x * invW * 0.5f + 0.5f) * _width;
+        float y = (0.5f - p.y * invW * 0.5f) * _height;
+        minX = (std::min)(minX, x);
+        maxX = (std::max)(maxX, x);
+        minY = (std::min)(minY, y);
+        maxY = (std::max)(maxY, y);
+        nearest = (std::max)(nearest, p.z * invW);
+    }
+
+    int x0 = (std::max)(0, (int)floorf(minX));
+    int x1 = (std::min)((int)_width - 1, (int)ceilf(maxX));
+    int y0 = (std::max)(0, (int)floorf(minY));
+    int y1 = (std::min)((int)_height - 1, (int)ceilf(maxY));
+    if (x0 > x1 || y0 > y1)
+        return true; // off screen, that's for the frustum test to decide
+
+    __m128 boxDepth = _mm_set1_ps(nearest);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+
+    for (int ty = y0 / (int)TileSize; ty <= y1 / (int)TileSize; ty++)
+    {
+        for (int tx = x0 / (int)TileSize; tx <= x1 / (int)TileSize; tx++)
+        {
+            if (_tileFar[ty * _tilesX + tx] > nearest)
+                continue; // the whole tile is in front of the box
+
+            // Partially covered tile: check the pixels of the box rectangle four at a time
+            int px0 = (std::max)(x0, tx * (int)TileSize), px1 = (std::min)(x1, tx * (int)TileSize + (int)TileSize - 1);
+            int py0 = (std::max)(y0, ty * (int)TileSize), py1 = (std::min)(y1, ty * (int)TileSize + (int)TileSize - 1);
+            for (int y = py0; y <= py1; y++)
+            {
+                const float* pixel = &_depth[y * _width];
+                for (int x = px0 & ~3; x <= px1; x += 4)
+                {
+                    __m128i lane = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+                    __m128 inRect = _mm_castsi128_ps(_mm_and_si128(
+                        _mm_cmpgt_epi32(lane, _mm_set1_epi32(px0 - 1)), _mm_cmplt_epi32(lane, _mm_set1_epi32(px1 + 1))));
+                    __m128 uncovered = _mm_cmple_ps(_mm_loadu_ps(pixel + x), boxDepth);
+                    if (_mm_movemask_ps(_mm_and_ps(inRect, uncovered)))
+                        return true;
+                }
+            }
+        }
+    }
+
+    _stats.occludedObjects++;
+    return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "bvh.h"
+#include "threadPool.h"
+
+struct OcclusionStats
+{
+    uint32_t occluderTriangles = 0;
+    uint32_t testedObjects = 0;
+    uint32_t occludedObjects = 0;
+};
+
+// Low-resolution software depth buffer for occlusion culling. Occluder triangles are
+// rasterized with SSE into a reverse-Z depth buffer split in tile rows that run on the
+// worker threads; every 8x8 tile keeps the farthest depth it contains so most object
+// tests finish at the tile level without touching pixels.
+class OcclusionBuffer
+{
+public:
+    static const uint32_t TileSize = 8;
+
+    // The size is rounded up to whole tiles
+    void Resize(uint32_t width, uint32_t height);
+    uint32_t GetWidth() const { return _width; }
+    uint32_t GetHeight() const { return _height; }
+
+    void Begin(FXMMATRIX viewProjection);
+    void AddOccluder(const XMFLOAT3* vertices, uint32_t numVertices, const uint16_t* indices, uint32_t numIndices, FXMMATRIX world);
+    void Rasterize(ThreadPool* pPool);
+
+    // Conservative: false only when every pixel the box covers is behind an occluder
+    bool IsVisible(const Aabb& box);
+
+    const OcclusionStats& GetStats() const { return _stats; }
+    float GetDepth(uint32_t x, uint32_t y) const { return _depth[y * _width + x]; }
+
+private:
+    // Edges and depth as plane equations in pixel coordinates: e = a*x + b*y + c
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        float zA, zB, zC;
+        int minX, minY, maxX, maxY;
+    };
+
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    uint32_t _tilesX = 0;
+    uint32_t _tilesY = 0;
+
+    XMFLOAT4X4 _viewProjection;
+    std::vector<XMFLOAT4> _clip;
+    std::vector<Triangle> _triangles;
+    std::vector<std::vector<uint32_t>> _rowBins;
+    std::vector<float> _depth;
+    std::vector<float> _tileFar;
+    OcclusionStats _stats;
+
+    void _setupTriangle(const XMFLOAT4& p0, const XMFLOAT4& p1, const XMFLOAT4& p2);
+    void _rasterizeTileRow(uint32_t row);
+};
@@ -0,0 +1,260 @@
+#include "profiler.h"
+#include "hiResClock.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// One per thread, written only by that thread. head counts every zone ever finished; the
+// main thread reads from tail up to head.
+struct ProfilerRing
+{
+    ProfileEvent events[ProfilerRingSize];
+    std::atomic<uint64_t> head{ 0 };
+    uint64_t tail = 0;
+    uint32_t thread = 0;
+    uint32_t osThread = 0;
+    std::atomic<const char*> name{ nullptr };
+
+    // Open zones
+    const char* names[ProfilerMaxDepth];
+    int64_t starts[ProfilerMaxDepth];
+    uint32_t depth = 0;
+};
+
+struct ProfilerZone
+{
+    const char* name;
+    uint32_t depth;
+    int64_t firstStart;
+    uint32_t frames;
+    double frameMs;             // this frame so far
+    double minMs;
+    double maxMs;
+    double totalMs;
+};
+
+static std::atomic<bool> g_profilerEnabled{ false };
+// Rings outlive their threads so the last zones of a finished thread can still be read
+static std::mutex g_ringsMutex;
+static std::vector<std::unique_ptr<ProfilerRing>> g_rings;
+static thread_local ProfilerRing* t_pRing = nullptr;
+// Kept apart from the ring so naming a thread that never records costs nothing
+static thread_local const char* t_threadName = nullptr;
+
+// Only touched by the thread calling ProfilerEndFrame
+static std::vector<ProfilerZone> g_zones;
+static std::vector<ProfileEvent> g_frameEvents;
+
+static ProfilerRing* _ring()
+{
+    if (!t_pRing)
+    {
+        std::lock_guard<std::mutex> lock(g_ringsMutex);
+        g_rings.push_back(std::make_unique<ProfilerRing>());
+        t_pRing = g_rings.back().get();
+        t_pRing->thread = (uint32_t)g_rings.size() - 1;
+        t_pRing->name = t_threadName;
+#ifdef _WIN32
+        t_pRing->osThread = GetCurrentThreadId();
+#else
+        t_pRing->osThread = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+    }
+    return t_pRing;
+}
+
+void ProfilerSetEnabled(bool enabled)
+{
+    g_profilerEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool ProfilerIsEnabled()
+{
+    return g_profilerEnabled.load(std::memory_order_relaxed);
+}
+
+void ProfilerBegin(const char* name)
+{
+    ProfilerRing* pRing = _ring();
+    // Zones deeper than the stack are counted but not timed
+    if (pRing->depth < ProfilerMaxDepth)
+    {
+        pRing->names[pRing->depth] = name;
+        pRing->starts[pRing->depth] = ClockNow();
+    }
+    pRing->depth++;
+}
+
+void ProfilerSetThreadName(const char* name)
+{
+    t_threadName = name;
+    if (t_pRing)
+        t_pRing->name.store(name, std::memory_order_relaxed);
+}
+
+void ProfilerEnd()
+{
+    ProfilerRing* pRing = _ring();
+    if (pRing->depth == 0)
+        return;
+    pRing->depth--;
+    if (pRing->depth >= ProfilerMaxDepth)
+        return;
+
+    uint64_t head = pRing->head.load(std::memory_order_relaxed);
+    ProfileEvent& event = pRing->events[head % ProfilerRingSize];
+    event.name = pRing->names[pRing->depth];
+    event.start = pRing->starts[pRing->depth];
+    event.end = ClockNow();
+    event.depth = pRing->depth;
+    event.thread = pRing->thread;
+    pRing->head.store(head + 1, std::memory_order_release);
+}
+
+static ProfilerZone& _zone(const ProfileEvent& event)
+{
+    // Literals usually share an address, the comparison catches the ones that don't
+    for (ProfilerZone& zone : g_zones)
+    {
+        if (zone.name == event.name || strcmp(zone.name, event.name) == 0)
+        {
+            zone.firstStart = (std::min)(zone.firstStart, event.start);
+            return zone;
+        }
+    }
+    ProfilerZone zone = {};
+    zone.name = event.name;
+    zone.depth = event.depth;
+    zone.firstStart = event.start;
+    g_zones.push_back(zone);
+    return g_zones.back();
+}
+
+void ProfilerEndFrame()
+{
+    g_frameEvents.clear();
+    {
+        std::lock_guard<std::mutex> lock(g_ringsMutex);
+        for (std::unique_ptr<ProfilerRing>& pRing : g_rings)
+        {
+            uint64_t head = pRing->head.load(std::memory_order_acquire);
+            uint64_t first = head - (std::min)(head - pRing->tail, (uint64_t)ProfilerRingSize);
+            size_t copied = g_frameEvents.size();
+            for (uint64_t i = first; i < head; i++)
+                g_frameEvents.push_back(pRing->events[i % ProfilerRingSize]);
+            // Slots the thread reused while they were copied are dropped, and the one it may
+            // be writing now: event reused goes where event reused - ProfilerRingSize was
+            uint64_t reused = pRing->head.load(std::memory_order_acquire);
+            if (reused + 1 - first > ProfilerRingSize)
+            {
+                size_t lost = (size_t)(std::min)(reused + 1 - first - ProfilerRingSize, head - first);
+                g_frameEvents.erase(g_frameEvents.begin() + copied, g_frameEvents.begin() + copied + lost);
+            }
+            pRing->tail = head;
+        }
+    }
+
+    for (ProfilerZone& zone : g_zones)
+        zone.frameMs = -1.0;
+    for (const ProfileEvent& event : g_frameEvents)
+    {
+        ProfilerZone& zone = _zone(event);
+        zone.frameMs = (std::max)(zone.frameMs, 0.0) + ClockMilliseconds(event.end - event.start);
+    }
+    for (ProfilerZone& zone : g_zones)
+    {
+        if (zone.frameMs < 0.0)
+            continue;
+        zone.minMs = zone.frames ? (std::min)(zone.minMs, zone.frameMs) : zone.frameMs;
+        zone.maxMs = zone.frames ? (std::max)(zone.maxMs, zone.frameMs) : zone.frameMs;
+        zone.totalMs += zone.frameMs;
+        zone.frames++;
+    }
+}
+
+const std::vector<ProfileEvent>& ProfilerGetFrameEvents()
+{
+    return g_frameEvents;
+}
+
+void ProfilerGetThreads(std::vector<ProfileThread>& threads)
+{
+    std::lock_guard<std::mutex> lock(g_ringsMutex);
+    threads.resize(g_rings.size());
+    for (size_t i = 0; i < g_rings.size(); i++)
+    {
+        threads[i].id = g_rings[i]->osThread;
+        threads[i].name = g_rings[i]->name.load(std::memory_order_relaxed);
+    }
+}
+
+void ProfilerGetStats(std::vector<ProfileZoneStats>& stats)
+{
+    std::vector<const ProfilerZone*> order;
+    for (const ProfilerZone& zone : g_zones)
+    {
+        if (zone.frames > 0)
+            order.push_back(&zone);
+    }
+    std::sort(order.begin(), order.end(), [](const ProfilerZone* a, const ProfilerZone* b) { return a->firstStart < b->firstStart; });
+
+    stats.clear();
+    for (const ProfilerZone* pZone : order)
+    {
+        ProfileZoneStats zone;
+        zone.name = pZone->name;
+        zone.depth = pZone->depth;
+        zone.frames = pZone->frames;
+        zone.minMs = pZone->minMs;
+        zone.avgMs = pZone->totalMs / pZone->frames;
+        zone.maxMs = pZone->maxMs;
+        stats.push_back(zone);
+    }
+}
+
+void ProfilerResetStats()
+{
+    g_zones.clear();
+}
+
+std::string ProfilerFormatStats(const std::vector<ProfileZoneStats>& stats)
+{
+    std::string text = "zone                              frames     min ms     avg ms     max ms\n";
+    for (const ProfileZoneStats& zone : stats)
+    {
+        char line[160];
+        std::string name = std::string(2 * (std::min)(zone.depth, 8u), ' ') + zone.name;
+        snprintf(line, sizeof(line), "%-32s %8u %10.3f %10.3f %10.3f\n", name.c_str(), zone.frames, zone.minMs, zone.avgMs, zone.maxMs);
+        text += line;
+    }
+    return text;
+}
+
+std::string ProfilerFormatTopZones(const std::vector<ProfileZoneStats>& stats, uint32_t count)
+{
+    // Outermost zones like the frame or a worker's wait are skipped, they'd top every list
+    std::vector<const ProfileZoneStats*> nested;
+    for (const ProfileZoneStats& zone : stats)
+    {
+        if (zone.depth > 0)
+            nested.push_back(&zone);
+    }
+    std::sort(nested.begin(), nested.end(), [](const ProfileZoneStats* a, const ProfileZoneStats* b) { return a->avgMs > b->avgMs; });
+
+    std::string text;
+    for (size_t i = 0; i < nested.size() && i < count; i++)
+    {
+        char part[96];
+        snprintf(part, sizeof(part), "%s%s %.2f/%.2f/%.2f ms", i ? ", " : "", nested[i]->name, nested[i]->minMs,
+            nested[i]->avgMs, nested[i]->maxMs);
+        text += part;
+    }
+    return text;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Scoped CPU profiler. PROFILE_ZONE("name") times the rest of the enclosing block; zones
+// nest. Every thread writes its finished zones into a ring of its own without locking, and
+// ProfilerEndFrame, called once a frame by the main thread, empties the rings and adds
+// the frame to per-zone statistics. Names must be string literals or otherwise outlive
+// the profiler. Turned off, a zone costs one load of a flag.
+static const uint32_t ProfilerRingSize = 8192;     // zones a thread can finish between two frames
+static const uint32_t ProfilerMaxDepth = 32;
+
+struct ProfileEvent
+{
+    const char* name;
+    int64_t start;              // ClockNow ticks
+    int64_t end;
+    uint32_t depth;             // 0 for a zone outside any other
+    uint32_t thread;            // threads are numbered in the order they first record
+};
+
+struct ProfileThread
+{
+    uint32_t id;                // operating system thread id
+    const char* name;           // nullptr until ProfilerSetThreadName
+};
+
+// Time a zone took per frame, summed over its runs and threads, over the frames it ran in
+struct ProfileZoneStats
+{
+    const char* name;
+    uint32_t depth;
+    uint32_t frames;
+    double minMs;
+    double avgMs;
+    double maxMs;
+};
+
+void ProfilerSetEnabled(bool enabled);
+bool ProfilerIsEnabled();
+
+void ProfilerBegin(const char* name);
+void ProfilerEnd();
+// Labels the calling thread in captures
+void ProfilerSetThreadName(const char* name);
+
+void ProfilerEndFrame();
+// Every zone ProfilerEndFrame collected, in no particular order
+const std::vector<ProfileEvent>& ProfilerGetFrameEvents();
+// Indexed by ProfileEvent::thread
+void ProfilerGetThreads(std::vector<ProfileThread>& threads);
+// Zones in the order they first started, so children follow their parents
+void ProfilerGetStats(std::vector<ProfileZoneStats>& stats);
+void ProfilerResetStats();
+// The statistics as a table, a zone per line indented by depth
+std::string ProfilerFormatStats(const std::vector<ProfileZoneStats>& stats);
+// The count nested zones with the highest average on one line, "name min/avg/max ms"
+std::string ProfilerFormatTopZones(const std::vector<ProfileZoneStats>& stats, uint32_t count);
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : _active(ProfilerIsEnabled())
+    {
+        if (_active)
+            ProfilerBegin(name);
+    }
+    ~ProfileScope()
+    {
+        if (_active)
+            ProfilerEnd();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool _active;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(_profileZone, __LINE__)(name)
@@ -0,0 +1,362 @@
+#include "rayTracer.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const uint32_t SahBins = 16;
+static const uint32_t MaxTraceDepth = 256;
+
+static float _halfArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+{
+    float dx = mx.x - mn.x, dy = mx.y - mn.y, dz = mx.z - mn.z;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static void _grow(XMFLOAT3& mn, XMFLOAT3& mx, const XMFLOAT3& bmin, const XMFLOAT3& bmax)
+{
+    mn.x = (std::min)(mn.x, bmin.x); mn.y = (std::min)(mn.y, bmin.y); mn.z = (std::min)(mn.z, bmin.z);
+    mx.x = (std::max)(mx.x, bmax.x); mx.y = (std::max)(mx.y, bmax.y); mx.z = (std::max)(mx.z, bmax.z);
+}
+
+static float _axis(const XMFLOAT3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+void RayTracer::AddMesh(const XMFLOAT3* positions, size_t stride, const uint32_t* indices, size_t numIndices, FXMMATRIX world)
+{
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(positions);
+    size_t first = _triangles.size();
+    _triangles.resize(first + numIndices / 3 * 3);
+    for (size_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const XMFLOAT3* p = reinterpret_cast<const XMFLOAT3*>(base + indices[i + corner] * stride);
+            XMStoreFloat3(&_triangles[first + i + corner], XMVector3TransformCoord(XMLoadFloat3(p), world));
+        }
+    }
+}
+
+void RayTracer::Clear()
+{
+    _triangles.clear();
+    _nodes.clear();
+    _packets.clear();
+    _root = EmptyChild;
+    _bounds = {};
+}
+
+void RayTracer::Build()
+{
+    _nodes.clear();
+    _packets.clear();
+    _root = EmptyChild;
+
+    uint32_t count = (uint32_t)GetTriangleCount();
+    std::vector<BuildRef> refs(count);
+    _bounds = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const XMFLOAT3* corners = &_triangles[i * 3];
+        BuildRef& ref = refs[i];
+        ref.min = ref.max = corners[0];
+        _grow(ref.min, ref.max, corners[1], corners[1]);
+        _grow(ref.min, ref.max, corners[2], corners[2]);
+        ref.center = XMFLOAT3((ref.min.x + ref.max.x) * 0.5f, (ref.min.y + ref.max.y) * 0.5f, (ref.min.z + ref.max.z) * 0.5f);
+        ref.triangle = i;
+        _grow(_bounds.min, _bounds.max, ref.min, ref.max);
+    }
+    if (count == 0)
+    {
+        _bounds = {};
+        return;
+    }
+
+    _nodes.reserve(count / 2 + 1);
+    _packets.reserve(count / 2 + 1);
+    _root = _buildNode(refs, 0, count);
+}
+
+uint32_t RayTracer::_makeLeaf(const std::vector<BuildRef>& refs, uint32_t begin, uint32_t end)
+{
+    Packet packet = {};
+    for (uint32_t i = 0; i < LeafSize; i++)
+    {
+        if (begin + i >= end)
+        {
+            packet.ids[i] = 0xFFFFFFFF;
+            continue;
+        }
+        uint32_t triangle = refs[begin + i].triangle;
+        const XMFLOAT3* corners = &_triangles[triangle * 3];
+        packet.v0x[i] = corners[0].x; packet.v0y[i] = corners[0].y; packet.v0z[i] = corners[0].z;
+        packet.e1x[i] = corners[1].x - corners[0].x; packet.e1y[i] = corners[1].y - corners[0].y; packet.e1z[i] = corners[1].z - corners[0].z;
+        packet.e2x[i] = corners[2].x - corners[0].x; packet.e2y[i] = corners[2].y - corners[0].y; packet.e2z[i] = corners[2].z - corners[0].z;
+        packet.ids[i] = triangle;
+    }
+    _packets.push_back(packet);
+    return (uint32_t)(_packets.size() - 1) | LeafFlag;
+}
+
+uint32_t RayTracer::_splitRange(std::vector<BuildRef>& refs, uint32_t begin, uint32_t end) const
+{
+    XMFLOAT3 cmin(FLT_MAX, FLT_MAX, FLT_MAX), cmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t i = begin; i < end; i++)
+        _grow(cmin, cmax, refs[i].center, refs[i].center);
+
+    int axis = 0;
+    XMFLOAT3 extent(cmax.x - cmin.x, cmax.y - cmin.y, cmax.z - cmin.z);
+    if (extent.y > extent.x && extent.y >= extent.z)
+        axis = 1;
+    else if (extent.z > extent.x)
+        axis = 2;
+
+    uint32_t mid = (begin + end) / 2;
+    float lo = _axis(cmin, axis), size = _axis(extent, axis);
+    if (size <= 0.0f)
+        return mid; // all centers coincide, any split is as good
+
+    // Binned SAH: cost of every split between bins from prefix and suffix boxes
+    struct Bin
+    {
+        XMFLOAT3 min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        uint32_t count = 0;
+    } bins[SahBins];
+    float scale = SahBins * (1.0f - 1e-5f) / size;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        Bin& bin = bins[(uint32_t)((_axis(refs[i].center, axis) - lo) * scale)];
+        _grow(bin.min, bin.max, refs[i].min, refs[i].max);
+        bin.count++;
+    }
+
+    float rightCost[SahBins] = {};
+    Bin right;
+    for (uint32_t i = SahBins - 1; i > 0; i--)
+    {
+        _grow(right.min, right.max, bins[i].min, bins[i].max);
+        right.count += bins[i].count;
+        rightCost[i] = right.count ? _halfArea(right.min, right.max) * right.count : 0.0f;
+    }
+
+    float bestCost = FLT_MAX;
+    uint32_t bestSplit = 0;
+    Bin left;
+    for (uint32_t i = 0; i + 1 < SahBins; i++)
+    {
+        _grow(left.min, left.max, bins[i].min, bins[i].max);
+        left.count += bins[i].count;
+        float cost = (left.count ? _halfArea(left.min, left.max) * left.count : 0.0f) + rightCost[i + 1];
+        if (left.count > 0 && left.count < end - begin && cost < bestCost)
+        {
+            bestCost = cost;
+            bestSplit = i + 1;
+        }
+    }
+    if (bestSplit == 0)
+        return mid;
+
+    BuildRef* split = std::partition(refs.data() + begin, refs.data() + end, [&](const BuildRef& ref)
+        {
+            return (uint32_t)((_axis(ref.center, axis) - lo) * scale) < bestSplit;
+        });
+    uint32_t result = (uint32_t)(split - refs.data());
+    return result == begin || result == end ? mid : result;
+}
+
+uint32_t RayTracer::_buildNode(std::vector<BuildRef>& refs, uint32_t begin, uint32_t end)
+{
+    if (end - begin <= LeafSize)
+        return _makeLeaf(refs, begin, end);
+
+    // Two levels of binary splits give the up to four children of the node
+    uint32_t ranges[4][2] = { { begin, end } };
+    uint32_t numRanges = 1;
+    while (numRanges < 4)
+    {
+        uint32_t largest = 0;
+        for (uint32_t i = 1; i < numRanges; i++)
+        {
+            if (ranges[i][1] - ranges[i][0] > ranges[largest][1] - ranges[largest][0])
+                largest = i;
+        }
+        if (ranges[largest][1] - ranges[largest][0] <= LeafSize)
+            break;
+        uint32_t mid = _splitRange(refs, ranges[largest][0], ranges[largest][1]);
+        ranges[numRanges][0] = mid;
+        ranges[numRanges][1] = ranges[largest][1];
+        ranges[largest][1] = mid;
+        numRanges++;
+    }
+
+    uint32_t node = (uint32_t)_nodes.size();
+    _nodes.emplace_back();
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        XMFLOAT3 mn(FLT_MAX, FLT_MAX, FLT_MAX), mx(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        uint32_t child = EmptyChild;
+        if (i < numRanges)
+        {
+            for (uint32_t j = ranges[i][0]; j < ranges[i][1]; j++)
+                _grow(mn, mx, refs[j].min, refs[j].max);
+            child = _buildNode(refs, ranges[i][0], ranges[i][1]);
+        }
+
+        // _buildNode may have grown the array
+        Node& n = _nodes[node];
+        n.minX[i] = mn.x; n.minY[i] = mn.y; n.minZ[i] = mn.z;
+        n.maxX[i] = mx.x; n.maxY[i] = mx.y; n.maxZ[i] = mx.z;
+        n.children[i] = child;
+    }
+    return node;
+}
+
+XMFLOAT3 RayTracer::GetFaceNormal(uint32_t triangle) const
+{
+    XMVECTOR p0 = XMLoadFloat3(&_triangles[triangle * 3]);
+    XMVECTOR p1 = XMLoadFloat3(&_triangles[triangle * 3 + 1]);
+    XMVECTOR p2 = XMLoadFloat3(&_triangles[triangle * 3 + 2]);
+    XMFLOAT3 normal;
+    XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0))));
+    return normal;
+}
+
+bool RayTracer::Intersect(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax, RayHit& hit) const
+{
+    return _trace<false>(origin, dir, tMax, &hit);
+}
+
+bool RayTracer::Occluded(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax) const
+{
+    return _trace<true>(origin, dir, tMax, nullptr);
+}
+
+static int _firstBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+template <bool AnyHit>
+bool RayTracer::_trace(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax, RayHit* pHit) const
+{
+    if (_root == EmptyChild)
+        return false;
+
+    // Zero direction components would give 0 * inf in the slab test
+    auto safeInverse = [](float d) { return 1.0f / (fabsf(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f)); };
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+    const __m128 ix = _mm_set1_ps(safeInverse(dir.x)), iy = _mm_set1_ps(safeInverse(dir.y)), iz = _mm_set1_ps(safeInverse(dir.z));
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), detEpsilon = _mm_set1_ps(1e-20f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    float tBest = tMax;
+    bool found = false;
+    uint32_t stack[MaxTraceDepth];
+    uint32_t depth = 0;
+    stack[depth++] = _root;
+
+    while (depth > 0)
+    {
+        uint32_t ref = stack[--depth];
+        __m128 tLimit = _mm_set1_ps(tBest);
+
+        if (ref & LeafFlag)
+        {
+            // Moller-Trumbore on four triangles at once
+            const Packet& p = _packets[ref & ~LeafFlag];
+            __m128 e1x = _mm_load_ps(p.e1x), e1y = _mm_load_ps(p.e1y), e1z = _mm_load_ps(p.e1z);
+            __m128 e2x = _mm_load_ps(p.e2x), e2y = _mm_load_ps(p.e2y), e2z = _mm_load_ps(p.e2z);
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 invDet = _mm_div_ps(one, det);
+
+            __m128 tx = _mm_sub_ps(ox, _mm_load_ps(p.v0x)), ty = _mm_sub_ps(oy, _mm_load_ps(p.v0y)), tz = _mm_sub_ps(oz, _mm_load_ps(p.v0z));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+            __m128 mask = _mm_cmpgt_ps(_mm_and_ps(det, absMask), detEpsilon);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, tLimit));
+            int bits = _mm_movemask_ps(mask);
+            if (bits == 0)
+                continue;
+            if (AnyHit)
+                return true;
+
+            alignas(16) float ts[4], us[4], vs[4];
+            _mm_store_ps(ts, t);
+            _mm_store_ps(us, u);
+            _mm_store_ps(vs, v);
+            while (bits)
+            {
+                int lane = _firstBit((uint32_t)bits);
+                bits &= bits - 1;
+                if (ts[lane] < tBest)
+                {
+                    tBest = ts[lane];
+                    pHit->t = ts[lane];
+                    pHit->triangle = p.ids[lane];
+                    pHit->u = us[lane];
+                    pHit->v = vs[lane];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // Slab test of the four child boxes
+        const Node& n = _nodes[ref];
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.minX), ox), ix), tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.maxX), ox), ix);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.minY), oy), iy), ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.maxY), oy), iy);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.minZ), oz), iz), tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.maxZ), oz), iz);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_max_ps(_mm_min_ps(tz1, tz2), zero));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_min_ps(_mm_max_ps(tz1, tz2), tLimit));
+        int bits = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+        if (bits == 0)
+            continue;
+
+        alignas(16) float nears[4];
+        _mm_store_ps(nears, tNear);
+        uint32_t hits[4];
+        float hitNears[4];
+        uint32_t numHits = 0;
+        while (bits)
+        {
+            int lane = _firstBit((uint32_t)bits);
+            bits &= bits - 1;
+            if (n.children[lane] == EmptyChild)
+                continue;
+
+            // Keep the hits sorted far to near so the nearest child is popped first
+            uint32_t j = numHits++;
+            for (; j > 0 && (AnyHit || hitNears[j - 1] < nears[lane]); j--)
+            {
+                hits[j] = hits[j - 1];
+                hitNears[j] = hitNears[j - 1];
+            }
+            hits[j] = n.children[lane];
+            hitNears[j] = nears[lane];
+        }
+        for (uint32_t i = 0; i < numHits && depth < MaxTraceDepth; i++)
+            stack[depth++] = hits[i];
+    }
+    return found;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "bvh.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+struct RayHit
+{
+    float t;
+    uint32_t triangle;  // in the order the triangles were added
+    float u, v;         // barycentrics of the second and third corner
+};
+
+// Triangle ray tracer for offline work such as baking. The triangles are kept in a 4-wide
+// BVH: every node holds the boxes of its four children side by side so one SSE pass tests
+// a ray against all of them, and the leaves store their triangles four at a time in the
+// same layout. Rays are two-sided.
+class RayTracer
+{
+public:
+    // indices are relative to positions; the triangles are transformed to world space here
+    void AddMesh(const XMFLOAT3* positions, size_t stride, const uint32_t* indices, size_t numIndices, FXMMATRIX world);
+    void Build();
+    void Clear();
+
+    size_t GetTriangleCount() const { return _triangles.size() / 3; }
+    const Aabb& GetBounds() const { return _bounds; }
+
+    // Closest hit in (0, tMax)
+    bool Intersect(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax, RayHit& hit) const;
+    // Any hit in (0, tMax), for shadow and occlusion rays
+    bool Occluded(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax) const;
+    // Outward for clockwise triangles, the winding of meshgen.h meshes
+    XMFLOAT3 GetFaceNormal(uint32_t triangle) const;
+
+    static const uint32_t LeafSize = 4;
+
+private:
+    // Child references: inner nodes by index, leaves by their packet with the top bit set
+    static const uint32_t LeafFlag = 0x80000000;
+    static const uint32_t EmptyChild = 0xFFFFFFFF;
+
+    struct alignas(16) Node
+    {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        uint32_t children[4];
+    };
+
+    // Four triangles as a corner and two edges each; unused lanes have zero edges and never hit
+    struct alignas(16) Packet
+    {
+        float v0x[4], v0y[4], v0z[4];
+        float e1x[4], e1y[4], e1z[4];
+        float e2x[4], e2y[4], e2z[4];
+        uint32_t ids[4];
+    };
+
+    struct BuildRef
+    {
+        XMFLOAT3 min, max, center;
+        uint32_t triangle;
+    };
+
+    std::vector<XMFLOAT3> _triangles;   // three world-space corners per triangle
+    std::vector<Node> _nodes;
+    std::vector<Packet> _packets;
+    uint32_t _root = EmptyChild;
+    Aabb _bounds = {};
+
+    uint32_t _buildNode(std::vector<BuildRef>& refs, uint32_t begin, uint32_t end);
+    uint32_t _splitRange(std::vector<BuildRef>& refs, uint32_t begin, uint32_t end) const;
+    uint32_t _makeLeaf(const std::vector<BuildRef>& refs, uint32_t begin, uint32_t end);
+
+    template <bool AnyHit>
+    bool _trace(const XMFLOAT3& origin, const XMFLOAT3& dir, float tMax, RayHit* pHit) const;
+};
@@ -1,26 +1,21 @@
 #include "renderer.h"
 
-float Renderer::_getDistToTrans(XMMATRIX worldMatrix, XMFLOAT3 cameraPos) {
-    XMFLOAT4 rectVert[3];
-    float maxDist = -D3D11_FLOAT32_MAX;
-
-    for (int i = 0; i < 3; i++) {
-        rectVert[i].x = TransVertices[i].x;
-        rectVert[i].y = TransVertices[i].y;
-        rectVert[i].z = TransVertices[i].z;
-        rectVert[i].w = 1;
-    }
-    for (int i = 0; i < 3; i++) {
-        XMStoreFloat4(&rectVert[i], XMVector4Transform(XMLoadFloat4(&rectVert[i]), worldMatrix));
-        float dist = (rectVert[i].x * cameraPos.x) + (rectVert[i].y * cameraPos.y) + (rectVert[i].z * cameraPos.z);
-        maxDist = max(maxDist, dist);
-    }
-
-    return maxDist;
+void Renderer::_appendSphere(UINT latLines, UINT longLines, std::vector<SphereVertex>& vertices, std::vector<USHORT>& indices)
+{
+    // latLines counts the poles as lines, so there is one band less
+    Mesh sphere = GenerateUVSphere(latLines - 1, longLines);
+    OptimizeMesh(sphere);
+
+    // Indices stay relative to the first vertex of this sphere, the draw adds the base vertex
+    for (const MeshVertex& v : sphere.vertices)
+        vertices.push_back({ v.pos.x, v.pos.y, v.pos.z });
+    std::vector<uint16_t> sphereIndices = sphere.GetIndices16();
+    indices.insert(indices.end(), sphereIndices.begin(), sphereIndices.end());
 }
 
 HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
 {
+    PROFILE_ZONE("init");
     HRESULT hr = S_OK;
 
     RECT rc;
@@ -109,14 +104,28 @@ HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
         sd.SampleDesc.Count = 1;
         sd.SampleDesc.Quality = 0;
         sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-        sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
         sd.BufferCount = 2;
 
-        hr = dxgiFactory2->CreateSwapChainForHwnd(_pd3dDevice, hWnd, &sd, nullptr, nullptr, &_pSwapChain1);
+        // Prefer FLIP_DISCARD (Windows 10) with a frame-latency waitable object (Windows 8.1),
+        // falling back to plain flip-sequential on older systems
+        const DXGI_SWAP_EFFECT swapEffects[] = { DXGI_SWAP_EFFECT_FLIP_DISCARD, DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL, DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL };
+        const UINT swapFlags[] = { DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT, DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT, 0 };
+        for (int i = 0; i < ARRAYSIZE(swapEffects); i++)
+        {
+            sd.SwapEffect = swapEffects[i];
+            sd.Flags = swapFlags[i];
+            hr = dxgiFactory2->CreateSwapChainForHwnd(_pd3dDevice, hWnd, &sd, nullptr, nullptr, &_pSwapChain1);
+            if (SUCCEEDED(hr))
+                break;
+        }
         if (SUCCEEDED(hr))
         {
             hr = _pSwapChain1->QueryInterface(__uuidof(IDXGISwapChain), reinterpret_cast<void**>(&_pSwapChain));
         }
+        if (SUCCEEDED(hr))
+        {
+            hr = _pacer.Init(_pd3dDevice, _pSwapChain, sd.Flags != 0);
+        }
 
         dxgiFactory2->Release();
     }
@@ -139,6 +148,10 @@ HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
         sd.Windowed = TRUE;
 
         hr = dxgiFactory->CreateSwapChain(_pd3dDevice, &sd, &_pSwapChain);
+        if (SUCCEEDED(hr))
+        {
+            hr = _pacer.Init(_pd3dDevice, _pSwapChain, false);
+        }
     }
 
     // Note this tutorial doesn't handle full-screen swapchains so we block the ALT+ENTER shortcut
@@ -155,6 +168,9 @@ HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
     if (SUCCEEDED(hr))
         hr = _setupDepthBuffer();
 
+    if (SUCCEEDED(hr))
+        hr = _setupOitTargets();
+
     // Setup the viewport
     D3D11_VIEWPORT vp;
     vp.Width = (FLOAT)_width;
@@ -168,11 +184,61 @@ HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
     if (SUCCEEDED(hr)) 
         hr = _initScene();
 
+    if (SUCCEEDED(hr))
+        hr = _initShadows();
+
+    // A broken model file isn't fatal, the scene is drawn without it
+    if (SUCCEEDED(hr) && !_modelPath.empty() && !_initModel())
+    {
+        OutputDebugStringA(("Can't load mesh file " + _modelPath + "\n").c_str());
+        _modelSubmeshes.clear();
+    }
+
+    // Without a lightmap every object is lit at runtime
+    if (SUCCEEDED(hr) && !_lightmapPath.empty() && !_initLightmap())
+    {
+        OutputDebugStringA(("Can't load lightmap " + _lightmapPath + "\n").c_str());
+        SAFE_RELEASE(_pLightmapSRV);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _workers.Init();
+        _occlusion.Resize(OcclusionWidth, OcclusionWidth * _height / (std::max)(_width, 1u));
+    }
+
+    // Needs the model's geometry and the workers
+    if (SUCCEEDED(hr))
+        hr = _initProbes();
+
     if (SUCCEEDED(hr)) 
     {
         _pCamera = new Camera;
         if (!_pCamera) 
             hr = S_FALSE;
+        else
+            _pCamera->SetProjection(CameraFovY, _width / (FLOAT)_height, CameraNearZ, _farZ);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ResetSimulation(_simCurrent);
+        _simPrevious = _simCurrent;
+    }
+
+    // Without raw input the camera follows the cursor instead
+    if (SUCCEEDED(hr))
+        _mouse.Register(hWnd);
+
+    // Without timestamp queries traces only have the CPU side
+    if (SUCCEEDED(hr) && FAILED(_gpuProfiler.Init(_pd3dDevice)))
+        OutputDebugStringA("Can't create timestamp queries\n");
+
+    // A missing path leaves the camera interactive
+    if (SUCCEEDED(hr) && !_replayPath.empty() && !_cameraPath.Load(_replayPath.c_str()))
+    {
+        OutputDebugStringA(("Can't load camera path " + _replayPath + "\n").c_str());
+        _replayPath.clear();
     }
 
     if (FAILED(hr))
@@ -181,16 +247,37 @@ HRESULT Renderer::InitDevice(HINSTANCE hInstance, HWND hWnd)
     return hr;
 }
 
+void Renderer::SetFramePacing(UINT maxFramesInFlight, bool vsync, float fpsCap)
+{
+    _pacer.Configure(maxFramesInFlight, vsync, fpsCap);
+}
+
 void Renderer::Render()
 {
+    _pacer.BeginFrame();
+    PROFILE_ZONE("frame");
+    int64_t frameStart = ClockNow();
+
+    // A frame that can't be drawn still ends in a Present, blank: the frame latency wait
+    // before Render took a slot only a Present gives back, and the pacer's frame ends there
     if (!_updateScene())
+    {
+        _pImmediateContext->ClearRenderTargetView(_pRenderTargetView, &SceneClearColor.x);
+        HRESULT hr = _pacer.Present(_pSwapChain);
+        assert(SUCCEEDED(hr));
         return;
+    }
+
+    // GPU ranges are only worth their queries while a trace is recorded
+    if (_trace.IsRecording())
+        _gpuProfiler.BeginFrame(_pImmediateContext, ClockNow());
 
     _pImmediateContext->ClearState();
+    _renderShadows();
 
     ID3D11RenderTargetView* views[] = { _pRenderTargetView };
     _pImmediateContext->OMSetRenderTargets(1, views, _pDepthBufferDSV);
-    _pImmediateContext->ClearRenderTargetView(_pRenderTargetView, Colors::LightPink);
+    _pImmediateContext->ClearRenderTargetView(_pRenderTargetView, &SceneClearColor.x);
     _pImmediateContext->ClearDepthStencilView(_pDepthBufferDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
 
     D3D11_VIEWPORT vp;
@@ -210,14 +297,18 @@ void Renderer::Render()
 
     _pImmediateContext->RSSetScissorRects(1, &rect);
     _pImmediateContext->RSSetState(_pRasterizerState);
-    ID3D11SamplerState* samplers[] = { _pSampler };
-    _pImmediateContext->PSSetSamplers(0, 1, samplers);
+    ID3D11SamplerState* samplers[] = { _pSampler, _pShadowSampler, _pProbeSampler };
+    _pImmediateContext->PSSetSamplers(0, 3, samplers);
+    ID3D11ShaderResourceView* lightResources[] = { _pClusterLightSRV, _pClusterRangeSRV, _pClusterIndexSRV, _pShadowSRV };
+    _pImmediateContext->PSSetShaderResources(4, 4, lightResources);
+    _pImmediateContext->PSSetShaderResources(9, 1, &_pProbeSRV);
     //-----------SkyBox-------------
     {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "skybox pass");
         _pImmediateContext->OMSetDepthStencilState(_pZeroDepthState, 0);
         ID3D11ShaderResourceView* resources[] = { _pSkyboxTexture };
         _pImmediateContext->PSSetShaderResources(0, 1, resources);
-        _pImmediateContext->IASetIndexBuffer(_pSkyboxIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+        _pImmediateContext->IASetIndexBuffer(_pSkyboxIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
         ID3D11Buffer* vBuffers[] = { _pSkyboxVertexBuffer };
         UINT strides[] = { 12 };
         UINT offsets[] = { 0 };
@@ -225,37 +316,70 @@ void Renderer::Render()
         _pImmediateContext->IASetInputLayout(_pSkyboxInputLayout);
         _pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         _pImmediateContext->VSSetShader(_pSkyboxVertexShader, nullptr, 0);
-        _pImmediateContext->VSSetConstantBuffers(0, 1, &_pSkyboxWorldMatrixBuffer);
+        _cbRing.BindVS(_pImmediateContext, 0, _skyboxWorldSlice);
         _pImmediateContext->VSSetConstantBuffers(1, 1, &_pSkyboxViewMatrixBuffer);
         _pImmediateContext->PSSetShader(_pSkyboxPixelShader, nullptr, 0);
-        _pImmediateContext->DrawIndexed(_numSphereTriangles * 3, 0, 0);
+        _pImmediateContext->DrawIndexed(_sphereLods[0].indexCount, _sphereLods[0].startIndex, _sphereLods[0].baseVertex);
     }
     //-----------Cubes-------------
     {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "cube pass");
         _pImmediateContext->OMSetDepthStencilState(_pDepthState, 0);
         ID3D11ShaderResourceView* resources[2] = {_pTexture, _pNormTexture };
         _pImmediateContext->PSSetShaderResources(0, 2, resources);
+        _pImmediateContext->PSSetShaderResources(8, 1, &_pLightmapSRV);
         _pImmediateContext->IASetIndexBuffer(_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-        ID3D11Buffer* vBuffers[] = { _pVertexBuffer };
-        UINT strides[] = { sizeof(TexVertex)};
-        UINT offsets[] = { 0 };
-        _pImmediateContext->IASetVertexBuffers(0, 1, vBuffers, strides, offsets);
+        ID3D11Buffer* vBuffers[] = { _pVertexBuffer, _pLightmapUVBuffer };
+        UINT strides[] = { sizeof(PackedVertex), sizeof(XMUSHORTN2) };
+        UINT offsets[] = { 0, 0 };
+        _pImmediateContext->IASetVertexBuffers(0, 2, vBuffers, strides, offsets);
         _pImmediateContext->IASetInputLayout(_pInputLayout);
         _pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        _pImmediateContext->VSSetConstantBuffers(0, 1, &_pWorldMatrixBuffer[0]);
         _pImmediateContext->VSSetConstantBuffers(1, 1, &_pViewMatrixBuffer);
         _pImmediateContext->VSSetShader(_pVertexShader, nullptr, 0);
         _pImmediateContext->PSSetShader(_pPixelShader, nullptr, 0);
         _pImmediateContext->PSSetConstantBuffers(1, 1, &_pViewMatrixBuffer);
-        _pImmediateContext->PSSetConstantBuffers(0, 1, &_pWorldMatrixBuffer[0]);
-        _pImmediateContext->DrawIndexed(36, 0, 0); 
-        _pImmediateContext->VSSetConstantBuffers(0, 1, &_pWorldMatrixBuffer[1]);
-        _pImmediateContext->DrawIndexed(36, 0, 0);
+        for (int i = 0; i < 2; i++)
+        {
+            if (!_objectVisible[CubeObject + i])
+                continue;
+            _cbRing.BindVS(_pImmediateContext, 0, _worldSlice[i]);
+            _cbRing.BindPS(_pImmediateContext, 0, _worldSlice[i]);
+            _pImmediateContext->DrawIndexed(36, 0, 0);
+        }
+    }
+    //-----------Model-------------
+    if (!_modelSubmeshes.empty() && _objectVisible[_getModelObject()])
+    {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "model pass");
+        // Same pipeline and textures as the cubes
+        ID3D11Buffer* vBuffers[] = { _pModelVertexBuffer, _pModelLightmapUVBuffer };
+        UINT strides[] = { sizeof(PackedVertex), sizeof(XMUSHORTN2) };
+        UINT offsets[] = { 0, 0 };
+        _pImmediateContext->IASetVertexBuffers(0, 2, vBuffers, strides, offsets);
+        _cbRing.BindVS(_pImmediateContext, 0, _modelSlice);
+        _cbRing.BindPS(_pImmediateContext, 0, _modelSlice);
+        if (_modelFullyVisible)
+        {
+            // Nothing was culled, the static index buffer saves the upload
+            _pImmediateContext->IASetIndexBuffer(_pModelIndexBuffer, _modelIndexFormat, 0);
+            for (size_t i = 0; i < _modelSubmeshes.size(); i++)
+            {
+                const MeshLod& lod = _modelLods[_modelSubmeshes[i].firstLod + _modelLod[i]].range;
+                _pImmediateContext->DrawIndexed(lod.indexCount, lod.startIndex, lod.baseVertex);
+            }
+        }
+        else if (_modelCulledIndexCount > 0)
+        {
+            _pImmediateContext->IASetIndexBuffer(_pModelCulledIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+            _pImmediateContext->DrawIndexed(_modelCulledIndexCount, 0, 0);
+        }
     }
     //-----------Lights-------------
     {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "light pass");
         _pImmediateContext->OMSetDepthStencilState(_pDepthState, 0);
-        _pImmediateContext->IASetIndexBuffer(_pLightIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+        _pImmediateContext->IASetIndexBuffer(_pLightIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
         ID3D11Buffer* vBuffers[] = { _pLightVertexBuffer };
         UINT strides[] = { 12 };
         UINT offsets[] = { 0 };
@@ -266,17 +390,31 @@ void Renderer::Render()
         _pImmediateContext->VSSetConstantBuffers(1, 1, &_pLightViewMatrixBuffer);
         _pImmediateContext->PSSetShader(_pLightPixelShader, nullptr, 0);
         
-        for (int i = 0; i < 4; i++)
+        for (int i = 0; i < _lightWorldSlice.size(); i++)
         {
-            _pImmediateContext->VSSetConstantBuffers(0, 1, &_pLightWorldMatrixBuffer[i]);
-            _pImmediateContext->PSSetConstantBuffers(0, 1, &_pLightWorldMatrixBuffer[i]);
-            _pImmediateContext->DrawIndexed(_numSphereTriangles * 3, 0, 0);
+            if (!_objectVisible[LightObject + i])
+                continue;
+            _cbRing.BindVS(_pImmediateContext, 0, _lightWorldSlice[i]);
+            _cbRing.BindPS(_pImmediateContext, 0, _lightWorldSlice[i]);
+            const MeshLod& lod = _sphereLods[_lightLod[i]];
+            _pImmediateContext->DrawIndexed(lod.indexCount, lod.startIndex, lod.baseVertex);
         }
         
     }
-    //-----------Transparent-------------
+    //-----------Transparent (weighted blended OIT)-------------
+    if (_transparencyMode == TransparencyWeightedOit)
     {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "oit pass");
+        // Any order: accumulate into the two OIT targets, testing against the opaque depth
+        ID3D11RenderTargetView* oitViews[] = { _pOitAccumulationRTV, _pOitRevealageRTV };
+        static const FLOAT AccumulationClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        static const FLOAT RevealageClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        _pImmediateContext->ClearRenderTargetView(_pOitAccumulationRTV, AccumulationClear);
+        _pImmediateContext->ClearRenderTargetView(_pOitRevealageRTV, RevealageClear);
+        _pImmediateContext->OMSetRenderTargets(2, oitViews, _pDepthBufferDSV);
         _pImmediateContext->OMSetDepthStencilState(_pZeroDepthState, 0);
+        _pImmediateContext->OMSetBlendState(_pOitBlendState, nullptr, 0xFFFFFFFF);
+
         _pImmediateContext->IASetIndexBuffer(_pTIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
         ID3D11Buffer* vertexBuffers[] = { _pTVertexBuffer };
         UINT strides[] = { sizeof(XMFLOAT4) };
@@ -284,37 +422,123 @@ void Renderer::Render()
         _pImmediateContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
         _pImmediateContext->IASetInputLayout(_pTInputLayout);
         _pImmediateContext->VSSetShader(_pTVertexShader, nullptr, 0);
-        _pImmediateContext->PSSetShader(_pTPixelShader, nullptr, 0); 
+        _pImmediateContext->PSSetShader(_pOitPixelShader, nullptr, 0);
         _pImmediateContext->VSSetConstantBuffers(1, 1, &_pViewMatrixBuffer);
-        _pImmediateContext->OMSetBlendState(_pBlendState, nullptr, 0xFFFFFFFF);
-        std::vector<std::pair<int, float>> cameraDist;
         for (int i = 0; i < 2; i++)
         {
-            float dist = _getDistToTrans(_TWorld[i].worldMatrix, _pCamera->GetPos());
-            cameraDist.push_back({ i, dist });
+            if (!_objectVisible[TransObject + i])
+                continue;
+            _cbRing.BindVS(_pImmediateContext, 0, _TWorldSlice[i]);
+            _cbRing.BindPS(_pImmediateContext, 0, _TWorldSlice[i]);
+            _pImmediateContext->DrawIndexed(3, 0, 0);
         }
-        std::sort(cameraDist.begin(), cameraDist.end(), [](const std::pair<int, float>& a, const std::pair<int, float>& b)
-        {
-                return a.second < b.second;
-        });
-        for (int i = 0; i < cameraDist.size(); i++)
+
+        // Resolve: average color over the back buffer with the accumulated coverage
+        ID3D11RenderTargetView* resolveViews[] = { _pRenderTargetView };
+        _pImmediateContext->OMSetRenderTargets(1, resolveViews, nullptr);
+        _pImmediateContext->OMSetBlendState(_pBlendState, nullptr, 0xFFFFFFFF);
+        ID3D11ShaderResourceView* resources[] = { _pOitAccumulationSRV, _pOitRevealageSRV };
+        _pImmediateContext->PSSetShaderResources(0, 2, resources);
+        _pImmediateContext->IASetInputLayout(nullptr);
+        _pImmediateContext->VSSetShader(_pOitResolveVertexShader, nullptr, 0);
+        _pImmediateContext->PSSetShader(_pOitResolvePixelShader, nullptr, 0);
+        _pImmediateContext->Draw(3, 0);
+
+        ID3D11ShaderResourceView* nullResources[] = { nullptr, nullptr };
+        _pImmediateContext->PSSetShaderResources(0, 2, nullResources);
+    }
+    //-----------Transparent (sorted)-------------
+    else
+    {
+        PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "transparent pass");
+        _pImmediateContext->OMSetDepthStencilState(_pZeroDepthState, 0);
+        _pImmediateContext->IASetIndexBuffer(_pTIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+        ID3D11Buffer* vertexBuffers[] = { _pTVertexBuffer };
+        UINT strides[] = { sizeof(XMFLOAT4) };
+        UINT offsets[] = { 0 };
+        _pImmediateContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+        _pImmediateContext->IASetInputLayout(_pTInputLayout);
+        _pImmediateContext->VSSetShader(_pTVertexShader, nullptr, 0);
+        _pImmediateContext->PSSetShader(_pTPixelShader, nullptr, 0); 
+        _pImmediateContext->VSSetConstantBuffers(1, 1, &_pViewMatrixBuffer);
+        _pImmediateContext->OMSetBlendState(_pBlendState, nullptr, 0xFFFFFFFF);
+        for (uint32_t i : _transparencySorter.GetOrder())
         {
-            _pImmediateContext->VSSetConstantBuffers(0, 1, &_pTWorldMatrixBuffer[cameraDist[i].first]);
-            _pImmediateContext->PSSetConstantBuffers(0, 1, &_pTWorldMatrixBuffer[cameraDist[i].first]);
+            if (!_objectVisible[TransObject + i])
+                continue;
+            _cbRing.BindVS(_pImmediateContext, 0, _TWorldSlice[i]);
+            _cbRing.BindPS(_pImmediateContext, 0, _TWorldSlice[i]);
             _pImmediateContext->DrawIndexed(3, 0, 0);
         }
     }
    
     
 
-    HRESULT hr = _pSwapChain->Present(0, 0);
+    // Replay times the CPU side of the frame, without the waits of the pacer
+    if (!_replayPath.empty() && !_replayFinished)
+    {
+        _replayFrameMs.push_back(ClockMilliseconds(ClockNow() - frameStart));
+        if (_replayTime >= _cameraPath.GetEndTime())
+        {
+            _replayFinished = true;
+            if (!WriteFrameTimings(_replayReportPath.c_str(), _replayPath.c_str(), ReplayTimestep, _replayFrameMs))
+                OutputDebugStringA(("Can't write " + _replayReportPath + "\n").c_str());
+        }
+        _replayFrame++;
+    }
+
+    _gpuProfiler.EndFrame(_pImmediateContext);
+
+    PROFILE_ZONE("present");
+    HRESULT hr = _pacer.Present(_pSwapChain);
     assert(SUCCEEDED(hr));
 }
 
+void Renderer::StartTraceCapture(UINT frames, const char* path)
+{
+    if (!_trace.IsActive())
+        _trace.Start(frames, GpuProfilerFrames, path);
+}
+
+void Renderer::UpdateTraceCapture()
+{
+    if (!_trace.IsActive())
+        return;
+
+    int64_t start = ClockNow();
+    _trace.AddFrame(ProfilerGetFrameEvents());
+    // GPU ranges arrive a few frames late, on the CPU clock from when their frame was submitted
+    int64_t cpuStart;
+    while (_pImmediateContext && _gpuProfiler.Collect(_pImmediateContext, cpuStart, _gpuRanges))
+    {
+        double ticksPerMs = ClockFrequency() / 1000.0;
+        for (const GpuRange& range : _gpuRanges)
+            _trace.AddGpuRange(range.name, range.depth, cpuStart + (int64_t)(range.startMs * ticksPerMs), cpuStart + (int64_t)(range.endMs * ticksPerMs));
+    }
+    _trace.AddOverhead(ClockNow() - start + _gpuProfiler.TakeQueryTicks());
+
+    if (_trace.EndFrame())
+    {
+        char text[256];
+        snprintf(text, sizeof(text), "%s %s, capture overhead %.3f%% of the frame time%s\n", _trace.Succeeded() ? "Wrote" : "Can't write",
+            _trace.GetPath().c_str(), _trace.GetOverheadPercent(),
+            _trace.IsOverheadHigh() ? ", WARNING: too high, the traced frames run slower than usual" : "");
+        OutputDebugStringA(text);
+    }
+}
+
 void Renderer::CleanupDevice()
 {
     if (_pImmediateContext) _pImmediateContext->ClearState();
 
+    _pacer.Cleanup();
+    _workers.Cleanup();
+    _gpuProfiler.Cleanup();
+
+    if (!_recordPath.empty() && _cameraPath.GetKeyCount() > 0 && !_cameraPath.Save(_recordPath.c_str()))
+        OutputDebugStringA(("Can't write camera path " + _recordPath + "\n").c_str());
+    _recordPath.clear();
+
     if (_pRenderTargetView) _pRenderTargetView->Release();
 
     if (_pSwapChain1) _pSwapChain1->Release();
@@ -339,10 +563,7 @@ void Renderer::CleanupDevice()
     if (_pInputLayout) _pInputLayout->Release();
     if (_pSkyboxInputLayout) _pSkyboxInputLayout->Release();
 
-    if (_pWorldMatrixBuffer[0]) _pWorldMatrixBuffer[0]->Release();
-    if (_pWorldMatrixBuffer[1]) _pWorldMatrixBuffer[1]->Release();
     if (_pViewMatrixBuffer) _pViewMatrixBuffer->Release();
-    if (_pSkyboxWorldMatrixBuffer) _pSkyboxWorldMatrixBuffer->Release();
     if (_pSkyboxViewMatrixBuffer) _pSkyboxViewMatrixBuffer->Release();
     if (_pRasterizerState) _pRasterizerState->Release();
 
@@ -356,25 +577,55 @@ void Renderer::CleanupDevice()
     if (_pZeroDepthState) _pZeroDepthState->Release();
     if (_pBlendState) _pBlendState->Release();
 
+    _releaseOitTargets();
+    if (_pOitPixelShader) _pOitPixelShader->Release();
+    if (_pOitResolveVertexShader) _pOitResolveVertexShader->Release();
+    if (_pOitResolvePixelShader) _pOitResolvePixelShader->Release();
+    if (_pOitBlendState) _pOitBlendState->Release();
+
+    SAFE_RELEASE(_pClusterLightSRV);
+    SAFE_RELEASE(_pClusterLightBuffer);
+    SAFE_RELEASE(_pClusterRangeSRV);
+    SAFE_RELEASE(_pClusterRangeBuffer);
+    SAFE_RELEASE(_pClusterIndexSRV);
+    SAFE_RELEASE(_pClusterIndexBuffer);
+
+    for (UINT i = 0; i < MaxShadowCascades; i++)
+    {
+        SAFE_RELEASE(_pShadowDSV[i]);
+        SAFE_RELEASE(_pShadowViewBuffer[i]);
+    }
+    SAFE_RELEASE(_pShadowSRV);
+    SAFE_RELEASE(_pShadowTexture);
+    SAFE_RELEASE(_pShadowSampler);
+    SAFE_RELEASE(_pShadowDepthState);
+    SAFE_RELEASE(_pShadowRasterizerState);
+
+    SAFE_RELEASE(_pProbeSRV);
+    SAFE_RELEASE(_pProbeTexture);
+    SAFE_RELEASE(_pProbeSampler);
+
     if (_pTIndexBuffer) _pTIndexBuffer->Release();
     if (_pTVertexBuffer) _pTVertexBuffer->Release();
     if (_pTVertexShader) _pTVertexShader->Release();
     if (_pTPixelShader) _pTPixelShader->Release();
     if (_pTInputLayout) _pTInputLayout->Release();
-    if (_pTWorldMatrixBuffer[0]) _pTWorldMatrixBuffer[0]->Release();
-    if (_pTWorldMatrixBuffer[1]) _pTWorldMatrixBuffer[1]->Release();
 
     if (_pLightIndexBuffer) _pLightIndexBuffer->Release();
     if (_pLightVertexBuffer) _pLightVertexBuffer->Release();
     if (_pLightVertexShader) _pLightVertexShader->Release();
     if (_pLightPixelShader) _pLightPixelShader->Release();
     if (_pLightInputLayout) _pLightInputLayout->Release();
-    if (_pLightWorldMatrixBuffer[0]) _pLightWorldMatrixBuffer[0]->Release();
-    if (_pLightWorldMatrixBuffer[1]) _pLightWorldMatrixBuffer[1]->Release();
-    if (_pLightWorldMatrixBuffer[2]) _pLightWorldMatrixBuffer[2]->Release();
-    if (_pLightWorldMatrixBuffer[3]) _pLightWorldMatrixBuffer[3]->Release();
     if (_pLightViewMatrixBuffer) _pLightViewMatrixBuffer->Release();
-    
+
+    if (_pModelIndexBuffer) _pModelIndexBuffer->Release();
+    if (_pModelVertexBuffer) _pModelVertexBuffer->Release();
+    if (_pModelCulledIndexBuffer) _pModelCulledIndexBuffer->Release();
+    if (_pModelLightmapUVBuffer) _pModelLightmapUVBuffer->Release();
+    if (_pLightmapUVBuffer) _pLightmapUVBuffer->Release();
+    if (_pLightmapSRV) _pLightmapSRV->Release();
+
+    _cbRing.Cleanup();
 
 
     if (_pSampler) _pSampler->Release();
@@ -425,6 +676,48 @@ HRESULT Renderer::_setupDepthBuffer()
     return hr;
 }
 
+HRESULT Renderer::_setupOitTargets()
+{
+    // Premultiplied weighted color sum in RGBA16F, product of (1 - alpha) in an 8-bit target
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.ArraySize = 1;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = _height;
+    desc.Width = _width;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    desc.SampleDesc.Count = 1;
+
+    HRESULT hr = _pd3dDevice->CreateTexture2D(&desc, nullptr, &_pOitAccumulationTexture);
+    if (SUCCEEDED(hr))
+        hr = _pd3dDevice->CreateRenderTargetView(_pOitAccumulationTexture, nullptr, &_pOitAccumulationRTV);
+    if (SUCCEEDED(hr))
+        hr = _pd3dDevice->CreateShaderResourceView(_pOitAccumulationTexture, nullptr, &_pOitAccumulationSRV);
+
+    if (SUCCEEDED(hr))
+    {
+        desc.Format = DXGI_FORMAT_R8_UNORM;
+        hr = _pd3dDevice->CreateTexture2D(&desc, nullptr, &_pOitRevealageTexture);
+    }
+    if (SUCCEEDED(hr))
+        hr = _pd3dDevice->CreateRenderTargetView(_pOitRevealageTexture, nullptr, &_pOitRevealageRTV);
+    if (SUCCEEDED(hr))
+        hr = _pd3dDevice->CreateShaderResourceView(_pOitRevealageTexture, nullptr, &_pOitRevealageSRV);
+
+    return hr;
+}
+
+void Renderer::_releaseOitTargets()
+{
+    SAFE_RELEASE(_pOitAccumulationSRV);
+    SAFE_RELEASE(_pOitAccumulationRTV);
+    SAFE_RELEASE(_pOitAccumulationTexture);
+    SAFE_RELEASE(_pOitRevealageSRV);
+    SAFE_RELEASE(_pOitRevealageRTV);
+    SAFE_RELEASE(_pOitRevealageTexture);
+}
+
 bool Renderer::WinResize(UINT width, UINT height) 
 {
     if (!_pSwapChain)
@@ -434,8 +727,9 @@ bool Renderer::WinResize(UINT width, UINT height)
         SAFE_RELEASE(_pRenderTargetView);
         SAFE_RELEASE(_pDepthBufferDSV);
         SAFE_RELEASE(_pDepthBuffer);
+        _releaseOitTargets();
 
-        HRESULT hr = _pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+        HRESULT hr = _pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, _pacer.GetSwapChainFlags());
         assert(SUCCEEDED(hr));
         if (SUCCEEDED(hr)) 
         {
@@ -445,7 +739,12 @@ bool Renderer::WinResize(UINT width, UINT height)
             hr = _setupBackBuffer();
 
             if (SUCCEEDED(hr))
-                hr = _setupBackBuffer();
+                hr = _setupDepthBuffer();
+
+            if (SUCCEEDED(hr))
+                hr = _setupOitTargets();
+
+            _occlusion.Resize(OcclusionWidth, OcclusionWidth * _height / (std::max)(_width, 1u));
         }
         return SUCCEEDED(hr);
     }
@@ -454,57 +753,34 @@ bool Renderer::WinResize(UINT width, UINT height)
 
 HRESULT Renderer::_initScene() 
 {
-    HRESULT hr = S_OK;
+    PROFILE_ZONE("init scene");
+    HRESULT hr = _cbRing.Init(_pd3dDevice, _pImmediateContext1, ConstantRingSize);
 //-----------Cubes-------------
     { 
-        static const TexVertex Vertices[] = {
-            {{-1.0, -1.0,  1.0}, {0,1}, {0,-1,0}, {1,0,0}},
-            {{ 1.0, -1.0,  1.0}, {1,1}, {0,-1,0}, {1,0,0}},
-            {{ 1.0, -1.0, -1.0}, {1,0}, {0,-1,0}, {1,0,0}},
-            {{-1.0, -1.0, -1.0}, {0,0}, {0,-1,0}, {1,0,0}},
-
-            {{-1.0,  1.0, -1.0}, {0,1}, {0,1,0}, {1,0,0}},
-            {{ 1.0,  1.0, -1.0}, {1,1}, {0,1,0}, {1,0,0}},
-            {{ 1.0,  1.0,  1.0}, {1,0}, {0,1,0}, {1,0,0}},
-            {{-1.0,  1.0,  1.0}, {0,0}, {0,1,0}, {1,0,0}},
-
-            {{ 1.0, -1.0, -1.0}, {0,1}, {1,0,0}, {0,0,1}},
-            {{ 1.0, -1.0,  1.0}, {1,1}, {1,0,0}, {0,0,1}},
-            {{ 1.0,  1.0,  1.0}, {1,0}, {1,0,0}, {0,0,1}},
-            {{ 1.0,  1.0, -1.0}, {0,0}, {1,0,0}, {0,0,1}},
-
-            {{-1.0, -1.0,  1.0}, {0,1}, {-1,0,0}, {0,0,-1}},
-            {{-1.0, -1.0, -1.0}, {1,1}, {-1,0,0}, {0,0,-1}},
-            {{-1.0,  1.0, -1.0}, {1,0}, {-1,0,0}, {0,0,-1}},
-            {{-1.0,  1.0,  1.0}, {0,0}, {-1,0,0}, {0,0,-1}},
-
-            {{ 1.0, -1.0,  1.0}, {0,1}, {0,0,1}, {-1,0,0}},
-            {{-1.0, -1.0,  1.0}, {1,1}, {0,0,1}, {-1,0,0}},
-            {{-1.0,  1.0,  1.0}, {1,0}, {0,0,1}, {-1,0,0}},
-            {{ 1.0,  1.0,  1.0}, {0,0}, {0,0,1}, {-1,0,0}},
-
-            {{-1.0, -1.0, -1.0}, {0,1}, {0,0,-1}, {1,0,0}},
-            {{ 1.0, -1.0, -1.0}, {1,1}, {0,0,-1}, {1,0,0}},
-            {{ 1.0,  1.0, -1.0}, {1,0}, {0,0,-1}, {1,0,0}},
-            {{-1.0,  1.0, -1.0}, {0,0}, {0,0,-1}, {1,0,0}}
-        };
-        static const USHORT Indices[] = {
-            0, 2, 1, 0, 3, 2,
-            4, 6, 5, 4, 7, 6,
-            8, 10, 9, 8, 11, 10,
-            12, 14, 13, 12, 15, 14,
-            16, 18, 17, 16, 19, 18,
-            20, 22, 21, 20, 23, 22
-        };
+        // Generated like the baker's cube, so the lightmap charts line up
+        Mesh cube = GenerateCube();
+        LightmapAtlasBuilder atlas;
+        atlas.AddMesh(cube);
+        atlas.Pack();
+        std::vector<uint16_t> indices = cube.GetIndices16();
+        _staticScene.AddMesh(&cube.vertices[0].pos, sizeof(MeshVertex), cube.indices.data(), cube.indices.size(),
+            XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z));
         static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-           {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-           {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-           {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0},
-           {"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0},
+           {"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+           {"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0},
+           {"NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+           {"TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0},
+           {"TEXCOORD", 1, DXGI_FORMAT_R16G16_UNORM, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
         };
 
+        // The GPU copy uses the compact layout, VS.hlsl decodes it
+        const UINT numVertices = (UINT)cube.vertices.size();
+        std::vector<PackedVertex> packedVertices(numVertices);
+        _cubeQuantization = ComputePositionQuantization(cube.vertices.data(), numVertices);
+        PackVertices(cube.vertices.data(), numVertices, _cubeQuantization, packedVertices.data());
+
         D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = sizeof(Vertices);
+        desc.ByteWidth = numVertices * sizeof(PackedVertex);
         desc.Usage = D3D11_USAGE_IMMUTABLE;
         desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
         desc.CPUAccessFlags = 0;
@@ -513,16 +789,35 @@ HRESULT Renderer::_initScene()
 
         D3D11_SUBRESOURCE_DATA data;
         ZeroMemory(&data, sizeof(data));
-        data.pSysMem = &Vertices;
-        data.SysMemPitch = sizeof(Vertices);
+        data.pSysMem = packedVertices.data();
+        data.SysMemPitch = desc.ByteWidth;
         data.SysMemSlicePitch = 0;
 
         hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pVertexBuffer);
 
+        if (SUCCEEDED(hr))
+        {
+            // Second vertex stream with the lightmap uvs, read through TEXCOORD1
+            std::vector<XMUSHORTN2> lightmapUVs(numVertices);
+            for (UINT i = 0; i < numVertices; i++)
+                lightmapUVs[i] = XMUSHORTN2(atlas.GetUVs()[i].x, atlas.GetUVs()[i].y);
+
+            D3D11_BUFFER_DESC desc = {};
+            desc.ByteWidth = numVertices * sizeof(XMUSHORTN2);
+            desc.Usage = D3D11_USAGE_IMMUTABLE;
+            desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+            D3D11_SUBRESOURCE_DATA data = {};
+            data.pSysMem = lightmapUVs.data();
+            data.SysMemPitch = desc.ByteWidth;
+
+            hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pLightmapUVBuffer);
+        }
+
         if (SUCCEEDED(hr))
         {
             D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(Indices);
+            desc.ByteWidth = (UINT)(indices.size() * sizeof(uint16_t));
             desc.Usage = D3D11_USAGE_IMMUTABLE;
             desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
             desc.CPUAccessFlags = 0;
@@ -530,8 +825,8 @@ HRESULT Renderer::_initScene()
             desc.StructureByteStride = 0;
 
             D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &Indices;
-            data.SysMemPitch = sizeof(Indices);
+            data.pSysMem = indices.data();
+            data.SysMemPitch = desc.ByteWidth;
             data.SysMemSlicePitch = 0;
 
             hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pIndexBuffer);
@@ -567,29 +862,6 @@ HRESULT Renderer::_initScene()
         SAFE_RELEASE(vertexShaderBuffer);
         SAFE_RELEASE(pixelShaderBuffer);
 
-        if (SUCCEEDED(hr))
-        {
-            D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(WorldMatrixBuffer);
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.StructureByteStride = 0;
-
-            WorldMatrixBuffer worldMatrixBuffer;
-            worldMatrixBuffer.worldMatrix = XMMatrixIdentity();
-            worldMatrixBuffer.shine = XMFLOAT4(1.0f, 0.0f, 0.0f, 0.0f);
-
-            D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &worldMatrixBuffer;
-            data.SysMemPitch = sizeof(worldMatrixBuffer);
-            data.SysMemSlicePitch = 0;
-
-            hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pWorldMatrixBuffer[0]);
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pWorldMatrixBuffer[1]);
-        }
         if (SUCCEEDED(hr))
         {
             D3D11_BUFFER_DESC desc = {};
@@ -619,29 +891,6 @@ HRESULT Renderer::_initScene()
             {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
         };
 
-        if (SUCCEEDED(hr))
-        {
-            D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(ColoredObjMatrixBuffer);
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.StructureByteStride = 0;
-
-            ColoredObjMatrixBuffer worldMatrixBuffer;
-            worldMatrixBuffer.worldMatrix = XMMatrixIdentity();
-
-            D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &worldMatrixBuffer;
-            data.SysMemPitch = sizeof(worldMatrixBuffer);
-            data.SysMemSlicePitch = 0;
-
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pTWorldMatrixBuffer[0]);
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pTWorldMatrixBuffer[1]);
-        }
         if (SUCCEEDED(hr))
         {
             D3D11_BUFFER_DESC desc = {};
@@ -707,97 +956,44 @@ HRESULT Renderer::_initScene()
 
         SAFE_RELEASE(vertexShaderBuffer);
         SAFE_RELEASE(pixelShaderBuffer);
-    }
-
-//-----------Spheres-------------
-    {
-        UINT LatLines = 20, LongLines = 20;
-        UINT numSphereVertices = ((LatLines - 2) * LongLines) + 2;
-        _numSphereTriangles = ((LatLines - 3) * (LongLines) * 2) + (LongLines * 2);
-
-        float phi = 0.0f;
-        float theta = 0.0f;
 
-        std::vector<SphereVertex> vertices(numSphereVertices);
-
-        XMVECTOR currVertPos = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
-
-        vertices[0].x = 0.0f;
-        vertices[0].y = 0.0f;
-        vertices[0].z = 1.0f;
-
-        for (UINT i = 0; i < LatLines - 2; i++)
+        // Weighted blended OIT: same vertex shader, a pixel shader writing both targets and a resolve pass
+        if (SUCCEEDED(hr))
         {
-            theta = (i + 1) * (XM_PI / (LatLines - 1));
-            XMMATRIX Rotationx = XMMatrixRotationX(theta);
-            for (UINT j = 0; j < LongLines; j++)
-            {
-                phi = j * (XM_2PI / LongLines);
-                XMMATRIX Rotationy = XMMatrixRotationZ(phi);
-                currVertPos = XMVector3TransformNormal(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), (Rotationx * Rotationy));
-                currVertPos = XMVector3Normalize(currVertPos);
-                vertices[i * (__int64)LongLines + j + 1].x = XMVectorGetX(currVertPos);
-                vertices[i * (__int64)LongLines + j + 1].y = XMVectorGetY(currVertPos);
-                vertices[i * (__int64)LongLines + j + 1].z = XMVectorGetZ(currVertPos);
-            }
+            hr = D3DCompileFromFile(L"Transparent_PS.hlsl", NULL, &includeObj, "oit", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
+            if (SUCCEEDED(hr))
+                hr = _pd3dDevice->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &_pOitPixelShader);
+            SAFE_RELEASE(pixelShaderBuffer);
         }
-
-        vertices[(__int64)numSphereVertices - 1].x = 0.0f;
-        vertices[(__int64)numSphereVertices - 1].y = 0.0f;
-        vertices[(__int64)numSphereVertices - 1].z = -1.0f;
-
-        std::vector<UINT> indices((__int64)_numSphereTriangles * 3);
-
-        UINT k = 0;
-        for (UINT i = 0; i < LongLines - 1; i++)
+        if (SUCCEEDED(hr))
         {
-            indices[k] = 0;
-            indices[(__int64)k + 2] = i + 1;
-            indices[(__int64)k + 1] = i + 2;
-            k += 3;
+            hr = D3DCompileFromFile(L"OitResolve_VS.hlsl", NULL, &includeObj, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
+            if (SUCCEEDED(hr))
+                hr = _pd3dDevice->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &_pOitResolveVertexShader);
+            SAFE_RELEASE(vertexShaderBuffer);
         }
-        indices[k] = 0;
-        indices[(__int64)k + 2] = LongLines;
-        indices[(__int64)k + 1] = 1;
-        k += 3;
-
-        for (UINT i = 0; i < LatLines - 3; i++)
+        if (SUCCEEDED(hr))
         {
-            for (UINT j = 0; j < LongLines - 1; j++)
-            {
-                indices[k] = i * LongLines + j + 1;
-                indices[(__int64)k + 1] = i * LongLines + j + 2;
-                indices[(__int64)k + 2] = (i + 1) * LongLines + j + 1;
-
-                indices[(__int64)k + 3] = (i + 1) * LongLines + j + 1;
-                indices[(__int64)k + 4] = i * LongLines + j + 2;
-                indices[(__int64)k + 5] = (i + 1) * LongLines + j + 2;
-
-                k += 6;
-            }
-
-            indices[k] = (i * LongLines) + LongLines;
-            indices[(__int64)k + 1] = (i * LongLines) + 1;
-            indices[(__int64)k + 2] = ((i + 1) * LongLines) + LongLines;
-
-            indices[(__int64)k + 3] = ((i + 1) * LongLines) + LongLines;
-            indices[(__int64)k + 4] = (i * LongLines) + 1;
-            indices[(__int64)k + 5] = ((i + 1) * LongLines) + 1;
-
-            k += 6;
+            hr = D3DCompileFromFile(L"OitResolve_PS.hlsl", NULL, &includeObj, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
+            if (SUCCEEDED(hr))
+                hr = _pd3dDevice->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &_pOitResolvePixelShader);
+            SAFE_RELEASE(pixelShaderBuffer);
         }
+    }
 
-        for (UINT i = 0; i < LongLines - 1; i++)
+//-----------Spheres-------------
+    {
+        // Every level of detail goes into the same buffers; draws pick theirs with the start index and base vertex
+        std::vector<SphereVertex> vertices;
+        std::vector<USHORT> indices;
+        for (UINT i = 0; i < SphereLodCount; i++)
         {
-            indices[k] = numSphereVertices - 1;
-            indices[(__int64)k + 2] = (numSphereVertices - 1) - (i + 1);
-            indices[(__int64)k + 1] = (numSphereVertices - 1) - (i + 2);
-            k += 3;
+            _sphereLods[i].startIndex = (UINT)indices.size();
+            _sphereLods[i].baseVertex = (INT)vertices.size();
+            _appendSphere(SphereLodLevels[i].latLines, SphereLodLevels[i].longLines, vertices, indices);
+            _sphereLods[i].indexCount = (UINT)indices.size() - _sphereLods[i].startIndex;
         }
-
-        indices[k] = numSphereVertices - 1;
-        indices[(__int64)k + 2] = (numSphereVertices - 1) - LongLines;
-        indices[(__int64)k + 1] = numSphereVertices - 2;
+        UINT numSphereVertices = (UINT)vertices.size();
 
         static const D3D11_INPUT_ELEMENT_DESC SphereInputDesc[] = {
             {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
@@ -826,7 +1022,7 @@ HRESULT Renderer::_initScene()
         {
             D3D11_BUFFER_DESC desc = {};
             ZeroMemory(&desc, sizeof(desc));
-            desc.ByteWidth = sizeof(UINT) * _numSphereTriangles * 3;
+            desc.ByteWidth = sizeof(USHORT) * (UINT)indices.size();
             desc.Usage = D3D11_USAGE_IMMUTABLE;
             desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
             desc.CPUAccessFlags = 0;
@@ -902,37 +1098,13 @@ HRESULT Renderer::_initScene()
         SAFE_RELEASE(pixelShaderBuffer);
         if (SUCCEEDED(hr))
         {
-            D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(ColoredObjMatrixBuffer);
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.StructureByteStride = 0;
-
-            ColoredObjMatrixBuffer worldMatrixBuffer;
-            worldMatrixBuffer.worldMatrix = XMMatrixIdentity();
+            _pLight.assign(StaticLights, StaticLights + StaticLightCount);
 
-
-            D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &worldMatrixBuffer;
-            data.SysMemPitch = sizeof(worldMatrixBuffer);
-            data.SysMemSlicePitch = 0;
-
-            hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pLightWorldMatrixBuffer[0]);
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pLightWorldMatrixBuffer[1]);
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pLightWorldMatrixBuffer[2]);
-            if (SUCCEEDED(hr))
-                hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pLightWorldMatrixBuffer[3]);
-            if (SUCCEEDED(hr))
-            {
-                _pLight.push_back({ XMFLOAT4(0.0f, 2.0f, 0.0f, 0.0f), XMFLOAT4(1.0f, 2.0f, 1.0f, 1.0f) });
-                _pLight.push_back({ XMFLOAT4(2.0f, 0.0f, 0.0f, 0.0f), XMFLOAT4(2.0f, 1.0f, 1.0f, 1.0f) });
-                _pLight.push_back({ XMFLOAT4(4.0f, 3.0f, 1.0f, 0.0f), XMFLOAT4(1.0f, 1.0f, 2.0f, 1.0f) });
-                _pLight.push_back({ XMFLOAT4(-2.0f, 0.0f, 0.0f, 0.0f), XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f) });
-            }
+            std::mt19937 rng(1);
+            std::uniform_real_distribution<float> x(ExtraLightsMin.x, ExtraLightsMax.x), y(ExtraLightsMin.y, ExtraLightsMax.y), z(ExtraLightsMin.z, ExtraLightsMax.z);
+            std::uniform_real_distribution<float> channel(0.1f, 0.4f), radius(ExtraLightRadiusMin, ExtraLightRadiusMax);
+            for (UINT i = 0; i < _extraLightCount; i++)
+                _extraLights.push_back({ XMFLOAT4(x(rng), y(rng), z(rng), radius(rng)), XMFLOAT4(channel(rng), channel(rng), channel(rng), 1.0f) });
         }
         if (SUCCEEDED(hr))
         {
@@ -947,27 +1119,6 @@ HRESULT Renderer::_initScene()
             hr = _pd3dDevice->CreateBuffer(&desc, nullptr, &_pLightViewMatrixBuffer);
         }
         if (SUCCEEDED(hr))
-        {
-            D3D11_BUFFER_DESC desc = {};
-            desc.ByteWidth = sizeof(SkyboxWorldMatrixBuffer);
-            desc.Usage = D3D11_USAGE_DEFAULT;
-            desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-            desc.CPUAccessFlags = 0;
-            desc.MiscFlags = 0;
-            desc.StructureByteStride = 0;
-
-            SkyboxWorldMatrixBuffer skyboxWorldMatrixBuffer;
-            skyboxWorldMatrixBuffer.worldMatrix = XMMatrixIdentity();
-            skyboxWorldMatrixBuffer.size = XMFLOAT4(_radius, 0.0f, 0.0f, 0.0f);
-
-            D3D11_SUBRESOURCE_DATA data;
-            data.pSysMem = &skyboxWorldMatrixBuffer;
-            data.SysMemPitch = sizeof(skyboxWorldMatrixBuffer);
-            data.SysMemSlicePitch = 0;
-
-            hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pSkyboxWorldMatrixBuffer);
-        }
-        if (SUCCEEDED(hr))
         {
             D3D11_BUFFER_DESC desc = {};
             desc.ByteWidth = sizeof(SkyboxViewMatrixBuffer);
@@ -1041,6 +1192,30 @@ HRESULT Renderer::_initScene()
         hr = _pd3dDevice->CreateBlendState(&desc, &_pBlendState);
     }
     if (SUCCEEDED(hr))
+    {
+        // OIT: additive accumulation, revealage multiplied by (1 - alpha)
+        D3D11_BLEND_DESC desc = { 0 };
+        desc.IndependentBlendEnable = true;
+        desc.RenderTarget[0].BlendEnable = true;
+        desc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+        desc.RenderTarget[1].BlendEnable = true;
+        desc.RenderTarget[1].SrcBlend = D3D11_BLEND_ZERO;
+        desc.RenderTarget[1].DestBlend = D3D11_BLEND_INV_SRC_COLOR;
+        desc.RenderTarget[1].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[1].SrcBlendAlpha = D3D11_BLEND_ZERO;
+        desc.RenderTarget[1].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+        desc.RenderTarget[1].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[1].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED;
+
+        hr = _pd3dDevice->CreateBlendState(&desc, &_pOitBlendState);
+    }
+    if (SUCCEEDED(hr))
     {
         D3D11_RASTERIZER_DESC desc = {};
         desc.AntialiasedLineEnable = false;
@@ -1060,78 +1235,722 @@ HRESULT Renderer::_initScene()
     return hr;
 }
 
+bool Renderer::_initModel()
+{
+    PROFILE_ZONE("init model");
+    MeshFile file;
+    if (!file.Open(_modelPath.c_str()))
+        return false;
+
+    const MeshFileHeader& header = file.GetHeader();
+    const void* pVertices = file.GetVertices();
+    std::vector<PackedVertex> packedVertices;
+    _modelQuantization = header.quantization;
+    if (header.vertexFormat == MeshFileVertexFormat_Float)
+    {
+        // The pipeline only reads the packed layout
+        const MeshVertex* vertices = static_cast<const MeshVertex*>(pVertices);
+        _modelQuantization = ComputePositionQuantization(vertices, header.numVertices);
+        packedVertices.resize(header.numVertices);
+        PackVertices(vertices, header.numVertices, _modelQuantization, packedVertices.data());
+        pVertices = packedVertices.data();
+    }
+
+    // Both buffers are filled straight from the mapping, the file is closed once they exist
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = header.numVertices * sizeof(PackedVertex);
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+    D3D11_SUBRESOURCE_DATA data = {};
+    data.pSysMem = pVertices;
+    data.SysMemPitch = desc.ByteWidth;
+
+    HRESULT hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pModelVertexBuffer);
+    if (SUCCEEDED(hr))
+    {
+        desc.ByteWidth = header.numIndices * header.indexSize;
+        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        data.pSysMem = file.GetIndices();
+        data.SysMemPitch = desc.ByteWidth;
+
+        hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pModelIndexBuffer);
+    }
+    if (SUCCEEDED(hr))
+    {
+        desc.ByteWidth = header.numVertices * sizeof(XMUSHORTN2);
+        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        data.pSysMem = file.GetLightmapUVs();
+        data.SysMemPitch = desc.ByteWidth;
+
+        hr = _pd3dDevice->CreateBuffer(&desc, &data, &_pModelLightmapUVBuffer);
+    }
+    if (FAILED(hr))
+        return false;
+
+    _modelIndexFormat = header.indexSize == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    _modelSubmeshes.assign(file.GetSubmeshes(), file.GetSubmeshes() + header.numSubmeshes);
+    _modelLods.assign(file.GetLods(), file.GetLods() + header.numLods);
+    _modelLod.assign(header.numSubmeshes, UINT_MAX);
+
+    // The baker places the model the same way
+    _modelBox = header.bounds;
+    _modelWorld = GetModelWorld(header.bounds);
+
+    // Meshlets of every LOD for the per-cluster culling; they need positions, so packed
+    // vertices are decoded once here
+    std::vector<MeshVertex> unpackedVertices;
+    const MeshVertex* vertices = static_cast<const MeshVertex*>(file.GetVertices());
+    if (header.vertexFormat == MeshFileVertexFormat_Packed)
+    {
+        unpackedVertices.resize(header.numVertices);
+        UnpackVertices(static_cast<const PackedVertex*>(file.GetVertices()), header.numVertices, header.quantization, unpackedVertices.data());
+        vertices = unpackedVertices.data();
+    }
+    std::vector<uint32_t> lodIndices;
+    _modelMeshlets.resize(_modelLods.size());
+    for (size_t i = 0; i < _modelLods.size(); i++)
+    {
+        const MeshLod& range = _modelLods[i].range;
+        lodIndices.resize(range.indexCount);
+        for (UINT j = 0; j < range.indexCount; j++)
+        {
+            UINT index = range.startIndex + j;
+            lodIndices[j] = header.indexSize == 2 ? static_cast<const uint16_t*>(file.GetIndices())[index] : static_cast<const uint32_t*>(file.GetIndices())[index];
+        }
+        if (!BuildMeshlets(lodIndices.data(), lodIndices.size(), vertices + range.baseVertex, header.numVertices - range.baseVertex, _modelMeshlets[i]))
+            return false;
+
+        // The finest level of each submesh blocks and reflects light for the probes
+        if (std::any_of(_modelSubmeshes.begin(), _modelSubmeshes.end(), [&](const MeshFileSubmesh& submesh) { return submesh.firstLod == i; }))
+            _staticScene.AddMesh(&vertices[range.baseVertex].pos, sizeof(MeshVertex), lodIndices.data(), lodIndices.size(), _modelWorld);
+    }
+
+    // Room for the finest level of every submesh
+    UINT maxIndices = 0;
+    for (const MeshFileSubmesh& submesh : _modelSubmeshes)
+    {
+        UINT submeshIndices = 0;
+        for (UINT j = 0; j < submesh.numLods; j++)
+            submeshIndices = (std::max)(submeshIndices, _modelLods[submesh.firstLod + j].range.indexCount);
+        maxIndices += submeshIndices;
+    }
+    _modelCulledIndices.reserve(maxIndices);
+
+    desc.ByteWidth = (std::max)(maxIndices, 3u) * sizeof(uint32_t);
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    if (FAILED(_pd3dDevice->CreateBuffer(&desc, nullptr, &_pModelCulledIndexBuffer)))
+        return false;
+
+    return true;
+}
+
+bool Renderer::_initLightmap()
+{
+    PROFILE_ZONE("init lightmap");
+    std::wstring path(_lightmapPath.begin(), _lightmapPath.end());
+    if (FAILED(CreateDDSTextureFromFile(_pd3dDevice, path.c_str(), nullptr, &_pLightmapSRV)))
+        return false;
+
+    // One slice per baked object, see sceneLayout.h
+    D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+    _pLightmapSRV->GetDesc(&desc);
+    return desc.ViewDimension == D3D11_SRV_DIMENSION_TEXTURE2DARRAY && desc.Texture2DArray.ArraySize == LightmapSliceCount;
+}
+
+void Renderer::_cullModelMeshlets(const XMFLOAT3& cameraPos)
+{
+    PROFILE_ZONE("meshlet culling");
+    // Test in object space: the frustum of world * viewProjection and the camera moved by the inverse world
+    XMMATRIX worldViewProjection = XMMatrixMultiply(_modelWorld, _viewProjection);
+    Frustum frustum = ExtractFrustum(worldViewProjection);
+    XMFLOAT3 localCamera;
+    XMStoreFloat3(&localCamera, XMVector3TransformCoord(XMLoadFloat3(&cameraPos), XMMatrixInverse(nullptr, _modelWorld)));
+
+    _modelCulledIndices.clear();
+    UINT selectedIndices = 0;
+    for (size_t i = 0; i < _modelSubmeshes.size(); i++)
+    {
+        UINT lod = _modelSubmeshes[i].firstLod + _modelLod[i];
+        CullMeshlets(_modelMeshlets[lod], frustum, localCamera, _modelLods[lod].range.baseVertex, _modelCulledIndices);
+        selectedIndices += _modelLods[lod].range.indexCount;
+    }
+    _modelCulledIndexCount = (UINT)_modelCulledIndices.size();
+    _modelFullyVisible = _modelCulledIndexCount == selectedIndices;
+    if (_modelFullyVisible || _modelCulledIndexCount == 0)
+        return;
+
+    D3D11_MAPPED_SUBRESOURCE subresource;
+    if (SUCCEEDED(_pImmediateContext->Map(_pModelCulledIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource)))
+    {
+        memcpy(subresource.pData, _modelCulledIndices.data(), _modelCulledIndexCount * sizeof(uint32_t));
+        _pImmediateContext->Unmap(_pModelCulledIndexBuffer, 0);
+    }
+    else
+    {
+        _modelFullyVisible = true;
+    }
+}
+
+HRESULT Renderer::_initShadows()
+{
+    PROFILE_ZONE("init shadows");
+    // One depth slice per cascade, read back as R32_FLOAT
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT_R32_TYPELESS;
+    desc.ArraySize = MaxShadowCascades;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Height = ShadowMapSize;
+    desc.Width = ShadowMapSize;
+    desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+    desc.SampleDesc.Count = 1;
+
+    HRESULT hr = _pd3dDevice->CreateTexture2D(&desc, nullptr, &_pShadowTexture);
+    for (UINT i = 0; i < MaxShadowCascades && SUCCEEDED(hr); i++)
+    {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+        dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+        dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+        dsvDesc.Texture2DArray.MipSlice = 0;
+        dsvDesc.Texture2DArray.FirstArraySlice = i;
+        dsvDesc.Texture2DArray.ArraySize = 1;
+        hr = _pd3dDevice->CreateDepthStencilView(_pShadowTexture, &dsvDesc, &_pShadowDSV[i]);
+    }
+    if (SUCCEEDED(hr))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Texture2DArray.MostDetailedMip = 0;
+        srvDesc.Texture2DArray.MipLevels = 1;
+        srvDesc.Texture2DArray.FirstArraySlice = 0;
+        srvDesc.Texture2DArray.ArraySize = MaxShadowCascades;
+        hr = _pd3dDevice->CreateShaderResourceView(_pShadowTexture, &srvDesc, &_pShadowSRV);
+    }
+
+    // Only viewProjectionMatrix is filled in, VS.hlsl reads nothing else
+    for (UINT i = 0; i < MaxShadowCascades && SUCCEEDED(hr); i++)
+    {
+        D3D11_BUFFER_DESC bufferDesc = {};
+        bufferDesc.ByteWidth = sizeof(ViewMatrixBuffer);
+        bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        hr = _pd3dDevice->CreateBuffer(&bufferDesc, nullptr, &_pShadowViewBuffer[i]);
+    }
+    if (SUCCEEDED(hr))
+    {
+        // Outside the map counts as lit
+        D3D11_SAMPLER_DESC samplerDesc = {};
+        samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+        samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+        samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+        samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+        samplerDesc.BorderColor[0] = samplerDesc.BorderColor[1] = samplerDesc.BorderColor[2] = samplerDesc.BorderColor[3] = 1.0f;
+        samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+        hr = _pd3dDevice->CreateSamplerState(&samplerDesc, &_pShadowSampler);
+    }
+    if (SUCCEEDED(hr))
+    {
+        // The shadow maps use ordinary depth, 0 nearest to the light
+        D3D11_DEPTH_STENCIL_DESC dsDesc = {};
+        dsDesc.DepthEnable = TRUE;
+        dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+        dsDesc.DepthFunc = D3D11_COMPARISON_LESS;
+        dsDesc.StencilEnable = FALSE;
+        hr = _pd3dDevice->CreateDepthStencilState(&dsDesc, &_pShadowDepthState);
+    }
+    if (SUCCEEDED(hr))
+    {
+        D3D11_RASTERIZER_DESC rsDesc = {};
+        rsDesc.FillMode = D3D11_FILL_SOLID;
+        rsDesc.CullMode = D3D11_CULL_NONE;
+        rsDesc.DepthBias = 1000;
+        rsDesc.SlopeScaledDepthBias = 2.0f;
+        rsDesc.DepthBiasClamp = 0.0f;
+        rsDesc.DepthClipEnable = true;
+        hr = _pd3dDevice->CreateRasterizerState(&rsDesc, &_pShadowRasterizerState);
+    }
+
+    return hr;
+}
+
+HRESULT Renderer::_initProbes()
+{
+    PROFILE_ZONE("init probes");
+    // Without a readable skybox.dds the probes see a constant sky
+    SkyCubemap sky;
+    bool skyLoaded = sky.Load("./skybox.dds", ProbeSkySize);
+    if (!skyLoaded)
+        OutputDebugStringA("Can't read skybox.dds for the probes, the sky is constant\n");
+
+    _staticScene.Build();
+    ProbeBakeDesc bake = {};
+    bake.pScene = &_staticScene;
+    bake.pSky = skyLoaded ? &sky : nullptr;
+    bake.skyRadiance = SkyRadiance;
+    bake.lights = _pLight;
+    XMStoreFloat3(&bake.sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+    bake.sunColor = XMFLOAT3(SunColor.x, SunColor.y, SunColor.z);
+    bake.albedo = ProbeAlbedo;
+    bake.gridMin = ProbeGridMin;
+    bake.gridMax = ProbeGridMax;
+    bake.counts = ProbeGridCounts;
+    bake.rays = ProbeRays;
+    std::vector<ProbeSH> probes;
+    BakeProbes(bake, _workers, probes);
+    _staticScene.Clear();
+
+    std::vector<XMHALF4> texels;
+    PackProbes(probes, ProbeGridCounts, texels);
+
+    D3D11_TEXTURE3D_DESC desc = {};
+    desc.Width = ProbeGridCounts.x;
+    desc.Height = ProbeGridCounts.y;
+    desc.Depth = ProbeGridCounts.z * ProbeTexels;
+    desc.MipLevels = 1;
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA data = {};
+    data.pSysMem = texels.data();
+    data.SysMemPitch = ProbeGridCounts.x * sizeof(XMHALF4);
+    data.SysMemSlicePitch = ProbeGridCounts.x * ProbeGridCounts.y * sizeof(XMHALF4);
+
+    HRESULT hr = _pd3dDevice->CreateTexture3D(&desc, &data, &_pProbeTexture);
+    if (SUCCEEDED(hr))
+        hr = _pd3dDevice->CreateShaderResourceView(_pProbeTexture, nullptr, &_pProbeSRV);
+    if (SUCCEEDED(hr))
+    {
+        // Trilinear between the eight nearest probes; the shader keeps z inside one slab
+        D3D11_SAMPLER_DESC samplerDesc = {};
+        samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+        hr = _pd3dDevice->CreateSamplerState(&samplerDesc, &_pProbeSampler);
+    }
+
+    return hr;
+}
+
+void Renderer::_updateShadows(FXMMATRIX view)
+{
+    PROFILE_ZONE("shadow fit");
+    ShadowFitDesc desc = {};
+    XMStoreFloat4x4(&desc.cameraView, view);
+    desc.fovY = CameraFovY;
+    desc.aspect = _width / (FLOAT)_height;
+    desc.nearZ = CameraNearZ;
+    desc.shadowDistance = ShadowDistance;
+    desc.lightDir = SunDirection;
+    desc.resolution = ShadowMapSize;
+    desc.numCascades = MaxShadowCascades;
+    desc.splitLambda = ShadowSplitLambda;
+    desc.casterReach = ShadowCasterReach;
+    _shadowCascades.Fit(desc);
+
+    // The model's state includes its LODs, its shadow is drawn with the ones the camera picked
+    UINT modelObject = _getModelObject();
+    _casterStates.assign(_sceneBvh.Size(), 0);
+    _casterStates[CubeObject] = ShadowCascades::GetCasterState(_cubeWorld[0]);
+    _casterStates[CubeObject + 1] = ShadowCascades::GetCasterState(_cubeWorld[1]);
+    if (!_modelSubmeshes.empty())
+    {
+        uint32_t lods = 0;
+        for (UINT lod : _modelLod)
+            lods = lods * 31 + lod;
+        _casterStates[modelObject] = ShadowCascades::GetCasterState(_modelWorld, lods);
+    }
+    _shadowCascades.CullCasters(_sceneBvh, [&](uint32_t object)
+        {
+            return object == CubeObject || object == CubeObject + 1 || (object == modelObject && !_modelSubmeshes.empty());
+        }, _casterStates.data());
+
+    for (UINT i = 0; i < _shadowCascades.GetCount(); i++)
+    {
+        if (!_shadowCascades.NeedsRender(i))
+            continue;
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        if (SUCCEEDED(_pImmediateContext->Map(_pShadowViewBuffer[i], 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource)))
+        {
+            ViewMatrixBuffer& sceneBuffer = *reinterpret_cast<ViewMatrixBuffer*>(subresource.pData);
+            sceneBuffer.viewProjectionMatrix = XMLoadFloat4x4(&_shadowCascades.GetCascade(i).viewProjection);
+            _pImmediateContext->Unmap(_pShadowViewBuffer[i], 0);
+        }
+    }
+}
+
+void Renderer::_renderShadows()
+{
+    PROFILE_GPU_ZONE(_gpuProfiler, _pImmediateContext, "shadow pass");
+    // Cascades whose box and casters are unchanged keep last frame's map
+    bool pipelineSet = false;
+    for (UINT i = 0; i < _shadowCascades.GetCount(); i++)
+    {
+        if (!_shadowCascades.NeedsRender(i))
+            continue;
+
+        if (!pipelineSet)
+        {
+            D3D11_VIEWPORT vp = { 0.0f, 0.0f, (FLOAT)ShadowMapSize, (FLOAT)ShadowMapSize, 0.0f, 1.0f };
+            _pImmediateContext->RSSetViewports(1, &vp);
+            _pImmediateContext->RSSetState(_pShadowRasterizerState);
+            _pImmediateContext->OMSetDepthStencilState(_pShadowDepthState, 0);
+            _pImmediateContext->IASetInputLayout(_pInputLayout);
+            _pImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            _pImmediateContext->VSSetShader(_pVertexShader, nullptr, 0);
+            _pImmediateContext->PSSetShader(nullptr, nullptr, 0);
+            pipelineSet = true;
+        }
+
+        _pImmediateContext->ClearDepthStencilView(_pShadowDSV[i], D3D11_CLEAR_DEPTH, 1.0f, 0);
+        _pImmediateContext->OMSetRenderTargets(0, nullptr, _pShadowDSV[i]);
+        _pImmediateContext->VSSetConstantBuffers(1, 1, &_pShadowViewBuffer[i]);
+
+        UINT strides[] = { sizeof(PackedVertex), sizeof(XMUSHORTN2) };
+        UINT offsets[] = { 0, 0 };
+        for (uint32_t object : _shadowCascades.GetCasters(i))
+        {
+            if (object == CubeObject || object == CubeObject + 1)
+            {
+                ID3D11Buffer* vBuffers[] = { _pVertexBuffer, _pLightmapUVBuffer };
+                _pImmediateContext->IASetVertexBuffers(0, 2, vBuffers, strides, offsets);
+                _pImmediateContext->IASetIndexBuffer(_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+                _cbRing.BindVS(_pImmediateContext, 0, _worldSlice[object - CubeObject]);
+                _pImmediateContext->DrawIndexed(36, 0, 0);
+            }
+            else
+            {
+                ID3D11Buffer* vBuffers[] = { _pModelVertexBuffer, _pModelLightmapUVBuffer };
+                _pImmediateContext->IASetVertexBuffers(0, 2, vBuffers, strides, offsets);
+                _pImmediateContext->IASetIndexBuffer(_pModelIndexBuffer, _modelIndexFormat, 0);
+                _cbRing.BindVS(_pImmediateContext, 0, _modelSlice);
+                for (size_t j = 0; j < _modelSubmeshes.size(); j++)
+                {
+                    const MeshLod& lod = _modelLods[_modelSubmeshes[j].firstLod + _modelLod[j]].range;
+                    _pImmediateContext->DrawIndexed(lod.indexCount, lod.startIndex, lod.baseVertex);
+                }
+            }
+        }
+        _shadowCascades.MarkRendered(i);
+    }
+
+    if (pipelineSet)
+        _pImmediateContext->ClearState();
+}
+
+HRESULT Renderer::_writeStructuredBuffer(ID3D11Buffer*& pBuffer, ID3D11ShaderResourceView*& pView, UINT& capacity, UINT stride, const void* pData, UINT count)
+{
+    HRESULT hr = S_OK;
+
+    // Grown to the next power of two, so the light lists stop reallocating after a few frames
+    if (!pBuffer || count > capacity)
+    {
+        SAFE_RELEASE(pView);
+        SAFE_RELEASE(pBuffer);
+        capacity = 1;
+        while (capacity < count)
+            capacity *= 2;
+
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = capacity * stride;
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = stride;
+        hr = _pd3dDevice->CreateBuffer(&desc, nullptr, &pBuffer);
+        if (SUCCEEDED(hr))
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+            viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+            viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            viewDesc.Buffer.FirstElement = 0;
+            viewDesc.Buffer.NumElements = capacity;
+            hr = _pd3dDevice->CreateShaderResourceView(pBuffer, &viewDesc, &pView);
+        }
+        if (FAILED(hr))
+        {
+            SAFE_RELEASE(pBuffer);
+            capacity = 0;
+            return hr;
+        }
+    }
+
+    if (count > 0)
+    {
+        D3D11_MAPPED_SUBRESOURCE subresource;
+        hr = _pImmediateContext->Map(pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+        if (SUCCEEDED(hr))
+        {
+            memcpy(subresource.pData, pData, (size_t)count * stride);
+            _pImmediateContext->Unmap(pBuffer, 0);
+        }
+    }
+    return hr;
+}
+
+void Renderer::_buildLightClusters(FXMMATRIX view, CXMMATRIX projection)
+{
+    PROFILE_ZONE("light clusters");
+    // Scene lights keep their indices, the extra ones follow
+    _clusterLights.assign(_pLight.begin(), _pLight.end());
+    _clusterLights.insert(_clusterLights.end(), _extraLights.begin(), _extraLights.end());
+    _lightBounds.Resize(_clusterLights.size());
+    for (size_t i = 0; i < _clusterLights.size(); i++)
+    {
+        const XMFLOAT4& pos = _clusterLights[i].pos;
+        _lightBounds.Set(i, XMFLOAT3(pos.x, pos.y, pos.z), pos.w);
+    }
+
+    XMFLOAT4X4 p;
+    XMStoreFloat4x4(&p, projection);
+    _lightClusters.Build(_lightBounds, view, p._11, p._22, &_workers);
+}
+
+XMUINT4 Renderer::_addObjectLights(UINT object)
+{
+    ClusterRange range = _lightClusters.AddObjectLights(_objectBoxes[object]);
+    return XMUINT4(range.offset, range.count, 0, 0);
+}
+
+HRESULT Renderer::_uploadLightClusters()
+{
+    const std::vector<ClusterRange>& ranges = _lightClusters.GetRanges();
+    const std::vector<uint32_t>& indices = _lightClusters.GetIndices();
+    HRESULT hr = _writeStructuredBuffer(_pClusterLightBuffer, _pClusterLightSRV, _clusterLightCapacity, sizeof(Light), _clusterLights.data(), (UINT)_clusterLights.size());
+    if (SUCCEEDED(hr))
+        hr = _writeStructuredBuffer(_pClusterRangeBuffer, _pClusterRangeSRV, _clusterRangeCapacity, sizeof(ClusterRange), ranges.data(), (UINT)ranges.size());
+    if (SUCCEEDED(hr))
+        hr = _writeStructuredBuffer(_pClusterIndexBuffer, _pClusterIndexSRV, _clusterIndexCapacity, sizeof(uint32_t), indices.data(), (UINT)indices.size());
+    return hr;
+}
+
 bool Renderer::_updateScene() 
 {
+    PROFILE_ZONE("update");
     HRESULT hr;
 
-    static float t = 0.0f;
-    static ULONGLONG timeStart = 0;
-    ULONGLONG timeCur = GetTickCount64();
-    if (timeStart == 0) 
-        timeStart = timeCur;
-    t = (timeCur - timeStart) / 1000.0f;
+    // A replay advances by exactly its time step, so it ticks the same on every machine
+    int64_t timeCur = ClockNow();
+    double elapsed = _lastUpdateTime == 0 ? 0.0 : ClockSeconds(timeCur - _lastUpdateTime);
+    _lastUpdateTime = timeCur;
+    if (!_replayPath.empty())
+        elapsed = _replayFrame == 0 ? 0.0 : ReplayTimestep;
 
-    WorldMatrixBuffer worldMatrixBuffer;
-    worldMatrixBuffer.worldMatrix = XMMatrixRotationY(t);
-    worldMatrixBuffer.shine = XMFLOAT4(32.f, 0.0f, 0.0f, 0.0f);
+    uint32_t ticks = _timestep.Advance(elapsed);
+    {
+        PROFILE_ZONE("simulation");
+        for (uint32_t i = 0; i < ticks; i++)
+        {
+            _simPrevious = _simCurrent;
+            StepSimulation(_simCurrent, _timestep.GetStep());
+        }
+    }
+    SimulationFrame simFrame;
+    InterpolateSimulation(_simPrevious, _simCurrent, _timestep.GetAlpha(), simFrame);
+
+    // All the mouse motion since the last frame in one step
+    float mouseX, mouseY;
+    _mouse.Consume(mouseX, mouseY);
+    if (!_replayPath.empty())
+    {
+        // The path decides the camera, the mouse is ignored. Keys were recorded at the
+        // simulation time, so that's where they are sampled.
+        _replayTime = simFrame.time;
+        CameraPathKey key = _cameraPath.Sample((std::min)((float)_replayTime, _cameraPath.GetEndTime()));
+        _pCamera->SetOrbit(key.phi, key.theta, key.r);
+    }
+    else if (mouseX != 0.0f || mouseY != 0.0f)
+    {
+        _pCamera->ChangePos(mouseX * CameraRadiansPerCount, mouseY * CameraRadiansPerCount);
+    }
 
-    worldMatrixBuffer.worldMatrix = XMMatrixRotationY(t);
-    _pImmediateContext->UpdateSubresource(_pWorldMatrixBuffer[0], 0, nullptr, &worldMatrixBuffer, 0, 0);
+    if (!_recordPath.empty())
+    {
+        CameraPathKey key;
+        key.time = (float)simFrame.time;
+        _pCamera->GetOrbit(key.phi, key.theta, key.r);
+        _cameraPath.Add(key);
+    }
 
-    worldMatrixBuffer.worldMatrix = XMMatrixTranslation(4.0f, 0.0f, 0.0f);
-    _pImmediateContext->UpdateSubresource(_pWorldMatrixBuffer[1], 0, nullptr, &worldMatrixBuffer, 0, 0);
+    // Rebuilt by the camera only when it moved or the window changed shape
+    _pCamera->SetAspect(_width / (FLOAT)_height);
+    XMMATRIX mView = _pCamera->GetViewMatrix();
+    XMMATRIX mProjection = _pCamera->GetProjectionMatrix();
+    XMFLOAT3 cameraPos = _pCamera->GetPos();
 
-    _TWorld[0].worldMatrix = XMMatrixTranslation(2.5f, sin(t), 0.0f);
-    _TWorld[0].color = XMFLOAT4(1.f, 1.f, 2.f, 0.5f);
-    _pImmediateContext->UpdateSubresource(_pTWorldMatrixBuffer[0], 0, nullptr, &_TWorld[0], 0, 0);
+    _cubeWorld[0] = simFrame.cubeWorld;
+    _cubeWorld[1] = XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z);
+
+    _TWorld[0].worldMatrix = simFrame.transWorld[0];
+    _TWorld[0].color = TransColors[0];
+    _TWorld[1].worldMatrix = simFrame.transWorld[1];
+    _TWorld[1].color = TransColors[1];
+
+    // Back-to-front order along the view direction, refined from last frame's
+    _transparencySorter.Resize(2);
+    for (int i = 0; i < 2; i++)
+    {
+        XMVECTOR center = XMVectorZero();
+        for (int j = 0; j < 3; j++)
+            center = XMVectorAdd(center, XMVector3TransformCoord(XMLoadFloat4(&TransVertices[j]), _TWorld[i].worldMatrix));
+        XMFLOAT3 position;
+        XMStoreFloat3(&position, XMVectorScale(center, 1.0f / 3.0f));
+        _transparencySorter.SetPosition(i, position);
+    }
+    XMFLOAT3 viewDir;
+    XMStoreFloat3(&viewDir, XMVector3Normalize(XMMatrixTranspose(mView).r[2]));
+    {
+        PROFILE_ZONE("transparency sort");
+        _transparencySorter.Sort(cameraPos, viewDir, &_workers);
+    }
+
+    _viewProjection = _pCamera->GetViewProjectionMatrix();
+    _cullObjects(_viewProjection, _pCamera->GetFrustum());
+
+    // Before the draws are recorded, so they can add their own light lists
+    _buildLightClusters(mView, mProjection);
+
+    // Every per-draw constant of the frame goes through one map of the ring. The cubes and the
+    // model always get one, they may cast shadows into view.
+    UINT numDraws = 4 + (UINT)_visibleObjects.size();
+    if (!_cbRing.Begin(_pImmediateContext, numDraws * ConstantRing::Alignment))
+        return false;
+
+    SkyboxWorldMatrixBuffer skyboxWorldMatrixBuffer;
+    skyboxWorldMatrixBuffer.worldMatrix = XMMatrixIdentity();
+    skyboxWorldMatrixBuffer.size = XMFLOAT4(SkyboxRadius, 0.0f, 0.0f, 0.0f);
+    _skyboxWorldSlice = _cbRing.Push(skyboxWorldMatrixBuffer);
+
+    WorldMatrixBuffer worldMatrixBuffer;
+    worldMatrixBuffer.shine = XMFLOAT4(CubeShine, 0.0f, 0.0f, 0.0f);
+    worldMatrixBuffer.posScale = _cubeQuantization.scale;
+    worldMatrixBuffer.posBias = _cubeQuantization.bias;
+    for (int i = 0; i < 2; i++)
+    {
+        worldMatrixBuffer.worldMatrix = _cubeWorld[i];
+        worldMatrixBuffer.lightList = _objectVisible[CubeObject + i] ? _addObjectLights(CubeObject + i) : XMUINT4(0, 0, 0, 0);
+        // Only the second cube stands still
+        if (i == 1 && _pLightmapSRV)
+            worldMatrixBuffer.lightList.z = LightmapCubeSlice + 1;
+        _worldSlice[i] = _cbRing.Push(worldMatrixBuffer);
+    }
 
-    _TWorld[1].worldMatrix = XMMatrixTranslation(-3.0f, 0.0f, sin(t));
-    _TWorld[1].color = XMFLOAT4(1.f, 0.f, 1.f, 0.5f);
-    _pImmediateContext->UpdateSubresource(_pTWorldMatrixBuffer[1], 0, nullptr, &_TWorld[1], 0, 0);
+    for (int i = 0; i < 2; i++)
+    {
+        if (!_objectVisible[TransObject + i])
+            continue;
+        _TWorld[i].lightList = _addObjectLights(TransObject + i);
+        _TWorldSlice[i] = _cbRing.Push(_TWorld[i]);
+    }
 
     ColoredObjMatrixBuffer lWorldMatrixBuffer;
-    
+    lWorldMatrixBuffer.lightList = XMUINT4(0, 0, 0, 0);
+    _lightWorldSlice.resize(_pLight.size());
+    _lightLod.resize(_pLight.size(), SphereLodCount);
     for (int i = 0; i < _pLight.size(); i++) 
     {
-        lWorldMatrixBuffer.worldMatrix = XMMatrixScaling(0.1f, 0.1f, 0.1f) * XMMatrixTranslation(_pLight[i].pos.x, _pLight[i].pos.y, _pLight[i].pos.z);
+        if (!_objectVisible[LightObject + i])
+            continue;
+        XMFLOAT3 toLight(_pLight[i].pos.x - cameraPos.x, _pLight[i].pos.y - cameraPos.y, _pLight[i].pos.z - cameraPos.z);
+        float dist = sqrtf(toLight.x * toLight.x + toLight.y * toLight.y + toLight.z * toLight.z);
+        _lightLod[i] = SelectLod(ProjectedSize(LightRadius, dist, (float)_height, CameraFovY), _lightLod[i], SphereLodMinPixels, SphereLodCount, LodHysteresis);
+
+        lWorldMatrixBuffer.worldMatrix = XMMatrixScaling(LightRadius, LightRadius, LightRadius) * XMMatrixTranslation(_pLight[i].pos.x, _pLight[i].pos.y, _pLight[i].pos.z);
         lWorldMatrixBuffer.color = _pLight[i].color;
-        _pImmediateContext->UpdateSubresource(_pLightWorldMatrixBuffer[i], 0, nullptr, &lWorldMatrixBuffer, 0, 0);
+        _lightWorldSlice[i] = _cbRing.Push(lWorldMatrixBuffer);
+    }
+
+    if (!_modelSubmeshes.empty())
+    {
+        worldMatrixBuffer.worldMatrix = _modelWorld;
+        worldMatrixBuffer.posScale = _modelQuantization.scale;
+        worldMatrixBuffer.posBias = _modelQuantization.bias;
+        worldMatrixBuffer.lightList = _objectVisible[_getModelObject()] ? _addObjectLights(_getModelObject()) : XMUINT4(0, 0, 0, 0);
+        if (_pLightmapSRV)
+            worldMatrixBuffer.lightList.z = LightmapModelSlice + 1;
+        _modelSlice = _cbRing.Push(worldMatrixBuffer);
+    }
+
+    if (!_modelSubmeshes.empty() && _objectVisible[_getModelObject()])
+    {
+        std::vector<float> minPixels;
+        for (size_t i = 0; i < _modelSubmeshes.size(); i++)
+        {
+            const MeshFileSubmesh& submesh = _modelSubmeshes[i];
+            XMVECTOR boundsMin = XMLoadFloat3(&submesh.bounds.min);
+            XMVECTOR boundsMax = XMLoadFloat3(&submesh.bounds.max);
+            XMVECTOR center = XMVector3TransformCoord(XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f), _modelWorld);
+            float radius = XMVectorGetX(XMVector3Length(XMVector3TransformNormal(XMVectorScale(XMVectorSubtract(boundsMax, boundsMin), 0.5f), _modelWorld)));
+            float dist = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, XMLoadFloat3(&cameraPos))));
+
+            minPixels.resize(submesh.numLods);
+            for (UINT j = 0; j < submesh.numLods; j++)
+                minPixels[j] = _modelLods[submesh.firstLod + j].minPixels;
+            _modelLod[i] = SelectLod(ProjectedSize(radius, dist, (float)_height, CameraFovY), _modelLod[i], minPixels.data(), submesh.numLods, LodHysteresis);
+        }
+
+        _cullModelMeshlets(cameraPos);
     }
-   
-    XMMATRIX mView = _pCamera->GetViewMatrix();
-    XMFLOAT3 cameraPos = _pCamera->GetPos();
-    XMMATRIX mProjection = XMMatrixPerspectiveFovLH(XM_PIDIV2, _width / (FLOAT)_height, 100.0f, 0.01f);
+
+    _updateShadows(mView);
+
+    _cbRing.End(_pImmediateContext);
+
+    hr = _uploadLightClusters();
+    if (FAILED(hr))
+        return false;
 
     D3D11_MAPPED_SUBRESOURCE tSubresource, subresource, skyboxSubresource;
     hr = _pImmediateContext->Map(_pViewMatrixBuffer , 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
     if (SUCCEEDED(hr))
     {
         ViewMatrixBuffer& sceneBuffer = *reinterpret_cast<ViewMatrixBuffer*>(subresource.pData);
-        sceneBuffer.viewProjectionMatrix = XMMatrixMultiply(mView, mProjection);
+        sceneBuffer.viewProjectionMatrix = _viewProjection;
         sceneBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
+        // Scales the light of the probes
         sceneBuffer.ambientColor = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-        sceneBuffer.lightParams = XMINT4(_pLight.size(), 1, 0, 0);
-        for (int i = 0; i < _pLight.size(); i++) {
-            sceneBuffer.lights[i].color = _pLight[i].color;
-            sceneBuffer.lights[i].pos = _pLight[i].pos;
+        // The static lights come first in _clusterLights, baked objects skip them
+        sceneBuffer.lightParams = XMINT4((int)_clusterLights.size(), 1, 0, (int)StaticLightCount);
+        sceneBuffer.clusterScale = XMFLOAT4(ClusterTilesX / (float)_width, ClusterTilesY / (float)_height, _lightClusters.GetSliceScale(), _lightClusters.GetSliceBias());
+        sceneBuffer.clusterCount = XMUINT4(ClusterTilesX, ClusterTilesY, ClusterSlices, 0);
+
+        float splits[MaxShadowCascades];
+        for (UINT i = 0; i < MaxShadowCascades; i++)
+        {
+            sceneBuffer.shadowMatrices[i] = XMLoadFloat4x4(&_shadowCascades.GetCascade(i).viewProjection);
+            splits[i] = _shadowCascades.GetCascade(i).splitFar;
         }
+        sceneBuffer.cascadeSplits = XMFLOAT4(splits[0], splits[1], splits[2], splits[3]);
+        XMFLOAT3 sunDirection;
+        XMStoreFloat3(&sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+        sceneBuffer.sunDirection = XMFLOAT4(sunDirection.x, sunDirection.y, sunDirection.z, 0.0f);
+        sceneBuffer.sunColor = SunColor;
+
+        XMFLOAT3 probeScale((ProbeGridCounts.x - 1) / (ProbeGridMax.x - ProbeGridMin.x), (ProbeGridCounts.y - 1) / (ProbeGridMax.y - ProbeGridMin.y),
+            (ProbeGridCounts.z - 1) / (ProbeGridMax.z - ProbeGridMin.z));
+        sceneBuffer.probeScale = XMFLOAT4(probeScale.x, probeScale.y, probeScale.z, 0.0f);
+        sceneBuffer.probeBias = XMFLOAT4(-ProbeGridMin.x * probeScale.x, -ProbeGridMin.y * probeScale.y, -ProbeGridMin.z * probeScale.z, 0.0f);
+        sceneBuffer.probeCount = XMFLOAT4((float)ProbeGridCounts.x, (float)ProbeGridCounts.y, (float)ProbeGridCounts.z, 0.0f);
 
         _pImmediateContext->Unmap(_pViewMatrixBuffer, 0);
     }
     if (SUCCEEDED(hr)) 
     {
-        SkyboxWorldMatrixBuffer skyboxWorldMatrixBuffer;
-        skyboxWorldMatrixBuffer.worldMatrix = XMMatrixIdentity();
-        skyboxWorldMatrixBuffer.size = XMFLOAT4(_radius, 0.0f, 0.0f, 0.0f);
-        _pImmediateContext->UpdateSubresource(_pSkyboxWorldMatrixBuffer, 0, nullptr, &skyboxWorldMatrixBuffer, 0, 0);
-
         hr = _pImmediateContext->Map(_pSkyboxViewMatrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &skyboxSubresource);
     }
     if (SUCCEEDED(hr)) 
     {
         SkyboxViewMatrixBuffer& skyboxSceneBuffer = *reinterpret_cast<SkyboxViewMatrixBuffer*>(skyboxSubresource.pData);
-        skyboxSceneBuffer.viewProjectionMatrix = XMMatrixMultiply(mView, mProjection);
-        XMFLOAT3 cameraPos = _pCamera->GetPos();
+        skyboxSceneBuffer.viewProjectionMatrix = _viewProjection;
         skyboxSceneBuffer.cameraPos = XMFLOAT4(cameraPos.x, cameraPos.y, cameraPos.z, 1.0f);
         _pImmediateContext->Unmap(_pSkyboxViewMatrixBuffer, 0);
     }
@@ -1139,18 +1958,143 @@ bool Renderer::_updateScene()
     {
         HRESULT hr = _pImmediateContext->Map(_pLightViewMatrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
         ViewMatrixBuffer& sceneBuffer = *reinterpret_cast<ViewMatrixBuffer*>(subresource.pData);
-        sceneBuffer.viewProjectionMatrix = XMMatrixMultiply(mView, mProjection);
+        sceneBuffer.viewProjectionMatrix = _viewProjection;
         _pImmediateContext->Unmap(_pLightViewMatrixBuffer, 0);
     }
 
     return SUCCEEDED(hr);
 }
 
+void Renderer::_cullObjects(FXMMATRIX viewProjection, const Frustum& frustum)
+{
+    PROFILE_ZONE("culling");
+    UINT numObjects = _getModelObject() + (_modelSubmeshes.empty() ? 0 : 1);
+    bool rebuild = _sceneBvh.Size() != numObjects;
+
+    _objectBoxes.resize(numObjects);
+    _objectBoxes[CubeObject] = TransformAabb(CubeBox, _cubeWorld[0]);
+    _objectBoxes[CubeObject + 1] = TransformAabb(CubeBox, _cubeWorld[1]);
+    _objectBoxes[TransObject] = TransformAabb(TransBox, _TWorld[0].worldMatrix);
+    _objectBoxes[TransObject + 1] = TransformAabb(TransBox, _TWorld[1].worldMatrix);
+    for (int i = 0; i < _pLight.size(); i++)
+        _objectBoxes[LightObject + i] = SphereAabb(XMFLOAT3(_pLight[i].pos.x, _pLight[i].pos.y, _pLight[i].pos.z), LightRadius);
+    if (!_modelSubmeshes.empty())
+        _objectBoxes[_getModelObject()] = TransformAabb(_modelBox, _modelWorld);
+
+    if (rebuild)
+    {
+        _sceneBvh.Build(_objectBoxes);
+    }
+    else
+    {
+        // Only the rotating cube and the animated triangles move; the rest of the tree stays as built
+        _sceneBvh.Update(CubeObject, _objectBoxes[CubeObject]);
+        _sceneBvh.Update(TransObject, _objectBoxes[TransObject]);
+        _sceneBvh.Update(TransObject + 1, _objectBoxes[TransObject + 1]);
+        _sceneBvh.Refit();
+    }
+
+    _visibleObjects.clear();
+    _sceneBvh.Cull(frustum, _visibleObjects);
+
+    // Rasterize the visible cubes and drop whatever ends up completely behind them
+    _occlusion.Begin(viewProjection);
+    for (uint32_t i : _visibleObjects)
+    {
+        if (i < TransObject)
+            _occlusion.AddOccluder(CubeOccluderVertices, 8, CubeOccluderIndices, 36, _cubeWorld[i - CubeObject]);
+    }
+    {
+        PROFILE_ZONE("occlusion");
+        _occlusion.Rasterize(&_workers);
+    }
+
+    // Occluders aren't tested: a cube would hide itself wherever its face coincides with its box
+    _visibleObjects.erase(std::remove_if(_visibleObjects.begin(), _visibleObjects.end(),
+        [&](uint32_t i) { return i >= TransObject && !_occlusion.IsVisible(_objectBoxes[i]); }), _visibleObjects.end());
+
+    _objectVisible.assign(numObjects, false);
+    for (uint32_t i : _visibleObjects)
+        _objectVisible[i] = true;
+}
+
+void Renderer::_pick(int x, int y)
+{
+    // Reverse-Z: NDC depth 1 is the near plane. The far plane may be at infinity, so the
+    // second point is taken halfway in depth, which is still on the ray.
+    float ndcX = 2.0f * x / _width - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / _height;
+    const XMMATRIX& inverseViewProjection = _pCamera->GetInverseViewProjectionMatrix();
+    XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverseViewProjection);
+    XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.5f, 1.0f), inverseViewProjection);
+
+    XMFLOAT3 origin, dir;
+    XMStoreFloat3(&origin, nearPoint);
+    XMStoreFloat3(&dir, XMVector3Normalize(XMVectorSubtract(farPoint, nearPoint)));
+
+    auto exactHit = [&](uint32_t object, float tMax) -> float
+    {
+        float tHit = -1.0f;
+        if (object < TransObject)
+        {
+            // Cube: intersect the unit box in object space, the distance is kept by the affine inverse
+            XMMATRIX inverseWorld = XMMatrixInverse(nullptr, _cubeWorld[object - CubeObject]);
+            XMFLOAT3 localOrigin, localDir, invDir;
+            XMStoreFloat3(&localOrigin, XMVector3TransformCoord(XMLoadFloat3(&origin), inverseWorld));
+            XMStoreFloat3(&localDir, XMVector3TransformNormal(XMLoadFloat3(&dir), inverseWorld));
+            invDir = XMFLOAT3(1.0f / localDir.x, 1.0f / localDir.y, 1.0f / localDir.z);
+            if (!IntersectRayAabb(localOrigin, invDir, CubeBox, tMax, tHit))
+                return -1.0f;
+        }
+        else if (object < LightObject)
+        {
+            XMFLOAT3 v[3];
+            for (int i = 0; i < 3; i++)
+                XMStoreFloat3(&v[i], XMVector3TransformCoord(XMLoadFloat4(&TransVertices[i]), _TWorld[object - TransObject].worldMatrix));
+            if (!IntersectRayTriangle(origin, dir, v[0], v[1], v[2], tHit))
+                return -1.0f;
+        }
+        else if (object == _getModelObject())
+        {
+            // The model is picked by its box, there is no CPU copy of its triangles
+            XMFLOAT3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+            if (!IntersectRayAabb(origin, invDir, _objectBoxes[object], tMax, tHit))
+                return -1.0f;
+        }
+        else
+        {
+            const XMFLOAT4& pos = _pLight[object - LightObject].pos;
+            if (!IntersectRaySphere(origin, dir, XMFLOAT3(pos.x, pos.y, pos.z), LightRadius, tHit))
+                return -1.0f;
+        }
+        return tHit;
+    };
+
+    uint32_t object;
+    float tHit;
+    _pickedObject = _sceneBvh.Raycast(origin, dir, exactHit, object, tHit) ? object : NoObject;
+}
+
+const char* Renderer::GetPickedObjectName() const
+{
+    if (_pickedObject == NoObject)
+        return "nothing";
+    if (_pickedObject < TransObject)
+        return _pickedObject == CubeObject ? "cube 1" : "cube 2";
+    if (_pickedObject < LightObject)
+        return _pickedObject == TransObject ? "blue plane" : "pink plane";
+    if (_pickedObject == _getModelObject())
+        return "model";
+    return "light";
+}
+
 void Renderer::MouseButtonDown(WPARAM wParam, LPARAM lParam) 
 {
     _mouseButtonPressed = true;
+    _pacer.OnInput();
     _prevMousePos.x = GET_X_LPARAM(lParam);
     _prevMousePos.y = GET_Y_LPARAM(lParam);
+    _pressMousePos = _prevMousePos;
 }
 
 void Renderer::MouseButtonUp(WPARAM wParam, LPARAM lParam) 
@@ -1158,15 +2102,29 @@ void Renderer::MouseButtonUp(WPARAM wParam, LPARAM lParam)
     _mouseButtonPressed = false;
     _prevMousePos.x = GET_X_LPARAM(lParam);
     _prevMousePos.y = GET_Y_LPARAM(lParam);
+
+    // A click without dragging picks, a drag only orbits the camera
+    if (abs(_prevMousePos.x - _pressMousePos.x) <= 2 && abs(_prevMousePos.y - _pressMousePos.y) <= 2)
+        _pick(_prevMousePos.x, _prevMousePos.y);
 }
 
 void Renderer::MouseMoved(WPARAM wParam, LPARAM lParam)
 {
     if (_mouseButtonPressed) 
     {
-        _pCamera->ChangePos((GET_X_LPARAM(lParam) - _prevMousePos.x) / 100.0f, (GET_Y_LPARAM(lParam) - _prevMousePos.y) / 100.0f);
+        if (!_mouse.IsRawInput())
+        {
+            _pacer.OnInput();
+            _mouse.AddDelta((float)(GET_X_LPARAM(lParam) - _prevMousePos.x), (float)(GET_Y_LPARAM(lParam) - _prevMousePos.y));
+        }
         _prevMousePos.x = GET_X_LPARAM(lParam);
         _prevMousePos.y = GET_Y_LPARAM(lParam);
     }
         
+}
+
+void Renderer::RawInput(LPARAM lParam)
+{
+    if (_mouseButtonPressed && _mouse.OnRawInput(lParam))
+        _pacer.OnInput();
 }
\ No newline at end of file
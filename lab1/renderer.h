@@ -4,10 +4,35 @@
 #include <directxcolors.h>
 #include <d3dcompiler.h>
 #include "camera.h"
+#include "constantRing.h"
+#include "framePacer.h"
+#include "culling.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "lod.h"
+#include "meshgen.h"
+#include "vertexFormat.h"
+#include "meshFile.h"
+#include "meshlet.h"
+#include "transparencySorter.h"
+#include "lightClusters.h"
+#include "shadowCascades.h"
+#include "sceneLayout.h"
+#include "lightmapAtlas.h"
+#include "irradianceProbes.h"
+#include "mouseInput.h"
+#include "cameraPath.h"
+#include "hiResClock.h"
+#include "profiler.h"
+#include "gpuProfiler.h"
+#include "traceCapture.h"
+#include "simulation.h"
 #include <DirectXMath.h>
 #include <windowsx.h>
 #include <vector>
+#include <string>
 #include <algorithm>
+#include <random>
 #include "DDSTextureLoader11.h"
 
 using namespace DirectX;
@@ -18,39 +43,41 @@ if (p != NULL) { \
     p = NULL;\
 }
 
-struct TexVertex
-{
-	XMFLOAT3 pos;
-	XMFLOAT2 uv;
-	XMFLOAT3 normal;
-	XMFLOAT3 tangent;
-};
+typedef MeshVertex TexVertex;
 
 struct WorldMatrixBuffer 
 {
 	XMMATRIX worldMatrix;
 	XMFLOAT4 shine;
+	XMFLOAT4 posScale;
+	XMFLOAT4 posBias;
+	XMUINT4 lightList;  // z is the object's lightmap slice + 1, 0 when it isn't baked
 };
 
+// lightList is the (offset, count) of the object's lights in the cluster index list
 struct ColoredObjMatrixBuffer
 {
 	XMMATRIX worldMatrix;
 	XMFLOAT4 color;
+	XMUINT4 lightList;
 };
 
-struct Light 
-{
-	XMFLOAT4 pos;
-	XMFLOAT4 color;
-};
-
+// The lights themselves live in structured buffers, see ColorCalc.hlsli
 struct ViewMatrixBuffer 
 {
 	XMMATRIX viewProjectionMatrix;
 	XMFLOAT4 cameraPos;
 	XMINT4 lightParams;
-	Light lights[4];
 	XMFLOAT4 ambientColor;
+	XMFLOAT4 clusterScale;
+	XMUINT4 clusterCount;
+	XMMATRIX shadowMatrices[MaxShadowCascades];
+	XMFLOAT4 cascadeSplits;
+	XMFLOAT4 sunDirection;
+	XMFLOAT4 sunColor;
+	XMFLOAT4 probeScale;	// world position to probe index: pos * scale + bias
+	XMFLOAT4 probeBias;
+	XMFLOAT4 probeCount;
 };
 
 
@@ -74,10 +101,68 @@ struct SphereVertex
 };
 
 
-static const XMFLOAT4 TransVertices[] = {
-	 {0, -2.5, -2.5, 1.0},
-	 {0,  2.5, 0, 1.0},
-	 {0,  -2.5,  2.5, 1.0}
+static const UINT ConstantRingSize = 1 << 20;
+
+// Simulation time between two frames of a camera path replay
+static const float ReplayTimestep = 1.0f / 60.0f;
+
+// Orbit angle per mouse count while dragging
+static const float CameraRadiansPerCount = 0.01f;
+
+// Slots of the scene objects in the BVH: two cubes, two transparent triangles, the light gizmos,
+// then the loaded model if there is one
+static const UINT CubeObject = 0;
+static const UINT TransObject = 2;
+static const UINT LightObject = 4;
+static const UINT NoObject = 0xFFFFFFFF;
+
+static const Aabb CubeBox = { XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+static const Aabb TransBox = { XMFLOAT3(0.0f, -2.5f, -2.5f), XMFLOAT3(0.0f, 2.5f, 2.5f) };
+
+// Extra lights asked for with -lights are scattered over this box and have no gizmo
+static const XMFLOAT3 ExtraLightsMin = { -20.0f, -3.0f, -20.0f };
+static const XMFLOAT3 ExtraLightsMax = { 20.0f, 3.0f, 20.0f };
+static const float ExtraLightRadiusMin = 1.0f;
+static const float ExtraLightRadiusMax = 2.0f;
+
+// The sun has cascaded shadows out to ShadowDistance. The cubes and the model cast;
+// a cascade's map is only redrawn when it or one of its casters moved.
+static const UINT ShadowMapSize = 2048;
+static const float ShadowDistance = 40.0f;
+static const float ShadowSplitLambda = 0.7f;
+static const float ShadowCasterReach = 50.0f;
+
+// Tessellations of the sphere mesh, finest first, and the smallest on-screen height in pixels
+// each one is used for. The skybox always uses level 0.
+struct SphereLodDesc
+{
+	UINT latLines;
+	UINT longLines;
+};
+
+static const SphereLodDesc SphereLodLevels[] = { { 20, 20 }, { 12, 12 }, { 8, 8 }, { 5, 6 } };
+static const float SphereLodMinPixels[] = { 96.0f, 32.0f, 12.0f, 0.0f };
+static const UINT SphereLodCount = sizeof(SphereLodLevels) / sizeof(SphereLodLevels[0]);
+static const float LodHysteresis = 0.15f;
+
+// The cubes are the only opaque geometry, so they double as occluders at a low resolution
+static const UINT OcclusionWidth = 256;
+static const XMFLOAT3 CubeOccluderVertices[] = {
+	{-1, -1, -1}, { 1, -1, -1}, { 1,  1, -1}, {-1,  1, -1},
+	{-1, -1,  1}, { 1, -1,  1}, { 1,  1,  1}, {-1,  1,  1}
+};
+static const uint16_t CubeOccluderIndices[] = {
+	0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,
+	0, 1, 5, 0, 5, 4,  3, 6, 2, 3, 7, 6,
+	0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+};
+
+// How the transparent pass composites: sorted back to front per object, or weighted
+// blended order-independent transparency, which needs no sort and handles intersections
+enum TransparencyMode
+{
+	TransparencySorted,
+	TransparencyWeightedOit
 };
 
 class Renderer 
@@ -90,6 +175,34 @@ public:
 	void MouseButtonDown(WPARAM wParam, LPARAM lParam);
 	void MouseButtonUp(WPARAM wParam, LPARAM lParam);
 	void MouseMoved(WPARAM wParam, LPARAM lParam);
+	void RawInput(LPARAM lParam);
+
+	void SetFramePacing(UINT maxFramesInFlight, bool vsync, float fpsCap);
+	void SetModelPath(const char* path) { _modelPath = path; }
+	void SetLightmapPath(const char* path) { _lightmapPath = path; }
+	void SetTransparencyMode(TransparencyMode mode) { _transparencyMode = mode; }
+	void SetExtraLightCount(UINT count) { _extraLightCount = count; }
+	// 0 or less for an infinite far plane
+	void SetCameraFarZ(float farZ) { _farZ = farZ; }
+	void SetMouseFilter(float smoothingMs, float predictionMs) { _mouse.SetFilter(smoothingMs, predictionMs); }
+	// The camera and the simulation time go to a camera path file, saved at cleanup
+	void SetCameraRecording(const char* path) { _recordPath = path; }
+	// Draws a recorded path at a fixed time step instead of following the mouse and the
+	// clock, then writes the CPU time of every frame to reportPath
+	void SetCameraReplay(const char* path, const char* reportPath) { _replayPath = path; _replayReportPath = reportPath; }
+	bool IsReplayFinished() const { return _replayFinished; }
+	void SetSimulationRate(float ticksPerSecond) { _timestep.SetRate(ticksPerSecond); }
+	// Records the profiler zones and GPU pass timings of the next frames to a Chrome trace
+	void StartTraceCapture(UINT frames, const char* path);
+	// Once per frame after ProfilerEndFrame
+	void UpdateTraceCapture();
+	bool IsCapturingTrace() const { return _trace.IsActive(); }
+	TransparencyMode GetTransparencyMode() const { return _transparencyMode; }
+	HANDLE GetFrameWaitHandle() const { return _pacer.GetFrameWaitHandle(); }
+	double GetInputLatency() const { return _pacer.GetInputLatencyMs(); }
+	double GetFrameTime() const { return _pacer.GetFrameTimeMs(); }
+	const char* GetPickedObjectName() const;
+	const OcclusionStats& GetOcclusionStats() const { return _occlusion.GetStats(); }
 
 private:
 	D3D_DRIVER_TYPE         _driverType = D3D_DRIVER_TYPE_NULL;
@@ -103,6 +216,7 @@ private:
 	
 	IDXGISwapChain* _pSwapChain = nullptr;
 	IDXGISwapChain1* _pSwapChain1 = nullptr;
+	FramePacer _pacer;
 
 	ID3D11RenderTargetView* _pRenderTargetView = nullptr;
 
@@ -113,8 +227,8 @@ private:
 	ID3D11InputLayout* _pInputLayout = nullptr;
 	ID3D11ShaderResourceView* _pTexture = nullptr;
 	ID3D11ShaderResourceView* _pNormTexture = nullptr;
-	ID3D11Buffer* _pWorldMatrixBuffer[2] = { nullptr, nullptr };
 	ID3D11Buffer* _pViewMatrixBuffer = nullptr;
+	ID3D11Buffer* _pLightmapUVBuffer = nullptr;
 
 	ID3D11Buffer* _pSkyboxIndexBuffer = nullptr;
 	ID3D11Buffer* _pSkyboxVertexBuffer = nullptr;
@@ -122,7 +236,6 @@ private:
 	ID3D11PixelShader* _pSkyboxPixelShader = nullptr;
 	ID3D11InputLayout* _pSkyboxInputLayout = nullptr;
 	ID3D11ShaderResourceView* _pSkyboxTexture = nullptr;
-	ID3D11Buffer* _pSkyboxWorldMatrixBuffer = nullptr;
 	ID3D11Buffer* _pSkyboxViewMatrixBuffer = nullptr;
 
 	UINT _width;
@@ -133,7 +246,6 @@ private:
 	ID3D11VertexShader* _pTVertexShader = nullptr;
 	ID3D11PixelShader* _pTPixelShader = nullptr;
 	ID3D11InputLayout* _pTInputLayout = nullptr;
-	ID3D11Buffer* _pTWorldMatrixBuffer[2] = { nullptr, nullptr };
 
 
 	ID3D11Buffer* _pLightIndexBuffer = nullptr;
@@ -141,9 +253,30 @@ private:
 	ID3D11VertexShader* _pLightVertexShader = nullptr;
 	ID3D11PixelShader* _pLightPixelShader = nullptr;
 	ID3D11InputLayout* _pLightInputLayout = nullptr;
-	ID3D11Buffer* _pLightWorldMatrixBuffer[4] = { nullptr, nullptr, nullptr, nullptr };
 	ID3D11Buffer* _pLightViewMatrixBuffer = nullptr;
 	
+	ID3D11Buffer* _pModelIndexBuffer = nullptr;
+	ID3D11Buffer* _pModelVertexBuffer = nullptr;
+	ID3D11Buffer* _pModelLightmapUVBuffer = nullptr;
+	DXGI_FORMAT _modelIndexFormat = DXGI_FORMAT_R16_UINT;
+	PositionQuantization _modelQuantization;
+	std::vector<MeshFileSubmesh> _modelSubmeshes;
+	std::vector<MeshFileLod> _modelLods;
+	std::vector<UINT> _modelLod;
+	std::vector<MeshletData> _modelMeshlets;  // per entry of _modelLods
+	ID3D11Buffer* _pModelCulledIndexBuffer = nullptr;
+	std::vector<uint32_t> _modelCulledIndices;
+	UINT _modelCulledIndexCount = 0;
+	bool _modelFullyVisible = true;
+	Aabb _modelBox;
+	XMMATRIX _modelWorld;
+	std::string _modelPath;
+
+	// Static lighting baked with -bake, slices LightmapCubeSlice and LightmapModelSlice.
+	// Baked objects take the static lights and the sun from it instead of shading them.
+	ID3D11ShaderResourceView* _pLightmapSRV = nullptr;
+	std::string _lightmapPath;
+
 	ID3D11RasterizerState* _pRasterizerState = nullptr;
 
 	ID3D11Texture2D* _pDepthBuffer = nullptr;
@@ -153,23 +286,126 @@ private:
 	  
 	ID3D11BlendState* _pBlendState = nullptr;
 
+	TransparencyMode _transparencyMode = TransparencySorted;
+	ID3D11Texture2D* _pOitAccumulationTexture = nullptr;
+	ID3D11RenderTargetView* _pOitAccumulationRTV = nullptr;
+	ID3D11ShaderResourceView* _pOitAccumulationSRV = nullptr;
+	ID3D11Texture2D* _pOitRevealageTexture = nullptr;
+	ID3D11RenderTargetView* _pOitRevealageRTV = nullptr;
+	ID3D11ShaderResourceView* _pOitRevealageSRV = nullptr;
+	ID3D11PixelShader* _pOitPixelShader = nullptr;
+	ID3D11VertexShader* _pOitResolveVertexShader = nullptr;
+	ID3D11PixelShader* _pOitResolvePixelShader = nullptr;
+	ID3D11BlendState* _pOitBlendState = nullptr;
+
+	ConstantRing _cbRing;
+	ConstantSlice _worldSlice[2];
+	ConstantSlice _skyboxWorldSlice;
+	ConstantSlice _TWorldSlice[2];
+	ConstantSlice _modelSlice;
+	std::vector<ConstantSlice> _lightWorldSlice;
+
+	Bvh _sceneBvh;
+	std::vector<Aabb> _objectBoxes;
+	std::vector<uint32_t> _visibleObjects;
+	std::vector<bool> _objectVisible;
+	XMMATRIX _cubeWorld[2];
+	// Animation runs in fixed ticks, frames draw between the last two
+	FixedTimestep _timestep;
+	SimulationState _simPrevious;
+	SimulationState _simCurrent;
+	int64_t _lastUpdateTime = 0;
+	PositionQuantization _cubeQuantization;
+	ThreadPool _workers;
+	OcclusionBuffer _occlusion;
+	XMMATRIX _viewProjection;
+	UINT _pickedObject = NoObject;
+
 	Camera* _pCamera = nullptr;
 	ID3D11SamplerState* _pSampler = nullptr;
 	ColoredObjMatrixBuffer _TWorld[2];
+	TransparencySorter _transparencySorter;
 
+	// Camera drags are summed here and applied once per frame in _updateScene
+	MouseInput _mouse;
 	bool _mouseButtonPressed = false;
 	POINT _prevMousePos;
+	POINT _pressMousePos;
+
+	// Camera path recording or replay
+	CameraPath _cameraPath;
+	std::string _recordPath;
+	std::string _replayPath;
+	std::string _replayReportPath;
+	UINT _replayFrame = 0;
+	double _replayTime = 0.0;  // simulation time of the frame, where the path is sampled
+	bool _replayFinished = false;
+	std::vector<double> _replayFrameMs;
+
+	GpuProfiler _gpuProfiler;
+	TraceCapture _trace;
+	std::vector<GpuRange> _gpuRanges;
 
-	UINT _numSphereTriangles = 0.0;
-	float _radius = 0.2;
+	MeshLod _sphereLods[SphereLodCount];
+	std::vector<UINT> _lightLod;
 
 	std::vector<Light> _pLight;
+	std::vector<Light> _extraLights;
+	UINT _extraLightCount = 0;
+	float _farZ = 0.0f;
+
+	// Clustered lighting: every light, the (offset, count) of each cluster and the light lists
+	LightClusters _lightClusters;
+	SphereBounds _lightBounds;
+	std::vector<Light> _clusterLights;
+	ID3D11Buffer* _pClusterLightBuffer = nullptr;
+	ID3D11ShaderResourceView* _pClusterLightSRV = nullptr;
+	UINT _clusterLightCapacity = 0;
+	ID3D11Buffer* _pClusterRangeBuffer = nullptr;
+	ID3D11ShaderResourceView* _pClusterRangeSRV = nullptr;
+	UINT _clusterRangeCapacity = 0;
+	ID3D11Buffer* _pClusterIndexBuffer = nullptr;
+	ID3D11ShaderResourceView* _pClusterIndexSRV = nullptr;
+	UINT _clusterIndexCapacity = 0;
+
+	ShadowCascades _shadowCascades;
+	std::vector<uint64_t> _casterStates;
+	ID3D11Texture2D* _pShadowTexture = nullptr;
+	ID3D11DepthStencilView* _pShadowDSV[MaxShadowCascades] = {};
+	ID3D11ShaderResourceView* _pShadowSRV = nullptr;
+	ID3D11Buffer* _pShadowViewBuffer[MaxShadowCascades] = {};
+	ID3D11SamplerState* _pShadowSampler = nullptr;
+	ID3D11DepthStencilState* _pShadowDepthState = nullptr;
+	ID3D11RasterizerState* _pShadowRasterizerState = nullptr;
+
+	// Ambient light from the probe grid, baked at startup from the static geometry collected
+	// in _staticScene. The texture holds the slabs PackProbes lays out.
+	RayTracer _staticScene;
+	ID3D11Texture3D* _pProbeTexture = nullptr;
+	ID3D11ShaderResourceView* _pProbeSRV = nullptr;
+	ID3D11SamplerState* _pProbeSampler = nullptr;
 
 	HRESULT _setupBackBuffer();
 	HRESULT _setupDepthBuffer();
+	HRESULT _setupOitTargets();
+	void _releaseOitTargets();
 	HRESULT _initScene();
-	float _getDistToTrans(XMMATRIX worldMatrix, XMFLOAT3 cameraPos);
+	bool _initModel();
+	bool _initLightmap();
+	HRESULT _initShadows();
+	HRESULT _initProbes();
+	void _updateShadows(FXMMATRIX view);
+	void _renderShadows();
+	void _cullModelMeshlets(const XMFLOAT3& cameraPos);
+	UINT _getModelObject() const { return LightObject + (UINT)_pLight.size(); }
+	void _appendSphere(UINT latLines, UINT longLines, std::vector<SphereVertex>& vertices, std::vector<USHORT>& indices);
 	bool _updateScene();
+	void _buildLightClusters(FXMMATRIX view, CXMMATRIX projection);
+	XMUINT4 _addObjectLights(UINT object);
+	HRESULT _uploadLightClusters();
+	HRESULT _writeStructuredBuffer(ID3D11Buffer*& pBuffer, ID3D11ShaderResourceView*& pView, UINT& capacity, UINT stride, const void* pData, UINT count);
+	void _cullObjects(FXMMATRIX viewProjection, const Frustum& frustum);
+	void _pick(int x, int y);
 };
 
 class D3DInclude : public ID3DInclude
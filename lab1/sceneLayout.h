@@ -0,0 +1,92 @@
+#pragma once
+#include "bvh.h"
+#include <DirectXMath.h>
+#include <cstdint>
+
+using namespace DirectX;
+
+// The static part of the scene: what the renderer draws without moving it and what the
+// lightmap baker bakes, so the two can't drift apart.
+
+// pos.w is the radius the light's falloff reaches zero at; matches LIGHT in Scene.hlsli
+struct Light
+{
+    XMFLOAT4 pos;
+    XMFLOAT4 color;
+};
+
+// Perspective of the main camera. The far plane is at infinity unless -farz sets one;
+// with reverse-Z that costs no depth precision worth having.
+static const float CameraFovY = XM_PIDIV2;
+static const float CameraNearZ = 0.01f;
+
+// Colors::LightPink, what the back buffer is cleared to
+static const XMFLOAT4 SceneClearColor = { 1.0f, 0.713725507f, 0.756862760f, 1.0f };
+
+// Scale of the unit sphere the skybox is drawn on around the camera
+static const float SkyboxRadius = 0.2f;
+
+// Specular exponent of the cubes
+static const float CubeShine = 32.0f;
+
+// The light gizmos are unit spheres scaled to this
+static const float LightRadius = 0.1f;
+
+// The transparent triangle in its object space, and the colors of the two instances
+static const XMFLOAT4 TransVertices[] = {
+    { 0.0f, -2.5f, -2.5f, 1.0f },
+    { 0.0f, 2.5f, 0.0f, 1.0f },
+    { 0.0f, -2.5f, 2.5f, 1.0f }
+};
+static const XMFLOAT4 TransColors[] = {
+    { 1.0f, 1.0f, 2.0f, 0.5f },
+    { 1.0f, 0.0f, 1.0f, 0.5f }
+};
+
+// Distance at which the falloff of the four scene lights reaches zero
+static const float SceneLightRadius = 10.0f;
+
+static const Light StaticLights[] = {
+    { XMFLOAT4(0.0f, 2.0f, 0.0f, SceneLightRadius), XMFLOAT4(1.0f, 2.0f, 1.0f, 1.0f) },
+    { XMFLOAT4(2.0f, 0.0f, 0.0f, SceneLightRadius), XMFLOAT4(2.0f, 1.0f, 1.0f, 1.0f) },
+    { XMFLOAT4(4.0f, 3.0f, 1.0f, SceneLightRadius), XMFLOAT4(1.0f, 1.0f, 2.0f, 1.0f) },
+    { XMFLOAT4(-2.0f, 0.0f, 0.0f, SceneLightRadius), XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f) }
+};
+static const uint32_t StaticLightCount = sizeof(StaticLights) / sizeof(StaticLights[0]);
+
+// Directional light, travelling along SunDirection
+static const XMFLOAT3 SunDirection = { -0.4f, -1.0f, 0.3f };
+static const XMFLOAT4 SunColor = { 0.6f, 0.6f, 0.5f, 1.0f };
+
+// The first cube spins around the origin, the second one stays here
+static const XMFLOAT3 StaticCubePosition = { 4.0f, 0.0f, 0.0f };
+
+// A loaded model is scaled to this radius and placed next to the cubes
+static const float ModelRadius = 1.5f;
+static const XMFLOAT3 ModelPosition = { 0.0f, 0.0f, 4.0f };
+
+// Slices of the lightmap array written by -bake
+static const uint32_t LightmapCubeSlice = 0;
+static const uint32_t LightmapModelSlice = 1;
+static const uint32_t LightmapSliceCount = 2;
+
+// Irradiance probes cover the cubes, the model and the transparent quads, one per meter
+static const XMFLOAT3 ProbeGridMin = { -5.0f, -2.0f, -3.0f };
+static const XMFLOAT3 ProbeGridMax = { 7.0f, 4.0f, 7.0f };
+static const XMUINT3 ProbeGridCounts = { 13, 7, 11 };
+
+// The skybox texture is drawn as is; as a light source it is scaled down to sit under the
+// direct lights. Also the sky's radiance when skybox.dds can't be read.
+static const XMFLOAT3 SkyRadiance = { 0.25f, 0.25f, 0.25f };
+
+// Centers the model's bounds on ModelPosition and scales them to ModelRadius
+inline XMMATRIX GetModelWorld(const Aabb& bounds)
+{
+    XMVECTOR boundsMin = XMLoadFloat3(&bounds.min);
+    XMVECTOR boundsMax = XMLoadFloat3(&bounds.max);
+    XMVECTOR center = XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f);
+    float radius = XMVectorGetX(XMVector3Length(XMVectorSubtract(boundsMax, center)));
+    float scale = ModelRadius / (radius > 1e-6f ? radius : 1e-6f);
+    return XMMatrixTranslationFromVector(XMVectorNegate(center)) * XMMatrixScaling(scale, scale, scale) *
+        XMMatrixTranslation(ModelPosition.x, ModelPosition.y, ModelPosition.z);
+}
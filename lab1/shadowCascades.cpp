@@ -0,0 +1,96 @@
+#include "shadowCascades.h"
+#include <algorithm>
+#include <cmath>
+
+// FNV-1a; 0 is kept for "never rendered"
+static uint64_t _hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash ? hash : 1;
+}
+
+uint64_t ShadowCascades::GetCasterState(FXMMATRIX world, uint32_t variant)
+{
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, world);
+    return _hash(&variant, sizeof(variant), _hash(&m, sizeof(m)));
+}
+
+void ShadowCascades::Fit(const ShadowFitDesc& desc)
+{
+    _count = (std::min)(desc.numCascades, MaxShadowCascades);
+
+    // Light view through the origin, so light space only rotates with the light itself
+    XMVECTOR lightDir = XMVector3Normalize(XMLoadFloat3(&desc.lightDir));
+    XMVECTOR up = fabsf(XMVectorGetY(lightDir)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), lightDir, up);
+    XMMATRIX invCameraView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&desc.cameraView));
+
+    float tanY = tanf(desc.fovY * 0.5f);
+    float tanX = tanY * desc.aspect;
+    float k2 = tanX * tanX + tanY * tanY;
+    float range = desc.shadowDistance / desc.nearZ;
+
+    float splitNear = desc.nearZ;
+    for (uint32_t i = 0; i < _count; i++)
+    {
+        float t = (float)(i + 1) / _count;
+        float logSplit = desc.nearZ * powf(range, t);
+        float uniformSplit = desc.nearZ + (desc.shadowDistance - desc.nearZ) * t;
+        float splitFar = desc.splitLambda * logSplit + (1.0f - desc.splitLambda) * uniformSplit;
+
+        // Smallest sphere around the slice: its center is on the view axis, equally far from
+        // the near and far corners unless that would put it past the far plane
+        float a = splitNear, b = splitFar;
+        float centerZ = (std::min)(0.5f * (a + b) * (1.0f + k2), b);
+        float radius = sqrtf((std::max)(a * a * k2 + (centerZ - a) * (centerZ - a), b * b * k2 + (b - centerZ) * (b - centerZ)));
+        // Rounded up so float noise in the matrices can't change the size between frames
+        radius = ceilf(radius * 16.0f) / 16.0f;
+
+        float texelSize = 2.0f * radius / desc.resolution;
+        XMVECTOR center = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, centerZ, 1.0f), invCameraView);
+        XMFLOAT3 lightCenter;
+        XMStoreFloat3(&lightCenter, XMVector3TransformCoord(center, lightView));
+        lightCenter.x = floorf(lightCenter.x / texelSize + 0.5f) * texelSize;
+        lightCenter.y = floorf(lightCenter.y / texelSize + 0.5f) * texelSize;
+        lightCenter.z = floorf(lightCenter.z / texelSize + 0.5f) * texelSize;
+
+        XMMATRIX projection = XMMatrixOrthographicOffCenterLH(lightCenter.x - radius, lightCenter.x + radius,
+            lightCenter.y - radius, lightCenter.y + radius, lightCenter.z - radius - desc.casterReach, lightCenter.z + radius);
+
+        ShadowCascade& cascade = _cascades[i];
+        XMStoreFloat4x4(&cascade.viewProjection, XMMatrixMultiply(lightView, projection));
+        cascade.splitNear = splitNear;
+        cascade.splitFar = splitFar;
+        cascade.texelSize = texelSize;
+        splitNear = splitFar;
+    }
+}
+
+void ShadowCascades::CullCasters(const Bvh& bvh, const std::function<bool(uint32_t)>& isCaster, const uint64_t* casterStates)
+{
+    for (uint32_t i = 0; i < _count; i++)
+    {
+        std::vector<uint32_t>& casters = _casters[i];
+        casters.clear();
+        bvh.Cull(ExtractFrustum(XMLoadFloat4x4(&_cascades[i].viewProjection)), casters);
+        casters.erase(std::remove_if(casters.begin(), casters.end(), [&](uint32_t object) { return !isCaster(object); }), casters.end());
+        std::sort(casters.begin(), casters.end());
+
+        uint64_t signature = _hash(&_cascades[i].viewProjection, sizeof(XMFLOAT4X4));
+        for (uint32_t object : casters)
+        {
+            signature = _hash(&object, sizeof(object), signature);
+            signature = _hash(&casterStates[object], sizeof(uint64_t), signature);
+        }
+        _signatures[i] = signature;
+    }
+}
+
+void ShadowCascades::Invalidate()
+{
+    for (uint32_t i = 0; i < MaxShadowCascades; i++)
+        _renderedSignatures[i] = 0;
+}
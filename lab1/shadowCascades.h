@@ -0,0 +1,67 @@
+#pragma once
+#include "bvh.h"
+#include <DirectXMath.h>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+static const uint32_t MaxShadowCascades = 4;
+
+// Camera and light the cascades are fitted to. Splits blend logarithmic and uniform
+// spacing by splitLambda; casterReach is how far towards the light casters are kept.
+struct ShadowFitDesc
+{
+    XMFLOAT4X4 cameraView;
+    float fovY;
+    float aspect;
+    float nearZ;
+    float shadowDistance;
+    XMFLOAT3 lightDir;
+    uint32_t resolution;
+    uint32_t numCascades;
+    float splitLambda;
+    float casterReach;
+};
+
+struct ShadowCascade
+{
+    XMFLOAT4X4 viewProjection;  // world to light clip space, depth 0 is nearest to the light
+    float splitNear;            // camera view depths the cascade is used for
+    float splitFar;
+    float texelSize;            // world units per shadow map texel
+};
+
+// Cascaded shadow map fitting, caster culling and caching, without a device. Every cascade
+// is an orthographic box around the bounding sphere of its slice of the camera frustum:
+// the sphere doesn't change size as the camera turns, and its center is snapped to whole
+// texels in light space, so shadow edges don't shimmer. A cascade only has to be redrawn
+// when its box moved or the set or transforms of its casters changed.
+class ShadowCascades
+{
+public:
+    void Fit(const ShadowFitDesc& desc);
+
+    uint32_t GetCount() const { return _count; }
+    const ShadowCascade& GetCascade(uint32_t i) const { return _cascades[i]; }
+
+    // Casters are objects of the BVH that pass isCaster. casterStates[object] changes
+    // whenever an object moves or its geometry changes, see GetCasterState.
+    void CullCasters(const Bvh& bvh, const std::function<bool(uint32_t)>& isCaster, const uint64_t* casterStates);
+    const std::vector<uint32_t>& GetCasters(uint32_t i) const { return _casters[i]; }
+
+    bool NeedsRender(uint32_t i) const { return _signatures[i] != _renderedSignatures[i]; }
+    void MarkRendered(uint32_t i) { _renderedSignatures[i] = _signatures[i]; }
+    void Invalidate();
+
+    // variant tells apart different geometry under the same transform, such as LODs
+    static uint64_t GetCasterState(FXMMATRIX world, uint32_t variant = 0);
+
+private:
+    ShadowCascade _cascades[MaxShadowCascades];
+    std::vector<uint32_t> _casters[MaxShadowCascades];
+    uint64_t _signatures[MaxShadowCascades] = {};
+    uint64_t _renderedSignatures[MaxShadowCascades] = {};
+    uint32_t _count = 0;
+};
@@ -0,0 +1,62 @@
+#include "simulation.h"
+#include <cmath>
+#include <algorithm>
+
+void ResetSimulation(SimulationState& state)
+{
+    state.time = 0.0;
+    state.cubeAngle = 0.0f;
+    state.transPositions[0] = XMFLOAT3(2.5f, 0.0f, 0.0f);
+    state.transPositions[1] = XMFLOAT3(-3.0f, 0.0f, 0.0f);
+}
+
+void StepSimulation(SimulationState& state, float step)
+{
+    state.time += step;
+    // From the total time rather than summed, so the angle doesn't drift
+    state.cubeAngle = (float)fmod(state.time, (double)XM_2PI);
+    float wave = (float)sin(state.time);
+    state.transPositions[0] = XMFLOAT3(2.5f, wave, 0.0f);
+    state.transPositions[1] = XMFLOAT3(-3.0f, 0.0f, wave);
+}
+
+void InterpolateSimulation(const SimulationState& previous, const SimulationState& current, float alpha, SimulationFrame& frame)
+{
+    frame.time = previous.time + (current.time - previous.time) * alpha;
+
+    // The short way round when the angle wrapped between the two ticks
+    float turn = current.cubeAngle - previous.cubeAngle;
+    if (turn > XM_PI)
+        turn -= XM_2PI;
+    else if (turn < -XM_PI)
+        turn += XM_2PI;
+    frame.cubeWorld = XMMatrixRotationY(previous.cubeAngle + turn * alpha);
+
+    for (int i = 0; i < 2; i++)
+    {
+        XMVECTOR position = XMVectorLerp(XMLoadFloat3(&previous.transPositions[i]), XMLoadFloat3(&current.transPositions[i]), alpha);
+        frame.transWorld[i] = XMMatrixTranslationFromVector(position);
+    }
+}
+
+void FixedTimestep::SetRate(float ticksPerSecond)
+{
+    _step = 1.0 / (ticksPerSecond > 0.0f ? ticksPerSecond : DefaultSimulationRate);
+    _accumulator = 0.0;
+}
+
+uint32_t FixedTimestep::Advance(double seconds)
+{
+    _accumulator += seconds > 0.0 ? seconds : 0.0;
+    uint32_t ticks = (uint32_t)(std::min)(floor(_accumulator / _step), (double)MaxSimulationTicks);
+    _accumulator -= ticks * _step;
+    // Behind by more than the cap: the rest is let go, leaving less than a tick for alpha
+    if (_accumulator >= _step)
+    {
+        double excess = _accumulator - fmod(_accumulator, _step);
+        _dropped += excess;
+        _accumulator -= excess;
+    }
+    _ticks += ticks;
+    return ticks;
+}
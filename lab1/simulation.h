@@ -0,0 +1,55 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+
+using namespace DirectX;
+
+// The animated part of the scene, advanced in fixed ticks apart from rendering. A frame draws
+// the blend of the last two states, so the animation is as smooth as the frame rate while
+// the simulation runs at its own rate, and a given number of ticks always gives the same state.
+static const float DefaultSimulationRate = 60.0f;  // ticks per second
+// Ticks one frame may run to catch up; time beyond that is dropped and the scene slows down
+// instead of the frames getting longer and longer
+static const uint32_t MaxSimulationTicks = 8;
+
+struct SimulationState
+{
+    double time;                // seconds simulated
+    float cubeAngle;            // spin of the first cube about y, in [0, 2pi)
+    XMFLOAT3 transPositions[2]; // translation of the two transparent planes
+};
+
+void ResetSimulation(SimulationState& state);
+void StepSimulation(SimulationState& state, float step);
+
+// What is drawn: alpha 0 is previous, 1 current
+struct SimulationFrame
+{
+    double time;
+    XMMATRIX cubeWorld;
+    XMMATRIX transWorld[2];
+};
+
+void InterpolateSimulation(const SimulationState& previous, const SimulationState& current, float alpha, SimulationFrame& frame);
+
+// Accumulates frame time and hands it out as whole ticks
+class FixedTimestep
+{
+public:
+    void SetRate(float ticksPerSecond);
+    float GetStep() const { return (float)_step; }
+
+    // Ticks due after `seconds` more real time, at most MaxSimulationTicks
+    uint32_t Advance(double seconds);
+    // Where the frame sits between the last two ticks
+    float GetAlpha() const { return (float)(_accumulator / _step); }
+
+    uint64_t GetTicks() const { return _ticks; }
+    double GetDroppedSeconds() const { return _dropped; }
+
+private:
+    double _step = 1.0 / DefaultSimulationRate;
+    double _accumulator = 0.0;
+    uint64_t _ticks = 0;
+    double _dropped = 0.0;
+};
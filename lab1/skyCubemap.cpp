@@ -0,0 +1,292 @@
+#include "skyCubemap.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace DirectX::PackedVector;
+
+enum SkyFormat
+{
+    SkyFormat_Unknown,
+    SkyFormat_RGBA8,
+    SkyFormat_BGRA8,
+    SkyFormat_BC1,
+    SkyFormat_BC2,
+    SkyFormat_BC3,
+    SkyFormat_RGBA16F,
+    SkyFormat_RGBA32F
+};
+
+// DDS_HEADER after the magic, the optional DDS_HEADER_DXT10 follows it
+struct DdsHeader
+{
+    uint32_t size, flags, height, width, pitch, depth, mipMapCount, reserved1[11];
+    uint32_t pfSize, pfFlags, pfFourCC, pfRGBBitCount, pfRMask, pfGMask, pfBMask, pfAMask;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct DdsHeaderDx10
+{
+    uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+};
+
+static uint32_t _fourCC(char a, char b, char c, char d)
+{
+    return (uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24;
+}
+
+static SkyFormat _dxgiFormat(uint32_t format)
+{
+    switch (format)
+    {
+    case 2: return SkyFormat_RGBA32F;               // R32G32B32A32_FLOAT
+    case 10: return SkyFormat_RGBA16F;              // R16G16B16A16_FLOAT
+    case 28: case 29: return SkyFormat_RGBA8;       // R8G8B8A8_UNORM(_SRGB)
+    case 71: case 72: return SkyFormat_BC1;
+    case 74: case 75: return SkyFormat_BC2;
+    case 77: case 78: return SkyFormat_BC3;
+    case 87: case 91: return SkyFormat_BGRA8;       // B8G8R8A8_UNORM(_SRGB)
+    default: return SkyFormat_Unknown;
+    }
+}
+
+static SkyFormat _legacyFormat(const DdsHeader& header)
+{
+    if (header.pfFlags & 0x4)   // DDPF_FOURCC
+    {
+        uint32_t fourCC = header.pfFourCC;
+        if (fourCC == _fourCC('D', 'X', 'T', '1'))
+            return SkyFormat_BC1;
+        if (fourCC == _fourCC('D', 'X', 'T', '2') || fourCC == _fourCC('D', 'X', 'T', '3'))
+            return SkyFormat_BC2;
+        if (fourCC == _fourCC('D', 'X', 'T', '4') || fourCC == _fourCC('D', 'X', 'T', '5'))
+            return SkyFormat_BC3;
+        if (fourCC == 113)      // D3DFMT_A16B16G16R16F
+            return SkyFormat_RGBA16F;
+        if (fourCC == 116)      // D3DFMT_A32B32G32R32F
+            return SkyFormat_RGBA32F;
+        return SkyFormat_Unknown;
+    }
+    if ((header.pfFlags & 0x40) && header.pfRGBBitCount == 32)  // DDPF_RGB
+    {
+        if (header.pfRMask == 0x000000FF && header.pfGMask == 0x0000FF00 && header.pfBMask == 0x00FF0000)
+            return SkyFormat_RGBA8;
+        if (header.pfRMask == 0x00FF0000 && header.pfGMask == 0x0000FF00 && header.pfBMask == 0x000000FF)
+            return SkyFormat_BGRA8;
+    }
+    return SkyFormat_Unknown;
+}
+
+static size_t _levelSize(SkyFormat format, uint32_t size)
+{
+    size_t blocks = (size_t)(std::max)(1u, (size + 3) / 4);
+    switch (format)
+    {
+    case SkyFormat_BC1: return blocks * blocks * 8;
+    case SkyFormat_BC2:
+    case SkyFormat_BC3: return blocks * blocks * 16;
+    case SkyFormat_RGBA16F: return (size_t)size * size * 8;
+    case SkyFormat_RGBA32F: return (size_t)size * size * 16;
+    default: return (size_t)size * size * 4;
+    }
+}
+
+static XMFLOAT3 _unpack565(uint16_t color)
+{
+    return XMFLOAT3(((color >> 11) & 31) / 31.0f, ((color >> 5) & 63) / 63.0f, (color & 31) / 31.0f);
+}
+
+// Color part of a BC1 to BC3 block; BC2 and BC3 always use the four color mode
+static void _decodeColorBlock(const uint8_t* block, bool bc1, XMFLOAT3 colors[16])
+{
+    uint16_t c0, c1;
+    uint32_t bits;
+    memcpy(&c0, block, 2);
+    memcpy(&c1, block + 2, 2);
+    memcpy(&bits, block + 4, 4);
+
+    XMFLOAT3 palette[4] = { _unpack565(c0), _unpack565(c1) };
+    if (!bc1 || c0 > c1)
+    {
+        palette[2] = XMFLOAT3((2 * palette[0].x + palette[1].x) / 3, (2 * palette[0].y + palette[1].y) / 3, (2 * palette[0].z + palette[1].z) / 3);
+        palette[3] = XMFLOAT3((palette[0].x + 2 * palette[1].x) / 3, (palette[0].y + 2 * palette[1].y) / 3, (palette[0].z + 2 * palette[1].z) / 3);
+    }
+    else
+    {
+        palette[2] = XMFLOAT3((palette[0].x + palette[1].x) / 2, (palette[0].y + palette[1].y) / 2, (palette[0].z + palette[1].z) / 2);
+        palette[3] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    }
+    for (int i = 0; i < 16; i++)
+        colors[i] = palette[(bits >> (i * 2)) & 3];
+}
+
+static void _decodeFace(SkyFormat format, const uint8_t* data, uint32_t size, XMFLOAT3* texels)
+{
+    if (format == SkyFormat_BC1 || format == SkyFormat_BC2 || format == SkyFormat_BC3)
+    {
+        uint32_t blocks = (std::max)(1u, (size + 3) / 4);
+        size_t blockSize = format == SkyFormat_BC1 ? 8 : 16;
+        for (uint32_t by = 0; by < blocks; by++)
+        {
+            for (uint32_t bx = 0; bx < blocks; bx++)
+            {
+                // The alpha half comes first in BC2 and BC3
+                const uint8_t* block = data + ((size_t)by * blocks + bx) * blockSize;
+                XMFLOAT3 colors[16];
+                _decodeColorBlock(format == SkyFormat_BC1 ? block : block + 8, format == SkyFormat_BC1, colors);
+                for (uint32_t y = 0; y < 4 && by * 4 + y < size; y++)
+                {
+                    for (uint32_t x = 0; x < 4 && bx * 4 + x < size; x++)
+                        texels[(size_t)(by * 4 + y) * size + bx * 4 + x] = colors[y * 4 + x];
+                }
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < (size_t)size * size; i++)
+    {
+        switch (format)
+        {
+        case SkyFormat_RGBA8:
+            texels[i] = XMFLOAT3(data[i * 4] / 255.0f, data[i * 4 + 1] / 255.0f, data[i * 4 + 2] / 255.0f);
+            break;
+        case SkyFormat_BGRA8:
+            texels[i] = XMFLOAT3(data[i * 4 + 2] / 255.0f, data[i * 4 + 1] / 255.0f, data[i * 4] / 255.0f);
+            break;
+        case SkyFormat_RGBA16F:
+        {
+            HALF h[3];
+            memcpy(h, data + i * 8, sizeof(h));
+            texels[i] = XMFLOAT3(XMConvertHalfToFloat(h[0]), XMConvertHalfToFloat(h[1]), XMConvertHalfToFloat(h[2]));
+            break;
+        }
+        default:
+            memcpy(&texels[i], data + i * 16, sizeof(XMFLOAT3));
+            break;
+        }
+    }
+}
+
+bool SkyCubemap::Load(const char* path, uint32_t maxSize)
+{
+    _size = 0;
+    _texels.clear();
+
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, path, "rb");
+#else
+    pFile = fopen(path, "rb");
+#endif
+    if (!pFile)
+        return false;
+    std::vector<uint8_t> file;
+    uint8_t buffer[65536];
+    for (size_t read; (read = fread(buffer, 1, sizeof(buffer), pFile)) > 0;)
+        file.insert(file.end(), buffer, buffer + read);
+    fclose(pFile);
+
+    DdsHeader header;
+    if (file.size() < 4 + sizeof(header) || memcmp(file.data(), "DDS ", 4) != 0)
+        return false;
+    memcpy(&header, file.data() + 4, sizeof(header));
+    size_t offset = 4 + sizeof(header);
+
+    SkyFormat format;
+    uint32_t numFaces = (header.caps2 & 0xFE00) == 0xFE00 ? 6 : 1;     // DDSCAPS2_CUBEMAP and all six faces
+    if ((header.pfFlags & 0x4) && header.pfFourCC == _fourCC('D', 'X', '1', '0'))
+    {
+        DdsHeaderDx10 dx10;
+        if (file.size() < offset + sizeof(dx10))
+            return false;
+        memcpy(&dx10, file.data() + offset, sizeof(dx10));
+        offset += sizeof(dx10);
+        format = _dxgiFormat(dx10.dxgiFormat);
+        // A cube is six array slices; the renderer also accepts a plain array of six
+        numFaces = dx10.arraySize * ((dx10.miscFlag & 0x4) ? 6 : 1);
+    }
+    else
+    {
+        format = _legacyFormat(header);
+    }
+    if (format == SkyFormat_Unknown || numFaces != 6 || header.width != header.height || header.width == 0)
+        return false;
+
+    // Every face holds its whole mip chain before the next face starts
+    uint32_t numMips = (std::max)(header.mipMapCount, 1u);
+    size_t faceSize = 0;
+    size_t levelOffset = 0;
+    for (uint32_t mip = 0; mip < numMips; mip++)
+    {
+        uint32_t size = (std::max)(header.width >> mip, 1u);
+        if (_size == 0 && (size <= maxSize || mip + 1 == numMips))
+        {
+            _size = size;
+            levelOffset = faceSize;
+        }
+        faceSize += _levelSize(format, size);
+    }
+    if (file.size() < offset + faceSize * 6)
+    {
+        _size = 0;
+        return false;
+    }
+
+    _texels.resize((size_t)_size * _size * 6);
+    for (uint32_t face = 0; face < 6; face++)
+        _decodeFace(format, file.data() + offset + face * faceSize + levelOffset, _size, &_texels[(size_t)face * _size * _size]);
+    return true;
+}
+
+XMFLOAT3 SkyCubemap::Sample(const XMFLOAT3& dir) const
+{
+    if (_size == 0)
+        return XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+    // Face selection and face coordinates as in the D3D cube map addressing rules
+    float ax = fabsf(dir.x), ay = fabsf(dir.y), az = fabsf(dir.z);
+    uint32_t face;
+    float s, t, major;
+    if (ax >= ay && ax >= az)
+    {
+        face = dir.x >= 0.0f ? 0 : 1;
+        s = dir.x >= 0.0f ? -dir.z : dir.z;
+        t = -dir.y;
+        major = ax;
+    }
+    else if (ay >= az)
+    {
+        face = dir.y >= 0.0f ? 2 : 3;
+        s = dir.x;
+        t = dir.y >= 0.0f ? dir.z : -dir.z;
+        major = ay;
+    }
+    else
+    {
+        face = dir.z >= 0.0f ? 4 : 5;
+        s = dir.z >= 0.0f ? dir.x : -dir.x;
+        t = -dir.y;
+        major = az;
+    }
+    if (major < 1e-12f)
+        return XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+    // Texel centers at half-integers, clamped to the face
+    float x = (s / major * 0.5f + 0.5f) * _size - 0.5f;
+    float y = (t / major * 0.5f + 0.5f) * _size - 0.5f;
+    x = (std::min)((std::max)(x, 0.0f), (float)(_size - 1));
+    y = (std::min)((std::max)(y, 0.0f), (float)(_size - 1));
+    uint32_t x0 = (uint32_t)x, y0 = (uint32_t)y;
+    uint32_t x1 = (std::min)(x0 + 1, _size - 1), y1 = (std::min)(y0 + 1, _size - 1);
+    float fx = x - x0, fy = y - y0;
+
+    const XMFLOAT3* texels = &_texels[(size_t)face * _size * _size];
+    XMVECTOR top = XMVectorLerp(XMLoadFloat3(&texels[y0 * _size + x0]), XMLoadFloat3(&texels[y0 * _size + x1]), fx);
+    XMVECTOR bottom = XMVectorLerp(XMLoadFloat3(&texels[y1 * _size + x0]), XMLoadFloat3(&texels[y1 * _size + x1]), fx);
+    XMFLOAT3 color;
+    XMStoreFloat3(&color, XMVectorLerp(top, bottom, fy));
+    return color;
+}
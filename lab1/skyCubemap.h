@@ -0,0 +1,24 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// CPU copy of a cube map DDS such as skybox.dds, for baking. Reads uncompressed 8-bit RGBA
+// and BGRA, BC1 to BC3 and 16- and 32-bit float RGBA, with the legacy or the DX10 header.
+// Only the color is kept; alpha is dropped.
+class SkyCubemap
+{
+public:
+    // Keeps the first mip level whose faces are at most maxSize texels wide
+    bool Load(const char* path, uint32_t maxSize);
+
+    uint32_t GetSize() const { return _size; }
+    // Bilinear inside the face dir points at, faces in the D3D order +x -x +y -y +z -z
+    XMFLOAT3 Sample(const XMFLOAT3& dir) const;
+
+private:
+    uint32_t _size = 0;
+    std::vector<XMFLOAT3> _texels;      // six faces of _size * _size, row by row
+};
@@ -0,0 +1,367 @@
+#include "softRaster.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <immintrin.h>
+
+static uint32_t _packColor(const XMFLOAT4& color)
+{
+    auto unorm = [](float v) { return (uint32_t)((std::min)((std::max)(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    return unorm(color.x) | unorm(color.y) << 8 | unorm(color.z) << 16 | unorm(color.w) << 24;
+}
+
+void SoftRasterizer::Resize(uint32_t width, uint32_t height)
+{
+    _width = width;
+    _height = height;
+    _tilesX = (width + SoftTileSize - 1) / SoftTileSize;
+    _tilesY = (height + SoftTileSize - 1) / SoftTileSize;
+
+    _color.assign((size_t)width * height, 0);
+    _depth.assign((size_t)width * height, 0.0f);
+    _tileBins.resize(_tilesX * _tilesY);
+    _tileShaded.assign(_tilesX * _tilesY, 0);
+}
+
+void SoftRasterizer::Clear(const XMFLOAT4& color)
+{
+    _clearColor = _packColor(color);
+    _clearPending = true;
+    _stats = SoftRasterStats();
+}
+
+// Position and the used varyings at t between a and b
+static void _lerpVertex(const SoftVertex& a, const SoftVertex& b, float t, uint32_t numVaryings, SoftVertex& out)
+{
+    out.clip = XMFLOAT4(a.clip.x + (b.clip.x - a.clip.x) * t, a.clip.y + (b.clip.y - a.clip.y) * t,
+        a.clip.z + (b.clip.z - a.clip.z) * t, a.clip.w + (b.clip.w - a.clip.w) * t);
+    for (uint32_t k = 0; k < numVaryings; k++)
+        out.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+}
+
+// Sutherland-Hodgman against one plane; distance(v) >= 0 is kept
+template <typename Distance>
+static uint32_t _clipPolygon(const SoftVertex* in, uint32_t count, SoftVertex* out, uint32_t numVaryings, Distance distance)
+{
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const SoftVertex& a = in[i];
+        const SoftVertex& b = in[(i + 1) % count];
+        float da = distance(a.clip), db = distance(b.clip);
+        if (da >= 0.0f)
+            out[result++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f))
+            _lerpVertex(a, b, da / (da - db), numVaryings, out[result++]);
+    }
+    return result;
+}
+
+void SoftRasterizer::Draw(const SoftDrawState& state, const SoftVertex* vertices, const uint32_t* indices, uint32_t numIndices)
+{
+    uint32_t draw = (uint32_t)_draws.size();
+    _draws.push_back(state);
+
+    // Near plane z <= w and far plane z >= 0; the sides are left to the bounding boxes
+    auto nearDistance = [](const XMFLOAT4& p) { return p.w - p.z; };
+    auto farDistance = [](const XMFLOAT4& p) { return p.z; };
+    for (uint32_t i = 0; i + 2 < numIndices; i += 3)
+    {
+        const SoftVertex& v0 = vertices[indices[i]];
+        const SoftVertex& v1 = vertices[indices[i + 1]];
+        const SoftVertex& v2 = vertices[indices[i + 2]];
+        bool inside = true;
+        for (const SoftVertex* v : { &v0, &v1, &v2 })
+            inside = inside && nearDistance(v->clip) >= 0.0f && farDistance(v->clip) >= 0.0f;
+        if (inside)
+        {
+            _setupTriangle(v0, v1, v2, draw);
+            continue;
+        }
+
+        // Each plane adds at most one vertex
+        SoftVertex polygon[5], clipped[5];
+        polygon[0] = v0;
+        polygon[1] = v1;
+        polygon[2] = v2;
+        uint32_t count = _clipPolygon(polygon, 3, clipped, state.numVaryings, nearDistance);
+        count = _clipPolygon(clipped, count, polygon, state.numVaryings, farDistance);
+        for (uint32_t k = 2; k < count; k++)
+            _setupTriangle(polygon[0], polygon[k - 1], polygon[k], draw);
+    }
+}
+
+void SoftRasterizer::_setupTriangle(const SoftVertex& v0, const SoftVertex& v1, const SoftVertex& v2, uint32_t draw)
+{
+    _stats.triangles++;
+    const SoftVertex* p[3] = { &v0, &v1, &v2 };
+    float x[3], y[3], z[3], invW[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const XMFLOAT4& v = p[i]->clip;
+        // Clipping left w at least z >= 0; a degenerate vertex at the eye has no pixels
+        if (v.w <= 0.0f)
+            return;
+        invW[i] = 1.0f / v.w;
+        x[i] = (v.x * invW[i] * 0.5f + 0.5f) * _width;
+        y[i] = (0.5f - v.y * invW[i] * 0.5f) * _height;
+        z[i] = v.z * invW[i];
+    }
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(fabsf(area) >= 1e-8f))
+        return;
+    // No culling: the other winding is turned around
+    if (area < 0.0f)
+    {
+        std::swap(p[1], p[2]);
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        std::swap(invW[1], invW[2]);
+        area = -area;
+    }
+
+    Triangle tri;
+    tri.minX = (std::max)(0, (int)floorf((std::min)({ x[0], x[1], x[2] })));
+    tri.maxX = (std::min)((int)_width - 1, (int)ceilf((std::max)({ x[0], x[1], x[2] })));
+    tri.minY = (std::max)(0, (int)floorf((std::min)({ y[0], y[1], y[2] })));
+    tri.maxY = (std::min)((int)_height - 1, (int)ceilf((std::max)({ y[0], y[1], y[2] })));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+        return;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        tri.edgeA[i] = -(y[j] - y[i]);
+        tri.edgeB[i] = x[j] - x[i];
+        tri.edgeC[i] = -tri.edgeA[i] * x[i] - tri.edgeB[i] * y[i];
+        // The inside is along (a, b): a top edge has it straight down, a left edge to the right
+        bool topLeft = tri.edgeA[i] > 0.0f || (tri.edgeA[i] == 0.0f && tri.edgeB[i] > 0.0f);
+        tri.edgeBias[i] = topLeft ? 0.0f : FLT_MIN;
+    }
+
+    auto plane = [&](const float q[3], float& a, float& b, float& c)
+    {
+        a = ((q[1] - q[0]) * (y[2] - y[0]) - (q[2] - q[0]) * (y[1] - y[0])) / area;
+        b = ((q[2] - q[0]) * (x[1] - x[0]) - (q[1] - q[0]) * (x[2] - x[0])) / area;
+        c = q[0] - a * x[0] - b * y[0];
+    };
+    plane(z, tri.zA, tri.zB, tri.zC);
+    plane(invW, tri.invWA, tri.invWB, tri.invWC);
+
+    const SoftDrawState& state = _draws[draw];
+    tri.draw = draw;
+    tri.firstVarying = (uint32_t)_varyingPlanes.size();
+    _varyingPlanes.resize(_varyingPlanes.size() + state.numVaryings * 3);
+    float* planes = &_varyingPlanes[tri.firstVarying];
+    for (uint32_t k = 0; k < state.numVaryings; k++)
+    {
+        float q[3] = { p[0]->varyings[k] * invW[0], p[1]->varyings[k] * invW[1], p[2]->varyings[k] * invW[2] };
+        plane(q, planes[k * 3], planes[k * 3 + 1], planes[k * 3 + 2]);
+    }
+
+    // Into every tile of the bounding box that an edge doesn't reject at its most inside corner
+    uint32_t index = (uint32_t)_triangles.size();
+    _triangles.push_back(tri);
+    for (int ty = tri.minY / (int)SoftTileSize; ty <= tri.maxY / (int)SoftTileSize; ty++)
+    {
+        for (int tx = tri.minX / (int)SoftTileSize; tx <= tri.maxX / (int)SoftTileSize; tx++)
+        {
+            float x0 = (float)(tx * SoftTileSize), y0 = (float)(ty * SoftTileSize);
+            bool outside = false;
+            for (int i = 0; i < 3 && !outside; i++)
+            {
+                float cx = tri.edgeA[i] > 0.0f ? x0 + SoftTileSize : x0;
+                float cy = tri.edgeB[i] > 0.0f ? y0 + SoftTileSize : y0;
+                outside = tri.edgeA[i] * cx + tri.edgeB[i] * cy + tri.edgeC[i] < 0.0f;
+            }
+            if (outside)
+                continue;
+            _tileBins[ty * _tilesX + tx].push_back(index);
+            _stats.binned++;
+        }
+    }
+}
+
+void SoftRasterizer::Flush(ThreadPool* pPool)
+{
+    PROFILE_ZONE("soft raster");
+    auto tiles = [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t tile = begin; tile < end; tile++)
+            _rasterizeTile(tile);
+    };
+    if (pPool)
+        pPool->ParallelFor(_tilesX * _tilesY, 1, tiles);
+    else
+        tiles(0, _tilesX * _tilesY);
+
+    for (uint32_t tile = 0; tile < _tilesX * _tilesY; tile++)
+    {
+        _stats.shadedPixels += _tileShaded[tile];
+        _tileBins[tile].clear();
+    }
+    _draws.clear();
+    _triangles.clear();
+    _varyingPlanes.clear();
+    _clearPending = false;
+}
+
+void SoftRasterizer::_rasterizeTile(uint32_t tile)
+{
+    int tileMinX = (int)(tile % _tilesX * SoftTileSize);
+    int tileMinY = (int)(tile / _tilesX * SoftTileSize);
+    int tileMaxX = (std::min)(tileMinX + (int)SoftTileSize, (int)_width) - 1;
+    int tileMaxY = (std::min)(tileMinY + (int)SoftTileSize, (int)_height) - 1;
+
+    if (_clearPending)
+    {
+        for (int y = tileMinY; y <= tileMaxY; y++)
+        {
+            std::fill(&_color[y * _width + tileMinX], &_color[y * _width + tileMaxX] + 1, _clearColor);
+            std::fill(&_depth[y * _width + tileMinX], &_depth[y * _width + tileMaxX] + 1, 0.0f);
+        }
+    }
+
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    // Groups of four start on multiples of four inside the tile; lanes past its right
+    // edge belong to nobody or to the next tile
+    const __m128 laneLimit = _mm_set1_ps((float)(tileMaxX + 1));
+    alignas(16) float lanes[SoftMaxVaryings + 2][4];
+    float pixelVaryings[SoftMaxVaryings];
+    uint64_t shaded = 0;
+
+    for (uint32_t index : _tileBins[tile])
+    {
+        const Triangle& tri = _triangles[index];
+        const SoftDrawState& state = _draws[tri.draw];
+        const float* planes = &_varyingPlanes[tri.firstVarying];
+        int minY = (std::max)(tri.minY, tileMinY);
+        int maxY = (std::min)(tri.maxY, tileMaxY);
+        int minX = (std::max)(tri.minX, tileMinX) & ~3;
+        int maxX = (std::min)(tri.maxX, tileMaxX);
+
+        __m128 a0 = _mm_set1_ps(tri.edgeA[0]), a1 = _mm_set1_ps(tri.edgeA[1]), a2 = _mm_set1_ps(tri.edgeA[2]);
+        __m128 bias0 = _mm_set1_ps(tri.edgeBias[0]), bias1 = _mm_set1_ps(tri.edgeBias[1]), bias2 = _mm_set1_ps(tri.edgeBias[2]);
+        __m128 za = _mm_set1_ps(tri.zA), invWA = _mm_set1_ps(tri.invWA);
+        __m128 a0Step = _mm_set1_ps(tri.edgeA[0] * 4.0f), a1Step = _mm_set1_ps(tri.edgeA[1] * 4.0f), a2Step = _mm_set1_ps(tri.edgeA[2] * 4.0f);
+        __m128 zStep = _mm_set1_ps(tri.zA * 4.0f);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)minX), laneOffsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(tri.edgeB[0] * py + tri.edgeC[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(tri.edgeB[1] * py + tri.edgeC[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(tri.edgeB[2] * py + tri.edgeC[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(za, px), _mm_set1_ps(tri.zB * py + tri.zC));
+
+            float* depthRow = &_depth[y * _width];
+            uint32_t* colorRow = &_color[y * _width];
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, bias0), _mm_cmpge_ps(e1, bias1)),
+                    _mm_and_ps(_mm_cmpge_ps(e2, bias2), _mm_cmplt_ps(px, laneLimit)));
+                int mask = _mm_movemask_ps(inside);
+                if (mask)
+                {
+                    // Lanes past the tile may be past the row too: there only covered ones are read
+                    __m128 old;
+                    if (x + 3 <= tileMaxX)
+                    {
+                        old = _mm_loadu_ps(depthRow + x);
+                    }
+                    else
+                    {
+                        alignas(16) float oldDepth[4];
+                        for (int lane = 0; lane < 4; lane++)
+                            oldDepth[lane] = mask & (1 << lane) ? depthRow[x + lane] : 0.0f;
+                        old = _mm_load_ps(oldDepth);
+                    }
+                    __m128 pass = _mm_and_ps(inside, _mm_cmpge_ps(z, old));
+                    mask = _mm_movemask_ps(pass);
+                }
+                if (mask)
+                {
+                    // Perspective correct: each varying / w over the interpolated 1 / w
+                    __m128 invW = _mm_add_ps(_mm_mul_ps(invWA, px), _mm_set1_ps(tri.invWB * py + tri.invWC));
+                    _mm_store_ps(lanes[0], z);
+                    _mm_store_ps(lanes[1], _mm_div_ps(_mm_set1_ps(1.0f), invW));
+                    for (uint32_t k = 0; k < state.numVaryings; k++)
+                    {
+                        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[k * 3]), px), _mm_set1_ps(planes[k * 3 + 1] * py + planes[k * 3 + 2]));
+                        _mm_store_ps(lanes[k + 2], _mm_mul_ps(v, _mm_load_ps(lanes[1])));
+                    }
+
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        if (!(mask & (1 << lane)))
+                            continue;
+                        if (state.depth == SoftDepthTestWrite)
+                            depthRow[x + lane] = lanes[0][lane];
+                        for (uint32_t k = 0; k < state.numVaryings; k++)
+                            pixelVaryings[k] = lanes[k + 2][lane];
+                        SoftPixel pixel = { x + lane + 0.5f, py, lanes[1][lane], pixelVaryings };
+                        XMFLOAT4 color = state.pShader(state.pConstants, pixel);
+                        uint32_t& target = colorRow[x + lane];
+                        if (state.blend == SoftBlendAlpha)
+                        {
+                            // A unorm target clamps the shader output before blending; the target
+                            // is read back and blended in float, alpha untouched
+                            auto saturate = [](float v) { return (std::min)((std::max)(v, 0.0f), 1.0f); };
+                            float a = saturate(color.w);
+                            float dst[3] = { (target & 0xFF) / 255.0f, (target >> 8 & 0xFF) / 255.0f, (target >> 16 & 0xFF) / 255.0f };
+                            XMFLOAT4 blended(saturate(color.x) * a + dst[0] * (1.0f - a), saturate(color.y) * a + dst[1] * (1.0f - a),
+                                saturate(color.z) * a + dst[2] * (1.0f - a), 0.0f);
+                            target = (_packColor(blended) & 0x00FFFFFF) | (target & 0xFF000000);
+                        }
+                        else
+                        {
+                            target = _packColor(color);
+                        }
+                        shaded++;
+                    }
+                }
+                px = _mm_add_ps(px, _mm_set1_ps(4.0f));
+                e0 = _mm_add_ps(e0, a0Step);
+                e1 = _mm_add_ps(e1, a1Step);
+                e2 = _mm_add_ps(e2, a2Step);
+                z = _mm_add_ps(z, zStep);
+            }
+        }
+    }
+    _tileShaded[tile] = shaded;
+}
+
+bool SoftRasterizer::WritePpm(const char* path) const
+{
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path, "wb") != 0)
+        file = nullptr;
+#else
+    file = fopen(path, "wb");
+#endif
+    if (!file)
+        return false;
+
+    fprintf(file, "P6\n%u %u\n255\n", _width, _height);
+    std::vector<uint8_t> row(_width * 3);
+    for (uint32_t y = 0; y < _height; y++)
+    {
+        for (uint32_t x = 0; x < _width; x++)
+        {
+            uint32_t c = _color[y * _width + x];
+            row[x * 3] = (uint8_t)(c & 0xFF);
+            row[x * 3 + 1] = (uint8_t)(c >> 8 & 0xFF);
+            row[x * 3 + 2] = (uint8_t)(c >> 16 & 0xFF);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "threadPool.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Headless rasterizer for the renderer's passes on the CPU. Draws are queued: Draw clips the
+// triangles against the near and far planes, sets them up and bins them into SoftTileSize
+// tiles in submission order; Flush then runs the tiles on the worker threads, so every pixel
+// still sees its triangles in draw order and blending needs no locks. Edge functions, the
+// depth test and the varyings are evaluated four pixels at a time with SSE. No culling, like
+// _pRasterizerState, and the target is RGBA8 like the swap chain.
+static const uint32_t SoftTileSize = 64;
+static const uint32_t SoftMaxVaryings = 12;
+
+// Output of a vertex shader: clip space position and the values to interpolate
+struct SoftVertex
+{
+    XMFLOAT4 clip;
+    float varyings[SoftMaxVaryings];
+};
+
+// Pixel shader input: x, y and w as in SV_POSITION (pixel center, view depth), the
+// varyings interpolated perspective correct
+struct SoftPixel
+{
+    float x, y, w;
+    const float* varyings;
+};
+
+typedef XMFLOAT4 (*SoftPixelShader)(const void* pConstants, const SoftPixel& pixel);
+
+// _pDepthState and _pZeroDepthState: reverse-Z GREATER_EQUAL, with or without the write
+enum SoftDepthMode
+{
+    SoftDepthTestWrite,
+    SoftDepthTest
+};
+
+// No blending, or _pBlendState: rgb = src * srcAlpha + dst * (1 - srcAlpha), alpha kept
+enum SoftBlendMode
+{
+    SoftBlendOpaque,
+    SoftBlendAlpha
+};
+
+struct SoftDrawState
+{
+    SoftDepthMode depth;
+    SoftBlendMode blend;
+    uint32_t numVaryings;
+    SoftPixelShader pShader;
+    const void* pConstants;     // must stay valid until Flush
+};
+
+struct SoftRasterStats
+{
+    uint32_t triangles;         // after clipping, before the empty ones are dropped
+    uint32_t binned;            // tile entries
+    uint64_t shadedPixels;
+};
+
+class SoftRasterizer
+{
+public:
+    void Resize(uint32_t width, uint32_t height);
+    uint32_t GetWidth() const { return _width; }
+    uint32_t GetHeight() const { return _height; }
+
+    // Applied by the tiles at the next Flush; depth goes to 0, the far end of reverse-Z
+    void Clear(const XMFLOAT4& color);
+    // Triangle list
+    void Draw(const SoftDrawState& state, const SoftVertex* vertices, const uint32_t* indices, uint32_t numIndices);
+    void Flush(ThreadPool* pPool);
+
+    // RGBA8 rows, top first
+    const uint32_t* GetColor() const { return _color.data(); }
+    float GetDepth(uint32_t x, uint32_t y) const { return _depth[y * _width + x]; }
+    const SoftRasterStats& GetStats() const { return _stats; }
+
+    // Binary PPM of the color
+    bool WritePpm(const char* path) const;
+
+private:
+    // Plane equations in pixel coordinates, p = a*x + b*y + c. The varyings are divided by
+    // w and divided back with the interpolated 1 / w.
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3];
+        // 0 or the smallest normal float: pixels exactly on an edge that isn't top or left
+        // fail, so shared edges are drawn once
+        float edgeBias[3];
+        float zA, zB, zC;
+        float invWA, invWB, invWC;
+        int minX, minY, maxX, maxY;
+        uint32_t draw;
+        uint32_t firstVarying;  // into _varyingPlanes, three floats per varying
+    };
+
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    uint32_t _tilesX = 0;
+    uint32_t _tilesY = 0;
+
+    std::vector<uint32_t> _color;
+    std::vector<float> _depth;
+    uint32_t _clearColor = 0;
+    bool _clearPending = false;
+
+    std::vector<SoftDrawState> _draws;
+    std::vector<Triangle> _triangles;
+    std::vector<float> _varyingPlanes;
+    std::vector<std::vector<uint32_t>> _tileBins;
+    std::vector<uint64_t> _tileShaded;
+    SoftRasterStats _stats = {};
+
+    void _setupTriangle(const SoftVertex& v0, const SoftVertex& v1, const SoftVertex& v2, uint32_t draw);
+    void _rasterizeTile(uint32_t tile);
+};
@@ -0,0 +1,409 @@
+#include "softRenderer.h"
+#include "benchmark.h"
+#include "cameraPath.h"
+#include "hiResClock.h"
+#include "profiler.h"
+#include "rayTracer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Varyings of the cube pass, PS_INPUT in VS.hlsl without the lightmap uv
+static const uint32_t SurfaceVaryings = 11;
+static const uint32_t PositionVaryings = 3;
+
+//-----------SoftTexture-------------
+
+void SoftTexture::Create(uint32_t width, uint32_t height, const std::vector<XMFLOAT3>& texels)
+{
+    _width = width;
+    _height = height;
+    _texels = texels;
+}
+
+void SoftTexture::CreateChecker(uint32_t size, uint32_t squares, const XMFLOAT3& a, const XMFLOAT3& b)
+{
+    std::vector<XMFLOAT3> texels(size * size);
+    uint32_t square = (std::max)(size / (std::max)(squares, 1u), 1u);
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+            texels[y * size + x] = (x / square + y / square) % 2 ? b : a;
+    }
+    Create(size, size, texels);
+}
+
+void SoftTexture::CreateFlat(const XMFLOAT3& color)
+{
+    Create(1, 1, std::vector<XMFLOAT3>(1, color));
+}
+
+XMFLOAT3 SoftTexture::Sample(float u, float v) const
+{
+    if (_texels.empty())
+        return XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+    // Texel centers at half coordinates, the border texels repeat outside
+    float fx = (std::min)((std::max)(u * _width - 0.5f, 0.0f), (float)(_width - 1));
+    float fy = (std::min)((std::max)(v * _height - 0.5f, 0.0f), (float)(_height - 1));
+    uint32_t x0 = (uint32_t)fx, y0 = (uint32_t)fy;
+    uint32_t x1 = (std::min)(x0 + 1, _width - 1), y1 = (std::min)(y0 + 1, _height - 1);
+    float tx = fx - x0, ty = fy - y0;
+
+    const XMFLOAT3& c00 = _texels[y0 * _width + x0];
+    const XMFLOAT3& c10 = _texels[y0 * _width + x1];
+    const XMFLOAT3& c01 = _texels[y1 * _width + x0];
+    const XMFLOAT3& c11 = _texels[y1 * _width + x1];
+    auto lerp2 = [&](float a, float b, float c, float d) { return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * ty; };
+    return XMFLOAT3(lerp2(c00.x, c10.x, c01.x, c11.x), lerp2(c00.y, c10.y, c01.y, c11.y), lerp2(c00.z, c10.z, c01.z, c11.z));
+}
+
+//-----------Shaders-------------
+
+// GetProbeIrradiance: trilinear between the eight nearest probes, twoSided drops the linear band
+static XMVECTOR _getProbeIrradiance(const SoftScene& scene, FXMVECTOR pos, FXMVECTOR normal, bool twoSided)
+{
+    if (!scene.pProbes || scene.pProbes->empty())
+        return XMVectorZero();
+
+    const uint32_t counts[3] = { ProbeGridCounts.x, ProbeGridCounts.y, ProbeGridCounts.z };
+    const float gridMin[3] = { ProbeGridMin.x, ProbeGridMin.y, ProbeGridMin.z };
+    const float gridMax[3] = { ProbeGridMax.x, ProbeGridMax.y, ProbeGridMax.z };
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, pos);
+    const float coords[3] = { p.x, p.y, p.z };
+    uint32_t i0[3], i1[3];
+    float t[3];
+    for (int a = 0; a < 3; a++)
+    {
+        float probe = (coords[a] - gridMin[a]) * (counts[a] - 1) / (gridMax[a] - gridMin[a]);
+        probe = (std::min)((std::max)(probe, 0.0f), (float)(counts[a] - 1));
+        i0[a] = (uint32_t)probe;
+        i1[a] = (std::min)(i0[a] + 1, counts[a] - 1);
+        t[a] = probe - i0[a];
+    }
+
+    float sh[ProbeCoefficients * 3] = {};
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        uint32_t x = corner & 1 ? i1[0] : i0[0], y = corner & 2 ? i1[1] : i0[1], z = corner & 4 ? i1[2] : i0[2];
+        float weight = (corner & 1 ? t[0] : 1.0f - t[0]) * (corner & 2 ? t[1] : 1.0f - t[1]) * (corner & 4 ? t[2] : 1.0f - t[2]);
+        const ProbeSH& probe = (*scene.pProbes)[(z * counts[1] + y) * counts[0] + x];
+        for (uint32_t k = 0; k < ProbeCoefficients * 3; k++)
+            sh[k] += probe.values[k] * weight;
+    }
+
+    XMFLOAT3 n;
+    XMStoreFloat3(&n, XMVector3Normalize(normal));
+    float basis[ProbeCoefficients] = { 1.0f, n.y, n.z, n.x, n.x * n.y, n.y * n.z, 3.0f * n.z * n.z - 1.0f, n.x * n.z, n.x * n.x - n.y * n.y };
+    if (twoSided)
+        basis[1] = basis[2] = basis[3] = 0.0f;
+    XMFLOAT3 color(0.0f, 0.0f, 0.0f);
+    for (uint32_t c = 0; c < ProbeCoefficients; c++)
+    {
+        color.x += sh[c * 3] * basis[c];
+        color.y += sh[c * 3 + 1] * basis[c];
+        color.z += sh[c * 3 + 2] * basis[c];
+    }
+    return XMVectorMax(XMLoadFloat3(&color), XMVectorZero());
+}
+
+// GetAttenuation
+static float _getAttenuation(float dist, float radius)
+{
+    float ratio = dist / radius;
+    float window = (std::min)((std::max)(1.0f - ratio * ratio * ratio * ratio, 0.0f), 1.0f);
+    return window * window / (dist * dist + 1.0f);
+}
+
+// CalculateColor of an object that isn't baked, without the sun's shadow
+static XMVECTOR _calculateColor(const SoftScene& scene, FXMVECTOR objColor, FXMVECTOR objNormal, FXMVECTOR pos, float shine, bool transparent)
+{
+    XMVECTOR finalColor = XMVectorZero();
+
+    XMVECTOR sunDir = XMVectorNegate(XMLoadFloat3(&scene.sunDirection));
+    XMVECTOR sunNorm = transparent && XMVectorGetX(XMVector3Dot(sunDir, objNormal)) < 0.0f ? XMVectorNegate(objNormal) : objNormal;
+    float sunDiffuse = (std::max)(XMVectorGetX(XMVector3Dot(sunDir, sunNorm)), 0.0f);
+    finalColor = XMVectorMultiply(XMVectorScale(objColor, sunDiffuse), XMLoadFloat3(&scene.sunColor));
+
+    XMVECTOR viewDir = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&scene.cameraPos), pos));
+    for (const Light& light : scene.lights)
+    {
+        XMVECTOR lightDir = XMVectorSubtract(XMLoadFloat4(&light.pos), pos);
+        float lightDist = XMVectorGetX(XMVector3Length(lightDir));
+        if (lightDist >= light.pos.w)
+            continue;
+        lightDir = XMVectorScale(lightDir, 1.0f / lightDist);
+
+        float atten = _getAttenuation(lightDist, light.pos.w);
+        XMVECTOR norm = transparent && XMVectorGetX(XMVector3Dot(lightDir, objNormal)) < 0.0f ? XMVectorNegate(objNormal) : objNormal;
+        XMVECTOR lightColor = XMLoadFloat4(&light.color);
+        float diffuse = (std::max)(XMVectorGetX(XMVector3Dot(lightDir, norm)), 0.0f);
+        finalColor = XMVectorAdd(finalColor, XMVectorMultiply(XMVectorScale(objColor, diffuse * atten), lightColor));
+
+        XMVECTOR reflectDir = XMVector3Reflect(XMVectorNegate(lightDir), norm);
+        float spec = shine > 0.0f ? powf((std::max)(XMVectorGetX(XMVector3Dot(viewDir, reflectDir)), 0.0f), shine) : 0.0f;
+        finalColor = XMVectorAdd(finalColor, XMVectorMultiply(XMVectorScale(objColor, spec * atten), lightColor));
+    }
+    return finalColor;
+}
+
+// CubeMap_PS.hlsl
+static XMFLOAT4 _skyShader(const void* pConstants, const SoftPixel& pixel)
+{
+    const SoftScene& scene = *static_cast<const SoftScene*>(pConstants);
+    XMFLOAT3 dir(pixel.varyings[0], pixel.varyings[1], pixel.varyings[2]);
+    XMFLOAT3 color = scene.pSky ? scene.pSky->Sample(dir) : SkyRadiance;
+    return XMFLOAT4(color.x, color.y, color.z, 1.0f);
+}
+
+// PS.hlsl with the normal map on and no lightmap
+static XMFLOAT4 _surfaceShader(const void* pConstants, const SoftPixel& pixel)
+{
+    const SoftScene& scene = *static_cast<const SoftScene*>(pConstants);
+    const float* v = pixel.varyings;
+    XMVECTOR worldPos = XMVectorSet(v[0], v[1], v[2], 1.0f);
+    XMVECTOR normal = XMVectorSet(v[5], v[6], v[7], 0.0f);
+    XMVECTOR tangent = XMVectorSet(v[8], v[9], v[10], 0.0f);
+
+    XMFLOAT3 texel = scene.pColor->Sample(v[3], v[4]);
+    XMVECTOR color = XMLoadFloat3(&texel);
+    XMVECTOR binorm = XMVector3Normalize(XMVector3Cross(normal, tangent));
+    XMFLOAT3 local = scene.pNormals->Sample(v[3], v[4]);
+    XMVECTOR norm = XMVectorAdd(XMVectorAdd(XMVectorScale(XMVector3Normalize(tangent), local.x * 2.0f - 1.0f),
+        XMVectorScale(binorm, local.y * 2.0f - 1.0f)), XMVectorScale(XMVector3Normalize(normal), local.z * 2.0f - 1.0f));
+
+    XMVECTOR ambient = XMVectorMultiply(color, _getProbeIrradiance(scene, worldPos, norm, false));
+    XMFLOAT4 result;
+    XMStoreFloat4(&result, XMVectorAdd(ambient, _calculateColor(scene, color, norm, worldPos, CubeShine, false)));
+    result.w = 1.0f;
+    return result;
+}
+
+// Light_PS.hlsl
+static XMFLOAT4 _lightShader(const void* pConstants, const SoftPixel&)
+{
+    return static_cast<const SoftColorConstants*>(pConstants)->color;
+}
+
+// main in Transparent_PS.hlsl: a fixed normal, lit from both sides
+static XMFLOAT4 _transparentShader(const void* pConstants, const SoftPixel& pixel)
+{
+    const SoftColorConstants& constants = *static_cast<const SoftColorConstants*>(pConstants);
+    const SoftScene& scene = *constants.pScene;
+    const XMFLOAT4& objColor = constants.color;
+    XMVECTOR worldPos = XMVectorSet(pixel.varyings[0], pixel.varyings[1], pixel.varyings[2], 1.0f);
+    XMVECTOR normal = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+    XMVECTOR color = XMLoadFloat4(&objColor);
+    XMVECTOR ambient = XMVectorMultiply(color, _getProbeIrradiance(scene, worldPos, normal, true));
+    XMFLOAT4 result;
+    XMStoreFloat4(&result, XMVectorAdd(ambient, _calculateColor(scene, color, normal, worldPos, 0.0f, true)));
+    result.w = objColor.w;
+    return result;
+}
+
+//-----------SoftRenderer-------------
+
+void GetDefaultSoftCamera(float aspect, XMMATRIX& view, XMMATRIX& projection)
+{
+    // Camera's starting orbit
+    const float r = 7.0f, theta = XM_PIDIV4, phi = -XM_PIDIV4;
+    float sinTheta, cosTheta, sinPhi, cosPhi;
+    XMScalarSinCos(&sinTheta, &cosTheta, theta);
+    XMScalarSinCos(&sinPhi, &cosPhi, phi);
+    view = XMMatrixLookAtLH(XMVectorSet(cosTheta * cosPhi * r, sinTheta * r, cosTheta * sinPhi * r, 0.0f),
+        XMVectorZero(), XMVectorSet(-sinTheta * cosPhi, cosTheta, -sinTheta * sinPhi, 0.0f));
+
+    // Reverse-Z with the far plane at infinity, as Camera builds it by default
+    float yScale = 1.0f / tanf(CameraFovY * 0.5f);
+    projection = XMMATRIX(
+        yScale / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, yScale, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, CameraNearZ, 0.0f);
+}
+
+void SoftRenderer::Init(ThreadPool& pool)
+{
+    PROFILE_ZONE("init soft renderer");
+    _pPool = &pool;
+
+    _cube = GenerateCube();
+    // The same sphere as _appendSphere's finest level
+    _sphere = GenerateUVSphere(SoftSphereLatLines - 1, SoftSphereLongLines);
+    OptimizeMesh(_sphere);
+    _trans.vertices.assign(3, MeshVertex());
+    for (int i = 0; i < 3; i++)
+        _trans.vertices[i].pos = XMFLOAT3(TransVertices[i].x, TransVertices[i].y, TransVertices[i].z);
+    _trans.indices = { 0, 1, 2 };
+
+    _color.CreateChecker(SoftTextureSize, SoftCheckerSquares, XMFLOAT3(0.9f, 0.85f, 0.8f), XMFLOAT3(0.35f, 0.3f, 0.3f));
+    _normals.CreateFlat(XMFLOAT3(0.5f, 0.5f, 1.0f));
+    bool skyLoaded = _sky.Load("./skybox.dds", SoftSkySize);
+
+    _scene.lights.assign(StaticLights, StaticLights + StaticLightCount);
+    XMStoreFloat3(&_scene.sunDirection, XMVector3Normalize(XMLoadFloat3(&SunDirection)));
+    _scene.sunColor = XMFLOAT3(SunColor.x, SunColor.y, SunColor.z);
+    _scene.pColor = &_color;
+    _scene.pNormals = &_normals;
+    _scene.pSky = skyLoaded ? &_sky : nullptr;
+
+    // The probes as Renderer::_initProbes bakes them, around the static cube
+    SkyCubemap probeSky;
+    bool probeSkyLoaded = probeSky.Load("./skybox.dds", ProbeSkySize);
+    RayTracer staticScene;
+    staticScene.AddMesh(&_cube.vertices[0].pos, sizeof(MeshVertex), _cube.indices.data(), _cube.indices.size(),
+        XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z));
+    staticScene.Build();
+    ProbeBakeDesc bake = {};
+    bake.pScene = &staticScene;
+    bake.pSky = probeSkyLoaded ? &probeSky : nullptr;
+    bake.skyRadiance = SkyRadiance;
+    bake.lights = _scene.lights;
+    bake.sunDirection = _scene.sunDirection;
+    bake.sunColor = _scene.sunColor;
+    bake.albedo = ProbeAlbedo;
+    bake.gridMin = ProbeGridMin;
+    bake.gridMax = ProbeGridMax;
+    bake.counts = ProbeGridCounts;
+    bake.rays = ProbeRays;
+    BakeProbes(bake, pool, _probes);
+    _scene.pProbes = &_probes;
+}
+
+std::vector<SoftVertex>& SoftRenderer::_transform(uint32_t draw, const MeshVertex* vertices, size_t numVertices, FXMMATRIX world,
+    CXMMATRIX viewProjection, uint32_t numVaryings)
+{
+    if (_drawVertices.size() <= draw)
+        _drawVertices.resize(draw + 1);
+    std::vector<SoftVertex>& out = _drawVertices[draw];
+    out.resize(numVertices);
+    for (size_t i = 0; i < numVertices; i++)
+    {
+        const MeshVertex& v = vertices[i];
+        XMVECTOR worldPos = XMVector3Transform(XMLoadFloat3(&v.pos), world);
+        XMStoreFloat4(&out[i].clip, XMVector4Transform(worldPos, viewProjection));
+        float* varyings = out[i].varyings;
+        if (numVaryings >= PositionVaryings)
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(varyings), worldPos);
+        if (numVaryings == SurfaceVaryings)
+        {
+            varyings[3] = v.uv.x;
+            varyings[4] = v.uv.y;
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(varyings + 5), XMVector3TransformNormal(XMLoadFloat3(&v.normal), world));
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(varyings + 8), XMVector3TransformNormal(XMLoadFloat3(&v.tangent), world));
+        }
+    }
+    return out;
+}
+
+void SoftRenderer::Render(FXMMATRIX view, CXMMATRIX projection, const SimulationFrame& frame)
+{
+    PROFILE_ZONE("soft render");
+    XMMATRIX viewProjection = XMMatrixMultiply(view, projection);
+    XMMATRIX cameraWorld = XMMatrixInverse(nullptr, view);
+    XMStoreFloat3(&_scene.cameraPos, cameraWorld.r[3]);
+    XMFLOAT3 viewDir;
+    XMStoreFloat3(&viewDir, XMVector3Normalize(cameraWorld.r[2]));
+    const XMFLOAT3& cameraPos = _scene.cameraPos;
+
+    _target.Clear(SceneClearColor);
+    uint32_t draw = 0;
+    //-----------SkyBox-------------
+    {
+        XMMATRIX world = XMMatrixScaling(SkyboxRadius, SkyboxRadius, SkyboxRadius) * XMMatrixTranslation(cameraPos.x, cameraPos.y, cameraPos.z);
+        std::vector<SoftVertex>& vertices = _transform(draw++, _sphere.vertices.data(), _sphere.vertices.size(), world, viewProjection, PositionVaryings);
+        // The cube map is looked up with the sphere's own position
+        for (size_t i = 0; i < vertices.size(); i++)
+            memcpy(vertices[i].varyings, &_sphere.vertices[i].pos, sizeof(XMFLOAT3));
+        SoftDrawState state = { SoftDepthTest, SoftBlendOpaque, PositionVaryings, _skyShader, &_scene };
+        _target.Draw(state, vertices.data(), _sphere.indices.data(), (uint32_t)_sphere.indices.size());
+    }
+    //-----------Cubes-------------
+    for (int i = 0; i < 2; i++)
+    {
+        XMMATRIX world = i == 0 ? frame.cubeWorld : XMMatrixTranslation(StaticCubePosition.x, StaticCubePosition.y, StaticCubePosition.z);
+        std::vector<SoftVertex>& vertices = _transform(draw++, _cube.vertices.data(), _cube.vertices.size(), world, viewProjection, SurfaceVaryings);
+        SoftDrawState state = { SoftDepthTestWrite, SoftBlendOpaque, SurfaceVaryings, _surfaceShader, &_scene };
+        _target.Draw(state, vertices.data(), _cube.indices.data(), (uint32_t)_cube.indices.size());
+    }
+    //-----------Lights-------------
+    for (uint32_t i = 0; i < StaticLightCount; i++)
+    {
+        const XMFLOAT4& pos = _scene.lights[i].pos;
+        XMMATRIX world = XMMatrixScaling(LightRadius, LightRadius, LightRadius) * XMMatrixTranslation(pos.x, pos.y, pos.z);
+        std::vector<SoftVertex>& vertices = _transform(draw++, _sphere.vertices.data(), _sphere.vertices.size(), world, viewProjection, 0);
+        _drawColors[i] = { &_scene, _scene.lights[i].color };
+        SoftDrawState state = { SoftDepthTestWrite, SoftBlendOpaque, 0, _lightShader, &_drawColors[i] };
+        _target.Draw(state, vertices.data(), _sphere.indices.data(), (uint32_t)_sphere.indices.size());
+    }
+    //-----------Transparent (sorted)-------------
+    {
+        _sorter.Resize(2);
+        for (int i = 0; i < 2; i++)
+        {
+            XMVECTOR center = XMVectorZero();
+            for (int j = 0; j < 3; j++)
+                center = XMVectorAdd(center, XMVector3TransformCoord(XMLoadFloat4(&TransVertices[j]), frame.transWorld[i]));
+            XMFLOAT3 position;
+            XMStoreFloat3(&position, XMVectorScale(center, 1.0f / 3.0f));
+            _sorter.SetPosition(i, position);
+        }
+        for (uint32_t i : _sorter.Sort(cameraPos, viewDir))
+        {
+            std::vector<SoftVertex>& vertices = _transform(draw++, _trans.vertices.data(), _trans.vertices.size(), frame.transWorld[i], viewProjection, PositionVaryings);
+            _drawColors[StaticLightCount + i] = { &_scene, TransColors[i] };
+            SoftDrawState state = { SoftDepthTest, SoftBlendAlpha, PositionVaryings, _transparentShader, &_drawColors[StaticLightCount + i] };
+            _target.Draw(state, vertices.data(), _trans.indices.data(), (uint32_t)_trans.indices.size());
+        }
+    }
+
+    _target.Flush(_pPool);
+}
+
+bool SoftRenderScene(const char* output, uint32_t width, uint32_t height, uint32_t frames)
+{
+    if (width == 0 || height == 0)
+    {
+        BenchPrint("softrender: bad size %ux%u\n", width, height);
+        return false;
+    }
+
+    ThreadPool pool;
+    pool.Init();
+    SoftRenderer renderer;
+    renderer.Init(pool);
+    renderer.Resize(width, height);
+
+    XMMATRIX view, projection;
+    GetDefaultSoftCamera(width / (float)height, view, projection);
+
+    // One simulation tick per frame, so the frames don't depend on how long they take
+    SimulationState previous, current;
+    ResetSimulation(current);
+    std::vector<double> frameMs;
+    for (uint32_t i = 0; i < (std::max)(frames, 1u); i++)
+    {
+        previous = current;
+        StepSimulation(current, 1.0f / DefaultSimulationRate);
+        SimulationFrame frame;
+        InterpolateSimulation(previous, current, 1.0f, frame);
+        int64_t start = ClockNow();
+        renderer.Render(view, projection, frame);
+        frameMs.push_back(ClockMilliseconds(ClockNow() - start));
+    }
+
+    FrameTimingSummary summary = SummarizeFrameTimes(frameMs);
+    const SoftRasterStats& stats = renderer.GetTarget().GetStats();
+    BenchPrint("softrender: %ux%u on %u threads, %zu frames: mean %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms; "
+        "%u triangles, %llu pixels shaded\n",
+        width, height, pool.GetNumThreads(), summary.frames, summary.meanMs, summary.p50Ms, summary.p95Ms, summary.maxMs,
+        stats.triangles, (unsigned long long)stats.shadedPixels);
+
+    if (!renderer.GetTarget().WritePpm(output))
+    {
+        BenchPrint("softrender: can't write '%s'\n", output);
+        return false;
+    }
+    return true;
+}
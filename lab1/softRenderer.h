@@ -0,0 +1,104 @@
+#pragma once
+#include "softRaster.h"
+#include "irradianceProbes.h"
+#include "meshgen.h"
+#include "sceneLayout.h"
+#include "simulation.h"
+#include "skyCubemap.h"
+#include "threadPool.h"
+#include "transparencySorter.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// The renderer's main passes on the CPU, for machines without a GPU and for checking the
+// GPU against: skybox, the two normal-mapped cubes, the light gizmos and the sorted
+// transparent triangles, with the states and shaders of Renderer::Render ported to C++.
+// Left out: the loaded model, shadows, lightmaps and the -lights extras; the lights aren't
+// clustered, every pixel loops over the scene lights, which gives the same color.
+static const uint32_t SoftSkySize = 512;            // largest skybox.dds mip level kept
+static const uint32_t SoftSphereLatLines = 20;      // the finest of SphereLodLevels
+static const uint32_t SoftSphereLongLines = 20;
+// Only cube maps have a CPU loader; a checker and a flat normal map stand in for kisa.dds
+// and 242_norm.dds
+static const uint32_t SoftTextureSize = 256;
+static const uint32_t SoftCheckerSquares = 8;
+
+// RGB texture sampled bilinear with clamped addressing, like _pSampler without the mips
+class SoftTexture
+{
+public:
+    void Create(uint32_t width, uint32_t height, const std::vector<XMFLOAT3>& texels);
+    void CreateChecker(uint32_t size, uint32_t squares, const XMFLOAT3& a, const XMFLOAT3& b);
+    void CreateFlat(const XMFLOAT3& color);
+
+    XMFLOAT3 Sample(float u, float v) const;
+
+private:
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    std::vector<XMFLOAT3> _texels;
+};
+
+// What the pixel shaders read: Scene.hlsli's SceneMatrixBuffer and the resources
+struct SoftScene
+{
+    XMFLOAT3 cameraPos;
+    XMFLOAT3 sunDirection;      // direction the sunlight travels in
+    XMFLOAT3 sunColor;
+    std::vector<Light> lights;
+    const SoftTexture* pColor;
+    const SoftTexture* pNormals;
+    const SkyCubemap* pSky;     // nullptr draws SkyRadiance
+    const std::vector<ProbeSH>* pProbes;    // ProbeGridCounts of them, nullptr for no ambient
+};
+
+// Constants of the light and transparent draws, the color of ColoredObjMatrixBuffer
+struct SoftColorConstants
+{
+    const SoftScene* pScene;
+    XMFLOAT4 color;
+};
+
+class SoftRenderer
+{
+public:
+    // Loads skybox.dds if it can and bakes the probes like Renderer::_initProbes
+    void Init(ThreadPool& pool);
+    void Resize(uint32_t width, uint32_t height) { _target.Resize(width, height); }
+
+    void Render(FXMMATRIX view, CXMMATRIX projection, const SimulationFrame& frame);
+    const SoftRasterizer& GetTarget() const { return _target; }
+
+private:
+    ThreadPool* _pPool = nullptr;
+    SoftRasterizer _target;
+    SoftScene _scene = {};
+    SoftTexture _color;
+    SoftTexture _normals;
+    SkyCubemap _sky;
+    std::vector<ProbeSH> _probes;
+    TransparencySorter _sorter;
+
+    Mesh _cube;
+    Mesh _sphere;
+    Mesh _trans;
+
+    // Per frame: the vertex stage output of every draw and the constants of the colored
+    // ones, alive until the flush
+    std::vector<std::vector<SoftVertex>> _drawVertices;
+    SoftColorConstants _drawColors[StaticLightCount + 2];
+
+    std::vector<SoftVertex>& _transform(uint32_t draw, const MeshVertex* vertices, size_t numVertices, FXMMATRIX world,
+        CXMMATRIX viewProjection, uint32_t numVaryings);
+};
+
+// Camera's starting orbit with the renderer's default projection
+void GetDefaultSoftCamera(float aspect, XMMATRIX& view, XMMATRIX& projection);
+
+// The -softrender mode: frames of the scene's animation from the default camera at the
+// given size. Frame times go through BenchPrint, the last frame to output as a PPM.
+static const uint32_t SoftRenderFrames = 60;
+bool SoftRenderScene(const char* output, uint32_t width, uint32_t height, uint32_t frames);
@@ -0,0 +1,108 @@
+#include "threadPool.h"
+#include "profiler.h"
+
+void ThreadPool::Init(uint32_t numWorkers)
+{
+    Cleanup();
+
+    if (numWorkers == 0)
+    {
+        uint32_t hardware = std::thread::hardware_concurrency();
+        numWorkers = hardware > 1 ? hardware - 1 : 0;
+    }
+
+    _quit = false;
+    for (uint32_t i = 0; i < numWorkers; i++)
+        _workers.emplace_back(&ThreadPool::_workerMain, this);
+}
+
+void ThreadPool::Cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (std::thread& worker : _workers)
+        worker.join();
+    _workers.clear();
+}
+
+void ThreadPool::_runChunks(const std::function<void(uint32_t, uint32_t)>& job, uint32_t count, uint32_t grain)
+{
+    for (;;)
+    {
+        uint32_t begin = _next.fetch_add(grain);
+        if (begin >= count)
+            break;
+        PROFILE_ZONE("task");
+        job(begin, begin + grain < count ? begin + grain : count);
+    }
+}
+
+void ThreadPool::_workerMain()
+{
+    ProfilerSetThreadName("worker");
+    uint64_t seen = 0;
+    for (;;)
+    {
+        const std::function<void(uint32_t, uint32_t)>* pJob;
+        uint32_t count, grain;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _quit || _generation != seen; });
+            if (_quit)
+                return;
+            seen = _generation;
+            if (!_pJob)
+                continue; // that loop already finished without us
+            pJob = _pJob;
+            count = _count;
+            grain = _grain;
+            _busy++;
+        }
+
+        {
+            PROFILE_ZONE("worker");
+            _runChunks(*pJob, count, grain);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _busy--;
+        }
+        _done.notify_one();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& job)
+{
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    // Not worth waking anybody for a single chunk
+    if (_workers.empty() || count <= grain)
+    {
+        job(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pJob = &job;
+        _count = count;
+        _grain = grain;
+        _next = 0;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    _runChunks(job, count, grain);
+
+    // Workers that woke up late find the counter exhausted and leave right away
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [&] { return _busy == 0 && _next >= _count; });
+    _pJob = nullptr;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// Fixed set of worker threads for data-parallel loops. ParallelFor splits [0, count)
+// into chunks of `grain` items that the workers and the calling thread pull from a
+// shared counter; it returns once every chunk has run.
+class ThreadPool
+{
+public:
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() { Cleanup(); }
+
+    // 0 picks one worker per hardware thread, minus the caller
+    void Init(uint32_t numWorkers = 0);
+    void Cleanup();
+
+    uint32_t GetNumThreads() const { return (uint32_t)_workers.size() + 1; }
+
+    void ParallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t begin, uint32_t end)>& job);
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+
+    const std::function<void(uint32_t, uint32_t)>* _pJob = nullptr;
+    uint32_t _count = 0;
+    uint32_t _grain = 1;
+    std::atomic<uint32_t> _next{ 0 };
+    uint32_t _busy = 0;
+    uint64_t _generation = 0;
+    bool _quit = false;
+
+    void _workerMain();
+    void _runChunks(const std::function<void(uint32_t, uint32_t)>& job, uint32_t count, uint32_t grain);
+};
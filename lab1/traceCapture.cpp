@@ -0,0 +1,178 @@
+#include "traceCapture.h"
+#include "hiResClock.h"
+#include <algorithm>
+#include <cstdio>
+
+static const uint32_t CpuProcess = 1;
+static const uint32_t GpuProcess = 2;
+
+// Empty zones timed through their collection. The profiler was off, so the statistics they
+// leave behind replace none worth keeping.
+static double _calibrateZoneCostNs()
+{
+    int64_t start = ClockNow();
+    for (uint32_t i = 0; i < TraceCalibrationZones; i++)
+    {
+        PROFILE_ZONE("trace calibration");
+    }
+    ProfilerEndFrame();
+    int64_t ticks = ClockNow() - start;
+    ProfilerResetStats();
+    return ClockSeconds(ticks) * 1e9 / TraceCalibrationZones;
+}
+
+void TraceCapture::Start(uint32_t frames, uint32_t drainFrames, const char* path)
+{
+    _active = frames > 0;
+    _written = false;
+    _frames = frames;
+    _drainFrames = drainFrames;
+    _framesRecorded = 0;
+    _framesDrained = 0;
+    _path = path;
+
+    _events.clear();
+    _events.reserve(TraceMaxEvents);
+    _gpuEvents.clear();
+    _gpuEvents.reserve(TraceMaxGpuRanges);
+    _dropped = 0;
+    _zones = 0;
+    _overheadTicks = 0;
+
+    _profilerWasEnabled = ProfilerIsEnabled();
+    ProfilerSetEnabled(true);
+    _zoneCostNs = _profilerWasEnabled ? 0.0 : _calibrateZoneCostNs();
+    _firstFrame = _lastFrame = ClockNow();
+}
+
+void TraceCapture::AddFrame(const std::vector<ProfileEvent>& events)
+{
+    if (!IsRecording())
+        return;
+    // The first frame also holds whatever ran before the capture began
+    size_t room = TraceMaxEvents - _events.size();
+    size_t count = (std::min)(room, events.size());
+    _events.insert(_events.end(), events.begin(), events.begin() + count);
+    _dropped += events.size() - count;
+    _zones += events.size();
+
+    _lastFrame = ClockNow();
+    _framesRecorded++;
+}
+
+void TraceCapture::AddOverhead(int64_t ticks)
+{
+    // EndFrame counts the drain frames, starting after the last recorded one
+    if (_active && _framesDrained == 0)
+    {
+        _overheadTicks += ticks;
+        _lastFrame = ClockNow();
+    }
+}
+
+void TraceCapture::AddGpuRange(const char* name, uint32_t depth, int64_t start, int64_t end)
+{
+    if (!_active)
+        return;
+    if (_gpuEvents.size() == TraceMaxGpuRanges)
+    {
+        _dropped++;
+        return;
+    }
+    GpuEvent event = { name, depth, start, end };
+    _gpuEvents.push_back(event);
+}
+
+bool TraceCapture::EndFrame()
+{
+    if (!_active || IsRecording())
+        return false;
+    if (_framesDrained++ < _drainFrames)
+        return false;
+
+    _active = false;
+    ProfilerSetEnabled(_profilerWasEnabled);
+    _written = _write();
+    // The memory goes back too, the next capture reserves it again
+    std::vector<ProfileEvent>().swap(_events);
+    std::vector<GpuEvent>().swap(_gpuEvents);
+    return true;
+}
+
+double TraceCapture::GetOverheadPercent() const
+{
+    int64_t duration = _lastFrame - _firstFrame;
+    if (duration <= 0)
+        return 0.0;
+    double zoneSeconds = _zones * _zoneCostNs * 1e-9;
+    return 100.0 * (ClockSeconds(_overheadTicks) + zoneSeconds) / ClockSeconds(duration);
+}
+
+// Zone names are literals from the code, this only guards the JSON
+static void _writeName(FILE* pFile, const char* name)
+{
+    fputc('"', pFile);
+    for (const char* c = name; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', pFile);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, pFile);
+    }
+    fputc('"', pFile);
+}
+
+bool TraceCapture::_write() const
+{
+    FILE* pFile = nullptr;
+#ifdef _WIN32
+    fopen_s(&pFile, _path.c_str(), "w");
+#else
+    pFile = fopen(_path.c_str(), "w");
+#endif
+    if (!pFile)
+        return false;
+
+    // Timestamps in microseconds from the earliest event
+    int64_t base = _firstFrame;
+    for (const ProfileEvent& event : _events)
+        base = (std::min)(base, event.start);
+    for (const GpuEvent& event : _gpuEvents)
+        base = (std::min)(base, event.start);
+    auto us = [](int64_t ticks) { return ClockMilliseconds(ticks) * 1000.0; };
+
+    std::vector<ProfileThread> threads;
+    ProfilerGetThreads(threads);
+
+    fprintf(pFile, "{\"traceEvents\":[\n");
+    fprintf(pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"CPU\"}},\n", CpuProcess);
+    fprintf(pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"GPU\"}},\n", GpuProcess);
+    fprintf(pFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"queue\"}}", GpuProcess);
+    for (const ProfileThread& thread : threads)
+    {
+        fprintf(pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", CpuProcess, thread.id);
+        _writeName(pFile, thread.name ? thread.name : "thread");
+        fprintf(pFile, "}}");
+    }
+
+    for (const ProfileEvent& event : _events)
+    {
+        uint32_t tid = event.thread < threads.size() ? threads[event.thread].id : event.thread;
+        fprintf(pFile, ",\n{\"name\":");
+        _writeName(pFile, event.name);
+        fprintf(pFile, ",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+            us(event.start - base), us(event.end - event.start), CpuProcess, tid);
+    }
+    for (const GpuEvent& event : _gpuEvents)
+    {
+        fprintf(pFile, ",\n{\"name\":");
+        _writeName(pFile, event.name);
+        fprintf(pFile, ",\"cat\":\"gpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":0,\"args\":{\"depth\":%u}}",
+            us(event.start - base), us(event.end - event.start), GpuProcess, event.depth);
+    }
+
+    fprintf(pFile, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"frames\":%u,\"cpu_zones\":%zu,\"gpu_ranges\":%zu,"
+        "\"dropped\":%zu,\"zone_cost_ns\":%.1f,\"capture_overhead_percent\":%.4f}}\n",
+        _framesRecorded, _events.size(), _gpuEvents.size(), _dropped, _zoneCostNs, GetOverheadPercent());
+    return fclose(pFile) == 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "profiler.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Captures the profiler zones of a number of frames, and GPU ranges where the renderer has
+// them, into a Chrome Trace Event JSON file that chrome://tracing and ui.perfetto.dev open.
+// CPU zones sit on their threads under one process, GPU ranges on a track of a second one.
+// The buffers are reserved when the capture starts and never grow: zones past
+// TraceMaxEvents are counted and dropped. The file is only written once the capture is over.
+static const size_t TraceMaxEvents = 1 << 18;       // 8 MB of zones
+static const size_t TraceMaxGpuRanges = 1 << 14;
+// Empty zones Start times to find what a zone costs on this machine with the profiler on
+// (begin, end and collection); fewer than a profiler ring holds. Zones are only charged to
+// the capture when it was the one to turn the profiler on.
+static const uint32_t TraceCalibrationZones = 4096;
+// The report warns above this, the trace then shows the frames noticeably slower
+static const double TraceOverheadWarnPercent = 1.0;
+
+class TraceCapture
+{
+public:
+    // Records the next frames frames, then waits drainFrames more for their GPU ranges.
+    // Turns the profiler on for the duration.
+    void Start(uint32_t frames, uint32_t drainFrames, const char* path);
+    bool IsActive() const { return _active; }
+    // Frames still being recorded, as opposed to waiting for the GPU
+    bool IsRecording() const { return _active && _framesRecorded < _frames; }
+
+    // Once per frame after ProfilerEndFrame
+    void AddFrame(const std::vector<ProfileEvent>& events);
+    // start and end in ClockNow ticks
+    void AddGpuRange(const char* name, uint32_t depth, int64_t start, int64_t end);
+    // Time the capture itself spent this frame, copying zones and issuing and reading the
+    // timestamp queries; the zones' own cost is added from their count. Only recorded
+    // frames count, like their time; call before EndFrame.
+    void AddOverhead(int64_t ticks);
+
+    // Writes the file when the last frame is in; true when the capture finished this frame
+    bool EndFrame();
+    const std::string& GetPath() const { return _path; }
+    // All of the above against the time from Start, which comes between frames, to the end
+    // of the last recorded frame
+    double GetOverheadPercent() const;
+    bool IsOverheadHigh() const { return GetOverheadPercent() > TraceOverheadWarnPercent; }
+    bool Succeeded() const { return _written; }
+
+private:
+    struct GpuEvent
+    {
+        const char* name;
+        uint32_t depth;
+        int64_t start;
+        int64_t end;
+    };
+
+    bool _active = false;
+    bool _written = false;
+    bool _profilerWasEnabled = false;
+    uint32_t _frames = 0;
+    uint32_t _drainFrames = 0;
+    uint32_t _framesRecorded = 0;
+    uint32_t _framesDrained = 0;
+    std::string _path;
+
+    std::vector<ProfileEvent> _events;
+    std::vector<GpuEvent> _gpuEvents;
+    size_t _dropped = 0;
+    size_t _zones = 0;          // recorded, including the dropped ones
+    double _zoneCostNs = 0.0;   // calibrated by Start, 0 when the zones aren't charged
+    int64_t _firstFrame = 0;
+    int64_t _lastFrame = 0;
+    int64_t _overheadTicks = 0;
+
+    bool _write() const;
+};
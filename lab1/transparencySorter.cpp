@@ -0,0 +1,282 @@
+#include "transparencySorter.h"
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+// Insertion sort gives up after this many element moves per object
+static const uint64_t MaxMovesPerObject = 2;
+// Every this many neighbour pairs is checked for order before the insertion sort starts
+static const size_t InversionSampleStride = 16;
+static const uint32_t RadixBits = 11;
+static const uint32_t RadixBuckets = 1 << RadixBits;
+static const uint32_t RadixMask = RadixBuckets - 1;
+static const uint32_t RadixBlockSize = 16384;
+// The insertion sort looks at the clock after this many objects
+static const size_t InsertionClockInterval = 256;
+// Share of the budget the sort works in
+static const double BudgetWorkShare = 0.9;
+
+void TransparencySorter::Resize(size_t count)
+{
+    // Padded so the depth loop can always read whole vectors
+    size_t padded = (count + 3) & ~(size_t)3;
+    _x.resize(padded, 0.0f);
+    _y.resize(padded, 0.0f);
+    _z.resize(padded, 0.0f);
+    _depth.resize(padded, 0.0f);
+
+    if (count != _count)
+    {
+        // A radix sort under way sorts the old objects
+        _radixPending = false;
+        _order.resize(count);
+        for (size_t i = 0; i < count; i++)
+            _order[i] = (uint32_t)i;
+    }
+    _count = count;
+}
+
+void TransparencySorter::SetPosition(size_t i, const XMFLOAT3& position)
+{
+    _x[i] = position.x;
+    _y[i] = position.y;
+    _z[i] = position.z;
+}
+
+void TransparencySorter::_computeDepths(const XMFLOAT3& cameraPos, const XMFLOAT3& viewDir, ThreadPool* pPool)
+{
+    // depth = dot(p - camera, dir) = dot(p, dir) - dot(camera, dir)
+    float offset = cameraPos.x * viewDir.x + cameraPos.y * viewDir.y + cameraPos.z * viewDir.z;
+    auto job = [&](uint32_t begin, uint32_t end)
+    {
+        __m128 dx = _mm_set1_ps(viewDir.x);
+        __m128 dy = _mm_set1_ps(viewDir.y);
+        __m128 dz = _mm_set1_ps(viewDir.z);
+        __m128 d0 = _mm_set1_ps(offset);
+        for (uint32_t i = begin * 4; i < end * 4; i += 4)
+        {
+            __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&_x[i]), dx), _mm_mul_ps(_mm_loadu_ps(&_y[i]), dy));
+            depth = _mm_sub_ps(_mm_add_ps(depth, _mm_mul_ps(_mm_loadu_ps(&_z[i]), dz)), d0);
+            _mm_storeu_ps(&_depth[i], depth);
+        }
+    };
+
+    uint32_t numVectors = (uint32_t)(_depth.size() / 4);
+    if (pPool && numVectors > RadixBlockSize / 4)
+        pPool->ParallelFor(numVectors, RadixBlockSize / 4, job);
+    else
+        job(0, numVectors);
+}
+
+// Float bits to an unsigned key with the same order; inverted for a descending sort
+static uint32_t _descendingKey(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t key = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+    return ~key;
+}
+
+void TransparencySorter::_gatherKeys(ThreadPool* pPool)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        _keys[i].resize(_count);
+        _values[i].resize(_count);
+    }
+
+    // Keys in last frame's order, so both sorts walk contiguous memory and ties keep their order
+    uint32_t* keys = _keys[0].data();
+    uint32_t* values = _values[0].data();
+    const uint32_t* order = _order.data();
+    const float* depth = _depth.data();
+    auto job = [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            values[i] = order[i];
+            keys[i] = _descendingKey(depth[order[i]]);
+        }
+    };
+    if (pPool && _count > RadixBlockSize)
+        pPool->ParallelFor((uint32_t)_count, RadixBlockSize, job);
+    else
+        job(0, (uint32_t)_count);
+}
+
+bool TransparencySorter::_looksCoherent() const
+{
+    // Each pair out of order costs the insertion sort at least one move, so when the sampled
+    // pairs extrapolate past the budget it would give up anyway, after most of its work
+    uint64_t budget = _count * MaxMovesPerObject + 16;
+    uint64_t inversions = 0;
+    const uint32_t* keys = _keys[0].data();
+    for (size_t i = 1; i < _count; i += InversionSampleStride)
+        inversions += keys[i - 1] > keys[i];
+    return inversions * InversionSampleStride <= budget;
+}
+
+bool TransparencySorter::_insertionSort(int64_t deadline)
+{
+    uint64_t budget = _count * MaxMovesPerObject + 16;
+    uint64_t moves = 0;
+    uint32_t* keys = _keys[0].data();
+    uint32_t* values = _values[0].data();
+    for (size_t i = 1; i < _count; i++)
+    {
+        if (i % InsertionClockInterval == 0 && ClockNow() > deadline)
+            return false;
+
+        uint32_t key = keys[i];
+        if (keys[i - 1] <= key)
+            continue;
+
+        uint32_t value = values[i];
+        size_t j = i;
+        for (; j > 0 && keys[j - 1] > key; j--)
+        {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+        }
+        keys[j] = key;
+        values[j] = value;
+
+        moves += i - j;
+        if (moves > budget)
+            return false;
+    }
+    _order.swap(_values[0]);
+    return true;
+}
+
+// One phase of the stable LSD radix sort: the block histograms of a digit with an exclusive
+// scan over (digit, block), or the scatter, where every block moves its items behind those
+// of the earlier blocks. The last phase hands the order over.
+void TransparencySorter::_radixStep(ThreadPool* pPool)
+{
+    uint32_t count = (uint32_t)_count;
+    uint32_t numBlocks = (count + RadixBlockSize - 1) / RadixBlockSize;
+    _histograms.resize((size_t)numBlocks * RadixBuckets);
+
+    auto parallelFor = [&](const std::function<void(uint32_t, uint32_t)>& job)
+    {
+        if (pPool && numBlocks > 1)
+            pPool->ParallelFor(numBlocks, 1, job);
+        else
+            job(0, numBlocks);
+    };
+
+    uint32_t shift = _radixShift;
+    const uint32_t* keys = _keys[_radixSource].data();
+    const uint32_t* values = _values[_radixSource].data();
+    uint32_t* outKeys = _keys[_radixSource ^ 1].data();
+    uint32_t* outValues = _values[_radixSource ^ 1].data();
+    uint32_t* histograms = _histograms.data();
+
+    if (!_radixScatter)
+    {
+        parallelFor([&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t block = begin; block < end; block++)
+            {
+                uint32_t* histogram = histograms + (size_t)block * RadixBuckets;
+                memset(histogram, 0, RadixBuckets * sizeof(uint32_t));
+                uint32_t last = (std::min)((block + 1) * RadixBlockSize, count);
+                for (uint32_t i = block * RadixBlockSize; i < last; i++)
+                    histogram[(keys[i] >> shift) & RadixMask]++;
+            }
+        });
+
+        // All keys sharing this digit: nothing to move
+        bool trivial = false;
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < RadixBuckets; digit++)
+        {
+            uint32_t digitCount = 0;
+            for (uint32_t block = 0; block < numBlocks; block++)
+            {
+                uint32_t& slot = histograms[(size_t)block * RadixBuckets + digit];
+                uint32_t blockCount = slot;
+                slot = sum;
+                sum += blockCount;
+                digitCount += blockCount;
+            }
+            trivial |= digitCount == count;
+        }
+        _radixScatter = !trivial;
+    }
+    else
+    {
+        parallelFor([&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t block = begin; block < end; block++)
+            {
+                uint32_t* offsets = histograms + (size_t)block * RadixBuckets;
+                uint32_t last = (std::min)((block + 1) * RadixBlockSize, count);
+                for (uint32_t i = block * RadixBlockSize; i < last; i++)
+                {
+                    uint32_t key = keys[i];
+                    uint32_t position = offsets[(key >> shift) & RadixMask]++;
+                    outKeys[position] = key;
+                    outValues[position] = values[i];
+                }
+            }
+        });
+        _radixSource ^= 1;
+        _radixScatter = false;
+    }
+
+    if (_radixScatter)
+        return;
+    _radixShift += RadixBits;
+    if (_radixShift >= 32)
+    {
+        _order.swap(_values[_radixSource]);
+        _radixPending = false;
+    }
+}
+
+const std::vector<uint32_t>& TransparencySorter::Sort(const XMFLOAT3& cameraPos, const XMFLOAT3& viewDir, ThreadPool* pPool)
+{
+    int64_t start = ClockNow();
+    // Work stops a little short of the budget, for the clock checks' granularity and the
+    // phase time estimates being off
+    int64_t deadline = start + (int64_t)(_budgetMs * BudgetWorkShare * 1e-3 * ClockFrequency());
+
+    // A radix sort left from earlier frames goes on with the keys it started from
+    bool continuing = _radixPending;
+    if (!continuing)
+    {
+        _computeDepths(cameraPos, viewDir, pPool);
+        _gatherKeys(pPool);
+
+        // An aborted insertion sort leaves a permutation of the keys behind, which the radix sort accepts
+        if (_looksCoherent() && _insertionSort(deadline))
+        {
+            _lastMethod = Insertion;
+            return _order;
+        }
+        _radixPending = true;
+        _radixShift = 0;
+        _radixScatter = false;
+        _radixSource = 0;
+    }
+
+    // Phases while the next one is expected to fit; a frame that only continues the sort
+    // runs at least one, so it always finishes
+    bool ran = false;
+    while (_radixPending)
+    {
+        // The low digits scatter all over the buckets and the high ones mostly in order, so
+        // every phase is timed on its own
+        double& phaseMs = _radixPhaseMs[_radixShift / RadixBits][_radixScatter];
+        int64_t now = ClockNow();
+        if ((ran || !continuing) && now + (int64_t)(phaseMs * 1e-3 * ClockFrequency()) > deadline)
+            break;
+        _radixStep(pPool);
+        phaseMs = ClockMilliseconds(ClockNow() - now);
+        ran = true;
+    }
+    _lastMethod = _radixPending ? Deferred : Radix;
+    return _order;
+}
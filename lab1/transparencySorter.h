@@ -0,0 +1,73 @@
+#pragma once
+#include "threadPool.h"
+#include "hiResClock.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// CPU time one Sort may take, unless SetBudget changes it
+static const double TransparencySortBudgetMs = 2.0;
+
+// Back-to-front order of transparent objects that is kept between frames. View depths
+// come from SoA positions four at a time; last frame's order is then repaired with an
+// insertion sort, which is close to linear while the camera moves a little. When that
+// would take too many moves, as a sample of the pairs out of order predicts or the sort
+// finds out, or runs out of time, the order is rebuilt with a parallel LSD radix sort.
+// The radix sort runs pass by pass within the budget and carries on over the next frames
+// when it doesn't fit; meanwhile Sort keeps returning the last finished order.
+class TransparencySorter
+{
+public:
+    enum Method
+    {
+        None,
+        Insertion,
+        Radix,
+        Deferred        // a radix sort is still under way, the order is an earlier frame's
+    };
+
+    void Resize(size_t count);
+    size_t Size() const { return _count; }
+    void SetPosition(size_t i, const XMFLOAT3& position);
+    void SetBudget(double ms) { _budgetMs = ms; }
+
+    // Farthest first along viewDir (normalized), as of the frame the sort started in
+    const std::vector<uint32_t>& Sort(const XMFLOAT3& cameraPos, const XMFLOAT3& viewDir, ThreadPool* pPool = nullptr);
+
+    const std::vector<uint32_t>& GetOrder() const { return _order; }
+    // Depth the last Insertion or Radix order was sorted by; a Deferred frame doesn't
+    // compute new ones
+    float GetDepth(uint32_t i) const { return _depth[i]; }
+    Method GetLastMethod() const { return _lastMethod; }
+
+private:
+    size_t _count = 0;
+    std::vector<float> _x;
+    std::vector<float> _y;
+    std::vector<float> _z;
+    std::vector<float> _depth;
+    std::vector<uint32_t> _order;
+    Method _lastMethod = None;
+    double _budgetMs = TransparencySortBudgetMs;
+
+    // Keys and object indices in sort order; the radix sort ping-pongs between the pairs
+    std::vector<uint32_t> _keys[2];
+    std::vector<uint32_t> _values[2];
+    std::vector<uint32_t> _histograms;
+
+    // Radix sort under way: the digit and phase to run next, where its keys are, and how long
+    // each phase took last time to tell whether it still fits
+    bool _radixPending = false;
+    uint32_t _radixShift = 0;
+    bool _radixScatter = false;
+    int _radixSource = 0;
+    double _radixPhaseMs[3][2] = {};  // last time of each digit's histogram and scatter phases
+
+    void _computeDepths(const XMFLOAT3& cameraPos, const XMFLOAT3& viewDir, ThreadPool* pPool);
+    void _gatherKeys(ThreadPool* pPool);
+    bool _looksCoherent() const;
+    bool _insertionSort(int64_t deadline);
+    void _radixStep(ThreadPool* pPool);
+};
@@ -0,0 +1,95 @@
+#include "vertexFormat.h"
+#include <cfloat>
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the input layout");
+
+PositionQuantization ComputePositionQuantization(const MeshVertex* vertices, size_t count)
+{
+    XMVECTOR vMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR vMax = XMVectorReplicate(-FLT_MAX);
+    for (size_t i = 0; i < count; i++)
+    {
+        XMVECTOR p = XMLoadFloat3(&vertices[i].pos);
+        vMin = XMVectorMin(vMin, p);
+        vMax = XMVectorMax(vMax, p);
+    }
+
+    // Flat axes still need a non-zero scale to invert
+    XMVECTOR halfExtent = XMVectorMax(XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f), XMVectorReplicate(1e-6f));
+
+    PositionQuantization quantization;
+    XMStoreFloat4(&quantization.scale, XMVectorSetW(halfExtent, 0.0f));
+    XMStoreFloat4(&quantization.bias, XMVectorSetW(XMVectorScale(XMVectorAdd(vMax, vMin), 0.5f), 1.0f));
+    return quantization;
+}
+
+XMFLOAT2 OctEncode(const XMFLOAT3& direction)
+{
+    // Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+    XMVECTOR n = XMLoadFloat3(&direction);
+    XMVECTOR l1 = XMVector3Dot(XMVectorAbs(n), XMVectorSplatOne());
+    n = XMVectorDivide(n, l1);
+
+    XMFLOAT3 p;
+    XMStoreFloat3(&p, n);
+    if (p.z < 0.0f)
+    {
+        float x = (1.0f - fabsf(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - fabsf(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+        return XMFLOAT2(x, y);
+    }
+    return XMFLOAT2(p.x, p.y);
+}
+
+XMFLOAT3 OctDecode(const XMFLOAT2& encoded)
+{
+    XMFLOAT3 n(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+    float t = n.z < 0.0f ? -n.z : 0.0f;
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+
+    XMFLOAT3 result;
+    XMStoreFloat3(&result, XMVector3Normalize(XMLoadFloat3(&n)));
+    return result;
+}
+
+void PackVertices(const MeshVertex* vertices, size_t count, const PositionQuantization& quantization, PackedVertex* packed)
+{
+    XMVECTOR invScale = XMVectorReciprocal(XMVectorSetW(XMLoadFloat4(&quantization.scale), 1.0f));
+    XMVECTOR bias = XMVectorSetW(XMLoadFloat4(&quantization.bias), 0.0f);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const MeshVertex& v = vertices[i];
+        PackedVertex& out = packed[i];
+
+        XMStoreShortN4(&out.pos, XMVectorSetW(XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&v.pos), bias), invScale), 0.0f));
+        XMStoreHalf2(&out.uv, XMLoadFloat2(&v.uv));
+
+        XMFLOAT2 normal = OctEncode(v.normal);
+        XMFLOAT2 tangent = OctEncode(v.tangent);
+        XMStoreShortN2(&out.normal, XMLoadFloat2(&normal));
+        XMStoreShortN2(&out.tangent, XMLoadFloat2(&tangent));
+    }
+}
+
+void UnpackVertices(const PackedVertex* packed, size_t count, const PositionQuantization& quantization, MeshVertex* vertices)
+{
+    XMVECTOR scale = XMLoadFloat4(&quantization.scale);
+    XMVECTOR bias = XMLoadFloat4(&quantization.bias);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const PackedVertex& in = packed[i];
+        MeshVertex& v = vertices[i];
+
+        XMStoreFloat3(&v.pos, XMVectorMultiplyAdd(XMLoadShortN4(&in.pos), scale, bias));
+        XMStoreFloat2(&v.uv, XMLoadHalf2(&in.uv));
+
+        XMFLOAT2 normal, tangent;
+        XMStoreFloat2(&normal, XMLoadShortN2(&in.normal));
+        XMStoreFloat2(&tangent, XMLoadShortN2(&in.tangent));
+        v.normal = OctDecode(normal);
+        v.tangent = OctDecode(tangent);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include "meshgen.h"
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// 20-byte vertex: positions as SNORM16 inside the mesh bounds, half-float uv, and octahedral
+// SNORM16 normal and tangent. Compared with the 44-byte TexVertex it roughly halves vertex
+// memory and fetch bandwidth.
+struct PackedVertex
+{
+    XMSHORTN4 pos;      // w is unused padding
+    XMHALF2 uv;
+    XMSHORTN2 normal;
+    XMSHORTN2 tangent;
+};
+
+// Decoded position = packed * scale + bias, which maps [-1, 1] onto the mesh bounds
+struct PositionQuantization
+{
+    XMFLOAT4 scale;
+    XMFLOAT4 bias;
+};
+
+PositionQuantization ComputePositionQuantization(const MeshVertex* vertices, size_t count);
+
+XMFLOAT2 OctEncode(const XMFLOAT3& direction);
+XMFLOAT3 OctDecode(const XMFLOAT2& encoded);
+
+void PackVertices(const MeshVertex* vertices, size_t count, const PositionQuantization& quantization, PackedVertex* packed);
+void UnpackVertices(const PackedVertex* packed, size_t count, const PositionQuantization& quantization, MeshVertex* vertices);